@@ -0,0 +1,264 @@
+"""Evaluates shake curves into NumPy arrays without Maya.
+
+Thin ctypes wrapper around the C interface of the noise core (source/shakeNoiseC.h),
+which is built as the shakeNoiseC shared library. Works in mayapy and in plain
+CPython, the only dependency is NumPy.
+
+Times, outputs and layers are passed to the library as pointers to the memory of
+the arrays, nothing is copied when they already are C contiguous arrays of the
+right dtype, so outputs can be preallocated and reused between calls. The GIL is
+released while the noise runs, so several Python threads can evaluate at once.
+
+The library is looked up in the SHAKENOISE_LIBRARY environment variable (full
+path), then next to this file, then on the system library path.
+
+Example:
+	layers = shakeNoise.createLayers(2)
+	layers[1]["frequency"] = 4.0
+	layers[1]["strength"] = (1.0, 1.0, 0.0)
+	curve = shakeNoise.evaluate(layers, numpy.arange(1.0, 241.0))  # shape (240, 3)
+
+"""
+# Built-in imports
+import os
+import sys
+import ctypes
+import ctypes.util
+import logging
+from typing import Iterable, Optional, Tuple, Union
+
+# Third-party imports
+import numpy as np
+
+
+
+logger = logging.getLogger("shakeNoise")
+
+ABI_VERSION = 1
+
+PRECISIONS = ("double", "single")
+ENGINES = ("perlin", "gradient1D", "hash")
+FRACTAL_MODES = ("classic", "fbm")
+
+# Mirrors ShakeNoiseLayer, the offsets are part of the C interface
+LAYER_DTYPE = np.dtype({
+	"names": ["weight", "seed", "fractalMode", "frequency", "strength", "fractal", "rough",
+		"octaves", "reserved", "lacunarity", "gain"],
+	"formats": [np.float64, np.int32, np.int32, np.float64, (np.float64, 3), np.float64, np.float64,
+		np.int32, np.int32, np.float64, np.float64],
+	"offsets": [0, 8, 12, 16, 24, 48, 56, 64, 68, 72, 80],
+	"itemsize": 88,
+})
+
+ArrayLike = Union[np.ndarray, Iterable[float]]
+
+
+
+class ShakeNoiseError(RuntimeError):
+	"""Raised when the library can't be loaded or an evaluation fails."""
+
+
+
+def _libraryNames() -> Tuple[str, ...]:
+	"""File names of the shakeNoiseC library on this platform."""
+	if sys.platform.startswith("win"):
+		return ("shakeNoiseC.dll",)
+	if sys.platform == "darwin":
+		return ("libshakeNoiseC.dylib",)
+	return ("libshakeNoiseC.so",)
+
+
+def _loadLibrary() -> ctypes.CDLL:
+	"""Loads the shakeNoiseC library and declares the signatures of its functions.
+
+	Returns:
+		ctypes.CDLL: The loaded library
+
+	Raises:
+		ShakeNoiseError: If no library was found or its ABI version doesn't match
+
+	"""
+	candidates = []
+	if os.environ.get("SHAKENOISE_LIBRARY"):
+		candidates.append(os.environ["SHAKENOISE_LIBRARY"])
+	scriptsPath = os.path.dirname(os.path.abspath(__file__))
+	candidates.extend(os.path.join(scriptsPath, name) for name in _libraryNames())
+	systemPath = ctypes.util.find_library("shakeNoiseC")
+	if systemPath:
+		candidates.append(systemPath)
+
+	library = None
+	for path in candidates:
+		try:
+			library = ctypes.CDLL(path)
+			break
+		except OSError:
+			logger.debug(f"Could not load '{path}'")
+	if library is None:
+		raise ShakeNoiseError(
+			f"Could not find the shakeNoiseC library, set SHAKENOISE_LIBRARY or copy {_libraryNames()[0]} to {scriptsPath}")
+
+	doublePointer = ctypes.POINTER(ctypes.c_double)
+	layerPointer = ctypes.c_void_p
+	library.shakeNoiseAbiVersion.restype = ctypes.c_uint32
+	library.shakeNoiseAbiVersion.argtypes = []
+	library.shakeNoiseStatusString.restype = ctypes.c_char_p
+	library.shakeNoiseStatusString.argtypes = [ctypes.c_int]
+	library.shakeNoiseDefaultLayer.restype = None
+	library.shakeNoiseDefaultLayer.argtypes = [layerPointer]
+	library.shakeNoiseEvaluate.restype = ctypes.c_int
+	library.shakeNoiseEvaluate.argtypes = [
+		layerPointer, ctypes.c_size_t, doublePointer, ctypes.c_size_t,
+		ctypes.c_int, ctypes.c_int, ctypes.c_double, doublePointer]
+	library.shakeNoiseEvaluateDerivatives.restype = ctypes.c_int
+	library.shakeNoiseEvaluateDerivatives.argtypes = [
+		layerPointer, ctypes.c_size_t, doublePointer, ctypes.c_size_t,
+		ctypes.c_int, ctypes.c_int, ctypes.c_double, doublePointer, doublePointer, doublePointer]
+
+	abiVersion = library.shakeNoiseAbiVersion()
+	if abiVersion != ABI_VERSION:
+		raise ShakeNoiseError(f"shakeNoiseC has ABI version {abiVersion}, this wrapper needs {ABI_VERSION}")
+	return library
+
+
+_library = None
+
+
+def library() -> ctypes.CDLL:
+	"""The shakeNoiseC library, loaded on first use."""
+	global _library
+	if _library is None:
+		_library = _loadLibrary()
+	return _library
+
+
+
+def createLayers(count: int = 1) -> np.ndarray:
+	"""Creates layers with the defaults of new shakeLayer elements.
+
+	Args:
+		count (int): Number of layers
+
+	Returns:
+		np.ndarray: Structured array of LAYER_DTYPE, its fields can be set like attributes
+			of the shakeLayer compound, fractalMode takes the index in FRACTAL_MODES
+
+	"""
+	layers = np.zeros(count, dtype=LAYER_DTYPE)
+	if count > 0:
+		library().shakeNoiseDefaultLayer(layers[:1].ctypes.data)
+		layers[1:] = layers[0]
+	return layers
+
+
+def _layerArray(layers: Union[np.ndarray, Iterable[dict]]) -> np.ndarray:
+	"""Layers as a C contiguous array of LAYER_DTYPE, without a copy if they already are one.
+
+	Dictionaries are filled in on top of the defaults, with the same keys as the fields
+	of LAYER_DTYPE, fractalMode may also be given by name.
+
+	"""
+	if isinstance(layers, np.ndarray):
+		if layers.dtype != LAYER_DTYPE:
+			raise ValueError(f"Layers must have the dtype shakeNoise.LAYER_DTYPE, got {layers.dtype}")
+		return np.ascontiguousarray(layers)
+
+	layerDicts = list(layers)
+	array = createLayers(len(layerDicts))
+	for layer, values in zip(array, layerDicts):
+		for key, value in values.items():
+			if key == "fractalMode" and isinstance(value, str):
+				value = FRACTAL_MODES.index(value)
+			layer[key] = value
+	return array
+
+
+def _outputArray(out: Optional[np.ndarray], numTimes: int, name: str) -> np.ndarray:
+	"""Validates a caller owned output array, or allocates one."""
+	if out is None:
+		return np.empty((numTimes, 3), dtype=np.float64)
+	if out.dtype != np.float64 or out.shape != (numTimes, 3) or not out.flags.c_contiguous or not out.flags.writeable:
+		raise ValueError(f"{name} must be a writeable C contiguous float64 array of shape ({numTimes}, 3)")
+	return out
+
+
+def _checkStatus(status: int):
+	if status != 0:
+		raise ShakeNoiseError(library().shakeNoiseStatusString(status).decode())
+
+
+def evaluate(
+	layers: Union[np.ndarray, Iterable[dict]],
+	times: ArrayLike,
+	precision: str = "double",
+	engine: str = "perlin",
+	errorBudget: float = 0.0,
+	out: Optional[np.ndarray] = None) -> np.ndarray:
+	"""Evaluates a layer stack at many times.
+
+	The values are identical to the output of a shake node with the same layers,
+	precision, noiseEngine and errorBudget at the same inTime. Rotation stacks come
+	out in degrees.
+
+	Args:
+		layers (np.ndarray | list[dict]): Layers of the stack, see createLayers
+		times (np.ndarray | list[float]): Times in frames, used in place if already float64
+		precision (str): One of PRECISIONS
+		engine (str): One of ENGINES
+		errorBudget (float): Maximum deviation culled layers and bands may add, 0 culls nothing
+		out (np.ndarray): Optional float64 array of shape (len(times), 3) to write to
+
+	Returns:
+		np.ndarray: X, Y and Z values of shape (len(times), 3), out if it was given
+
+	"""
+	layerArray = _layerArray(layers)
+	timeArray = np.ascontiguousarray(times, dtype=np.float64).reshape(-1)
+	output = _outputArray(out, len(timeArray), "out")
+	doublePointer = ctypes.POINTER(ctypes.c_double)
+	_checkStatus(library().shakeNoiseEvaluate(
+		layerArray.ctypes.data, len(layerArray), timeArray.ctypes.data_as(doublePointer), len(timeArray),
+		PRECISIONS.index(precision), ENGINES.index(engine), errorBudget, output.ctypes.data_as(doublePointer)))
+	return output
+
+
+def evaluateDerivatives(
+	layers: Union[np.ndarray, Iterable[dict]],
+	times: ArrayLike,
+	precision: str = "double",
+	engine: str = "perlin",
+	errorBudget: float = 0.0,
+	out: Optional[np.ndarray] = None,
+	velocity: Optional[np.ndarray] = None,
+	acceleration: Optional[np.ndarray] = None) -> Tuple[np.ndarray, np.ndarray, np.ndarray]:
+	"""Evaluates a layer stack and its first two time derivatives at many times.
+
+	Same values as evaluate, the derivatives are the outputVelocity and
+	outputAcceleration of a shake node, per frame and per frame squared.
+
+	Args:
+		layers (np.ndarray | list[dict]): Layers of the stack, see createLayers
+		times (np.ndarray | list[float]): Times in frames, used in place if already float64
+		precision (str): One of PRECISIONS
+		engine (str): One of ENGINES
+		errorBudget (float): Maximum deviation culled layers and bands may add, 0 culls nothing
+		out (np.ndarray): Optional float64 array of shape (len(times), 3) for the values
+		velocity (np.ndarray): Optional float64 array of shape (len(times), 3) for the velocity
+		acceleration (np.ndarray): Optional float64 array of shape (len(times), 3) for the acceleration
+
+	Returns:
+		tuple[np.ndarray, np.ndarray, np.ndarray]: Values, velocity and acceleration
+
+	"""
+	layerArray = _layerArray(layers)
+	timeArray = np.ascontiguousarray(times, dtype=np.float64).reshape(-1)
+	output = _outputArray(out, len(timeArray), "out")
+	velocity = _outputArray(velocity, len(timeArray), "velocity")
+	acceleration = _outputArray(acceleration, len(timeArray), "acceleration")
+	doublePointer = ctypes.POINTER(ctypes.c_double)
+	_checkStatus(library().shakeNoiseEvaluateDerivatives(
+		layerArray.ctypes.data, len(layerArray), timeArray.ctypes.data_as(doublePointer), len(timeArray),
+		PRECISIONS.index(precision), ENGINES.index(engine), errorBudget,
+		output.ctypes.data_as(doublePointer), velocity.ctypes.data_as(doublePointer),
+		acceleration.ctypes.data_as(doublePointer)))
+	return output, velocity, acceleration
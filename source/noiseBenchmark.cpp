@@ -0,0 +1,392 @@
+/* Microbenchmarks for the Maya independent noise core.
+
+Reports the cost of the noise kernel in ns/sample and samples/sec, so regressions in
+the per-frame cost can be caught without a Maya install.
+
+Usage:
+	noiseBenchmark [repeats]
+
+Set SHAKENODE_NOISE_ISA to baseline, avx2 or avx512 to time another build of the
+kernels than the best one of the machine.
+
+*/
+#include "perlinNoise.h"
+#include "shakeCurveCache.h"
+
+// System Includes
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <string>
+#include <vector>
+
+
+
+namespace {
+
+// Accumulates results so the compiler cannot discard the benchmarked work
+volatile double benchmarkSink = 0.0;
+
+struct TimeRange {
+	const char *name;
+	double start;
+	double end;
+	double step;
+};
+
+const TimeRange timeRanges[] = {
+	{"shot 1-120", 1.0, 120.0, 1.0},
+	{"bake 0-10000 x4", 0.0, 10000.0, 0.25},
+	{"far 1e6+500", 1.0e6, 1.0e6 + 500.0, 0.1},
+};
+
+const unsigned int layerCounts[] = {1, 4, 16};
+
+std::vector<double> buildTimes(const TimeRange &range) {
+	/* Builds the list of sampled times for the given range.
+
+	Args:
+		range (TimeRange): Start, end and step of the range
+
+	Returns:
+		vector<double>: Sampled times
+
+	*/
+	std::vector<double> times;
+	for (double time = range.start; time <= range.end; time += range.step) {
+		times.push_back(time);
+	}
+	return times;
+}
+
+void report(const std::string &name, std::size_t samples, int repeats, const std::function<double()> &body) {
+	/* Runs the benchmark body and prints its timings.
+
+	The body is run once for warm up, then the fastest of the repeats is reported.
+
+	Args:
+		name (string): Label of the benchmark
+		samples (size_t): Number of samples evaluated by one run of the body
+		repeats (int): Number of timed runs
+		body (function): Benchmarked work, returns a checksum of the results
+
+	*/
+	benchmarkSink = benchmarkSink + body();
+
+	double bestSeconds = 0.0;
+	for (int i = 0; i < repeats; ++i) {
+		auto start = std::chrono::steady_clock::now();
+		benchmarkSink = benchmarkSink + body();
+		std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+		if (i == 0 || elapsed.count() < bestSeconds) {
+			bestSeconds = elapsed.count();
+		}
+	}
+
+	double nsPerSample = bestSeconds * 1.0e9 / samples;
+	double samplesPerSec = samples / bestSeconds;
+	std::printf("%-52s %10zu %12.2f %16.0f\n", name.c_str(), samples, nsPerSample, samplesPerSec);
+}
+
+}
+
+
+
+int main(int argc, char **argv) {
+	int repeats = argc > 1 ? std::atoi(argv[1]) : 5;
+	if (repeats < 1) {
+		repeats = 1;
+	}
+
+	// SHAKENODE_NOISE_ISA compares the instruction set builds of the kernels
+	std::string isaWarning;
+	NoiseIsa isa = PerlinNoise::selectIsa(&isaWarning);
+	if (!isaWarning.empty()) {
+		std::fprintf(stderr, "%s\n", isaWarning.c_str());
+	}
+	std::printf("%s kernels\n", PerlinNoise::isaName(isa));
+	std::printf("%-52s %10s %12s %16s\n", "benchmark", "samples", "ns/sample", "samples/sec");
+
+	for (const TimeRange &range : timeRanges) {
+		std::vector<double> times = buildTimes(range);
+
+		// Raw lattice evaluation
+		report(std::string("gradNoise [") + range.name + "]", times.size(), repeats, [&]() {
+			double checksum = 0.0;
+			for (double time : times) {
+				checksum += PerlinNoise::gradNoise(time * 0.078 + 21.0);
+			}
+			return checksum;
+		});
+
+		// Per frame cost of a node, three axes per layer
+		for (unsigned int numLayers : layerCounts) {
+			for (double fractal : {0.0, 0.6}) {
+				std::string name = std::string("calculateNoise [") + range.name + "] layers=" +
+					std::to_string(numLayers) + (fractal != 0.0 ? " fractal" : "");
+				report(name, times.size() * numLayers * 3, repeats, [&]() {
+					double checksum = 0.0;
+					for (double time : times) {
+						for (unsigned int layer = 0; layer < numLayers; ++layer) {
+							double seed = 21.0 + layer;
+							double freq = 1.0 + 0.5 * layer;
+							checksum += PerlinNoise::calculateNoise(1.0, time, seed + 13.0, freq, 10.0, fractal, 0.3);
+							checksum += PerlinNoise::calculateNoise(1.0, time, seed + 578.0, freq, 10.0, fractal, 0.3);
+							checksum += PerlinNoise::calculateNoise(1.0, time, seed + 1511.0, freq, 10.0, fractal, 0.3);
+						}
+					}
+					return checksum;
+				});
+			}
+		}
+
+		// Same work packing the axes and bands of each layer in one kernel call
+		for (NoisePrecision precision : {NoisePrecision::kDouble, NoisePrecision::kSingle}) {
+			for (unsigned int numLayers : layerCounts) {
+				std::string name = std::string("accumulateShake [") + range.name + "] layers=" + std::to_string(numLayers) +
+					(precision == NoisePrecision::kSingle ? " single" : "");
+				report(name, times.size() * numLayers * 3, repeats, [&]() {
+					double checksum = 0.0;
+					ShakeLayer layer;
+					layer.fractal = 0.6;
+					layer.rough = 0.3;
+					for (double time : times) {
+						double result[3] = {0.0, 0.0, 0.0};
+						for (unsigned int i = 0; i < numLayers; ++i) {
+							layer.seed = 21 + i;
+							layer.frequency = 1.0 + 0.5 * i;
+							PerlinNoise::accumulateShake(layer, time, result, precision);
+						}
+						checksum += result[0] + result[1] + result[2];
+					}
+					return checksum;
+				});
+			}
+		}
+
+		// Same work from a structure of arrays stack, several layers packed per kernel call
+		for (NoisePrecision precision : {NoisePrecision::kDouble, NoisePrecision::kSingle}) {
+			for (unsigned int numLayers : layerCounts) {
+				ShakeLayerStack stack;
+				stack.resize(numLayers);
+				for (unsigned int i = 0; i < numLayers; ++i) {
+					stack.seed[i] = 21 + i;
+					stack.frequency[i] = 1.0 + 0.5 * i;
+					stack.fractal[i] = 0.6;
+					stack.rough[i] = 0.3;
+				}
+				std::string name = std::string("accumulateShakeStack [") + range.name + "] layers=" + std::to_string(numLayers) +
+					(precision == NoisePrecision::kSingle ? " single" : "");
+				report(name, times.size() * numLayers * 3, repeats, [&]() {
+					double checksum = 0.0;
+					for (double time : times) {
+						double result[3] = {0.0, 0.0, 0.0};
+						PerlinNoise::accumulateShakeStack(stack, time, result, precision);
+						checksum += result[0] + result[1] + result[2];
+					}
+					return checksum;
+				});
+			}
+		}
+
+		// Motion blur sub-samples of one frame, per time stack calls against one batched call
+		for (int numSamples : {5, 16}) {
+			ShakeLayerStack stack;
+			stack.resize(4);
+			for (unsigned int i = 0; i < 4; ++i) {
+				stack.seed[i] = 21 + i;
+				stack.frequency[i] = 1.0 + 0.5 * i;
+				stack.fractal[i] = 0.6;
+				stack.rough[i] = 0.3;
+			}
+			std::vector<double> sampleTimes(numSamples);
+			std::vector<double> sampleResults(3 * numSamples);
+			for (bool batched : {false, true}) {
+				std::string name = std::string(batched ? "accumulateShakeStackSamples [" : "accumulateShakeStack per sample [") +
+					range.name + "] samples=" + std::to_string(numSamples);
+				report(name, times.size() * numSamples * 4 * 3, repeats, [&]() {
+					double checksum = 0.0;
+					for (double time : times) {
+						for (int i = 0; i < numSamples; ++i) {
+							sampleTimes[i] = time - 0.25 + 0.5 * i / (numSamples - 1);
+						}
+						std::fill(sampleResults.begin(), sampleResults.end(), 0.0);
+						if (batched) {
+							PerlinNoise::accumulateShakeStackSamples(stack, sampleTimes.data(), numSamples, sampleResults.data());
+						} else {
+							for (int i = 0; i < numSamples; ++i) {
+								PerlinNoise::accumulateShakeStack(stack, sampleTimes[i], &sampleResults[3 * i]);
+							}
+						}
+						checksum += sampleResults[0] + sampleResults[3 * numSamples - 1];
+					}
+					return checksum;
+				});
+			}
+		}
+
+		// Shake plus analytic velocity and acceleration from the same lattice evaluation
+		for (unsigned int numLayers : layerCounts) {
+			ShakeLayerStack stack;
+			stack.resize(numLayers);
+			for (unsigned int i = 0; i < numLayers; ++i) {
+				stack.seed[i] = 21 + i;
+				stack.frequency[i] = 1.0 + 0.5 * i;
+				stack.fractal[i] = 0.6;
+				stack.rough[i] = 0.3;
+			}
+			std::string name = std::string("accumulateShakeStackDerivatives [") + range.name + "] layers=" + std::to_string(numLayers);
+			report(name, times.size() * numLayers * 3, repeats, [&]() {
+				double checksum = 0.0;
+				for (double time : times) {
+					double result[3] = {0.0, 0.0, 0.0};
+					double velocity[3] = {0.0, 0.0, 0.0};
+					double acceleration[3] = {0.0, 0.0, 0.0};
+					PerlinNoise::accumulateShakeStackDerivatives(stack, time, result, velocity, acceleration);
+					checksum += result[0] + velocity[1] + acceleration[2];
+				}
+				return checksum;
+			});
+		}
+
+		// Same stacks through the 1D gradient and the hashed lattice engines
+		for (NoiseEngine engine : {NoiseEngine::kGradient1D, NoiseEngine::kHash}) {
+			for (unsigned int numLayers : layerCounts) {
+				ShakeLayerStack stack;
+				stack.resize(numLayers);
+				for (unsigned int i = 0; i < numLayers; ++i) {
+					stack.seed[i] = 21 + i;
+					stack.frequency[i] = 1.0 + 0.5 * i;
+					stack.fractal[i] = 0.6;
+					stack.rough[i] = 0.3;
+				}
+				std::string name = std::string(engine == NoiseEngine::kHash ? "accumulateShakeStack hash [" : "accumulateShakeStack gradient1D [") + range.name + "] layers=" + std::to_string(numLayers);
+				report(name, times.size() * numLayers * 3, repeats, [&]() {
+					double checksum = 0.0;
+					for (double time : times) {
+						double result[3] = {0.0, 0.0, 0.0};
+						PerlinNoise::accumulateShakeStack(stack, time, result, NoisePrecision::kDouble, engine);
+						checksum += result[0] + result[1] + result[2];
+					}
+					return checksum;
+				});
+			}
+		}
+
+		// fBm layers, the octaves of all axes are packed into the kernel lanes
+		for (int octaves : {4, 8}) {
+			std::string name = std::string("accumulateShake fBm [") + range.name + "] octaves=" + std::to_string(octaves);
+			report(name, times.size() * 3, repeats, [&]() {
+				double checksum = 0.0;
+				ShakeLayer layer;
+				layer.fractalMode = FractalMode::kFbm;
+				layer.octaves = octaves;
+				for (double time : times) {
+					double result[3] = {0.0, 0.0, 0.0};
+					PerlinNoise::accumulateShake(layer, time, result);
+					checksum += result[0] + result[1] + result[2];
+				}
+				return checksum;
+			});
+		}
+
+		// Baked curve lookup of the same layer stack
+		for (unsigned int numLayers : layerCounts) {
+			std::vector<ShakeLayer> layers(numLayers);
+			for (unsigned int i = 0; i < numLayers; ++i) {
+				layers[i].seed = 21 + i;
+				layers[i].frequency = 1.0 + 0.5 * i;
+				layers[i].fractal = 0.6;
+				layers[i].rough = 0.3;
+			}
+			ShakeLayerStack stack;
+			stack.assign(layers.data(), layers.size());
+			ShakeCurveCache curveCache;
+			curveCache.build(stack, NoisePrecision::kDouble, NoiseEngine::kPerlin, range.start, range.end, 4);
+			std::string name = std::string("ShakeCurveCache::lookup [") + range.name + "] layers=" + std::to_string(numLayers);
+			report(name, times.size() * numLayers * 3, repeats, [&]() {
+				double checksum = 0.0;
+				for (double time : times) {
+					double result[3];
+					curveCache.lookup(time, result);
+					checksum += result[0] + result[1] + result[2];
+				}
+				return checksum;
+			});
+		}
+
+		// Same work through the batch entry point, one call per layer and axis
+		std::vector<double> output(times.size());
+		std::vector<float> outputSingle(times.size());
+		for (NoisePrecision precision : {NoisePrecision::kDouble, NoisePrecision::kSingle}) {
+			for (unsigned int numLayers : layerCounts) {
+				std::string name = std::string("calculateNoiseBatch [") + range.name + "] layers=" + std::to_string(numLayers) +
+					(precision == NoisePrecision::kSingle ? " single" : "");
+				report(name, times.size() * numLayers * 3, repeats, [&]() {
+					double checksum = 0.0;
+					for (unsigned int layer = 0; layer < numLayers; ++layer) {
+						NoiseLayer params;
+						params.frequency = 1.0 + 0.5 * layer;
+						params.strength = 10.0;
+						params.fractal = 0.6;
+						params.rough = 0.3;
+						for (double axisSeed : PerlinNoise::axisSeeds) {
+							params.seed = 21.0 + layer + axisSeed;
+							if (precision == NoisePrecision::kSingle) {
+								PerlinNoise::calculateNoiseBatch(params, times.data(), times.size(), outputSingle.data());
+								checksum += outputSingle.back();
+							} else {
+								PerlinNoise::calculateNoiseBatch(params, times.data(), times.size(), output.data());
+								checksum += output.back();
+							}
+						}
+					}
+					return checksum;
+				});
+			}
+		}
+	}
+
+	// Crowd of elements sharing one layer over the shot range, per element calls versus one array call
+	std::vector<double> shotTimes = buildTimes(timeRanges[0]);
+	for (unsigned int numElements : {64u, 2000u}) {
+		std::vector<int> seedOffsets(numElements);
+		for (unsigned int i = 0; i < numElements; ++i) {
+			seedOffsets[i] = (int) i * 37;
+		}
+		std::vector<double> results(3 * numElements);
+		ShakeLayer layer;
+		layer.fractal = 0.6;
+		layer.rough = 0.3;
+
+		std::string name = std::string("accumulateShake [") + timeRanges[0].name + "] elements=" + std::to_string(numElements);
+		report(name, shotTimes.size() * numElements * 3, repeats, [&]() {
+			double checksum = 0.0;
+			ShakeLayer elementLayer = layer;
+			for (double time : shotTimes) {
+				std::fill(results.begin(), results.end(), 0.0);
+				for (unsigned int i = 0; i < numElements; ++i) {
+					elementLayer.seed = layer.seed + seedOffsets[i];
+					PerlinNoise::accumulateShake(elementLayer, time, &results[3 * i]);
+				}
+				checksum += results.back();
+			}
+			return checksum;
+		});
+
+		name = std::string("accumulateShakeArray [") + timeRanges[0].name + "] elements=" + std::to_string(numElements);
+		report(name, shotTimes.size() * numElements * 3, repeats, [&]() {
+			double checksum = 0.0;
+			for (double time : shotTimes) {
+				std::fill(results.begin(), results.end(), 0.0);
+				PerlinNoise::accumulateShakeArray(layer, time, seedOffsets.data(), numElements, results.data());
+				checksum += results.back();
+			}
+			return checksum;
+		});
+	}
+
+	return 0;
+}
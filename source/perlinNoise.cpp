@@ -1,116 +1,343 @@
 #include "perlinNoise.h"
+#include "perlinNoiseKernels.h"
 
+// System Includes
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdlib>
+#include <utility>
 
+#ifdef SHAKENODE_KERNEL_DISPATCH
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
 
-PerlinNoise::PerlinNoise()
-  /* C++ implementation of the improved perlin noise.
-
-  Reference:
-    https://cs.nyu.edu/~perlin/noise/
-
-  */
-  // Ken's permutation array composed of 512 elements = 2 sets of (0, 255)
-  : permutation{
-    151, 160, 137, 91, 90, 15, 131, 13, 201, 95, 96, 53, 194, 233, 7, 225, 140, 36,
-    103, 30, 69, 142, 8, 99, 37, 240, 21, 10, 23, 190, 6, 148, 247, 120, 234, 75, 0,
-    26, 197, 62, 94, 252, 219, 203, 117, 35, 11, 32, 57, 177, 33, 88, 237, 149, 56,
-    87, 174, 20, 125, 136, 171, 168, 68, 175, 74, 165, 71, 134, 139, 48, 27, 166,
-    77, 146, 158, 231, 83, 111, 229, 122, 60, 211, 133, 230, 220, 105, 92, 41, 55,
-    46, 245, 40, 244, 102, 143, 54, 65, 25, 63, 161, 1, 216, 80, 73, 209, 76, 132,
-    187, 208, 89, 18, 169, 200, 196, 135, 130, 116, 188, 159, 86, 164, 100, 109,
-    198, 173, 186, 3, 64, 52, 217, 226, 250, 124, 123, 5, 202, 38, 147, 118, 126,
-    255, 82, 85, 212, 207, 206, 59, 227, 47, 16, 58, 17, 182, 189, 28, 42, 223, 183,
-    170, 213, 119, 248, 152, 2, 44, 154, 163, 70, 221, 153, 101, 155, 167, 43, 172,
-    9, 129, 22, 39, 253, 19, 98, 108, 110, 79, 113, 224, 232, 178, 185, 112, 104,
-    218, 246, 97, 228, 251, 34, 242, 193, 238, 210, 144, 12, 191, 179, 162, 241, 81,
-    51, 145, 235, 249, 14, 239, 107, 49, 192, 214, 31, 181, 199, 106, 157, 184, 84,
-    204, 176, 115, 121, 50, 45, 127, 4, 150, 254, 138, 236, 205, 93, 222, 114, 67,
-    29, 24, 72, 243, 141, 128, 195, 78, 66, 215, 61, 156, 180, 151, 160, 137, 91,
-    90, 15, 131, 13, 201, 95, 96, 53, 194, 233, 7, 225, 140, 36, 103, 30, 69, 142,
-    8, 99, 37, 240, 21, 10, 23, 190, 6, 148, 247, 120, 234, 75, 0, 26, 197, 62, 94,
-    252, 219, 203, 117, 35, 11, 32, 57, 177, 33, 88, 237, 149, 56, 87, 174, 20, 125,
-    136, 171, 168, 68, 175, 74, 165, 71, 134, 139, 48, 27, 166, 77, 146, 158, 231,
-    83, 111, 229, 122, 60, 211, 133, 230, 220, 105, 92, 41, 55, 46, 245, 40, 244,
-    102, 143, 54, 65, 25, 63, 161, 1, 216, 80, 73, 209, 76, 132, 187, 208, 89, 18,
-    169, 200, 196, 135, 130, 116, 188, 159, 86, 164, 100, 109, 198, 173, 186, 3, 64,
-    52, 217, 226, 250, 124, 123, 5, 202, 38, 147, 118, 126, 255, 82, 85, 212, 207,
-    206, 59, 227, 47, 16, 58, 17, 182, 189, 28, 42, 223, 183, 170, 213, 119, 248,
-    152, 2, 44, 154, 163, 70, 221, 153, 101, 155, 167, 43, 172, 9, 129, 22, 39, 253,
-    19, 98, 108, 110, 79, 113, 224, 232, 178, 185, 112, 104, 218, 246, 97, 228, 251,
-    34, 242, 193, 238, 210, 144, 12, 191, 179, 162, 241, 81, 51, 145, 235, 249, 14,
-    239, 107, 49, 192, 214, 31, 181, 199, 106, 157, 184, 84, 204, 176, 115, 121, 50,
-    45, 127, 4, 150, 254, 138, 236, 205, 93, 222, 114, 67, 29, 24, 72, 243, 141,
-    128, 195, 78, 66, 215, 61, 156, 180
-  } {
-}
-
-
-double PerlinNoise::lerp(double valT, double valA, double valB) {
-  /* Linear interpolation function.
-
-  Args:
-    valT (double): Interpolation value
-    valA (double): Input value one
-    valB (double): Input value two
+
+
+namespace {
+
+// Instruction set of the kernels used by the PerlinNoise entry points, -1 until selectIsa
+std::atomic<int> activeIsa(-1);
+
+const NoiseKernelTable &kernelTable(NoiseIsa isa) {
+  /* Build of the kernels for an instruction set, only ever called with supported ones. */
+#ifdef SHAKENODE_KERNEL_DISPATCH
+  if (isa == NoiseIsa::kAvx512) {
+    return kAvx512Kernels;
+  }
+  if (isa == NoiseIsa::kAvx2) {
+    return kAvx2Kernels;
+  }
+#endif
+  return kBaselineKernels;
+}
+
+#ifdef SHAKENODE_KERNEL_DISPATCH
+void cpuid(std::uint32_t leaf, std::uint32_t subleaf, std::uint32_t registers[4]) {
+  /* EAX, EBX, ECX and EDX of a CPUID leaf. */
+#ifdef _MSC_VER
+  int values[4];
+  __cpuidex(values, static_cast<int>(leaf), static_cast<int>(subleaf));
+  std::copy(values, values + 4, registers);
+#else
+  __cpuid_count(leaf, subleaf, registers[0], registers[1], registers[2], registers[3]);
+#endif
+}
+
+std::uint64_t enabledRegisterStates() {
+  /* XCR0, the register states the operating system saves on context switches. */
+#ifdef _MSC_VER
+  return _xgetbv(0);
+#else
+  std::uint32_t low = 0;
+  std::uint32_t high = 0;
+  __asm__ volatile("xgetbv" : "=a"(low), "=d"(high) : "c"(0));
+  return (static_cast<std::uint64_t>(high) << 32) | low;
+#endif
+}
+
+NoiseIsa detectCpuIsa() {
+  /* Best instruction set the CPU and the operating system both support.
+
+  AVX needs the OS to save the YMM registers (XCR0 bits 1 and 2), AVX-512 the
+  opmask and ZMM registers as well (bits 5 to 7).
+
+  */
+  std::uint32_t registers[4];
+  cpuid(0, 0, registers);
+  if (registers[0] < 7) {
+    return NoiseIsa::kBaseline;
+  }
+  cpuid(1, 0, registers);
+  const bool fma = registers[2] & (1u << 12);
+  const bool osxsave = registers[2] & (1u << 27);
+  const bool avx = registers[2] & (1u << 28);
+  if (!osxsave || !avx || !fma) {
+    return NoiseIsa::kBaseline;
+  }
+  const std::uint64_t states = enabledRegisterStates();
+  if ((states & 0x6) != 0x6) {
+    return NoiseIsa::kBaseline;
+  }
+  cpuid(7, 0, registers);
+  const std::uint32_t features = registers[1];
+  if (!(features & (1u << 5))) {
+    return NoiseIsa::kBaseline;
+  }
+  const std::uint32_t avx512Features = (1u << 16) | (1u << 17) | (1u << 30) | (1u << 31);  // F, DQ, BW and VL
+  if ((features & avx512Features) == avx512Features && (states & 0xe6) == 0xe6) {
+    return NoiseIsa::kAvx512;
+  }
+  return NoiseIsa::kAvx2;
+}
+#endif
+
+}
+
+
+
+const NoiseKernelTable &activeKernels() {
+  /* Kernels the PerlinNoise entry points call, selected on first use if no one did before. */
+  int isa = activeIsa.load(std::memory_order_relaxed);
+  if (isa < 0) {
+    isa = static_cast<int>(PerlinNoise::selectIsa());
+  }
+  return kernelTable(static_cast<NoiseIsa>(isa));
+}
+
+ShakeLayerColumns layerColumns(const ShakeLayerStack &layers) {
+  /* Column pointers of a stack for the kernels, valid until the stack is resized. */
+  return {
+    layers.size(),
+    layers.weight.data(),
+    layers.seed.data(),
+    layers.frequency.data(),
+    {layers.strength[0].data(), layers.strength[1].data(), layers.strength[2].data()},
+    layers.fractal.data(),
+    layers.rough.data(),
+    layers.fractalMode.data(),
+    &layers,
+  };
+}
+
+
+
+void ShakeLayerStack::resize(std::size_t numLayers) {
+  /* Resizes every column to the number of layers, new layers get the default parameters. */
+  ShakeLayer defaults;
+  weight.resize(numLayers, defaults.weight);
+  seed.resize(numLayers, defaults.seed);
+  frequency.resize(numLayers, defaults.frequency);
+  for (int axis = 0; axis < 3; ++axis) {
+    strength[axis].resize(numLayers, defaults.strength[axis]);
+  }
+  fractal.resize(numLayers, defaults.fractal);
+  rough.resize(numLayers, defaults.rough);
+  fractalMode.resize(numLayers, defaults.fractalMode);
+  octaves.resize(numLayers, defaults.octaves);
+  lacunarity.resize(numLayers, defaults.lacunarity);
+  gain.resize(numLayers, defaults.gain);
+}
+
+void ShakeLayerStack::assign(const ShakeLayer *layers, std::size_t numLayers) {
+  /* Replaces the stack with a copy of the given layers.
+
+  Args:
+    layers (const ShakeLayer*): Layers to copy
+    numLayers (size_t): Number of layers
+
+  */
+  resize(numLayers);
+  for (std::size_t i = 0; i < numLayers; ++i) {
+    setLayer(i, layers[i]);
+  }
+}
+
+ShakeLayer ShakeLayerStack::layer(std::size_t index) const {
+  /* Gathers the parameters of one layer.
+
+  Args:
+    index (size_t): Index of the layer
 
   Returns:
-    double: Interpolated value
+    ShakeLayer: Copy of the layer's parameters
 
   */
-  return valA + valT * (valB - valA);
+  ShakeLayer layer;
+  layer.weight = weight[index];
+  layer.seed = seed[index];
+  layer.frequency = frequency[index];
+  for (int axis = 0; axis < 3; ++axis) {
+    layer.strength[axis] = strength[axis][index];
+  }
+  layer.fractal = fractal[index];
+  layer.rough = rough[index];
+  layer.fractalMode = fractalMode[index];
+  layer.octaves = octaves[index];
+  layer.lacunarity = lacunarity[index];
+  layer.gain = gain[index];
+  return layer;
 }
 
-double PerlinNoise::fade(double valT) {
-  /* Ken's new spline interpolation.
+void ShakeLayerStack::setLayer(std::size_t index, const ShakeLayer &layer) {
+  /* Scatters the parameters of one layer into the columns.
 
   Args:
-    valT (double): Interpolation value
+    index (size_t): Index of the layer, has to be smaller than size()
+    layer (ShakeLayer): Parameters to store
 
   */
-  return valT * valT * valT * (valT * (valT * 6.0 - 15.0) + 10.0);
+  weight[index] = layer.weight;
+  seed[index] = layer.seed;
+  frequency[index] = layer.frequency;
+  for (int axis = 0; axis < 3; ++axis) {
+    strength[axis][index] = layer.strength[axis];
+  }
+  fractal[index] = layer.fractal;
+  rough[index] = layer.rough;
+  fractalMode[index] = layer.fractalMode;
+  octaves[index] = layer.octaves;
+  lacunarity[index] = layer.lacunarity;
+  gain[index] = layer.gain;
 }
 
-double PerlinNoise::gradient(int hashID, double valX, double valY, double valZ) {
-  /* Gradient function.
+ShakeCullStats ShakeLayerStack::cull(double errorBudget) {
+  /* Leaves out the layers and bands that cannot move the shake by more than the budget.
 
-  Ken's new function to return gradient values based on bit operations.
+  The largest possible contribution of a band on an axis is its amplitude times
+  PerlinNoise::noiseBound. Culled contributions add up, so the budget is shared by
+  everything culled and the culled stack stays within errorBudget of the full one
+  on every axis, at any time and with any engine.
+
+  Whole layers are culled first, the smallest first, as they save the most work for
+  their error. The remaining budget then goes to the fractal band of classic layers
+  and the top octaves of fBm layers, again the smallest first. Culled layers get a
+  weight of 0, culled fractal bands a fractal of 0 and fBm layers fewer octaves, so
+  the kernels simply skip them.
 
   Args:
-    hashID (int):
-    valX (double): X input value
-    valY (double): Y input value
-    valZ (double): Z input value
+    errorBudget (double): Largest allowed deviation per axis, in the units of the
+      shake, 0 culls nothing
 
   Returns:
-    double: Result of hshU plus hshV
+    ShakeCullStats: Number of culled layers and bands and the deviation they allow
 
   */
-  int hshID = hashID & 15;
-  double hshU, hshV;
-
-  if (hshID < 8) {
-    hshU = valX;
-  } else {
-    hshV = valZ;
+  ShakeCullStats stats;
+  if (!(errorBudget > 0)) {
+    return stats;
   }
 
-  if (hshID < 4) {
-    hshV = valZ;
-  } else if (hshID == 12 || hshID == 14) {
-    hshV = valX;
-  } else {
-    hshV = valZ;
+  const std::size_t numLayers = size();
+  double spent[3] = {0.0, 0.0, 0.0};
+  auto trySpend = [&](const double cost[3]) {
+    for (int axis = 0; axis < 3; ++axis) {
+      if (spent[axis] + cost[axis] > errorBudget) {
+        return false;
+      }
+    }
+    for (int axis = 0; axis < 3; ++axis) {
+      spent[axis] += cost[axis];
+    }
+    return true;
+  };
+  auto maxCost = [](const double cost[3]) {
+    return std::max(cost[0], std::max(cost[1], cost[2]));
+  };
+  auto fractalAmplitude = [&](std::size_t index) {
+    return std::fabs(weight[index] * fractal[index] * ((rough[index] + 0.084) * 3.3));
+  };
+  auto octaveAmplitude = [&](std::size_t index, int octave) {
+    return std::pow(std::fabs(gain[index]), octave);
+  };
+
+  // Whole layers
+  std::vector<std::array<double, 3>> layerCosts(numLayers);
+  std::vector<std::pair<double, std::size_t>> order;
+  for (std::size_t index = 0; index < numLayers; ++index) {
+    if (weight[index] == 0) {
+      continue;
+    }
+    double scale = 0.0;
+    double extra = 0.0;
+    if (fractalMode[index] == FractalMode::kFbm) {
+      int numOctaves = PerlinNoise::fbmOctaveCount(layer(index));
+      for (int octave = 0; octave < numOctaves; ++octave) {
+        scale += octaveAmplitude(index, octave);
+      }
+    } else {
+      scale = 1.0;
+      extra = fractalAmplitude(index);
+    }
+    for (int axis = 0; axis < 3; ++axis) {
+      layerCosts[index][axis] = (std::fabs(weight[index] * strength[axis][index]) * scale + extra) * PerlinNoise::noiseBound;
+    }
+    order.emplace_back(maxCost(layerCosts[index].data()), index);
+  }
+  std::sort(order.begin(), order.end());
+  for (const std::pair<double, std::size_t> &entry : order) {
+    if (trySpend(layerCosts[entry.second].data())) {
+      weight[entry.second] = 0.0;
+      ++stats.layersCulled;
+    }
   }
 
-  if ((hshID & 1) != 0) {
-  }   hshU = -hshU;
-  if ((hshID & 2) != 0) {
-    hshV = -hshV;
+  // Detail bands of the remaining layers, an fBm layer offers its top octave
+  while (true) {
+    double bestCost[3] = {0.0, 0.0, 0.0};
+    double bestMax = 0.0;
+    std::size_t bestIndex = numLayers;
+    for (std::size_t index = 0; index < numLayers; ++index) {
+      if (weight[index] == 0) {
+        continue;
+      }
+      double cost[3];
+      if (fractalMode[index] == FractalMode::kFbm) {
+        int numOctaves = PerlinNoise::fbmOctaveCount(layer(index));
+        if (numOctaves < 2) {
+          continue;
+        }
+        for (int axis = 0; axis < 3; ++axis) {
+          cost[axis] = std::fabs(weight[index] * strength[axis][index]) * octaveAmplitude(index, numOctaves - 1) * PerlinNoise::noiseBound;
+        }
+      } else {
+        if (fractal[index] == 0) {
+          continue;
+        }
+        cost[0] = cost[1] = cost[2] = fractalAmplitude(index) * PerlinNoise::noiseBound;
+      }
+      bool fits = true;
+      for (int axis = 0; axis < 3; ++axis) {
+        fits = fits && spent[axis] + cost[axis] <= errorBudget;
+      }
+      if (fits && (bestIndex == numLayers || maxCost(cost) < bestMax)) {
+        std::copy(cost, cost + 3, bestCost);
+        bestMax = maxCost(cost);
+        bestIndex = index;
+      }
+    }
+    if (bestIndex == numLayers) {
+      break;
+    }
+    trySpend(bestCost);
+    if (fractalMode[bestIndex] == FractalMode::kFbm) {
+      octaves[bestIndex] = PerlinNoise::fbmOctaveCount(layer(bestIndex)) - 1;
+    } else {
+      fractal[bestIndex] = 0.0;
+    }
+    ++stats.bandsCulled;
   }
 
-  return hshU + hshV;
+  stats.maxError = maxCost(spent);
+  return stats;
 }
 
+
+
 double PerlinNoise::gradNoise(double valXYZ) {   
   /* Improved Perlin Noise.
 
@@ -124,19 +351,19 @@ double PerlinNoise::gradNoise(double valXYZ) {
     double: Interpolated noise output
 
   */
-  double valX = valXYZ;
-  double valY = valXYZ;
-  double valZ = valXYZ;
+  double valX = wrapLattice(valXYZ);
+  double valY = valX;
+  double valZ = valX;
 
   // Get integer lattice values for sample point position
-  int intX = (int) floor(valX) & 255;
-  int intY = (int) floor(valY) & 255;
-  int intZ = (int) floor(valZ) & 255;
+  int intX = (int) std::floor(valX) & 255;
+  int intY = (int) std::floor(valY) & 255;
+  int intZ = (int) std::floor(valZ) & 255;
 
   // Fractional part of point position
-  valX -= floor(valX);
-  valY -= floor(valY);
-  valZ -= floor(valZ);
+  valX -= std::floor(valX);
+  valY -= std::floor(valY);
+  valZ -= std::floor(valZ);
 
   // Interpolate fractional part of point position
   double valU = fade(valX);
@@ -173,6 +400,68 @@ double PerlinNoise::gradNoise(double valXYZ) {
   return trilinear;
 }
 
+double PerlinNoise::gradientNoise1D(double valX) {
+  /* One dimensional gradient noise.
+
+  Cheaper alternative to gradNoise, only the gradients of the two lattice points
+  around the input are blended. The gradients are scaled so the noise has about
+  the same RMS amplitude as gradNoise, which keeps the strength of existing layers
+  meaningful when switching engines.
+
+  Args:
+    valX (double): X input
+
+  Returns:
+    double: Interpolated noise output
+
+  */
+  valX = wrapLattice(valX);
+  double floorX = std::floor(valX);
+  int intX = (int) floorX & 255;
+  valX -= floorX;
+
+  int hashA = permutation[intX] & 15;
+  int hashB = permutation[intX + 1] & 15;
+  double gradA = ((hashA & 7) + 1) * ((hashA & 8) != 0 ? -gradient1DScale : gradient1DScale);
+  double gradB = ((hashB & 7) + 1) * ((hashB & 8) != 0 ? -gradient1DScale : gradient1DScale);
+
+  return lerp(fade(valX), gradA * valX, gradB * (valX - 1.0));
+}
+
+double PerlinNoise::hashNoise(double valXYZ, std::uint32_t stream) {
+  /* Improved Perlin Noise on integer hashed lattice corners.
+
+  Same gradients and interpolation as gradNoise, the corners are hashed with
+  latticeHash instead of the permutation table. The lattice does not wrap, and
+  every stream is an independent noise. The input is shifted by the stream's
+  phase, so different streams do not share the lattice cell boundaries and the
+  part of the diagonal noise that repeats with every cell.
+
+  Args:
+    valXYZ (double): XYZ input
+    stream (uint32): Noise stream, see streamSeed
+
+  Returns:
+    double: Interpolated noise output
+
+  */
+  valXYZ = wrapLattice(valXYZ + streamPhase(stream));
+  double floorXYZ = std::floor(valXYZ);
+  std::uint32_t cell = (std::uint32_t) (int) floorXYZ;
+  double valX = valXYZ - floorXYZ;
+  double valU = fade(valX);
+
+  double grads[8];
+  for (int corner = 0; corner < 8; ++corner) {
+    int hashID = (int) (latticeHash(cell + (corner & 1), cell + ((corner >> 1) & 1), cell + ((corner >> 2) & 1), stream) >> 28);
+    grads[corner] = gradient(hashID, valX - (corner & 1), valX - ((corner >> 1) & 1), valX - ((corner >> 2) & 1));
+  }
+
+  double firstPassesCombined = lerp(valU, lerp(valU, grads[0], grads[1]), lerp(valU, grads[2], grads[3]));
+  double secondPassesCombined = lerp(valU, lerp(valU, grads[4], grads[5]), lerp(valU, grads[6], grads[7]));
+  return lerp(valU, firstPassesCombined, secondPassesCombined);
+}
+
 double PerlinNoise::calculateNoise(double weight, double time, double seed, double frequency, double strength, double fractal, double rough) {
   /* Calculates the noise based on the given arguments.
 
@@ -198,3 +487,276 @@ double PerlinNoise::calculateNoise(double weight, double time, double seed, doub
 
   return combinedNoise;
 }
+
+void PerlinNoise::calculateNoiseBatch(const NoiseLayer &layer, const double *times, std::size_t count, double *output) {
+  /* Calculates the noise of one layer for a series of times.
+
+  Batch version of calculateNoise, the times are processed in blocks of lanes so
+  the kernel vectorizes across samples. Results are identical to calling
+  calculateNoise once per time.
+
+  Args:
+    layer (NoiseLayer): Parameters of the layer
+    times (const double*): Times to evaluate
+    count (size_t): Number of times
+    output (double*): Contiguous buffer receiving count results
+
+  */
+  activeKernels().calculateNoiseBatch(layer, times, count, output);
+}
+
+void PerlinNoise::calculateNoiseBatch(const NoiseLayer &layer, const double *times, std::size_t count, float *output) {
+  /* Single precision version of calculateNoiseBatch.
+
+  Twice as many samples fit in a vector register, the deviation from the double
+  precision result stays below maxSingleDeviation per unit of layer amplitude.
+
+  Args:
+    layer (NoiseLayer): Parameters of the layer
+    times (const double*): Times to evaluate
+    count (size_t): Number of times
+    output (float*): Contiguous buffer receiving count results
+
+  */
+  activeKernels().calculateNoiseBatchSingle(layer, times, count, output);
+}
+
+void PerlinNoise::accumulateShake(const ShakeLayer &layer, double time, double result[3], NoisePrecision precision, NoiseEngine engine) {
+  /* Adds the noise of one layer on all three axes to the result.
+
+  The base and fractal bands of the X, Y and Z axes only differ by their seed, so
+  the six lattice evaluations are packed into the lanes of a single vectorized
+  kernel call. In fBm fractal mode the octaves of all axes are packed the same
+  way, see fbmOctaveCount for how many octaves contribute.
+
+  In classic mode and double precision the results are identical to three
+  calculateNoise calls with the axis seed offsets, in single precision they stay
+  within maxSingleDeviation per unit of layer amplitude.
+
+  Args:
+    layer (ShakeLayer): Parameters of the layer
+    time (double): Time input
+    result (double[3]): X, Y and Z values the layer noise is added to
+    precision (NoisePrecision): Floating point precision of the kernel
+    engine (NoiseEngine): Lattice noise evaluated for every band
+
+  */
+  activeKernels().accumulateShake(layer, time, result, precision, engine);
+}
+
+void PerlinNoise::accumulateShakeArray(const ShakeLayer &layer, double time, const int *seedOffsets, std::size_t count, double *results, NoisePrecision precision, NoiseEngine engine) {
+  /* Adds the noise of one layer to many elements that only differ by seed.
+
+  Element i is shaken like accumulateShake with the layer seed plus seedOffsets[i],
+  and the results are identical to it. In classic mode the elements are packed
+  into the lanes of the vectorized kernel together, in fBm mode every element
+  packs its own octaves.
+
+  Args:
+    layer (ShakeLayer): Parameters of the layer shared by all elements
+    time (double): Time input
+    seedOffsets (const int*): Seed offset of each element, added to the layer seed
+    count (size_t): Number of elements
+    results (double*): 3 * count interleaved X, Y and Z values the noise is added to
+    precision (NoisePrecision): Floating point precision of the kernel
+    engine (NoiseEngine): Lattice noise evaluated for every band
+
+  */
+  activeKernels().accumulateShakeArray(layer, time, seedOffsets, count, results, precision, engine);
+}
+
+void PerlinNoise::accumulateShakeStack(const ShakeLayerStack &layers, double time, double result[3], NoisePrecision precision, NoiseEngine engine) {
+  /* Adds the noise of a whole layer stack on all three axes to the result.
+
+  Packs several classic layers into the lanes of each kernel call instead of one
+  layer per call. The result is identical to calling accumulateShake for every
+  layer with a weight other than 0, in order.
+
+  Args:
+    layers (ShakeLayerStack): Parameters of the layers
+    time (double): Time input
+    result (double[3]): X, Y and Z values the noise is added to
+    precision (NoisePrecision): Floating point precision of the kernel
+    engine (NoiseEngine): Lattice noise evaluated for every band
+
+  */
+  activeKernels().accumulateShakeStack(layerColumns(layers), time, result, precision, engine);
+}
+
+void PerlinNoise::accumulateShakeStackSamples(const ShakeLayerStack &layers, const double *times, std::size_t count, double *results, NoisePrecision precision, NoiseEngine engine) {
+  /* Adds the noise of a whole layer stack at many times.
+
+  The layers of all samples are packed into the lanes of the vectorized kernel back
+  to back, so small stacks no longer pad every kernel block of a time. The layers
+  are still added to each sample in order, so sample i is identical to
+  accumulateShakeStack at times[i].
+
+  Args:
+    layers (ShakeLayerStack): Parameters of the layers
+    times (const double*): Time of each sample
+    count (size_t): Number of samples
+    results (double*): 3 * count interleaved X, Y and Z values the noise is added to
+    precision (NoisePrecision): Floating point precision of the kernel
+    engine (NoiseEngine): Lattice noise evaluated for every band
+
+  */
+  activeKernels().accumulateShakeStackSamples(layerColumns(layers), times, count, results, precision, engine);
+}
+
+void PerlinNoise::accumulateShakeStackDerivatives(const ShakeLayerStack &layers, double time, double result[3], double velocity[3], double acceleration[3], NoisePrecision precision, NoiseEngine engine) {
+  /* Adds the noise of a layer stack and its first two time derivatives.
+
+  Same evaluation as accumulateShakeStack, the derivatives are computed analytically
+  from the lattice hashes, fade curves and interpolations of the value pass instead
+  of evaluating the stack again at neighbouring times. The result is identical to
+  accumulateShakeStack.
+
+  Args:
+    layers (ShakeLayerStack): Parameters of the layers
+    time (double): Time input
+    result (double[3]): X, Y and Z values the noise is added to
+    velocity (double[3]): X, Y and Z derivatives per unit of time are added to it
+    acceleration (double[3]): X, Y and Z second derivatives per unit of time are added to it
+    precision (NoisePrecision): Floating point precision of the kernel
+    engine (NoiseEngine): Lattice noise evaluated for every band
+
+  */
+  activeKernels().accumulateShakeStackDerivatives(layerColumns(layers), time, result, velocity, acceleration, precision, engine);
+}
+
+int PerlinNoise::fbmOctaveCount(const ShakeLayer &layer) {
+  /* Number of fBm octaves actually evaluated for the layer.
+
+  The requested octaves are clamped to fbmMaxOctaves, and octaves whose amplitude
+  gain^octave falls below fbmAmplitudeCutoff are dropped.
+
+  Args:
+    layer (ShakeLayer): Parameters of the layer
+
+  Returns:
+    int: Number of octaves to evaluate, at least one
+
+  */
+  int maxOctaves = std::max(1, std::min(layer.octaves, fbmMaxOctaves));
+  int numOctaves = 1;
+  double amplitude = layer.gain;
+  while (numOctaves < maxOctaves && std::fabs(amplitude) >= fbmAmplitudeCutoff) {
+    amplitude *= layer.gain;
+    ++numOctaves;
+  }
+  return numOctaves;
+}
+
+NoiseIsa PerlinNoise::supportedIsa() {
+  /* Best instruction set both built into the kernels and supported by this machine.
+
+  Returns:
+    NoiseIsa: kBaseline on other architectures or builds without SHAKENODE_KERNEL_DISPATCH
+
+  */
+#ifdef SHAKENODE_KERNEL_DISPATCH
+  static const NoiseIsa cpuIsa = detectCpuIsa();
+  return cpuIsa;
+#else
+  return NoiseIsa::kBaseline;
+#endif
+}
+
+NoiseIsa PerlinNoise::isa() {
+  /* Instruction set of the kernels currently in use, selecting it if none was yet. */
+  int isa = activeIsa.load(std::memory_order_relaxed);
+  return isa < 0 ? selectIsa() : static_cast<NoiseIsa>(isa);
+}
+
+bool PerlinNoise::setIsa(NoiseIsa isa) {
+  /* Switches the kernels to an instruction set.
+
+  Every build of the kernels gives the same results, so switching while other
+  threads evaluate only changes their speed.
+
+  Args:
+    isa (NoiseIsa): Instruction set to use
+
+  Returns:
+    bool: False, leaving the kernels unchanged, if this machine does not support isa
+
+  */
+  if (static_cast<int>(isa) < 0 || isa > supportedIsa()) {
+    return false;
+  }
+  activeIsa.store(static_cast<int>(isa), std::memory_order_relaxed);
+  return true;
+}
+
+NoiseIsa PerlinNoise::selectIsa(std::string *warning) {
+  /* Switches the kernels to the best instruction set of this machine.
+
+  The AVX-512 build is only used when the isaEnvironmentVariable asks for it. It
+  measured no faster than the AVX2 build on the stack paths and 5 to 10% slower on
+  fBm stacks and sample batches on a Xeon, so AVX2 is the default on AVX-512
+  machines as well.
+
+  The isaEnvironmentVariable forces any instruction set the machine can run, for
+  testing. Unknown or unsupported names fall back to the default.
+
+  Args:
+    warning (string*): Receives why the environment variable was ignored, or nullptr
+
+  Returns:
+    NoiseIsa: The instruction set in use
+
+  */
+  NoiseIsa isa = std::min(supportedIsa(), NoiseIsa::kAvx2);
+  const char *requestedName = std::getenv(isaEnvironmentVariable);
+  if (requestedName != nullptr && *requestedName != '\0') {
+    NoiseIsa requested = NoiseIsa::kBaseline;
+    std::string problem;
+    if (!parseIsa(requestedName, requested)) {
+      problem = " is not baseline, sse2, avx2 or avx512";
+    } else if (requested > supportedIsa()) {
+      problem = " is not supported by this machine";
+    } else {
+      isa = requested;
+    }
+    if (!problem.empty() && warning != nullptr) {
+      *warning = std::string(isaEnvironmentVariable) + " " + requestedName + problem + ", using " + isaName(isa);
+    }
+  }
+  setIsa(isa);
+  return isa;
+}
+
+const char *PerlinNoise::isaName(NoiseIsa isa) {
+  /* Lower case name of an instruction set, as accepted by parseIsa. */
+  switch (isa) {
+    case NoiseIsa::kAvx2:
+      return "avx2";
+    case NoiseIsa::kAvx512:
+      return "avx512";
+    default:
+      return "baseline";
+  }
+}
+
+bool PerlinNoise::parseIsa(const std::string &name, NoiseIsa &isa) {
+  /* Instruction set of a name, sse2 is accepted for the x86-64 baseline.
+
+  Args:
+    name (string): Name to parse, case sensitive
+    isa (NoiseIsa&): Receives the instruction set
+
+  Returns:
+    bool: False, leaving isa unchanged, if the name is unknown
+
+  */
+  if (name == "baseline" || name == "sse2") {
+    isa = NoiseIsa::kBaseline;
+  } else if (name == "avx2") {
+    isa = NoiseIsa::kAvx2;
+  } else if (name == "avx512") {
+    isa = NoiseIsa::kAvx512;
+  } else {
+    return false;
+  }
+  return true;
+}
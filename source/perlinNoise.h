@@ -1,27 +1,398 @@
 #pragma once
 
 // System Includes
-#include <vector>
+#include <cstddef>
+#include <cstdint>
 #include <cmath>
+#include <string>
+#include <vector>
+
+
+
+enum class NoisePrecision {
+  /* Floating point precision used by the vectorized noise kernels. */
+  kDouble = 0,
+  kSingle = 1,
+};
+
+// Precision used by new nodes, switched at build time with SHAKENODE_SINGLE_PRECISION
+#ifdef SHAKENODE_SINGLE_PRECISION
+constexpr NoisePrecision kDefaultNoisePrecision = NoisePrecision::kSingle;
+#else
+constexpr NoisePrecision kDefaultNoisePrecision = NoisePrecision::kDouble;
+#endif
+
+
+
+enum class NoiseEngine {
+  /* Lattice noise evaluated by the kernels for every band of a layer. */
+  kPerlin = 0,      // Improved Perlin noise along the diagonal, the original look
+  kGradient1D = 1,  // One dimensional gradient noise, a quarter of the hashing for background shakes
+  kHash = 2,        // Improved Perlin noise on integer hashed lattice corners with full 32 bit seeds
+};
+
+
+
+enum class NoiseIsa {
+  /* Instruction set of the lane kernels, picked at runtime by PerlinNoise::selectIsa. */
+  kBaseline = 0,  // Baseline of the build, SSE2 on x86-64
+  kAvx2 = 1,      // AVX2 and FMA, Haswell and newer
+  kAvx512 = 2,    // AVX-512 F, DQ, BW and VL, Skylake-SP and newer, only used when forced
+};
+
+
+
+enum class FractalMode {
+  /* How the detail of a shake layer is built. */
+  kClassic = 0,  // Base band plus one fractal band driven by fractal and roughness
+  kFbm = 1,      // Fractional Brownian motion driven by octaves, lacunarity and gain
+};
+
+
+
+struct NoiseLayer {
+  /* Parameters of a single shake layer for one axis, as read from the shakeLayer compound. */
+  double weight = 1.0;
+  double seed = 0.0;
+  double frequency = 1.0;
+  double strength = 1.0;
+  double fractal = 0.0;
+  double rough = 0.0;
+};
+
+
+
+struct ShakeLayer {
+  /* Parameters of a single shake layer for all three axes, mirrors the shakeLayer compound. */
+  double weight = 1.0;
+  int seed = 21;
+  double frequency = 1.0;
+  double strength[3] = {10.0, 10.0, 10.0};
+  double fractal = 0.0;
+  double rough = 0.0;
+  FractalMode fractalMode = FractalMode::kClassic;
+  int octaves = 4;
+  double lacunarity = 2.0;
+  double gain = 0.5;
+};
+
+
+
+struct ShakeCullStats {
+  /* What ShakeLayerStack::cull left out of a stack. */
+  std::size_t layersCulled = 0;   // Layers whose weight was set to 0
+  std::size_t bandsCulled = 0;    // Fractal bands of classic layers and top octaves of fBm layers
+  double maxError = 0.0;          // Largest possible deviation of the culled stack on any axis
+};
+
+
+
+struct ShakeLayerStack {
+  /* Structure of arrays copy of a whole layer stack.
+
+  Every parameter of the layers is stored in its own contiguous column, so the
+  kernels can read the parameters of many layers without walking compound data
+  and nodes can keep the stack around between evaluations.
+
+  */
+  std::vector<double> weight;
+  std::vector<int> seed;
+  std::vector<double> frequency;
+  std::vector<double> strength[3];
+  std::vector<double> fractal;
+  std::vector<double> rough;
+  std::vector<FractalMode> fractalMode;
+  std::vector<int> octaves;
+  std::vector<double> lacunarity;
+  std::vector<double> gain;
+
+  std::size_t size() const {return weight.size();}
+  void resize(std::size_t numLayers);
+  void assign(const ShakeLayer *layers, std::size_t numLayers);
+  ShakeLayer layer(std::size_t index) const;
+  void setLayer(std::size_t index, const ShakeLayer &layer);
+  ShakeCullStats cull(double errorBudget);
+};
 
 
 
 class PerlinNoise {
+  /* C++ implementation of the improved perlin noise.
 
-public:
-  // Constructors
-  PerlinNoise();
+  All methods are static and the permutation table is built at compile time, so
+  evaluating the noise never allocates and is safe to call from any thread.
 
+  Reference:
+    https://cs.nyu.edu/~perlin/noise/
+
+  */
+
+public:
   // Public Methods
-  double calculateNoise(double weight, double time, double seed, double frequency, double strength, double fractal, double rough);
+  static double calculateNoise(double weight, double time, double seed, double frequency, double strength, double fractal, double rough);
+  static double gradNoise(double valXYZ=1.0);
+  static double gradientNoise1D(double valX=1.0);
+  static double hashNoise(double valXYZ=1.0, std::uint32_t stream=0);
+  static constexpr std::uint32_t latticeHash(std::uint32_t valX, std::uint32_t valY, std::uint32_t valZ, std::uint32_t stream);
+  static constexpr std::uint32_t mixBits(std::uint32_t value);
+  static constexpr std::uint32_t mixLatticeBits(std::uint32_t value);
+  static constexpr std::uint32_t streamSeed(std::uint32_t seed, std::uint32_t streamID);
+  static constexpr double streamPhase(std::uint32_t stream);
+  static constexpr double wrapLattice(double valXYZ);
+  static void calculateNoiseBatch(const NoiseLayer &layer, const double *times, std::size_t count, double *output);
+  static void calculateNoiseBatch(const NoiseLayer &layer, const double *times, std::size_t count, float *output);
+  static void accumulateShake(const ShakeLayer &layer, double time, double result[3], NoisePrecision precision=NoisePrecision::kDouble, NoiseEngine engine=NoiseEngine::kPerlin);
+  static void accumulateShakeArray(const ShakeLayer &layer, double time, const int *seedOffsets, std::size_t count, double *results, NoisePrecision precision=NoisePrecision::kDouble, NoiseEngine engine=NoiseEngine::kPerlin);
+  static void accumulateShakeStack(const ShakeLayerStack &layers, double time, double result[3], NoisePrecision precision=NoisePrecision::kDouble, NoiseEngine engine=NoiseEngine::kPerlin);
+  static void accumulateShakeStackSamples(const ShakeLayerStack &layers, const double *times, std::size_t count, double *results, NoisePrecision precision=NoisePrecision::kDouble, NoiseEngine engine=NoiseEngine::kPerlin);
+  static void accumulateShakeStackDerivatives(const ShakeLayerStack &layers, double time, double result[3], double velocity[3], double acceleration[3], NoisePrecision precision=NoisePrecision::kDouble, NoiseEngine engine=NoiseEngine::kPerlin);
+  static int fbmOctaveCount(const ShakeLayer &layer);
+  static NoiseIsa supportedIsa();
+  static NoiseIsa isa();
+  static bool setIsa(NoiseIsa isa);
+  static NoiseIsa selectIsa(std::string *warning=nullptr);
+  static const char *isaName(NoiseIsa isa);
+  static bool parseIsa(const std::string &name, NoiseIsa &isa);
+
+  // Public Data
+  // Environment variable forcing the instruction set of the kernels, baseline, sse2, avx2 or avx512
+  static constexpr const char *isaEnvironmentVariable = "SHAKENODE_NOISE_ISA";
+
+  // Seed offsets decorrelating the X, Y and Z axes of a layer
+  static constexpr double axisSeeds[3] = {13.0, 578.0, 1511.0};
+
+  // Odd multipliers spreading the X, Y and Z lattice coordinates in latticeHash
+  static constexpr std::uint32_t latticeMultipliers[3] = {0x8da6b343u, 0xd8163841u, 0xcb1ab31fu};
+
+  // Gradient magnitude step of gradientNoise1D, its 16 gradients are +-1 to +-8 steps.
+  // Matches the RMS amplitude of gradNoise within 2%
+  static constexpr double gradient1DScale = 1.0 / 6.0;
+
+  // Bound of the absolute value of every engine's noise. The Perlin gradients sum two
+  // coordinates in [-1, 1] and the interpolation is a convex blend, Gradient1D stays
+  // within 8 * gradient1DScale
+  static constexpr double noiseBound = 2.0;
+
+  // Largest absolute difference between the single and double precision kernels,
+  // relative to the layer amplitude weight * (|strength| + fractal * (rough + 0.084) * 3.3)
+  static constexpr double maxSingleDeviation = 5.0e-6;
+
+  // fBm octaves stop once their amplitude relative to the first octave drops below
+  // this cutoff, further octaves are well under the precision of a shake
+  static constexpr double fbmAmplitudeCutoff = 1.0e-3;
+  static constexpr int fbmMaxOctaves = 16;
+
+  // Seed offset between consecutive fBm octaves so they do not share lattice points
+  static constexpr double fbmOctaveSeed = 53.0;
+
+  // Ken's permutation array composed of 512 elements = 2 sets of (0, 255), aligned
+  // to cache lines so the whole table occupies 8 lines of L1
+  alignas(64) static constexpr std::uint8_t permutation[512] = {
+    151, 160, 137, 91, 90, 15, 131, 13, 201, 95, 96, 53, 194, 233, 7, 225, 140, 36,
+    103, 30, 69, 142, 8, 99, 37, 240, 21, 10, 23, 190, 6, 148, 247, 120, 234, 75, 0,
+    26, 197, 62, 94, 252, 219, 203, 117, 35, 11, 32, 57, 177, 33, 88, 237, 149, 56,
+    87, 174, 20, 125, 136, 171, 168, 68, 175, 74, 165, 71, 134, 139, 48, 27, 166,
+    77, 146, 158, 231, 83, 111, 229, 122, 60, 211, 133, 230, 220, 105, 92, 41, 55,
+    46, 245, 40, 244, 102, 143, 54, 65, 25, 63, 161, 1, 216, 80, 73, 209, 76, 132,
+    187, 208, 89, 18, 169, 200, 196, 135, 130, 116, 188, 159, 86, 164, 100, 109,
+    198, 173, 186, 3, 64, 52, 217, 226, 250, 124, 123, 5, 202, 38, 147, 118, 126,
+    255, 82, 85, 212, 207, 206, 59, 227, 47, 16, 58, 17, 182, 189, 28, 42, 223, 183,
+    170, 213, 119, 248, 152, 2, 44, 154, 163, 70, 221, 153, 101, 155, 167, 43, 172,
+    9, 129, 22, 39, 253, 19, 98, 108, 110, 79, 113, 224, 232, 178, 185, 112, 104,
+    218, 246, 97, 228, 251, 34, 242, 193, 238, 210, 144, 12, 191, 179, 162, 241, 81,
+    51, 145, 235, 249, 14, 239, 107, 49, 192, 214, 31, 181, 199, 106, 157, 184, 84,
+    204, 176, 115, 121, 50, 45, 127, 4, 150, 254, 138, 236, 205, 93, 222, 114, 67,
+    29, 24, 72, 243, 141, 128, 195, 78, 66, 215, 61, 156, 180, 151, 160, 137, 91,
+    90, 15, 131, 13, 201, 95, 96, 53, 194, 233, 7, 225, 140, 36, 103, 30, 69, 142,
+    8, 99, 37, 240, 21, 10, 23, 190, 6, 148, 247, 120, 234, 75, 0, 26, 197, 62, 94,
+    252, 219, 203, 117, 35, 11, 32, 57, 177, 33, 88, 237, 149, 56, 87, 174, 20, 125,
+    136, 171, 168, 68, 175, 74, 165, 71, 134, 139, 48, 27, 166, 77, 146, 158, 231,
+    83, 111, 229, 122, 60, 211, 133, 230, 220, 105, 92, 41, 55, 46, 245, 40, 244,
+    102, 143, 54, 65, 25, 63, 161, 1, 216, 80, 73, 209, 76, 132, 187, 208, 89, 18,
+    169, 200, 196, 135, 130, 116, 188, 159, 86, 164, 100, 109, 198, 173, 186, 3, 64,
+    52, 217, 226, 250, 124, 123, 5, 202, 38, 147, 118, 126, 255, 82, 85, 212, 207,
+    206, 59, 227, 47, 16, 58, 17, 182, 189, 28, 42, 223, 183, 170, 213, 119, 248,
+    152, 2, 44, 154, 163, 70, 221, 153, 101, 155, 167, 43, 172, 9, 129, 22, 39, 253,
+    19, 98, 108, 110, 79, 113, 224, 232, 178, 185, 112, 104, 218, 246, 97, 228, 251,
+    34, 242, 193, 238, 210, 144, 12, 191, 179, 162, 241, 81, 51, 145, 235, 249, 14,
+    239, 107, 49, 192, 214, 31, 181, 199, 106, 157, 184, 84, 204, 176, 115, 121, 50,
+    45, 127, 4, 150, 254, 138, 236, 205, 93, 222, 114, 67, 29, 24, 72, 243, 141,
+    128, 195, 78, 66, 215, 61, 156, 180
+  };
 
 private: 
   // Private Methods
-  double lerp(double valT=0.5, double valA=0.0, double valB=1.0);
-  double fade(double valT=1.0);
-  double gradient(int hashID=255, double valX=1.0, double valY=1.0, double valZ=1.0);
-  double gradNoise(double valXYZ=1.0);
-  
-  // Private Data
-  std::vector<int> permutation;
+  static constexpr double lerp(double valT=0.5, double valA=0.0, double valB=1.0);
+  static constexpr double fade(double valT=1.0);
+  static constexpr double gradient(int hashID=255, double valX=1.0, double valY=1.0, double valZ=1.0);
 };
+
+
+
+constexpr double PerlinNoise::lerp(double valT, double valA, double valB) {
+  /* Linear interpolation function.
+
+  Args:
+    valT (double): Interpolation value
+    valA (double): Input value one
+    valB (double): Input value two
+
+  Returns:
+    double: Interpolated value
+
+  */
+  return valA + valT * (valB - valA);
+}
+
+constexpr double PerlinNoise::fade(double valT) {
+  /* Ken's new spline interpolation.
+
+  Args:
+    valT (double): Interpolation value
+
+  */
+  return valT * valT * valT * (valT * (valT * 6.0 - 15.0) + 10.0);
+}
+
+constexpr std::uint32_t PerlinNoise::mixBits(std::uint32_t value) {
+  /* lowbias32 integer finalizer by Chris Wellons, a bijection with full avalanche.
+
+  Args:
+    value (uint32): Bits to mix
+
+  Returns:
+    uint32: Mixed bits
+
+  */
+  value ^= value >> 16;
+  value *= 0x7feb352du;
+  value ^= value >> 15;
+  value *= 0x846ca68bu;
+  value ^= value >> 16;
+  return value;
+}
+
+constexpr std::uint32_t PerlinNoise::mixLatticeBits(std::uint32_t value) {
+  /* First round of mixBits, enough for the top four bits that select a gradient.
+
+  The stream is already fully mixed by streamSeed, so a single multiply keeps the
+  gradients uniform and independent between neighbouring corners at half the cost.
+
+  Args:
+    value (uint32): Bits to mix
+
+  Returns:
+    uint32: Mixed bits, only the top bits are well distributed
+
+  */
+  value ^= value >> 16;
+  value *= 0x7feb352du;
+  value ^= value >> 15;
+  return value;
+}
+
+constexpr std::uint32_t PerlinNoise::latticeHash(std::uint32_t valX, std::uint32_t valY, std::uint32_t valZ, std::uint32_t stream) {
+  /* Integer hash of a lattice point, replaces the permutation table lookups of the hash engine.
+
+  The coordinates are spread with large odd multipliers, combined with the stream
+  and run through mixLatticeBits. Only multiplies, shifts and xors, so it
+  vectorizes and has no period in the lattice.
+
+  Args:
+    valX (uint32): X lattice coordinate
+    valY (uint32): Y lattice coordinate
+    valZ (uint32): Z lattice coordinate
+    stream (uint32): Noise stream, see streamSeed
+
+  Returns:
+    uint32: Hash, the top four bits select the gradient
+
+  */
+  return mixLatticeBits(stream ^ (valX * latticeMultipliers[0]) ^ (valY * latticeMultipliers[1]) ^ (valZ * latticeMultipliers[2]));
+}
+
+constexpr std::uint32_t PerlinNoise::streamSeed(std::uint32_t seed, std::uint32_t streamID) {
+  /* Noise stream of the hash engine for a layer seed.
+
+  The seed is mixed by a bijection before the stream ID is added, so every one of
+  the 2^32 seeds gets its own streams instead of repeating every 256 like the
+  permutation table.
+
+  Args:
+    seed (uint32): Layer seed, plus the element offset for shake arrays
+    streamID (uint32): Band or octave and axis within the seed
+
+  Returns:
+    uint32: Stream passed to latticeHash
+
+  */
+  return mixBits(mixBits(seed) + streamID * 0x9e3779b9u);
+}
+
+constexpr double PerlinNoise::streamPhase(std::uint32_t stream) {
+  /* Lattice offset of a hash stream in [0, 1), taken from its top 24 bits so it is exact in double.
+
+  Args:
+    stream (uint32): Noise stream, see streamSeed
+
+  Returns:
+    double: Offset added to the noise input
+
+  */
+  return (double) (int) (stream >> 8) * (1.0 / 16777216.0);
+}
+
+constexpr double PerlinNoise::wrapLattice(double valXYZ) {
+  /* Moves an input by whole multiples of 2^32 lattice cells into the int range.
+
+  Every engine only uses the lattice cell modulo 2^32, so the wrapped input has the
+  same corners and fractional part, inputs already in the int range are returned
+  unchanged. Without it the cell conversion overflows once time * frequency grows
+  past 2^31, like high fBm octaves far into a shot. Rounds by adding 1.5 * 2^52
+  instead of calling floor so the kernels still vectorize without SSE4.1.
+
+  Args:
+    valXYZ (double): Noise input
+
+  Returns:
+    double: Input in [-2^31, 2^31)
+
+  */
+  constexpr double period = 4294967296.0;
+  constexpr double roundBias = 6755399441055744.0;
+  double wraps = (valXYZ * (1.0 / period) + roundBias) - roundBias;
+  double wrapped = valXYZ - wraps * period;
+  return wrapped >= 2147483648.0 ? wrapped - period : wrapped;
+}
+
+constexpr double PerlinNoise::gradient(int hashID, double valX, double valY, double valZ) {
+  /* Gradient function.
+
+  Ken's new function to return gradient values based on bit operations.
+
+  Args:
+    hashID (int):
+    valX (double): X input value
+    valY (double): Y input value
+    valZ (double): Z input value
+
+  Returns:
+    double: Result of hshU plus hshV
+
+  */
+  int hshID = hashID & 15;
+  double hshU = hshID < 8 ? valX : valY;
+  double hshV = valZ;
+
+  if (hshID == 12 || hshID == 14) {
+    hshV = valX;
+  }
+
+  // The sign of hshU is always flipped, kept as is so existing shakes do not change
+  hshU = -hshU;
+  if ((hshID & 2) != 0) {
+    hshV = -hshV;
+  }
+
+  return hshU + hshV;
+}
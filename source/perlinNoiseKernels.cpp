@@ -0,0 +1,805 @@
+/* Vectorized lane kernels behind the batch and shake entry points of PerlinNoise.
+
+The kernels are plain loops over fixed size lanes that the compiler vectorizes.
+This file is compiled once for the baseline of the build and, on x86-64, again with
+AVX2 and AVX-512 enabled (see CMakeLists.txt), each build filling its own
+NoiseKernelTable named by SHAKENODE_KERNEL_TABLE. PerlinNoise::selectIsa picks
+the table matching the CPU at runtime.
+
+Everything but the table has internal linkage, so the builds cannot mix. That
+includes what this file uses from elsewhere: inline functions of headers, like
+the helpers of perlinNoise.h, member functions of std::vector or std algorithms,
+are emitted as weak symbols shared with every other translation unit in builds
+without optimization, and the linker may keep the copy compiled for a newer
+instruction set. The kernels only use local copies of such helpers, read stacks
+through the raw pointers of ShakeLayerColumns and only call out of line
+functions of the baseline build. The kernelSymbolTest of the build fails if an
+AVX object defines any global symbol besides its table.
+
+*/
+#include "perlinNoiseKernels.h"
+
+// System Includes
+#include <cstdint>
+
+#ifndef SHAKENODE_KERNEL_TABLE
+#define SHAKENODE_KERNEL_TABLE kBaselineKernels
+#endif
+
+
+
+namespace {
+
+// Local copies of the inline helpers of PerlinNoise, see the top of the file. The
+// equivalence test compares every build with a frozen reference, so they cannot drift
+
+constexpr std::uint32_t mixBits(std::uint32_t value) {
+  /* Same as PerlinNoise::mixBits. */
+  value ^= value >> 16;
+  value *= 0x7feb352du;
+  value ^= value >> 15;
+  value *= 0x846ca68bu;
+  value ^= value >> 16;
+  return value;
+}
+
+constexpr std::uint32_t mixLatticeBits(std::uint32_t value) {
+  /* Same as PerlinNoise::mixLatticeBits. */
+  value ^= value >> 16;
+  value *= 0x7feb352du;
+  value ^= value >> 15;
+  return value;
+}
+
+constexpr std::uint32_t streamSeed(std::uint32_t seed, std::uint32_t streamID) {
+  /* Same as PerlinNoise::streamSeed. */
+  return mixBits(mixBits(seed) + streamID * 0x9e3779b9u);
+}
+
+constexpr double streamPhase(std::uint32_t stream) {
+  /* Same as PerlinNoise::streamPhase. */
+  return (double) (int) (stream >> 8) * (1.0 / 16777216.0);
+}
+
+constexpr double wrapLattice(double valXYZ) {
+  /* Same as PerlinNoise::wrapLattice. */
+  constexpr double period = 4294967296.0;
+  constexpr double roundBias = 6755399441055744.0;
+  double wraps = (valXYZ * (1.0 / period) + roundBias) - roundBias;
+  double wrapped = valXYZ - wraps * period;
+  return wrapped >= 2147483648.0 ? wrapped - period : wrapped;
+}
+
+constexpr std::size_t minCount(std::size_t valA, std::size_t valB) {
+  return valA < valB ? valA : valB;
+}
+
+template <class T>
+void fillLanes(T *first, T *last, T value) {
+  for (; first != last; ++first) {
+    *first = value;
+  }
+}
+
+// Number of samples evaluated together by the batch kernel, sized to fill two AVX-512
+// registers of doubles while still fitting the lane arrays in a few cache lines
+constexpr std::size_t kBatchLanes = 16;
+
+// Lanes used to evaluate the base and fractal bands of the three axes of one layer
+constexpr std::size_t kShakeLanes = 8;
+
+// Layers of a stack evaluated together, their base and fractal bands on all three
+// axes fill 6 blocks of kShakeLanes without padding
+constexpr std::size_t kStackLayers = 8;
+
+// Elements of a shake array evaluated together, their base and fractal bands on all
+// three axes fill 6 blocks of kBatchLanes
+constexpr std::size_t kArrayElements = kBatchLanes;
+
+struct LatticeCellHashes {
+  /* Gradient hashes of the eight corners of every lattice cell of the Perlin engine.
+
+  Inputs are sampled along the diagonal, so a cell is the same on all three axes and
+  its corners only depend on that one value. Corner i is held in bits 4i to 4i + 3.
+
+  */
+  alignas(64) std::uint32_t corners[256] = {};
+
+  constexpr LatticeCellHashes() {
+    const std::uint8_t *perm = PerlinNoise::permutation;
+    for (int intXYZ = 0; intXYZ < 256; ++intXYZ) {
+      int A = perm[intXYZ] + intXYZ;
+      int B = perm[intXYZ + 1] + intXYZ;
+      int AA = perm[A] + intXYZ;
+      int BA = perm[B] + intXYZ;
+      int AB = perm[A + 1] + intXYZ;
+      int BB = perm[B + 1] + intXYZ;
+      const int hashes[8] = {perm[AA], perm[BA], perm[AB], perm[BB], perm[AA + 1], perm[BA + 1], perm[AB + 1], perm[BB + 1]};
+      for (int corner = 0; corner < 8; ++corner) {
+        corners[intXYZ] |= (std::uint32_t) (hashes[corner] & 15) << (4 * corner);
+      }
+    }
+  }
+};
+
+// Lattice cells hashed once at compile time, the kernels of every evaluation reuse
+// them and only compute the fade and interpolation of the fractional part
+constexpr LatticeCellHashes kLatticeCellHashes;
+
+template <class Real>
+struct NoiseDerivatives {
+  /* Value of an interpolated noise term with its first and second derivative. */
+  Real value;
+  Real slope;
+  Real curvature;
+};
+
+template <class Real>
+inline NoiseDerivatives<Real> lerpDerivatives(const NoiseDerivatives<Real> &fade, const NoiseDerivatives<Real> &valA, const NoiseDerivatives<Real> &valB) {
+  /* Product rule through valA + fade * (valB - valA), all three terms depend on the input.
+
+  The value is computed with the exact expression of the plain kernels, so it stays
+  identical to them.
+
+  */
+  Real delta = valB.value - valA.value;
+  Real deltaSlope = valB.slope - valA.slope;
+  return {
+    valA.value + fade.value * delta,
+    valA.slope + fade.slope * delta + fade.value * deltaSlope,
+    valA.curvature + fade.curvature * delta + Real(2) * fade.slope * deltaSlope + fade.value * (valB.curvature - valA.curvature)
+  };
+}
+
+template <class Real>
+inline NoiseDerivatives<Real> fadeDerivatives(Real frac) {
+  /* Ken's fade curve 6t^5 - 15t^4 + 10t^3 with its derivatives 30t^2(t - 1)^2 and 60t(t - 1)(2t - 1). */
+  Real fracOne = frac - Real(1);
+  return {
+    frac * frac * frac * (frac * (frac * Real(6) - Real(15)) + Real(10)),
+    Real(30) * frac * frac * fracOne * fracOne,
+    Real(60) * frac * fracOne * (Real(2) * frac - Real(1))
+  };
+}
+
+template <class Real, std::size_t kLanes, bool kDerivatives = false, bool kHashed = false>
+void gradNoiseLanes(const double *valXYZ, Real *output, Real *slope = nullptr, Real *curvature = nullptr, const std::uint32_t *streams = nullptr) {
+  /* Improved Perlin Noise evaluated for a block of kLanes inputs.
+
+  Same arithmetic as PerlinNoise::gradNoise, split into straight loops over the
+  lanes so the compiler can vectorize the floor, fade, gradient and interpolation
+  steps. The corner hashes of a cell are a single lookup in kLatticeCellHashes, so
+  no chain of dependent permutation lookups is left in the loops.
+
+  The lattice cell is always split off in double precision, so a float Real only
+  affects the fade, gradient and interpolation of the fractional part and the error
+  does not grow with the magnitude of time or seed.
+
+  With kDerivatives the first and second derivative of the noise with respect to
+  the input are computed from the same lattice hashes. The gradients are linear in
+  the input, so only the fade curve and the interpolation add terms.
+
+  With kHashed the input is shifted by the phase of the lane's stream and the
+  lattice corners are hashed by PerlinNoise::latticeHash instead of the permutation
+  table, the cells are not wrapped to 256 and the hashing is plain integer
+  arithmetic the compiler can vectorize.
+
+  Args:
+    valXYZ (const double*): kLanes XYZ inputs
+    output (Real*): kLanes interpolated noise outputs
+    slope (Real*): kLanes first derivatives, only written with kDerivatives
+    curvature (Real*): kLanes second derivatives, only written with kDerivatives
+    streams (const uint32*): kLanes hash streams, only read with kHashed
+
+  */
+  const Real one = 1;
+
+  alignas(64) int cell[kLanes];
+  alignas(64) Real frac[kLanes];
+  alignas(64) Real fade[kLanes];
+
+  // Lattice cell and fractional position, floor done with a truncating conversion
+  // so it vectorizes without SSE4.1
+  for (std::size_t i = 0; i < kLanes; ++i) {
+    double position = wrapLattice(kHashed ? valXYZ[i] + streamPhase(streams[i]) : valXYZ[i]);
+    int intXYZ = (int) position;
+    intXYZ -= position < (double) intXYZ;
+    cell[i] = kHashed ? intXYZ : intXYZ & 255;
+    frac[i] = (Real) (position - (double) intXYZ);
+    fade[i] = frac[i] * frac[i] * frac[i] * (frac[i] * (frac[i] * Real(6) - Real(15)) + Real(10));
+  }
+
+  // Hash the lattice cell corners
+  alignas(64) int hashes[8][kLanes];
+  if constexpr (kHashed) {
+    // Same as PerlinNoise::latticeHash, (cell + 1) * multiplier is the product of
+    // the cell plus the multiplier, so the corners only add to three products per lane
+    constexpr const std::uint32_t *multipliers = PerlinNoise::latticeMultipliers;
+    alignas(64) std::uint32_t products[3][kLanes];
+    for (std::size_t i = 0; i < kLanes; ++i) {
+      for (int axis = 0; axis < 3; ++axis) {
+        products[axis][i] = (std::uint32_t) cell[i] * multipliers[axis];
+      }
+    }
+    for (int corner = 0; corner < 8; ++corner) {
+      const std::uint32_t offsetX = (corner & 1) ? multipliers[0] : 0u;
+      const std::uint32_t offsetY = (corner & 2) ? multipliers[1] : 0u;
+      const std::uint32_t offsetZ = (corner & 4) ? multipliers[2] : 0u;
+      for (std::size_t i = 0; i < kLanes; ++i) {
+        std::uint32_t hash = streams[i] ^ (products[0][i] + offsetX) ^ (products[1][i] + offsetY) ^ (products[2][i] + offsetZ);
+        hashes[corner][i] = (int) (mixLatticeBits(hash) >> 28);
+      }
+    }
+  } else {
+    alignas(64) std::uint32_t corners[kLanes];
+    for (std::size_t i = 0; i < kLanes; ++i) {
+      corners[i] = kLatticeCellHashes.corners[cell[i]];
+    }
+    for (int corner = 0; corner < 8; ++corner) {
+      for (std::size_t i = 0; i < kLanes; ++i) {
+        hashes[corner][i] = (int) ((corners[i] >> (4 * corner)) & 15u);
+      }
+    }
+  }
+
+  if constexpr (kDerivatives) {
+    // Every gradient is -U +- V of inputs with slope 1, so its slope is 0 or -2
+    for (std::size_t i = 0; i < kLanes; ++i) {
+      NoiseDerivatives<Real> grads[8];
+      for (int corner = 0; corner < 8; ++corner) {
+        Real valX = (corner & 1) ? frac[i] - one : frac[i];
+        Real valY = (corner & 2) ? frac[i] - one : frac[i];
+        Real valZ = (corner & 4) ? frac[i] - one : frac[i];
+        int hshID = hashes[corner][i];
+        Real hshU = hshID < 8 ? valX : valY;
+        Real hshV = (hshID == 12 || hshID == 14) ? valX : valZ;
+        bool flipV = (hshID & 2) != 0;
+        grads[corner] = {-hshU + (flipV ? -hshV : hshV), flipV ? Real(-2) : Real(0), Real(0)};
+      }
+      NoiseDerivatives<Real> fadeI = fadeDerivatives(frac[i]);
+      NoiseDerivatives<Real> firstPassesCombined = lerpDerivatives(fadeI, lerpDerivatives(fadeI, grads[0], grads[1]), lerpDerivatives(fadeI, grads[2], grads[3]));
+      NoiseDerivatives<Real> secondPassesCombined = lerpDerivatives(fadeI, lerpDerivatives(fadeI, grads[4], grads[5]), lerpDerivatives(fadeI, grads[6], grads[7]));
+      NoiseDerivatives<Real> trilinear = lerpDerivatives(fadeI, firstPassesCombined, secondPassesCombined);
+      output[i] = trilinear.value;
+      slope[i] = trilinear.slope;
+      curvature[i] = trilinear.curvature;
+    }
+    return;
+  }
+
+  // Branchless gradients and trilinear interpolation
+  for (std::size_t i = 0; i < kLanes; ++i) {
+    Real grads[8];
+    for (int corner = 0; corner < 8; ++corner) {
+      Real valX = (corner & 1) ? frac[i] - one : frac[i];
+      Real valY = (corner & 2) ? frac[i] - one : frac[i];
+      Real valZ = (corner & 4) ? frac[i] - one : frac[i];
+      int hshID = hashes[corner][i];
+      Real hshU = hshID < 8 ? valX : valY;
+      Real hshV = (hshID == 12 || hshID == 14) ? valX : valZ;
+      grads[corner] = -hshU + ((hshID & 2) != 0 ? -hshV : hshV);
+    }
+    Real firstPassA = grads[0] + fade[i] * (grads[1] - grads[0]);
+    Real firstPassB = grads[2] + fade[i] * (grads[3] - grads[2]);
+    Real firstPassesCombined = firstPassA + fade[i] * (firstPassB - firstPassA);
+    Real secondPassA = grads[4] + fade[i] * (grads[5] - grads[4]);
+    Real secondPassB = grads[6] + fade[i] * (grads[7] - grads[6]);
+    Real secondPassesCombined = secondPassA + fade[i] * (secondPassB - secondPassA);
+    output[i] = firstPassesCombined + fade[i] * (secondPassesCombined - firstPassesCombined);
+  }
+}
+
+template <class Real, std::size_t kLanes, bool kDerivatives = false>
+void gradient1DLanes(const double *valXYZ, Real *output, Real *slope = nullptr, Real *curvature = nullptr) {
+  /* One dimensional gradient noise evaluated for a block of kLanes inputs.
+
+  Same arithmetic as PerlinNoise::gradientNoise1D. Only the two lattice points
+  around each input are hashed, a single permutation lookup each, and blended with
+  one interpolation instead of the eight corners and seven of the 3D noise.
+
+  Args:
+    valXYZ (const double*): kLanes inputs
+    output (Real*): kLanes interpolated noise outputs
+    slope (Real*): kLanes first derivatives, only written with kDerivatives
+    curvature (Real*): kLanes second derivatives, only written with kDerivatives
+
+  */
+  const std::uint8_t *perm = PerlinNoise::permutation;
+  const Real one = 1;
+  const Real scale = (Real) PerlinNoise::gradient1DScale;
+
+  alignas(64) int cell[kLanes];
+  alignas(64) Real frac[kLanes];
+  for (std::size_t i = 0; i < kLanes; ++i) {
+    double position = wrapLattice(valXYZ[i]);
+    int intX = (int) position;
+    intX -= position < (double) intX;
+    cell[i] = intX & 255;
+    frac[i] = (Real) (position - (double) intX);
+  }
+
+  alignas(64) int hashes[2][kLanes];
+  for (std::size_t i = 0; i < kLanes; ++i) {
+    hashes[0][i] = perm[cell[i]] & 15;
+    hashes[1][i] = perm[cell[i] + 1] & 15;
+  }
+
+  for (std::size_t i = 0; i < kLanes; ++i) {
+    Real fade = frac[i] * frac[i] * frac[i] * (frac[i] * (frac[i] * Real(6) - Real(15)) + Real(10));
+    Real gradA = (Real) ((hashes[0][i] & 7) + 1) * ((hashes[0][i] & 8) != 0 ? -scale : scale);
+    Real gradB = (Real) ((hashes[1][i] & 7) + 1) * ((hashes[1][i] & 8) != 0 ? -scale : scale);
+    Real valA = gradA * frac[i];
+    Real valB = gradB * (frac[i] - one);
+    if constexpr (kDerivatives) {
+      NoiseDerivatives<Real> blend = lerpDerivatives(fadeDerivatives(frac[i]), {valA, gradA, Real(0)}, {valB, gradB, Real(0)});
+      output[i] = blend.value;
+      slope[i] = blend.slope;
+      curvature[i] = blend.curvature;
+    } else {
+      output[i] = valA + fade * (valB - valA);
+    }
+  }
+}
+
+
+// Noise engine policies, the kernels below take one as template parameter so the
+// engine's lane function is inlined into them. Table based engines offset the input
+// by the seed, hashed engines select a stream of the seed instead
+
+struct PerlinEngine {
+  /* Improved Perlin noise sampled along the diagonal, eight gradient corners per sample. */
+  static constexpr bool kHashedSeeds = false;
+  template <class Real, std::size_t kLanes, bool kDerivatives = false>
+  static void noiseLanes(const double *valXYZ, const std::uint32_t *, Real *output, Real *slope = nullptr, Real *curvature = nullptr) {
+    gradNoiseLanes<Real, kLanes, kDerivatives>(valXYZ, output, slope, curvature);
+  }
+};
+
+struct Gradient1DEngine {
+  /* One dimensional gradient noise, two gradient points per sample. */
+  static constexpr bool kHashedSeeds = false;
+  template <class Real, std::size_t kLanes, bool kDerivatives = false>
+  static void noiseLanes(const double *valXYZ, const std::uint32_t *, Real *output, Real *slope = nullptr, Real *curvature = nullptr) {
+    gradient1DLanes<Real, kLanes, kDerivatives>(valXYZ, output, slope, curvature);
+  }
+};
+
+struct HashEngine {
+  /* Improved Perlin noise with integer hashed corners, one stream per seed, band and axis. */
+  static constexpr bool kHashedSeeds = true;
+  template <class Real, std::size_t kLanes, bool kDerivatives = false>
+  static void noiseLanes(const double *valXYZ, const std::uint32_t *streams, Real *output, Real *slope = nullptr, Real *curvature = nullptr) {
+    gradNoiseLanes<Real, kLanes, kDerivatives, true>(valXYZ, output, slope, curvature, streams);
+  }
+};
+
+template <class Engine>
+inline void setLane(double *positions, std::uint32_t *streams, std::size_t lane, double time, double frequency, double seed, std::uint32_t intSeed, std::uint32_t streamID) {
+  /* Input of one lane, a band of one axis.
+
+  Args:
+    positions (double*): Lane inputs
+    streams (uint32*): Lane hash streams
+    lane (size_t): Lane to set
+    time (double): Time input
+    frequency (double): Frequency of the band
+    seed (double): Offset of the input for table based engines, seed plus axis seed
+    intSeed (uint32): Seed of the layer for hashed engines
+    streamID (uint32): Band or octave and axis of the lane for hashed engines
+
+  */
+  if constexpr (Engine::kHashedSeeds) {
+    positions[lane] = time * frequency;
+    streams[lane] = streamSeed(intSeed, streamID);
+  } else {
+    positions[lane] = time * frequency + seed;
+  }
+}
+
+template <class Function>
+void dispatchKernel(NoiseEngine engine, NoisePrecision precision, Function &&function) {
+  /* Calls function with an engine policy and a Real value matching the settings.
+
+  Args:
+    engine (NoiseEngine): Noise engine to use
+    precision (NoisePrecision): Floating point precision of the kernel
+    function (Function&&): Generic callable taking (Engine, Real) tag arguments
+
+  */
+  auto dispatchPrecision = [&](auto engineTag) {
+    if (precision == NoisePrecision::kSingle) {
+      function(engineTag, float());
+    } else {
+      function(engineTag, double());
+    }
+  };
+  if (engine == NoiseEngine::kGradient1D) {
+    dispatchPrecision(Gradient1DEngine());
+  } else if (engine == NoiseEngine::kHash) {
+    dispatchPrecision(HashEngine());
+  } else {
+    dispatchPrecision(PerlinEngine());
+  }
+}
+
+template <class Real>
+void calculateNoiseBatchLanes(const NoiseLayer &layer, const double *times, std::size_t count, Real *output) {
+  /* Shared implementation of the double and single precision batch evaluation.
+
+  Args:
+    layer (NoiseLayer): Parameters of the layer
+    times (const double*): Times to evaluate
+    count (size_t): Number of times
+    output (Real*): Contiguous buffer receiving count results
+
+  */
+  const double baseFrequency = layer.frequency * 0.078;
+  const double fractalFrequency = 2 * (layer.frequency + 0.067);
+  const Real weight = (Real) layer.weight;
+  const Real strength = (Real) layer.strength;
+  const Real fractal = (Real) layer.fractal;
+  const Real fractalScale = (Real) ((layer.rough + 0.084) * 3.3);
+
+  alignas(64) double basePositions[kBatchLanes];
+  alignas(64) double fractalPositions[kBatchLanes];
+  alignas(64) Real baseNoise[kBatchLanes];
+  alignas(64) Real fractalNoise[kBatchLanes];
+
+  for (std::size_t offset = 0; offset < count; offset += kBatchLanes) {
+    std::size_t numLanes = minCount(kBatchLanes, count - offset);
+    for (std::size_t i = 0; i < kBatchLanes; ++i) {
+      double time = i < numLanes ? times[offset + i] : 0.0;
+      basePositions[i] = time * baseFrequency + layer.seed;
+      fractalPositions[i] = time * fractalFrequency + layer.seed;
+    }
+
+    gradNoiseLanes<Real, kBatchLanes>(basePositions, baseNoise);
+    if (layer.fractal != 0) {
+      gradNoiseLanes<Real, kBatchLanes>(fractalPositions, fractalNoise);
+    } else {
+      fillLanes(fractalNoise, fractalNoise + kBatchLanes, Real(0));
+    }
+
+    for (std::size_t i = 0; i < numLanes; ++i) {
+      output[offset + i] = weight * (strength * baseNoise[i] + fractal * (fractalScale * fractalNoise[i]));
+    }
+  }
+}
+
+template <class Engine, class Real>
+void accumulateShakeLanes(const ShakeLayer &layer, double time, double result[3]) {
+  /* Shared implementation of the double and single precision layer evaluation.
+
+  Args:
+    layer (ShakeLayer): Parameters of the layer
+    time (double): Time input
+    result (double[3]): X, Y and Z values the layer noise is added to
+
+  */
+  const double baseFrequency = layer.frequency * 0.078;
+  const double fractalFrequency = 2 * (layer.frequency + 0.067);
+  const Real weight = (Real) layer.weight;
+  const Real fractal = (Real) layer.fractal;
+  const Real fractalScale = (Real) ((layer.rough + 0.084) * 3.3);
+
+  // Lanes 0-2 hold the base band, lanes 4-6 the fractal band, lanes 3 and 7 are padding
+  alignas(64) double positions[kShakeLanes] = {};
+  alignas(64) std::uint32_t streams[kShakeLanes] = {};
+  alignas(64) Real noise[kShakeLanes];
+  for (int axis = 0; axis < 3; ++axis) {
+    double seed = layer.seed + PerlinNoise::axisSeeds[axis];
+    setLane<Engine>(positions, streams, axis, time, baseFrequency, seed, layer.seed, axis);
+    setLane<Engine>(positions, streams, 4 + axis, time, fractalFrequency, seed, layer.seed, 3 + axis);
+  }
+
+  Engine::template noiseLanes<Real, kShakeLanes>(positions, streams, noise);
+
+  for (int axis = 0; axis < 3; ++axis) {
+    result[axis] += weight * ((Real) layer.strength[axis] * noise[axis] + fractal * (fractalScale * noise[4 + axis]));
+  }
+}
+
+template <class Engine, class Real, bool kDerivatives = false>
+void accumulateFbmLanes(const ShakeLayer &layer, double time, double result[3], double velocity[3] = nullptr, double acceleration[3] = nullptr) {
+  /* Fractional Brownian motion evaluation of a layer on all three axes.
+
+  Every axis and octave pair is an independent lattice evaluation, they are packed
+  octave major into blocks of lanes so the whole stack runs through the vectorized
+  kernel in one tight loop.
+
+  Args:
+    layer (ShakeLayer): Parameters of the layer
+    time (double): Time input
+    result (double[3]): X, Y and Z values the layer noise is added to
+    velocity (double[3]): First time derivatives are added to it with kDerivatives
+    acceleration (double[3]): Second time derivatives are added to it with kDerivatives
+
+  */
+  constexpr std::size_t kMaxLanes = 3 * PerlinNoise::fbmMaxOctaves;
+  static_assert(kMaxLanes % kShakeLanes == 0, "fBm lanes must fill whole kernel blocks");
+
+  const int numOctaves = PerlinNoise::fbmOctaveCount(layer);
+  const std::size_t numLanes = 3 * (std::size_t) numOctaves;
+
+  alignas(64) double positions[kMaxLanes] = {};
+  alignas(64) std::uint32_t streams[kMaxLanes] = {};
+  alignas(64) Real noise[kMaxLanes];
+  alignas(64) Real slope[kMaxLanes];
+  alignas(64) Real curvature[kMaxLanes];
+  double frequencies[PerlinNoise::fbmMaxOctaves];
+  double frequency = layer.frequency * 0.078;
+  for (int octave = 0; octave < numOctaves; ++octave) {
+    double octaveSeed = layer.seed + octave * PerlinNoise::fbmOctaveSeed;
+    for (int axis = 0; axis < 3; ++axis) {
+      setLane<Engine>(positions, streams, 3 * octave + axis, time, frequency, octaveSeed + PerlinNoise::axisSeeds[axis], layer.seed, 3 * octave + axis);
+    }
+    frequencies[octave] = frequency;
+    frequency *= layer.lacunarity;
+  }
+
+  for (std::size_t offset = 0; offset < numLanes; offset += kShakeLanes) {
+    Engine::template noiseLanes<Real, kShakeLanes, kDerivatives>(positions + offset, streams + offset, noise + offset, slope + offset, curvature + offset);
+  }
+
+  Real sums[3] = {0, 0, 0};
+  Real slopeSums[3] = {0, 0, 0};
+  Real curvatureSums[3] = {0, 0, 0};
+  Real amplitude = 1;
+  for (int octave = 0; octave < numOctaves; ++octave) {
+    for (int axis = 0; axis < 3; ++axis) {
+      sums[axis] += amplitude * noise[3 * octave + axis];
+    }
+    if constexpr (kDerivatives) {
+      // d/dt noise(time * frequency + seed) scales the noise derivatives by the frequency
+      const Real octaveFrequency = (Real) frequencies[octave];
+      for (int axis = 0; axis < 3; ++axis) {
+        slopeSums[axis] += amplitude * octaveFrequency * slope[3 * octave + axis];
+        curvatureSums[axis] += amplitude * (octaveFrequency * octaveFrequency) * curvature[3 * octave + axis];
+      }
+    }
+    amplitude *= (Real) layer.gain;
+  }
+
+  for (int axis = 0; axis < 3; ++axis) {
+    result[axis] += (Real) layer.weight * ((Real) layer.strength[axis] * sums[axis]);
+    if constexpr (kDerivatives) {
+      velocity[axis] += (Real) layer.weight * ((Real) layer.strength[axis] * slopeSums[axis]);
+      acceleration[axis] += (Real) layer.weight * ((Real) layer.strength[axis] * curvatureSums[axis]);
+    }
+  }
+}
+
+template <class Engine, class Real>
+void accumulateShakeArrayLanes(const ShakeLayer &layer, double time, const int *seedOffsets, std::size_t count, double *results) {
+  /* Classic mode evaluation of a layer for many elements that only differ by seed.
+
+  The base and fractal bands of all three axes of kArrayElements elements are packed
+  element major into the lanes, so a block of elements runs through the kernel in a
+  few calls without any per element setup.
+
+  Args:
+    layer (ShakeLayer): Parameters of the layer shared by all elements
+    time (double): Time input
+    seedOffsets (const int*): Seed offset of each element, added to the layer seed
+    count (size_t): Number of elements
+    results (double*): Interleaved X, Y and Z values of the elements the noise is added to
+
+  */
+  constexpr std::size_t kBandLanes = 3 * kArrayElements;
+
+  const double baseFrequency = layer.frequency * 0.078;
+  const double fractalFrequency = 2 * (layer.frequency + 0.067);
+  const Real weight = (Real) layer.weight;
+  const Real fractal = (Real) layer.fractal;
+  const Real fractalScale = (Real) ((layer.rough + 0.084) * 3.3);
+  const Real strength[3] = {(Real) layer.strength[0], (Real) layer.strength[1], (Real) layer.strength[2]};
+
+  // The first kBandLanes lanes hold the base band, the second the fractal band
+  alignas(64) double positions[2 * kBandLanes];
+  alignas(64) std::uint32_t streams[2 * kBandLanes];
+  alignas(64) Real noise[2 * kBandLanes];
+
+  for (std::size_t offset = 0; offset < count; offset += kArrayElements) {
+    std::size_t numElements = minCount(kArrayElements, count - offset);
+    for (std::size_t element = 0; element < kArrayElements; ++element) {
+      // Adding the integers in double is exact, so the positions match accumulateShake
+      double elementSeed = element < numElements ? (double) layer.seed + (double) seedOffsets[offset + element] : 0.0;
+      std::uint32_t elementIntSeed = element < numElements ? (std::uint32_t) layer.seed + (std::uint32_t) seedOffsets[offset + element] : 0;
+      for (int axis = 0; axis < 3; ++axis) {
+        double seed = elementSeed + PerlinNoise::axisSeeds[axis];
+        setLane<Engine>(positions, streams, 3 * element + axis, time, baseFrequency, seed, elementIntSeed, axis);
+        setLane<Engine>(positions, streams, kBandLanes + 3 * element + axis, time, fractalFrequency, seed, elementIntSeed, 3 + axis);
+      }
+    }
+
+    // Without fractal noise the fractal band lanes are left out
+    const std::size_t numLanes = layer.fractal != 0 ? 2 * kBandLanes : kBandLanes;
+    for (std::size_t lane = 0; lane < numLanes; lane += kBatchLanes) {
+      Engine::template noiseLanes<Real, kBatchLanes>(positions + lane, streams + lane, noise + lane);
+    }
+    fillLanes(noise + numLanes, noise + 2 * kBandLanes, Real(0));
+
+    double *elementResults = results + 3 * offset;
+    for (std::size_t lane = 0; lane < 3 * numElements; ++lane) {
+      elementResults[lane] += weight * (strength[lane % 3] * noise[lane] + fractal * (fractalScale * noise[kBandLanes + lane]));
+    }
+  }
+}
+
+template <class Engine, class Real, bool kDerivatives = false>
+void accumulateShakeStackLanes(const ShakeLayerColumns &layers, const double *times, std::size_t count, double *results, double *velocities = nullptr, double *accelerations = nullptr) {
+  /* Shared implementation of the double and single precision stack evaluation.
+
+  Every layer of every sample is an entry, the base and fractal bands of the three
+  axes of up to kStackLayers classic entries are packed sample major into
+  consecutive lanes and only the kernel blocks covering them are evaluated. Entries
+  take six lanes, three without fractal noise and none with a weight of 0, so
+  layers and bands culled by ShakeLayerStack::cull cost nothing. fBm layers are
+  evaluated on their own. Each sample gets the contributions of its layers in layer
+  order, so the result is identical to accumulating the layers one by one.
+
+  Args:
+    layers (ShakeLayerStack): Parameters of the layers
+    times (const double*): Time of each sample
+    count (size_t): Number of samples
+    results (double*): Interleaved X, Y and Z values of the samples the noise is added to
+    velocities (double*): Interleaved first time derivatives are added to it with kDerivatives
+    accelerations (double*): Interleaved second time derivatives are added to it with kDerivatives
+
+  */
+  constexpr std::size_t kMaxLanes = 6 * kStackLayers;
+  static_assert(kMaxLanes % kShakeLanes == 0, "Stack lanes must fill whole kernel blocks");
+
+  // Lanes entryLanes[i] to entryLanes[i] + 2 hold the base band of entry i, the next
+  // three its fractal band if it has one
+  alignas(64) double positions[kMaxLanes];
+  alignas(64) std::uint32_t streams[kMaxLanes] = {};
+  alignas(64) Real noise[kMaxLanes];
+  alignas(64) Real slope[kMaxLanes];
+  alignas(64) Real curvature[kMaxLanes];
+  std::size_t entrySamples[kStackLayers];
+  std::size_t entryLayers[kStackLayers];
+  std::size_t entryLanes[kStackLayers];
+
+  const std::size_t numLayers = layers.size;
+  const std::size_t numEntries = numLayers * count;
+  std::size_t sample = 0;
+  std::size_t layer = 0;
+  for (std::size_t offset = 0; offset < numEntries; offset += kStackLayers) {
+    std::size_t numBlockEntries = minCount(kStackLayers, numEntries - offset);
+    std::size_t numPacked = 0;
+    for (std::size_t i = 0; i < numBlockEntries; ++i) {
+      const bool classic = layers.weight[layer] != 0 && layers.fractalMode[layer] == FractalMode::kClassic;
+      const bool fractalBand = classic && layers.fractal[layer] != 0;
+      const double time = times[sample];
+      const double baseFrequency = layers.frequency[layer] * 0.078;
+      const double fractalFrequency = 2 * (layers.frequency[layer] + 0.067);
+      for (int axis = 0; axis < 3 && classic; ++axis) {
+        double seed = layers.seed[layer] + PerlinNoise::axisSeeds[axis];
+        setLane<Engine>(positions, streams, numPacked + axis, time, baseFrequency, seed, layers.seed[layer], axis);
+        if (fractalBand) {
+          setLane<Engine>(positions, streams, numPacked + 3 + axis, time, fractalFrequency, seed, layers.seed[layer], 3 + axis);
+        }
+      }
+      entrySamples[i] = sample;
+      entryLayers[i] = layer;
+      entryLanes[i] = numPacked;
+      numPacked += fractalBand ? 6 : classic ? 3 : 0;
+      if (++layer == numLayers) {
+        layer = 0;
+        ++sample;
+      }
+    }
+    std::size_t numLanes = (numPacked + kShakeLanes - 1) / kShakeLanes * kShakeLanes;
+    fillLanes(positions + numPacked, positions + numLanes, 0.0);
+
+    for (std::size_t lane = 0; lane < numLanes; lane += kShakeLanes) {
+      Engine::template noiseLanes<Real, kShakeLanes, kDerivatives>(positions + lane, streams + lane, noise + lane, slope + lane, curvature + lane);
+    }
+
+    for (std::size_t i = 0; i < numBlockEntries; ++i) {
+      const std::size_t entryLayer = entryLayers[i];
+      double *result = results + 3 * entrySamples[i];
+      double *velocity = kDerivatives ? velocities + 3 * entrySamples[i] : nullptr;
+      double *acceleration = kDerivatives ? accelerations + 3 * entrySamples[i] : nullptr;
+      if (layers.weight[entryLayer] == 0) {
+        continue;
+      }
+      if (layers.fractalMode[entryLayer] == FractalMode::kFbm) {
+        accumulateFbmLanes<Engine, Real, kDerivatives>(layers.stack->layer(entryLayer), times[entrySamples[i]], result, velocity, acceleration);
+        continue;
+      }
+      const Real weight = (Real) layers.weight[entryLayer];
+      const Real fractal = (Real) layers.fractal[entryLayer];
+      const Real fractalScale = (Real) ((layers.rough[entryLayer] + 0.084) * 3.3);
+      const std::size_t lane = entryLanes[i];
+      const bool fractalBand = layers.fractal[entryLayer] != 0;
+      for (int axis = 0; axis < 3; ++axis) {
+        const Real fractalNoise = fractalBand ? noise[lane + 3 + axis] : Real(0);
+        result[axis] += weight * ((Real) layers.strength[axis][entryLayer] * noise[lane + axis] + fractal * (fractalScale * fractalNoise));
+      }
+      if constexpr (kDerivatives) {
+        // The bands are noise(time * frequency + seed), each time derivative adds a frequency factor
+        const Real baseFrequency = (Real) (layers.frequency[entryLayer] * 0.078);
+        const Real fractalFrequency = (Real) (2 * (layers.frequency[entryLayer] + 0.067));
+        for (int axis = 0; axis < 3; ++axis) {
+          const Real strength = (Real) layers.strength[axis][entryLayer];
+          const Real fractalSlope = fractalBand ? slope[lane + 3 + axis] : Real(0);
+          const Real fractalCurvature = fractalBand ? curvature[lane + 3 + axis] : Real(0);
+          velocity[axis] += weight * (strength * baseFrequency * slope[lane + axis] +
+            fractal * (fractalScale * fractalFrequency * fractalSlope));
+          acceleration[axis] += weight * (strength * (baseFrequency * baseFrequency) * curvature[lane + axis] +
+            fractal * (fractalScale * (fractalFrequency * fractalFrequency) * fractalCurvature));
+        }
+      }
+    }
+  }
+}
+
+
+void calculateNoiseBatch(const NoiseLayer &layer, const double *times, std::size_t count, double *output) {
+  calculateNoiseBatchLanes<double>(layer, times, count, output);
+}
+
+void calculateNoiseBatchSingle(const NoiseLayer &layer, const double *times, std::size_t count, float *output) {
+  calculateNoiseBatchLanes<float>(layer, times, count, output);
+}
+
+void accumulateShake(const ShakeLayer &layer, double time, double result[3], NoisePrecision precision, NoiseEngine engine) {
+  dispatchKernel(engine, precision, [&](auto engineTag, auto realTag) {
+    using Engine = decltype(engineTag);
+    using Real = decltype(realTag);
+    if (layer.fractalMode == FractalMode::kFbm) {
+      accumulateFbmLanes<Engine, Real>(layer, time, result);
+    } else {
+      accumulateShakeLanes<Engine, Real>(layer, time, result);
+    }
+  });
+}
+
+void accumulateShakeArray(const ShakeLayer &layer, double time, const int *seedOffsets, std::size_t count, double *results, NoisePrecision precision, NoiseEngine engine) {
+  if (layer.fractalMode == FractalMode::kFbm) {
+    ShakeLayer elementLayer = layer;
+    for (std::size_t element = 0; element < count; ++element) {
+      elementLayer.seed = layer.seed + seedOffsets[element];
+      accumulateShake(elementLayer, time, results + 3 * element, precision, engine);
+    }
+    return;
+  }
+  dispatchKernel(engine, precision, [&](auto engineTag, auto realTag) {
+    accumulateShakeArrayLanes<decltype(engineTag), decltype(realTag)>(layer, time, seedOffsets, count, results);
+  });
+}
+
+void accumulateShakeStack(const ShakeLayerColumns &layers, double time, double result[3], NoisePrecision precision, NoiseEngine engine) {
+  dispatchKernel(engine, precision, [&](auto engineTag, auto realTag) {
+    accumulateShakeStackLanes<decltype(engineTag), decltype(realTag)>(layers, &time, 1, result);
+  });
+}
+
+void accumulateShakeStackSamples(const ShakeLayerColumns &layers, const double *times, std::size_t count, double *results, NoisePrecision precision, NoiseEngine engine) {
+  dispatchKernel(engine, precision, [&](auto engineTag, auto realTag) {
+    accumulateShakeStackLanes<decltype(engineTag), decltype(realTag)>(layers, times, count, results);
+  });
+}
+
+void accumulateShakeStackDerivatives(const ShakeLayerColumns &layers, double time, double result[3], double velocity[3], double acceleration[3], NoisePrecision precision, NoiseEngine engine) {
+  dispatchKernel(engine, precision, [&](auto engineTag, auto realTag) {
+    accumulateShakeStackLanes<decltype(engineTag), decltype(realTag), true>(layers, &time, 1, result, velocity, acceleration);
+  });
+}
+
+}
+
+
+
+// Entry points of this build of the kernels, named by the build for its instruction set
+const NoiseKernelTable SHAKENODE_KERNEL_TABLE = {
+  calculateNoiseBatch,
+  calculateNoiseBatchSingle,
+  accumulateShake,
+  accumulateShakeArray,
+  accumulateShakeStack,
+  accumulateShakeStackSamples,
+  accumulateShakeStackDerivatives,
+};
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "perlinNoise.h"
+
+// System Includes
+#include <cstddef>
+
+
+
+struct ShakeLayerColumns {
+  /* Raw pointers to the columns of a ShakeLayerStack, filled by the baseline build.
+
+  The kernels read stacks through it, so no member of std::vector is ever
+  instantiated in a build for a newer instruction set.
+
+  */
+  std::size_t size;
+  const double *weight;
+  const int *seed;
+  const double *frequency;
+  const double *strength[3];
+  const double *fractal;
+  const double *rough;
+  const FractalMode *fractalMode;
+  const ShakeLayerStack *stack;  // Only passed back to the out of line ShakeLayerStack::layer
+};
+
+ShakeLayerColumns layerColumns(const ShakeLayerStack &layers);
+
+
+
+struct NoiseKernelTable {
+  /* Entry points of one build of the lane kernels, see perlinNoiseKernels.cpp. */
+  void (*calculateNoiseBatch)(const NoiseLayer &layer, const double *times, std::size_t count, double *output);
+  void (*calculateNoiseBatchSingle)(const NoiseLayer &layer, const double *times, std::size_t count, float *output);
+  void (*accumulateShake)(const ShakeLayer &layer, double time, double result[3], NoisePrecision precision, NoiseEngine engine);
+  void (*accumulateShakeArray)(const ShakeLayer &layer, double time, const int *seedOffsets, std::size_t count, double *results, NoisePrecision precision, NoiseEngine engine);
+  void (*accumulateShakeStack)(const ShakeLayerColumns &layers, double time, double result[3], NoisePrecision precision, NoiseEngine engine);
+  void (*accumulateShakeStackSamples)(const ShakeLayerColumns &layers, const double *times, std::size_t count, double *results, NoisePrecision precision, NoiseEngine engine);
+  void (*accumulateShakeStackDerivatives)(const ShakeLayerColumns &layers, double time, double result[3], double velocity[3], double acceleration[3], NoisePrecision precision, NoiseEngine engine);
+};
+
+// Builds of the kernels for each instruction set, the AVX builds only exist on x86-64
+// with SHAKENODE_KERNEL_DISPATCH
+extern const NoiseKernelTable kBaselineKernels;
+#ifdef SHAKENODE_KERNEL_DISPATCH
+extern const NoiseKernelTable kAvx2Kernels;
+extern const NoiseKernelTable kAvx512Kernels;
+#endif
+
+const NoiseKernelTable &activeKernels();
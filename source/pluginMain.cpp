@@ -1,9 +1,12 @@
 #include "shakeNode.h"
 #include "shakeNodeRot.h"
+#include "shakeArrayNode.h"
+#include "shakeTransformNode.h"
 #include "shakeCommand.h"
 
 // Function Sets
 #include <maya/MFnPlugin.h>
+#include <maya/MProfiler.h>
 
 
 
@@ -11,6 +14,16 @@ MStatus initializePlugin(MObject obj) {
 	MStatus status;
 	MFnPlugin pluginFn(obj, "Lunatics", "1.0.1", "Any");
 
+	ShakeNode::profilerCategory = MProfiler::addCategory("shakeNode", "Computes of the shake nodes");
+
+	// Pick the build of the noise kernels for this CPU before any shake evaluates
+	std::string isaWarning;
+	NoiseIsa isa = PerlinNoise::selectIsa(&isaWarning);
+	if (!isaWarning.empty()) {
+		MGlobal::displayWarning(isaWarning.c_str());
+	}
+	MGlobal::displayInfo(MString("shakeNode noise kernels: ") + PerlinNoise::isaName(isa));
+
 	status = pluginFn.registerNode(
 		ShakeNode::typeName,
 		ShakeNode::typeId,
@@ -29,6 +42,24 @@ MStatus initializePlugin(MObject obj) {
 	);
 	CHECK_MSTATUS_AND_RETURN_IT(status);
 
+	status = pluginFn.registerNode(
+		ShakeArrayNode::typeName,
+		ShakeArrayNode::typeId,
+		ShakeArrayNode::creator,
+		ShakeArrayNode::initialize,
+		MPxNode::kDependNode
+	);
+	CHECK_MSTATUS_AND_RETURN_IT(status);
+
+	status = pluginFn.registerNode(
+		ShakeTransformNode::typeName,
+		ShakeTransformNode::typeId,
+		ShakeTransformNode::creator,
+		ShakeTransformNode::initialize,
+		MPxNode::kDependNode
+	);
+	CHECK_MSTATUS_AND_RETURN_IT(status);
+
 	status = pluginFn.registerCommand(
 		ShakeCommand::commandName,
 		ShakeCommand::creator,
@@ -52,12 +83,20 @@ MStatus uninitializePlugin(MObject obj) {
 	status = pluginFn.deregisterCommand(ShakeCommand::commandName);
 	CHECK_MSTATUS_AND_RETURN_IT(status);
 
+	status = pluginFn.deregisterNode(ShakeTransformNode::typeId);
+	CHECK_MSTATUS_AND_RETURN_IT(status);
+
+	status = pluginFn.deregisterNode(ShakeArrayNode::typeId);
+	CHECK_MSTATUS_AND_RETURN_IT(status);
+
 	status = pluginFn.deregisterNode(ShakeNodeRot::typeId);
 	CHECK_MSTATUS_AND_RETURN_IT(status);
 
 	status = pluginFn.deregisterNode(ShakeNode::typeId);
 	CHECK_MSTATUS_AND_RETURN_IT(status);
 
+	MProfiler::removeCategory("shakeNode");
+
 	if (MGlobal::mayaState() == MGlobal::kInteractive) {
 		MGlobal::executePythonCommandOnIdle("ShakeNodeMainMenu().deleteMenuItems()");
 	}
@@ -0,0 +1,321 @@
+#include "shakeArrayNode.h"
+
+
+
+// Node's attributes
+const MString ShakeArrayNode::typeName("shakeArrayNode");
+const MTypeId ShakeArrayNode::typeId(0x00122712);
+
+// Node's input attributes
+MObject ShakeArrayNode::enableAttr;
+MObject ShakeArrayNode::inTimeAttr;
+MObject ShakeArrayNode::precisionAttr;
+MObject ShakeArrayNode::noiseEngineAttr;
+MObject ShakeArrayNode::weightAttr;
+MObject ShakeArrayNode::seedAttr;
+MObject ShakeArrayNode::frequencyAttr;
+MObject ShakeArrayNode::strengthAttrX;
+MObject ShakeArrayNode::strengthAttrY;
+MObject ShakeArrayNode::strengthAttrZ;
+MObject ShakeArrayNode::strengthAttr;
+MObject ShakeArrayNode::fractalAttr;
+MObject ShakeArrayNode::roughnessAttr;
+MObject ShakeArrayNode::fractalModeAttr;
+MObject ShakeArrayNode::octavesAttr;
+MObject ShakeArrayNode::lacunarityAttr;
+MObject ShakeArrayNode::gainAttr;
+MObject ShakeArrayNode::shakeAttr;
+MObject ShakeArrayNode::seedOffsetAttr;
+MObject ShakeArrayNode::errorBudgetAttr;
+
+// Node's output attributes
+MObject ShakeArrayNode::outputAttrX;
+MObject ShakeArrayNode::outputAttrY;
+MObject ShakeArrayNode::outputAttrZ;
+MObject ShakeArrayNode::outputAttr;
+MObject ShakeArrayNode::outputRotateAttrX;
+MObject ShakeArrayNode::outputRotateAttrY;
+MObject ShakeArrayNode::outputRotateAttrZ;
+MObject ShakeArrayNode::outputRotateAttr;
+MObject ShakeArrayNode::culledLayersAttr;
+MObject ShakeArrayNode::culledBandsAttr;
+
+
+
+ShakeArrayNode::~ShakeArrayNode() {
+	/* ShakeArrayNode Destructor */
+}
+
+MStatus ShakeArrayNode::initialize() {
+	/* Node initializer.
+
+	This method initializes the node, and should be overridden in user-defined
+	nodes.
+
+	Returns:
+		status code (MStatus): kSuccess if the operation was successful,
+			kFailure if an error occured during the operation
+
+	*/
+	MStatus status;
+	MFnNumericAttribute nAttr;
+	MFnEnumAttribute eAttr;
+	MFnUnitAttribute uAttr;
+	MFnCompoundAttribute cAttr;
+
+	enableAttr = nAttr.create("enable", "ena", MFnNumericData::kBoolean, 1);
+	nAttr.setKeyable(true);
+	nAttr.setReadable(false);
+
+	inTimeAttr = uAttr.create("inTime", "itm", MFnUnitAttribute::kTime);
+	uAttr.setKeyable(true);
+	uAttr.setReadable(false);
+
+	precisionAttr = eAttr.create("precision", "prc", static_cast<short>(kDefaultNoisePrecision));
+	eAttr.addField("Double", static_cast<short>(NoisePrecision::kDouble));
+	eAttr.addField("Single", static_cast<short>(NoisePrecision::kSingle));
+	eAttr.setReadable(false);
+
+	noiseEngineAttr = eAttr.create("noiseEngine", "nen", static_cast<short>(NoiseEngine::kPerlin));
+	eAttr.addField("Perlin", static_cast<short>(NoiseEngine::kPerlin));
+	eAttr.addField("Gradient1D", static_cast<short>(NoiseEngine::kGradient1D));
+	eAttr.addField("Hash", static_cast<short>(NoiseEngine::kHash));
+	eAttr.setReadable(false);
+
+	weightAttr = nAttr.create("weight", "wgt", MFnNumericData::kDouble, 1.0);
+	nAttr.setMin(0);
+	nAttr.setMax(1);
+
+	seedAttr = nAttr.create("seed", "sed", MFnNumericData::kInt, 21);
+	nAttr.setMin(0);
+
+	frequencyAttr = nAttr.create("frequency", "frq", MFnNumericData::kDouble, 1.0);
+	nAttr.setMin(0.001);
+	nAttr.setMax(10);
+
+	strengthAttrX = nAttr.create("strengthX", "strX", MFnNumericData::kDouble, 10.0);
+	strengthAttrY = nAttr.create("strengthY", "strY", MFnNumericData::kDouble, 10.0);
+	strengthAttrZ = nAttr.create("strengthZ", "strZ", MFnNumericData::kDouble, 10.0);
+	strengthAttr = nAttr.create("strength", "str", strengthAttrX, strengthAttrY, strengthAttrZ);
+
+	fractalAttr = nAttr.create("fractalNoise", "frn", MFnNumericData::kDouble, 0.0);
+	nAttr.setMin(0);
+	nAttr.setMax(1);
+
+	roughnessAttr = nAttr.create("roughness", "rgh", MFnNumericData::kDouble, 0.0);
+	nAttr.setMin(0);
+	nAttr.setMax(1);
+
+	fractalModeAttr = eAttr.create("fractalMode", "frm", static_cast<short>(FractalMode::kClassic));
+	eAttr.addField("Classic", static_cast<short>(FractalMode::kClassic));
+	eAttr.addField("fBm", static_cast<short>(FractalMode::kFbm));
+
+	octavesAttr = nAttr.create("octaves", "oct", MFnNumericData::kInt, 4);
+	nAttr.setMin(1);
+	nAttr.setMax(PerlinNoise::fbmMaxOctaves);
+
+	lacunarityAttr = nAttr.create("lacunarity", "lac", MFnNumericData::kDouble, 2.0);
+	nAttr.setMin(1);
+	nAttr.setSoftMax(4);
+
+	gainAttr = nAttr.create("gain", "gan", MFnNumericData::kDouble, 0.5);
+	nAttr.setMin(0);
+	nAttr.setMax(1);
+
+	/* shakeAttr:
+	-- shake
+		 | -- weight
+		 | -- seed
+		 | -- frequency
+		 | -- strength X Y Z
+		 | -- fractal
+		 | -- roughness
+		 | -- fractalMode
+		 | -- octaves
+		 | -- lacunarity
+		 | -- gain
+	*/
+	shakeAttr = cAttr.create("shakeLayer", "shk");
+	cAttr.addChild(weightAttr);
+	cAttr.addChild(seedAttr);
+	cAttr.addChild(frequencyAttr);
+	cAttr.addChild(strengthAttr);
+	cAttr.addChild(fractalAttr);
+	cAttr.addChild(roughnessAttr);
+	cAttr.addChild(fractalModeAttr);
+	cAttr.addChild(octavesAttr);
+	cAttr.addChild(lacunarityAttr);
+	cAttr.addChild(gainAttr);
+	cAttr.setArray(true);
+	cAttr.setKeyable(true);
+	cAttr.setReadable(false);
+
+	// One element per shaken object, its value is added to the seed of every layer. Only
+	// distinct modulo 256 with the Perlin and Gradient1D engines
+	seedOffsetAttr = nAttr.create("seedOffset", "sof", MFnNumericData::kInt, 0);
+	nAttr.setArray(true);
+	nAttr.setReadable(false);
+
+	errorBudgetAttr = nAttr.create("errorBudget", "erb", MFnNumericData::kDouble, 0.0);
+	nAttr.setMin(0);
+	nAttr.setSoftMax(1);
+	nAttr.setReadable(false);
+
+	outputAttrX = nAttr.create("outputX", "outX", MFnNumericData::kDouble, 0.0);
+	outputAttrY = nAttr.create("outputY", "outY", MFnNumericData::kDouble, 0.0);
+	outputAttrZ = nAttr.create("outputZ", "outZ", MFnNumericData::kDouble, 0.0);
+	outputAttr = nAttr.create("output", "out", outputAttrX, outputAttrY, outputAttrZ);
+	nAttr.setArray(true);
+	nAttr.setUsesArrayDataBuilder(true);
+	nAttr.setWritable(false);
+	nAttr.setStorable(false);
+
+	outputRotateAttrX = uAttr.create("outputRotateX", "orX", MFnUnitAttribute::kAngle, 0.0);
+	outputRotateAttrY = uAttr.create("outputRotateY", "orY", MFnUnitAttribute::kAngle, 0.0);
+	outputRotateAttrZ = uAttr.create("outputRotateZ", "orZ", MFnUnitAttribute::kAngle, 0.0);
+	outputRotateAttr = nAttr.create("outputRotate", "orot", outputRotateAttrX, outputRotateAttrY, outputRotateAttrZ);
+	nAttr.setArray(true);
+	nAttr.setUsesArrayDataBuilder(true);
+	nAttr.setWritable(false);
+	nAttr.setStorable(false);
+
+	culledLayersAttr = nAttr.create("culledLayers", "cly", MFnNumericData::kInt, 0);
+	nAttr.setWritable(false);
+	nAttr.setStorable(false);
+
+	culledBandsAttr = nAttr.create("culledBands", "cbd", MFnNumericData::kInt, 0);
+	nAttr.setWritable(false);
+	nAttr.setStorable(false);
+
+	addAttribute(enableAttr);
+	addAttribute(inTimeAttr);
+	addAttribute(precisionAttr);
+	addAttribute(noiseEngineAttr);
+	addAttribute(shakeAttr);
+	addAttribute(seedOffsetAttr);
+	addAttribute(errorBudgetAttr);
+	addAttribute(outputAttr);
+	addAttribute(outputRotateAttr);
+	addAttribute(culledLayersAttr);
+	addAttribute(culledBandsAttr);
+
+	for (const MObject *output : {&outputAttr, &outputRotateAttr}) {
+		attributeAffects(enableAttr, *output);
+		attributeAffects(inTimeAttr, *output);
+		attributeAffects(precisionAttr, *output);
+		attributeAffects(noiseEngineAttr, *output);
+		attributeAffects(shakeAttr, *output);
+		attributeAffects(seedOffsetAttr, *output);
+		attributeAffects(errorBudgetAttr, *output);
+	}
+	for (const MObject *output : {&culledLayersAttr, &culledBandsAttr}) {
+		attributeAffects(shakeAttr, *output);
+		attributeAffects(errorBudgetAttr, *output);
+	}
+
+	return MS::kSuccess;
+}
+
+MStatus ShakeArrayNode::compute(const MPlug &plug, MDataBlock &dataBlock) {
+	/* Computes the shake of every element.
+
+	The seed offsets are gathered into a contiguous array and each layer is evaluated
+	for all elements in one vectorized call. Both output arrays are written from the
+	same results, so requesting the other one afterwards costs no extra evaluation.
+
+	Args:
+		plug (MPlug&): Plug representing the attribute that needs to be recomputed
+		dataBlock (MDataBlock&): Data block containing storage for the node's attributes
+
+	Returns:
+		status code (MStatus): kSuccess if the operation was successful,
+			kFailure if an error occured during the operation
+
+	*/
+	MStatus status;
+	thread_local std::vector<unsigned int> indices;
+	thread_local std::vector<int> seedOffsets;
+	thread_local std::vector<double> results;
+
+	if (isCullPlug<ShakeArrayNode>(plug)) {
+		ShakeCullStats cullStats;
+		layerStack<ShakeArrayNode>(dataBlock, &cullStats);
+		return writeCullStats(dataBlock, culledLayersAttr, culledBandsAttr, cullStats);
+	}
+
+	ShakeComputeScope computeScope(*this, typeName.asChar());
+
+	bool enable = dataBlock.inputValue(enableAttr, &status).asBool();
+	if (enable == 0) {
+		dataBlock.setClean(outputAttr);
+		dataBlock.setClean(outputRotateAttr);
+		return MS::kSuccess;
+	}
+
+	double uiTime = dataBlock.inputValue(inTimeAttr, &status).asTime().asUnits(MTime::uiUnit());
+	NoisePrecision precision = static_cast<NoisePrecision>(dataBlock.inputValue(precisionAttr, &status).asShort());
+	NoiseEngine engine = static_cast<NoiseEngine>(dataBlock.inputValue(noiseEngineAttr, &status).asShort());
+
+	MArrayDataHandle seedOffsetsDH = dataBlock.inputArrayValue(seedOffsetAttr, &status);
+	CHECK_MSTATUS_AND_RETURN_IT(status);
+	unsigned int numElements = seedOffsetsDH.elementCount();
+	indices.resize(numElements);
+	seedOffsets.resize(numElements);
+	for (unsigned int i = 0; i < numElements; ++i, seedOffsetsDH.next()) {
+		indices[i] = seedOffsetsDH.elementIndex();
+		seedOffsets[i] = seedOffsetsDH.inputValue().asInt();
+	}
+
+	const ShakeLayerStack &layers = layerStack<ShakeArrayNode>(dataBlock);
+	results.assign(3 * (std::size_t) numElements, 0.0);
+	for (std::size_t i = 0; i < layers.size(); ++i) {
+		if (layers.weight[i] != 0) {
+			PerlinNoise::accumulateShakeArray(layers.layer(i), uiTime, seedOffsets.data(), numElements, results.data(), precision, engine);
+		}
+	}
+	ShakeComputeScope::countLayers(layers, numElements);
+
+	status = writeOutputArray(dataBlock, outputAttr, indices, results, 1.0);
+	CHECK_MSTATUS_AND_RETURN_IT(status);
+	status = writeOutputArray(dataBlock, outputRotateAttr, indices, results, pi / 180);
+	CHECK_MSTATUS_AND_RETURN_IT(status);
+	dataBlock.setClean(plug);
+
+	return MS::kSuccess;
+}
+
+MStatus ShakeArrayNode::setDependentsDirty(const MPlug &plug, MPlugArray &plugArray) {
+	/* Invalidates the copy of the layers when a layer attribute is dirtied.
+
+	Args:
+		plug (MPlug&): Plug being dirtied
+		plugArray (MPlugArray&): Extra plugs to mark dirty, left untouched
+
+	Returns:
+		status code (MStatus): kSuccess if the operation was successful,
+			kFailure if an error occured during the operation
+
+	*/
+	invalidateOnDirty<ShakeArrayNode>(plug);
+
+	return MPxNode::setDependentsDirty(plug, plugArray);
+}
+
+MStatus ShakeArrayNode::preEvaluation(const MDGContext &context, const MEvaluationNode &evaluationNode) {
+	/* Invalidates the copy of the layers before an Evaluation Manager evaluation.
+
+	Args:
+		context (MDGContext&): Context of the evaluation
+		evaluationNode (MEvaluationNode&): Evaluation node holding the dirty plugs
+
+	Returns:
+		status code (MStatus): kSuccess if the operation was successful,
+			kFailure if an error occured during the operation
+
+	*/
+	if (context.isNormal()) {
+		invalidateOnDirty<ShakeArrayNode>(evaluationNode);
+	}
+
+	return MS::kSuccess;
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include "shakeNode.h"
+
+// System Includes
+#include <string>
+#include <vector>
+
+// Maya Api Includes
+#include <maya/MPxNode.h>
+#include <maya/MGlobal.h>
+#include <maya/MArrayDataHandle.h>
+#include <maya/MArrayDataBuilder.h>
+#include <maya/MDataHandle.h>
+
+// Function Sets
+#include <maya/MFnNumericAttribute.h>
+#include <maya/MFnEnumAttribute.h>
+#include <maya/MFnUnitAttribute.h>
+#include <maya/MFnCompoundAttribute.h>
+
+
+
+class ShakeArrayNode: public ShakeNode {
+	/* Shakes many elements with a single shared layer stack.
+
+	Every element of the seedOffset array gets its own shake, the layer seeds are
+	offset by the element's value. The elements are written to the output and
+	outputRotate arrays at the same logical indices, so one node can drive a whole
+	crowd of objects instead of one shake node per object.
+
+	With the Perlin and Gradient1D engines seeds 256 apart give the same shake, so
+	offsets only give distinct shakes modulo 256. The Hash engine, which shake
+	-array selects, has full 32 bit seeds and no such limit.
+
+	*/
+
+public:
+	// Constructors
+	ShakeArrayNode(): ShakeNode() {};
+
+	// Destructor
+	virtual ~ShakeArrayNode() override;
+
+	// Public Methods
+	static void *creator() {return new ShakeArrayNode();}
+	static MStatus initialize();
+	virtual MStatus compute(const MPlug &plug, MDataBlock &dataBlock) override;
+	virtual MStatus setDependentsDirty(const MPlug &plug, MPlugArray &plugArray) override;
+	virtual MStatus preEvaluation(const MDGContext &context, const MEvaluationNode &evaluationNode) override;
+
+	// Node's attributes
+	static const MString typeName;
+	static const MTypeId typeId;
+
+	// Node's input attributes
+	static MObject enableAttr;
+	static MObject inTimeAttr;
+	static MObject precisionAttr;
+	static MObject noiseEngineAttr;
+	static MObject weightAttr;
+	static MObject seedAttr;
+	static MObject frequencyAttr;
+	static MObject strengthAttrX;
+	static MObject strengthAttrY;
+	static MObject strengthAttrZ;
+	static MObject strengthAttr;
+	static MObject fractalAttr;
+	static MObject roughnessAttr;
+	static MObject fractalModeAttr;
+	static MObject octavesAttr;
+	static MObject lacunarityAttr;
+	static MObject gainAttr;
+	static MObject shakeAttr;
+	static MObject seedOffsetAttr;
+	static MObject errorBudgetAttr;
+
+	// Node's output attributes
+	static MObject outputAttrX;
+	static MObject outputAttrY;
+	static MObject outputAttrZ;
+	static MObject outputAttr;
+	static MObject outputRotateAttrX;
+	static MObject outputRotateAttrY;
+	static MObject outputRotateAttrZ;
+	static MObject outputRotateAttr;
+	static MObject culledLayersAttr;
+	static MObject culledBandsAttr;
+
+private:
+	// Private Data
+	const double pi = 3.14159265358979323846;
+};
@@ -0,0 +1,79 @@
+#include "shakeBake.h"
+
+// System Includes
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+
+
+void bakeShakes(std::vector<ShakeBakeTarget> &targets, const std::vector<double> &times, unsigned int numThreads) {
+  /* Bakes the channels of every target for the given times.
+
+  The work is split into tasks of one target and kBakeChunkFrames frames, which the
+  worker threads pull from a shared counter until all are done. Every task writes a
+  disjoint range of the channels, so no locking is needed. All frames of a task go
+  through the batched stack kernel at once, which gives the same values as
+  accumulateShakeStack frame by frame. The result does not depend on the number of
+  threads.
+
+  Args:
+    targets (vector<ShakeBakeTarget>&): Shakes to bake, their channels are resized
+      to the number of times and filled
+    times (vector<double>&): Times to evaluate
+    numThreads (unsigned int): Number of worker threads, 0 uses all hardware threads
+
+  */
+  const std::size_t numFrames = times.size();
+  const std::size_t chunksPerTarget = (numFrames + kBakeChunkFrames - 1) / kBakeChunkFrames;
+  const std::size_t numTasks = chunksPerTarget * targets.size();
+
+  for (ShakeBakeTarget &target : targets) {
+    for (std::vector<double> &channel : target.channels) {
+      channel.assign(numFrames, 0.0);
+    }
+  }
+  if (numTasks == 0) {
+    return;
+  }
+
+  // Structure of arrays copies of the layers for the stacked kernel, culled like the nodes cull them
+  std::vector<ShakeLayerStack> stacks(targets.size());
+  for (std::size_t i = 0; i < targets.size(); ++i) {
+    stacks[i].assign(targets[i].layers.data(), targets[i].layers.size());
+    stacks[i].cull(targets[i].errorBudget);
+  }
+
+  std::atomic<std::size_t> nextTask(0);
+  auto worker = [&]() {
+    std::vector<double> results;
+    for (std::size_t task = nextTask++; task < numTasks; task = nextTask++) {
+      ShakeBakeTarget &target = targets[task / chunksPerTarget];
+      const ShakeLayerStack &stack = stacks[task / chunksPerTarget];
+      std::size_t first = (task % chunksPerTarget) * kBakeChunkFrames;
+      std::size_t last = std::min(first + kBakeChunkFrames, numFrames);
+      results.assign(3 * (last - first), 0.0);
+      PerlinNoise::accumulateShakeStackSamples(stack, times.data() + first, last - first, results.data(), target.precision, target.engine);
+      for (std::size_t frame = first; frame < last; ++frame) {
+        target.channels[0][frame] = results[3 * (frame - first)];
+        target.channels[1][frame] = results[3 * (frame - first) + 1];
+        target.channels[2][frame] = results[3 * (frame - first) + 2];
+      }
+    }
+  };
+
+  if (numThreads == 0) {
+    numThreads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  numThreads = (unsigned int) std::min<std::size_t>(numThreads, numTasks);
+
+  // The calling thread works as well
+  std::vector<std::thread> threads;
+  for (unsigned int i = 1; i < numThreads; ++i) {
+    threads.emplace_back(worker);
+  }
+  worker();
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include "perlinNoise.h"
+
+// System Includes
+#include <cstddef>
+#include <vector>
+
+
+
+struct ShakeBakeTarget {
+  /* Layer stack of one shake and the X, Y and Z channels baked from it. */
+  std::vector<ShakeLayer> layers;
+  NoisePrecision precision = NoisePrecision::kDouble;
+  NoiseEngine engine = NoiseEngine::kPerlin;
+  double errorBudget = 0.0;
+  std::vector<double> channels[3];
+};
+
+
+
+// Number of consecutive frames evaluated by one task of the thread pool
+constexpr std::size_t kBakeChunkFrames = 512;
+
+void bakeShakes(std::vector<ShakeBakeTarget> &targets, const std::vector<double> &times, unsigned int numThreads=0);
@@ -0,0 +1,405 @@
+/* Headless shake baker, bakes shake curves without starting Maya.
+
+Reads a text description of one or more shakes with the same fields as the
+shakeLayer compound of the nodes and streams the baked X, Y and Z channels of a
+frame range to a CSV file or a shake cache file (see shakeCacheFile.h), which the
+nodes can play back through their cacheFile attribute. The frames are baked by
+bakeShakes, in parallel across shakes and frame chunks. CSV output is baked and
+written one block of frames at a time so long ranges never have to be held in
+memory.
+
+The values come out of the same stacked kernel the nodes evaluate with, so they are
+identical to the output of a live node with the same layers, precision and noise
+engine at the same inTime (in frames). CSV values are written with 17 significant
+digits and read back to the exact doubles, so do float64 cache files. A node serving from its curve cache
+(cacheEnable) interpolates between cached samples and differs by that interpolation
+error only. Builds for another compiler or instruction set may round the last few
+bits differently.
+
+Rotation shakes are written in degrees, as shown in the channel box.
+
+Usage:
+	shakeBaker description.txt [--start 1] [--end 120] [--step 1]
+		[--format csv|cache] [--encoding float64] [--output file] [--threads 0]
+
+Description format, one key and its values per line, # starts a comment:
+	shake camera           Starts a new shake, optional for a single shake
+	precision double       double or single
+	noiseEngine perlin     perlin, gradient1D or hash
+	errorBudget 0.0        Maximum deviation culled layers and bands may add
+	enable 1               0 bakes zeros, like a disabled node
+	layer                  Starts a new layer of the current shake
+	weight 1.0
+	seed 21
+	frequency 1.0
+	strength 10 10 10      Or strengthX, strengthY and strengthZ
+	fractalNoise 0.0
+	roughness 0.0
+	fractalMode classic    classic or fbm
+	octaves 4
+	lacunarity 2.0
+	gain 0.5
+
+Cache files need a step of 1 / n frames and an --output file. The encoding is
+float64, float32, quantized16 or delta8, from exact to about a byte per sample.
+
+*/
+#include "perlinNoise.h"
+#include "shakeBake.h"
+#include "shakeCacheFile.h"
+
+// System Includes
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+
+
+namespace {
+
+// Number of frames baked and written at once
+constexpr std::size_t kStreamBlockFrames = 64 * kBakeChunkFrames;
+
+struct BakeOptions {
+	/* Command line options of the baker. */
+	std::string description;
+	std::string output;
+	bool cache = false;
+	ShakeCacheEncoding encoding = ShakeCacheEncoding::kFloat64;
+	double start = 1.0;
+	double end = 120.0;
+	double step = 1.0;
+	unsigned int numThreads = 0;
+};
+
+const char *usage =
+	"usage: shakeBaker description.txt [--start 1] [--end 120] [--step 1]\n"
+	"                  [--format csv|cache] [--encoding float64|float32|quantized16|delta8]\n"
+	"                  [--output file] [--threads 0]\n";
+
+bool parseDouble(const std::string &text, double &value) {
+	/* Parses a whole string as a double.
+
+	Args:
+		text (string): Text to parse
+		value (double&): Parsed value
+
+	Returns:
+		bool: True if the whole text was a number
+
+	*/
+	char *end = nullptr;
+	value = std::strtod(text.c_str(), &end);
+	return !text.empty() && *end == '\0';
+}
+
+bool parseInt(const std::string &text, int &value) {
+	/* Parses a whole string as an int.
+
+	Args:
+		text (string): Text to parse
+		value (int&): Parsed value
+
+	Returns:
+		bool: True if the whole text was an integer
+
+	*/
+	char *end = nullptr;
+	long parsed = std::strtol(text.c_str(), &end, 10);
+	value = (int) parsed;
+	return !text.empty() && *end == '\0' && parsed == value;
+}
+
+bool parseEnum(const std::string &text, const std::vector<std::string> &names, int &value) {
+	/* Parses an enum field by name, ignoring case, or by index like a Maya enum.
+
+	Args:
+		text (string): Text to parse
+		names (vector<string>): Field names in index order
+		value (int&): Index of the field
+
+	Returns:
+		bool: True if the text named one of the fields
+
+	*/
+	for (std::size_t i = 0; i < names.size(); ++i) {
+		if (text.size() == names[i].size() && std::equal(text.begin(), text.end(), names[i].begin(),
+				[](char a, char b) {return std::tolower((unsigned char) a) == std::tolower((unsigned char) b);})) {
+			value = (int) i;
+			return true;
+		}
+	}
+	return parseInt(text, value) && value >= 0 && value < (int) names.size();
+}
+
+bool parseLayerKey(const std::string &key, const std::vector<std::string> &values, ShakeLayer &layer) {
+	/* Sets a field of a layer from a line of the description.
+
+	Args:
+		key (string): Long name of the shakeLayer child attribute
+		values (vector<string>): Values following the key
+		layer (ShakeLayer&): Layer to set
+
+	Returns:
+		bool: True if the key and its values were valid
+
+	*/
+	int index = 0;
+	if (key == "strength") {
+		return values.size() == 3 && parseDouble(values[0], layer.strength[0]) &&
+			parseDouble(values[1], layer.strength[1]) && parseDouble(values[2], layer.strength[2]);
+	}
+	if (values.size() != 1) {
+		return false;
+	}
+	const std::string &value = values[0];
+	if (key == "weight") {return parseDouble(value, layer.weight);}
+	if (key == "seed") {return parseInt(value, layer.seed);}
+	if (key == "frequency") {return parseDouble(value, layer.frequency);}
+	if (key == "strengthX") {return parseDouble(value, layer.strength[0]);}
+	if (key == "strengthY") {return parseDouble(value, layer.strength[1]);}
+	if (key == "strengthZ") {return parseDouble(value, layer.strength[2]);}
+	if (key == "fractalNoise") {return parseDouble(value, layer.fractal);}
+	if (key == "roughness") {return parseDouble(value, layer.rough);}
+	if (key == "octaves") {return parseInt(value, layer.octaves);}
+	if (key == "lacunarity") {return parseDouble(value, layer.lacunarity);}
+	if (key == "gain") {return parseDouble(value, layer.gain);}
+	if (key == "fractalMode") {
+		if (!parseEnum(value, {"classic", "fbm"}, index)) {
+			return false;
+		}
+		layer.fractalMode = static_cast<FractalMode>(index);
+		return true;
+	}
+	return false;
+}
+
+bool readDescription(const std::string &path, std::vector<ShakeBakeTarget> &targets, std::vector<std::string> &names) {
+	/* Reads the shakes of a description file.
+
+	Args:
+		path (string): Path of the description file
+		targets (vector<ShakeBakeTarget>&): One target per shake with its layers,
+			precision, noise engine and error budget
+		names (vector<string>&): Name of each shake
+
+	Returns:
+		bool: True if the file was read, errors are printed to stderr
+
+	*/
+	std::ifstream file(path);
+	if (!file) {
+		std::fprintf(stderr, "Could not open %s\n", path.c_str());
+		return false;
+	}
+
+	std::vector<bool> enabled;
+	bool inLayer = false;
+	std::string line;
+	for (int lineNumber = 1; std::getline(file, line); ++lineNumber) {
+		line = line.substr(0, line.find('#'));
+		std::istringstream tokens(line);
+		std::string key;
+		if (!(tokens >> key)) {
+			continue;
+		}
+		std::vector<std::string> values;
+		for (std::string value; tokens >> value;) {
+			values.push_back(value);
+		}
+
+		bool valid = true;
+		int index = 0;
+		if (key == "shake") {
+			valid = values.size() <= 1;
+			targets.emplace_back();
+			names.push_back(values.empty() ? "shake" + std::to_string(targets.size()) : values[0]);
+			enabled.push_back(true);
+			inLayer = false;
+		} else {
+			// Keys before the first shake line belong to an unnamed single shake
+			if (targets.empty()) {
+				targets.emplace_back();
+				names.push_back("shake");
+				enabled.push_back(true);
+			}
+			ShakeBakeTarget &target = targets.back();
+			if (key == "layer") {
+				valid = values.empty();
+				target.layers.emplace_back();
+				inLayer = true;
+			} else if (key == "precision") {
+				valid = values.size() == 1 && parseEnum(values[0], {"double", "single"}, index);
+				target.precision = static_cast<NoisePrecision>(index);
+			} else if (key == "noiseEngine") {
+				valid = values.size() == 1 && parseEnum(values[0], {"perlin", "gradient1D", "hash"}, index);
+				target.engine = static_cast<NoiseEngine>(index);
+			} else if (key == "errorBudget") {
+				valid = values.size() == 1 && parseDouble(values[0], target.errorBudget) && target.errorBudget >= 0;
+			} else if (key == "enable") {
+				valid = values.size() == 1 && parseInt(values[0], index);
+				enabled.back() = index != 0;
+			} else {
+				valid = inLayer && parseLayerKey(key, values, target.layers.back());
+			}
+		}
+		if (!valid) {
+			std::fprintf(stderr, "%s:%d: invalid line \"%s\"\n", path.c_str(), lineNumber, line.c_str());
+			return false;
+		}
+	}
+
+	if (targets.empty()) {
+		std::fprintf(stderr, "%s: no shakes found\n", path.c_str());
+		return false;
+	}
+	for (std::size_t i = 0; i < targets.size(); ++i) {
+		if (targets[i].layers.empty()) {
+			std::fprintf(stderr, "%s: shake %s has no layers\n", path.c_str(), names[i].c_str());
+			return false;
+		}
+		if (!enabled[i]) {
+			targets[i].layers.clear();
+		}
+	}
+	return true;
+}
+
+bool parseOptions(int argc, char **argv, BakeOptions &options) {
+	/* Parses the command line.
+
+	Args:
+		argc (int): Number of arguments
+		argv (char**): Arguments
+		options (BakeOptions&): Parsed options
+
+	Returns:
+		bool: True if the command line was valid
+
+	*/
+	for (int i = 1; i < argc; ++i) {
+		std::string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+		std::string value = hasValue ? argv[i + 1] : "";
+		int numThreads = 0;
+		int index = 0;
+		if (arg == "--start" && hasValue && parseDouble(value, options.start)) {
+			++i;
+		} else if (arg == "--end" && hasValue && parseDouble(value, options.end)) {
+			++i;
+		} else if (arg == "--step" && hasValue && parseDouble(value, options.step) && options.step > 0.0) {
+			++i;
+		} else if (arg == "--format" && hasValue && (value == "csv" || value == "cache")) {
+			options.cache = value == "cache";
+			++i;
+		} else if (arg == "--encoding" && hasValue && parseEnum(value, {"float64", "float32", "quantized16", "delta8"}, index)) {
+			options.encoding = static_cast<ShakeCacheEncoding>(index);
+			++i;
+		} else if (arg == "--output" && hasValue) {
+			options.output = value;
+			++i;
+		} else if (arg == "--threads" && hasValue && parseInt(value, numThreads) && numThreads >= 0) {
+			options.numThreads = (unsigned int) numThreads;
+			++i;
+		} else if (arg.compare(0, 2, "--") != 0 && options.description.empty()) {
+			options.description = arg;
+		} else {
+			std::fprintf(stderr, "Invalid argument %s\n", arg.c_str());
+			return false;
+		}
+	}
+	if (options.description.empty()) {
+		return false;
+	}
+	if (options.cache && options.output.empty()) {
+		std::fprintf(stderr, "The cache format needs an --output file\n");
+		return false;
+	}
+	return true;
+}
+
+}
+
+
+
+int main(int argc, char **argv) {
+	BakeOptions options;
+	if (!parseOptions(argc, argv, options)) {
+		std::fputs(usage, stderr);
+		return 2;
+	}
+
+	std::vector<ShakeBakeTarget> targets;
+	std::vector<std::string> names;
+	if (!readDescription(options.description, targets, names)) {
+		return 1;
+	}
+
+	// Frames to bake, built from an index like shake -bake so the step does not accumulate errors
+	std::size_t numFrames = options.end >= options.start ? (std::size_t) ((options.end - options.start) / options.step + 1e-6) + 1 : 0;
+
+	if (options.cache) {
+		int samplesPerFrame = (int) std::lround(1.0 / options.step);
+		if (samplesPerFrame < 1 || std::abs(samplesPerFrame * options.step - 1.0) > 1e-9) {
+			std::fprintf(stderr, "The cache format needs a step of 1 / n frames\n");
+			return 2;
+		}
+		std::vector<double> times(numFrames);
+		for (std::size_t i = 0; i < numFrames; ++i) {
+			times[i] = options.start + (double) i / samplesPerFrame;
+		}
+		bakeShakes(targets, times, options.numThreads);
+		std::string error;
+		if (!writeShakeCache(options.output, targets, options.start, samplesPerFrame, options.encoding, &error)) {
+			std::fprintf(stderr, "%s\n", error.c_str());
+			return 1;
+		}
+		return 0;
+	}
+
+	FILE *output = options.output.empty() ? stdout : std::fopen(options.output.c_str(), "w");
+	if (output == nullptr) {
+		std::fprintf(stderr, "Could not open %s for writing\n", options.output.c_str());
+		return 1;
+	}
+
+	std::fputs("frame", output);
+	for (const std::string &name : names) {
+		std::fprintf(output, ",%s.x,%s.y,%s.z", name.c_str(), name.c_str(), name.c_str());
+	}
+	std::fputc('\n', output);
+
+	std::vector<double> times;
+	for (std::size_t first = 0; first < numFrames; first += kStreamBlockFrames) {
+		std::size_t count = std::min(kStreamBlockFrames, numFrames - first);
+		times.resize(count);
+		for (std::size_t i = 0; i < count; ++i) {
+			times[i] = options.start + (first + i) * options.step;
+		}
+		bakeShakes(targets, times, options.numThreads);
+
+		for (std::size_t i = 0; i < count; ++i) {
+			std::fprintf(output, "%.17g", times[i]);
+			for (const ShakeBakeTarget &target : targets) {
+				std::fprintf(output, ",%.17g,%.17g,%.17g", target.channels[0][i], target.channels[1][i], target.channels[2][i]);
+			}
+			std::fputc('\n', output);
+		}
+	}
+
+	bool failed = std::ferror(output) != 0;
+	if (output != stdout) {
+		failed = std::fclose(output) != 0 || failed;
+	}
+	if (failed) {
+		std::fprintf(stderr, "Could not write %s\n", options.output.empty() ? "the output" : options.output.c_str());
+		return 1;
+	}
+	return 0;
+}
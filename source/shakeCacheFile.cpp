@@ -0,0 +1,448 @@
+#include "shakeCacheFile.h"
+
+// System Includes
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+
+
+namespace {
+
+struct CacheFileState {
+  /* Identity and version of a file on disk.
+
+  The device and inode tell a file written next to the old one and renamed over
+  it apart from the old one, the nanosecond modification time a file rewritten
+  in place within the same second.
+
+  */
+  std::uint64_t device = 0;
+  std::uint64_t inode = 0;
+  std::int64_t modified = 0;
+  std::int64_t size = 0;
+
+  bool operator==(const CacheFileState &other) const {
+    return device == other.device && inode == other.inode && modified == other.modified && size == other.size;
+  }
+};
+
+struct OpenCacheFile {
+  /* Mapping handed out by ShakeCacheFile::open and the file state it was mapped from. */
+  std::weak_ptr<const ShakeCacheFile> file;
+  CacheFileState state;
+};
+
+CacheFileState cacheFileState(const struct stat &fileStat) {
+  /* State of a file from its stat, modification time in nanoseconds where the platform has it. */
+  CacheFileState state;
+  state.device = (std::uint64_t) fileStat.st_dev;
+  state.inode = (std::uint64_t) fileStat.st_ino;
+#if defined(__APPLE__)
+  state.modified = (std::int64_t) fileStat.st_mtimespec.tv_sec * 1000000000 + fileStat.st_mtimespec.tv_nsec;
+#elif defined(_WIN32)
+  state.modified = (std::int64_t) fileStat.st_mtime * 1000000000;
+#else
+  state.modified = (std::int64_t) fileStat.st_mtim.tv_sec * 1000000000 + fileStat.st_mtim.tv_nsec;
+#endif
+  state.size = (std::int64_t) fileStat.st_size;
+  return state;
+}
+
+std::mutex openFilesMutex;
+std::map<std::string, OpenCacheFile> openFiles;
+
+}
+
+
+
+ShakeCacheFile::~ShakeCacheFile() {
+  if (_data == nullptr) {
+    return;
+  }
+#ifdef _WIN32
+  UnmapViewOfFile(_data);
+  CloseHandle(_mapping);
+#else
+  munmap(const_cast<unsigned char *>(_data), _size);
+#endif
+}
+
+std::shared_ptr<const ShakeCacheFile> ShakeCacheFile::open(const std::string &path, std::string *error) {
+  /* Maps a shake cache file, or returns the mapping of it that is already open.
+
+  A mapping is reused while the file keeps its device, inode, size and
+  modification time, so rebaking a cache picks up the new file on the next open.
+
+  Args:
+    path (string): Path of the cache file
+    error (string*): Receives the reason the file could not be opened, or nullptr
+
+  Returns:
+    shared_ptr<const ShakeCacheFile>: The mapped file, nullptr if it is missing or invalid
+
+  */
+  struct stat fileStat;
+  if (stat(path.c_str(), &fileStat) != 0) {
+    if (error != nullptr) {
+      *error = "Could not find " + path;
+    }
+    return nullptr;
+  }
+
+  std::lock_guard<std::mutex> lock(openFilesMutex);
+  OpenCacheFile &openFile = openFiles[path];
+  const CacheFileState state = cacheFileState(fileStat);
+  std::shared_ptr<const ShakeCacheFile> file = openFile.file.lock();
+  if (file != nullptr && openFile.state == state) {
+    return file;
+  }
+
+  std::shared_ptr<ShakeCacheFile> newFile(new ShakeCacheFile());
+  std::string mapError;
+  if (!newFile->map(path, mapError)) {
+    openFiles.erase(path);
+    if (error != nullptr) {
+      *error = path + ": " + mapError;
+    }
+    return nullptr;
+  }
+  openFile.file = newFile;
+  openFile.state = state;
+  return newFile;
+}
+
+bool ShakeCacheFile::map(const std::string &path, std::string &error) {
+  /* Maps the file read only and validates its header and channel table.
+
+  Args:
+    path (string): Path of the cache file
+    error (string&): Receives the reason the file is invalid
+
+  Returns:
+    bool: True if the file was mapped and is a valid cache
+
+  */
+#ifdef _WIN32
+  HANDLE fileHandle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (fileHandle == INVALID_HANDLE_VALUE) {
+    error = "could not open the file";
+    return false;
+  }
+  LARGE_INTEGER fileSize;
+  GetFileSizeEx(fileHandle, &fileSize);
+  _size = (std::size_t) fileSize.QuadPart;
+  if (_size >= sizeof(ShakeCacheHeader)) {
+    _mapping = CreateFileMappingA(fileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (_mapping != nullptr) {
+      _data = static_cast<const unsigned char *>(MapViewOfFile(_mapping, FILE_MAP_READ, 0, 0, 0));
+      if (_data == nullptr) {
+        CloseHandle(_mapping);
+      }
+    }
+  }
+  CloseHandle(fileHandle);
+#else
+  int fileDescriptor = ::open(path.c_str(), O_RDONLY);
+  if (fileDescriptor < 0) {
+    error = "could not open the file";
+    return false;
+  }
+  struct stat fileStat;
+  _size = fstat(fileDescriptor, &fileStat) == 0 ? (std::size_t) fileStat.st_size : 0;
+  if (_size >= sizeof(ShakeCacheHeader)) {
+    void *data = mmap(nullptr, _size, PROT_READ, MAP_SHARED, fileDescriptor, 0);
+    _data = data != MAP_FAILED ? static_cast<const unsigned char *>(data) : nullptr;
+  }
+  ::close(fileDescriptor);
+#endif
+  if (_data == nullptr) {
+    error = _size < sizeof(ShakeCacheHeader) ? "file is too small for a shake cache" : "could not map the file";
+    return false;
+  }
+
+  std::memcpy(&_header, _data, sizeof(ShakeCacheHeader));
+  if (std::memcmp(_header.magic, "SHKC", 4) != 0) {
+    error = "not a shake cache file";
+    return false;
+  }
+  if (_header.version != 1) {
+    error = "unsupported shake cache version " + std::to_string(_header.version);
+    return false;
+  }
+  // Every encoding takes at least a byte per sample, bounding numSamples by the file
+  // size also keeps shakeCacheChannelSize from overflowing on a corrupt header
+  if (_header.encoding > static_cast<std::uint32_t>(ShakeCacheEncoding::kDelta8) || _header.samplesPerFrame == 0 ||
+      _header.numSamples == 0 || _header.numSamples > _size || _header.numShakes == 0 ||
+      _header.numShakes > (_size - sizeof(ShakeCacheHeader)) / (3 * sizeof(ShakeCacheChannel))) {
+    error = "invalid shake cache header";
+    return false;
+  }
+
+  // The channel table follows the 64 byte header, so it is aligned for direct access
+  _channels = reinterpret_cast<const ShakeCacheChannel *>(_data + sizeof(ShakeCacheHeader));
+  std::size_t channelSize = shakeCacheChannelSize(encoding(), numSamples());
+  for (std::size_t i = 0; i < 3 * numShakes(); ++i) {
+    const ShakeCacheChannel &channel = _channels[i];
+    if (channel.size != channelSize || channel.offset % 8 != 0 || channel.offset > _size || channel.size > _size - channel.offset) {
+      error = "channel " + std::to_string(i) + " does not fit the file";
+      return false;
+    }
+  }
+  return true;
+}
+
+double ShakeCacheFile::sample(std::size_t channel, std::size_t index) const {
+  /* Decodes one sample of a channel.
+
+  Args:
+    channel (size_t): Channel, 3 * shake + axis
+    index (size_t): Sample, at frame start + index / samplesPerFrame
+
+  Returns:
+    double: Value of the sample
+
+  */
+  const ShakeCacheChannel &info = _channels[channel];
+  const unsigned char *samples = _data + info.offset;
+
+  switch (encoding()) {
+    case ShakeCacheEncoding::kFloat64:
+      return reinterpret_cast<const double *>(samples)[index];
+    case ShakeCacheEncoding::kFloat32:
+      return reinterpret_cast<const float *>(samples)[index];
+    case ShakeCacheEncoding::kQuantized16:
+      return info.bias + info.scale * reinterpret_cast<const std::int16_t *>(samples)[index];
+    case ShakeCacheEncoding::kDelta8: {
+      // Each block is a 16 bit key followed by the 8 bit steps to the next samples
+      const unsigned char *block = samples + (index / kDeltaBlockSamples) * (kDeltaBlockSamples + 1);
+      std::int16_t key;
+      std::memcpy(&key, block, sizeof(key));
+      int value = key;
+      const std::int8_t *deltas = reinterpret_cast<const std::int8_t *>(block + 2);
+      for (std::size_t i = 0; i < index % kDeltaBlockSamples; ++i) {
+        value += deltas[i];
+      }
+      return info.bias + info.scale * value;
+    }
+  }
+  return 0.0;
+}
+
+bool ShakeCacheFile::lookup(std::size_t shake, double time, double result[3], double velocity[3], double acceleration[3]) const {
+  /* Interpolates the cached shake at the given time.
+
+  Uses the same Catmull-Rom spline as ShakeCurveCache, through the four surrounding
+  samples, so times that fall on a sample return it exactly. The neighbours of the
+  first and last interval are clamped to the ends, times outside of the cached range
+  hold the first or last sample.
+
+  Args:
+    shake (size_t): Index of the shake in the file
+    time (double): Time to evaluate, in frames
+    result (double[3]): Receives the X, Y and Z values
+    velocity (double[3]): Receives the first time derivative of the spline, or nullptr
+    acceleration (double[3]): Receives the second time derivative of the spline, or nullptr
+
+  Returns:
+    bool: False if the file holds no shake with this index
+
+  */
+  if (shake >= numShakes()) {
+    return false;
+  }
+
+  std::size_t lastIndex = numSamples() - 1;
+  double rate = _header.samplesPerFrame;
+  double position = std::min(std::max((time - start()) * rate, 0.0), (double) lastIndex);
+  std::size_t index = std::min((std::size_t) position, lastIndex > 0 ? lastIndex - 1 : 0);
+  double valT = position - (double) index;
+  double valT2 = valT * valT;
+  double valT3 = valT2 * valT;
+  bool inside = time > start() && time < end();
+
+  std::size_t indices[4] = {
+    index > 0 ? index - 1 : 0,
+    index,
+    std::min(index + 1, lastIndex),
+    std::min(index + 2, lastIndex),
+  };
+  for (int axis = 0; axis < 3; ++axis) {
+    std::size_t channel = 3 * shake + axis;
+    double p0 = sample(channel, indices[0]);
+    double p1 = sample(channel, indices[1]);
+    double p2 = sample(channel, indices[2]);
+    double p3 = sample(channel, indices[3]);
+    double c1 = p2 - p0;
+    double c2 = 2.0 * p0 - 5.0 * p1 + 4.0 * p2 - p3;
+    double c3 = 3.0 * (p1 - p2) + p3 - p0;
+    // The last sample is returned exactly like every other sample
+    result[axis] = valT == 1.0 ? p2 : 0.5 * (2.0 * p1 + c1 * valT + c2 * valT2 + c3 * valT3);
+    if (velocity != nullptr) {
+      velocity[axis] = inside ? 0.5 * (c1 + 2.0 * c2 * valT + 3.0 * c3 * valT2) * rate : 0.0;
+    }
+    if (acceleration != nullptr) {
+      acceleration[axis] = inside ? (c2 + 3.0 * c3 * valT) * rate * rate : 0.0;
+    }
+  }
+
+  return true;
+}
+
+std::size_t shakeCacheChannelSize(ShakeCacheEncoding encoding, std::size_t numSamples) {
+  /* Size of the samples of one channel in bytes.
+
+  Args:
+    encoding (ShakeCacheEncoding): Storage of the samples
+    numSamples (size_t): Number of samples of the channel
+
+  Returns:
+    size_t: Size of the channel, without the padding to the next 8 byte boundary
+
+  */
+  switch (encoding) {
+    case ShakeCacheEncoding::kFloat64:
+      return numSamples * sizeof(double);
+    case ShakeCacheEncoding::kFloat32:
+      return numSamples * sizeof(float);
+    case ShakeCacheEncoding::kQuantized16:
+      return numSamples * sizeof(std::int16_t);
+    case ShakeCacheEncoding::kDelta8:
+      return (numSamples + kDeltaBlockSamples - 1) / kDeltaBlockSamples * (kDeltaBlockSamples + 1);
+  }
+  return 0;
+}
+
+bool writeShakeCache(const std::string &path, const std::vector<ShakeBakeTarget> &targets, double start, int samplesPerFrame, ShakeCacheEncoding encoding, std::string *error) {
+  /* Writes the baked channels of the targets to a shake cache file.
+
+  The quantized encodings use a grid per channel. kQuantized16 spreads the range of
+  the channel over 65535 steps. kDelta8 widens the grid until the largest step
+  between two samples fits into 8 bits, so very rough or sparsely sampled shakes
+  lose more precision there.
+
+  Args:
+    path (string): Path of the file to write
+    targets (vector<ShakeBakeTarget>): Shakes with their baked channels, all of the same length
+    start (double): Frame of the first sample
+    samplesPerFrame (int): Number of samples per frame
+    encoding (ShakeCacheEncoding): Storage of the samples
+    error (string*): Receives the reason the file could not be written, or nullptr
+
+  Returns:
+    bool: True if the file was written
+
+  */
+  auto fail = [&](const std::string &message) {
+    if (error != nullptr) {
+      *error = path + ": " + message;
+    }
+    return false;
+  };
+
+  std::size_t numSamples = targets.empty() ? 0 : targets[0].channels[0].size();
+  if (numSamples == 0 || samplesPerFrame < 1) {
+    return fail("nothing to write");
+  }
+
+  ShakeCacheHeader header;
+  header.numShakes = (std::uint32_t) targets.size();
+  header.encoding = static_cast<std::uint32_t>(encoding);
+  header.samplesPerFrame = (std::uint32_t) samplesPerFrame;
+  header.numSamples = numSamples;
+  header.start = start;
+
+  std::size_t channelSize = shakeCacheChannelSize(encoding, numSamples);
+  std::size_t paddedSize = (channelSize + 7) / 8 * 8;
+  std::vector<ShakeCacheChannel> channels(3 * targets.size());
+  std::vector<unsigned char> data(paddedSize * channels.size(), 0);
+  std::size_t dataOffset = sizeof(ShakeCacheHeader) + channels.size() * sizeof(ShakeCacheChannel);
+
+  for (std::size_t i = 0; i < channels.size(); ++i) {
+    const std::vector<double> &values = targets[i / 3].channels[i % 3];
+    if (values.size() != numSamples) {
+      return fail("shakes have different numbers of samples");
+    }
+    ShakeCacheChannel &channel = channels[i];
+    channel.offset = dataOffset + i * paddedSize;
+    channel.size = channelSize;
+    unsigned char *samples = &data[i * paddedSize];
+
+    if (encoding == ShakeCacheEncoding::kFloat64) {
+      std::memcpy(samples, values.data(), channelSize);
+      continue;
+    }
+    if (encoding == ShakeCacheEncoding::kFloat32) {
+      for (std::size_t j = 0; j < numSamples; ++j) {
+        float value = (float) values[j];
+        std::memcpy(samples + j * sizeof(float), &value, sizeof(float));
+      }
+      continue;
+    }
+
+    auto range = std::minmax_element(values.begin(), values.end());
+    double largestStep = 0.0;
+    for (std::size_t j = 1; j < numSamples; ++j) {
+      largestStep = std::max(largestStep, std::abs(values[j] - values[j - 1]));
+    }
+    channel.bias = 0.5 * (*range.first + *range.second);
+    channel.scale = (*range.second - *range.first) / 65534.0;
+    if (encoding == ShakeCacheEncoding::kDelta8) {
+      // Rounding both ends of a step adds at most one grid step to it
+      channel.scale = std::max(channel.scale, largestStep / 126.0);
+    }
+    if (!(channel.scale > 0.0)) {
+      channel.scale = 1.0;
+    }
+
+    int previous = 0;
+    for (std::size_t j = 0; j < numSamples; ++j) {
+      int quantized = (int) std::lround((values[j] - channel.bias) / channel.scale);
+      if (encoding == ShakeCacheEncoding::kQuantized16) {
+        std::int16_t value = (std::int16_t) quantized;
+        std::memcpy(samples + j * sizeof(value), &value, sizeof(value));
+      } else if (j % kDeltaBlockSamples == 0) {
+        std::int16_t key = (std::int16_t) quantized;
+        std::memcpy(samples + (j / kDeltaBlockSamples) * (kDeltaBlockSamples + 1), &key, sizeof(key));
+      } else {
+        std::int8_t delta = (std::int8_t) (quantized - previous);
+        samples[(j / kDeltaBlockSamples) * (kDeltaBlockSamples + 1) + 1 + j % kDeltaBlockSamples] = (unsigned char) delta;
+      }
+      previous = quantized;
+    }
+  }
+
+  // Written next to the target and renamed over it, so a mapping of the previous
+  // bake keeps its pages instead of seeing a truncated file
+  std::string tempPath = path + ".tmp";
+  FILE *file = std::fopen(tempPath.c_str(), "wb");
+  if (file == nullptr) {
+    return fail("could not open the file for writing");
+  }
+  bool written = std::fwrite(&header, sizeof(header), 1, file) == 1 &&
+    std::fwrite(channels.data(), sizeof(ShakeCacheChannel), channels.size(), file) == channels.size() &&
+    std::fwrite(data.data(), 1, data.size(), file) == data.size();
+  written = std::fclose(file) == 0 && written;
+#ifdef _WIN32
+  // Windows does not rename over existing files, this fails while the file is mapped
+  std::remove(path.c_str());
+#endif
+  if (!written || std::rename(tempPath.c_str(), path.c_str()) != 0) {
+    std::remove(tempPath.c_str());
+    return fail("could not write the file");
+  }
+  return true;
+}
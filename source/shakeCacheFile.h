@@ -0,0 +1,104 @@
+#pragma once
+
+#include "shakeBake.h"
+
+// System Includes
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+
+
+enum class ShakeCacheEncoding {
+  /* Storage of the samples of a shake cache file. */
+  kFloat64 = 0,      // Doubles, exact
+  kFloat32 = 1,      // Floats, relative error of 6e-8
+  kQuantized16 = 2,  // 16 bit integers on a per channel grid, error of half the grid step
+  kDelta8 = 3,       // Blocks of a 16 bit key followed by 8 bit steps, about a byte per sample
+};
+
+
+
+struct ShakeCacheHeader {
+  /* Header at the start of a shake cache file.
+
+  The header is followed by numShakes * 3 ShakeCacheChannel entries, the X, Y and Z
+  channels of every shake in order, and the sample data of every channel. Sample i
+  of a channel is the shake at frame start + i / samplesPerFrame. All fields are
+  stored in the byte order of the machine that wrote the file.
+
+  */
+  char magic[4] = {'S', 'H', 'K', 'C'};
+  std::uint32_t version = 1;
+  std::uint32_t numShakes = 0;
+  std::uint32_t encoding = 0;
+  std::uint32_t samplesPerFrame = 1;
+  std::uint32_t reserved0 = 0;
+  std::uint64_t numSamples = 0;
+  double start = 0.0;
+  std::uint64_t reserved[3] = {0, 0, 0};
+};
+
+struct ShakeCacheChannel {
+  /* Location and quantization of the samples of one channel. */
+  std::uint64_t offset = 0;  // Byte offset of the first sample from the start of the file, 8 byte aligned
+  std::uint64_t size = 0;    // Size of the samples in bytes
+  double scale = 1.0;        // Quantized encodings store round((value - bias) / scale)
+  double bias = 0.0;
+};
+
+static_assert(sizeof(ShakeCacheHeader) == 64, "The cache header is part of the file format");
+static_assert(sizeof(ShakeCacheChannel) == 32, "The cache channel table is part of the file format");
+
+// Number of samples in one key and delta block of the kDelta8 encoding
+constexpr std::size_t kDeltaBlockSamples = 16;
+
+
+
+class ShakeCacheFile {
+  /* Read only memory mapping of a shake cache file.
+
+  Lookups read the mapped samples in place, nothing is decoded or copied when the
+  file is opened, so the pages of a cache only become resident once frames of it
+  are evaluated and are shared by every node and process that maps the same file.
+  Files are opened through open, which hands out the same mapping to every caller
+  as long as one of them holds on to it. All methods are safe to call concurrently.
+
+  */
+
+public:
+  // Destructor
+  ~ShakeCacheFile();
+
+  // Public Methods
+  static std::shared_ptr<const ShakeCacheFile> open(const std::string &path, std::string *error=nullptr);
+  bool lookup(std::size_t shake, double time, double result[3], double velocity[3]=nullptr, double acceleration[3]=nullptr) const;
+  double sample(std::size_t channel, std::size_t index) const;
+  std::size_t numShakes() const {return _header.numShakes;}
+  std::size_t numSamples() const {return (std::size_t) _header.numSamples;}
+  int samplesPerFrame() const {return (int) _header.samplesPerFrame;}
+  double start() const {return _header.start;}
+  double end() const {return _header.start + (double) (_header.numSamples - 1) / _header.samplesPerFrame;}
+  ShakeCacheEncoding encoding() const {return static_cast<ShakeCacheEncoding>(_header.encoding);}
+
+private:
+  // Constructors
+  ShakeCacheFile(): _channels(nullptr), _data(nullptr), _size(0), _mapping(nullptr) {};
+
+  // Private Methods
+  bool map(const std::string &path, std::string &error);
+
+  // Private Data
+  ShakeCacheHeader _header;
+  const ShakeCacheChannel *_channels;
+  const unsigned char *_data;
+  std::size_t _size;
+  void *_mapping;
+};
+
+
+
+std::size_t shakeCacheChannelSize(ShakeCacheEncoding encoding, std::size_t numSamples);
+bool writeShakeCache(const std::string &path, const std::vector<ShakeBakeTarget> &targets, double start, int samplesPerFrame, ShakeCacheEncoding encoding, std::string *error=nullptr);
@@ -1,4 +1,14 @@
 #include "shakeCommand.h"
+#include "shakeNode.h"
+#include "shakeNodeRot.h"
+#include "shakeArrayNode.h"
+#include "shakeTransformNode.h"
+#include "shakeBake.h"
+#include "shakeProfile.h"
+#include "shakeCacheFile.h"
+
+// System Includes
+#include <memory>
 
 
 
@@ -12,11 +22,170 @@ const char *ShakeCommand::nameFlagLong = "-name";
 const char *ShakeCommand::attributeFlagShort = "-a";
 const char *ShakeCommand::attributeFlagLong = "-attribute";
 
+const char *ShakeCommand::bakeFlagShort = "-b";
+const char *ShakeCommand::bakeFlagLong = "-bake";
+
+const char *ShakeCommand::startFlagShort = "-st";
+const char *ShakeCommand::startFlagLong = "-start";
+
+const char *ShakeCommand::endFlagShort = "-et";
+const char *ShakeCommand::endFlagLong = "-end";
+
+const char *ShakeCommand::stepFlagShort = "-sp";
+const char *ShakeCommand::stepFlagLong = "-step";
+
+const char *ShakeCommand::arrayFlagShort = "-ar";
+const char *ShakeCommand::arrayFlagLong = "-array";
+
+const char *ShakeCommand::matrixFlagShort = "-mx";
+const char *ShakeCommand::matrixFlagLong = "-matrix";
+
+const char *ShakeCommand::statsFlagShort = "-sts";
+const char *ShakeCommand::statsFlagLong = "-stats";
+
+const char *ShakeCommand::resetStatsFlagShort = "-rs";
+const char *ShakeCommand::resetStatsFlagLong = "-resetStats";
+
+const char *ShakeCommand::traceStartFlagShort = "-trs";
+const char *ShakeCommand::traceStartFlagLong = "-traceStart";
+
+const char *ShakeCommand::traceDumpFlagShort = "-trd";
+const char *ShakeCommand::traceDumpFlagLong = "-traceDump";
+
 const char *ShakeCommand::helpFlagShort = "-h";
 const char *ShakeCommand::helpFlagLong = "-help";
 
 
 
+namespace {
+
+struct BakeSource {
+	/* Where a bake target comes from in the scene. */
+	MPlug outputPlug;           // Output compound of the shake, its destinations are keyed
+	MPlug inTimePlug;
+	bool angular = false;       // Keyed in radians like the rotate outputs
+	std::string cacheFile;      // Played back cache file, empty for none
+	int cacheFileShake = 0;
+	std::vector<double> times;  // Value of a retimed inTime at each baked frame, empty on time1
+	bool animated = false;      // Settings or layers driven by a connection, the output is sampled instead
+};
+
+bool isDriven(const MPlug &plug) {
+	/* Whether a plug, or any of its elements or children, is the destination of a connection.
+
+	Keys, expressions and any other upstream node all connect to the plug, so this
+	is true whenever the value can change from frame to frame.
+
+	*/
+	if (plug.isDestination()) {
+		return true;
+	}
+	if (plug.isArray()) {
+		for (unsigned int i = 0; i < plug.numElements(); ++i) {
+			if (isDriven(plug.elementByPhysicalIndex(i))) {
+				return true;
+			}
+		}
+	} else if (plug.isCompound()) {
+		for (unsigned int i = 0; i < plug.numChildren(); ++i) {
+			if (isDriven(plug.child(i))) {
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+template <class NodeT>
+void readBakeTarget(const MObject &shakeObj, ShakeBakeTarget &target, BakeSource &source) {
+	/* Reads the layers and evaluation settings of a node of type NodeT at the current time.
+
+	Disabled nodes get no layers and bake to zero, the cache file is only played
+	back by enabled nodes. The values are only valid for the whole range when none
+	of them is driven, otherwise the source is marked animated.
+
+	*/
+	source.animated = isDriven(MPlug(shakeObj, NodeT::shakeAttr)) || isDriven(MPlug(shakeObj, NodeT::enableAttr)) ||
+		isDriven(MPlug(shakeObj, NodeT::precisionAttr)) || isDriven(MPlug(shakeObj, NodeT::noiseEngineAttr)) ||
+		isDriven(MPlug(shakeObj, NodeT::errorBudgetAttr));
+	ShakeNode::readShakeLayerPlugs<NodeT>(shakeObj, target.layers);
+	target.precision = static_cast<NoisePrecision>(MPlug(shakeObj, NodeT::precisionAttr).asShort());
+	target.engine = static_cast<NoiseEngine>(MPlug(shakeObj, NodeT::noiseEngineAttr).asShort());
+	target.errorBudget = MPlug(shakeObj, NodeT::errorBudgetAttr).asDouble();
+	source.inTimePlug = MPlug(shakeObj, NodeT::inTimeAttr);
+	if (!MPlug(shakeObj, NodeT::enableAttr).asBool()) {
+		target.layers.clear();
+	}
+}
+
+bool sampleInTime(const MPlug &inTimePlug, const std::vector<double> &times, std::vector<double> &inTimes) {
+	/* Samples inTime at every baked frame, unless a time node drives it directly.
+
+	Args:
+		inTimePlug (MPlug&): inTime of a shake node
+		times (vector<double>&): Baked frames
+		inTimes (vector<double>&): Receives the value of inTime at each frame, in ui units
+
+	Returns:
+		bool: True if inTime is retimed, unconnected or driven by anything else than
+			a time node, false if the baked frames can be used as they are
+
+	*/
+	MPlug sourcePlug = inTimePlug.source();
+	if (!sourcePlug.isNull() && sourcePlug.node().hasFn(MFn::kTime)) {
+		return false;
+	}
+	inTimes.resize(times.size());
+	for (std::size_t frame = 0; frame < times.size(); ++frame) {
+		MDGContext context(MTime(times[frame], MTime::uiUnit()));
+		MDGContextGuard contextGuard(context);
+		inTimes[frame] = inTimePlug.asMTime().asUnits(MTime::uiUnit());
+	}
+	return true;
+}
+
+void sampleOutput(const BakeSource &source, const std::vector<double> &times, ShakeBakeTarget &target) {
+	/* Bakes a shake by evaluating its output at every baked frame.
+
+	Used for shakes whose layers or settings are animated, which the bake can't
+	evaluate from a single read of the layers. Slower, but matches the node exactly.
+
+	Args:
+		source (BakeSource&): Shake to sample
+		times (vector<double>&): Baked frames
+		target (ShakeBakeTarget&): Receives the channels, angles in degrees like the layers
+
+	*/
+	const double pi = 3.14159265358979323846;
+	for (int axis = 0; axis < 3; ++axis) {
+		target.channels[axis].resize(times.size());
+	}
+	for (std::size_t frame = 0; frame < times.size(); ++frame) {
+		MDGContext context(MTime(times[frame], MTime::uiUnit()));
+		MDGContextGuard contextGuard(context);
+		for (unsigned int axis = 0; axis < 3; ++axis) {
+			double value = source.outputPlug.child(axis).asDouble();
+			target.channels[axis][frame] = source.angular ? value * 180 / pi : value;
+		}
+	}
+}
+
+void bakeTargets(std::vector<ShakeBakeTarget> &targets, const std::vector<unsigned int> &indices, const std::vector<double> &times) {
+	/* Bakes the targets at the given indices together, at the same times. */
+	std::vector<ShakeBakeTarget> group(indices.size());
+	for (std::size_t i = 0; i < indices.size(); ++i) {
+		group[i] = std::move(targets[indices[i]]);
+	}
+	bakeShakes(group, times);
+	for (std::size_t i = 0; i < indices.size(); ++i) {
+		targets[indices[i]] = std::move(group[i]);
+	}
+}
+
+}
+
+
+
 ShakeCommand::~ShakeCommand() {
 	/* ShakeCommand Destructor. */
 }
@@ -32,11 +201,21 @@ MSyntax ShakeCommand::syntaxCreator() {
 
 	sytnax.addFlag(nameFlagShort, nameFlagLong, MSyntax::kString);
 	sytnax.addFlag(attributeFlagShort, attributeFlagLong, MSyntax::kString);
+	sytnax.addFlag(bakeFlagShort, bakeFlagLong);
+	sytnax.addFlag(startFlagShort, startFlagLong, MSyntax::kDouble);
+	sytnax.addFlag(endFlagShort, endFlagLong, MSyntax::kDouble);
+	sytnax.addFlag(stepFlagShort, stepFlagLong, MSyntax::kDouble);
+	sytnax.addFlag(arrayFlagShort, arrayFlagLong);
+	sytnax.addFlag(matrixFlagShort, matrixFlagLong);
+	sytnax.addFlag(statsFlagShort, statsFlagLong);
+	sytnax.addFlag(resetStatsFlagShort, resetStatsFlagLong);
+	sytnax.addFlag(traceStartFlagShort, traceStartFlagLong);
+	sytnax.addFlag(traceDumpFlagShort, traceDumpFlagLong, MSyntax::kString);
 
 	sytnax.setObjectType(MSyntax::kSelectionList, 0, 255);
 	sytnax.useSelectionAsDefault(true);
 	sytnax.enableEdit(false);
-	sytnax.enableQuery(false);
+	sytnax.enableQuery(true);
 
 	return sytnax;
 }
@@ -47,6 +226,17 @@ void displayHelp() {
   helpStr += "Flags:\n";
   helpStr += "   -n -name          String     Name of the shake node to create.\n";
   helpStr += "   -a -attribute     String     Name of the attribute to shake.\n";
+  helpStr += "   -b -bake          N/A        Bake the selected shakes, or the shakes driving the selected nodes, to keys.\n";
+  helpStr += "   -st -start        Float      First frame to bake, defaults to the playback start.\n";
+  helpStr += "   -et -end          Float      Last frame to bake, defaults to the playback end.\n";
+  helpStr += "   -sp -step         Float      Frame step between baked keys, defaults to 1.\n";
+  helpStr += "   -ar -array        N/A        Shake the whole selection with a single shakeArrayNode.\n";
+  helpStr += "   -mx -matrix       N/A        Shake translation and rotation with a shakeTransformNode driving the offsetParentMatrix.\n";
+  helpStr += "   -sts -stats       N/A        Query only. Compute calls, cache hits, total and max compute time in ms, layers evaluated\n";
+  helpStr += "                                and layers skipped for a weight of 0, per given shake node or for all nodes together.\n";
+  helpStr += "   -rs -resetStats   N/A        Reset the counters of the given shake nodes, or of all nodes.\n";
+  helpStr += "   -trs -traceStart  N/A        Start recording the shake computes for a Chrome trace.\n";
+  helpStr += "   -trd -traceDump   String     Stop recording and write the computes to a Chrome trace JSON file.\n";
   helpStr += "   -h -help          N/A        Display this text.\n";
   MGlobal::displayInfo(helpStr);
 }
@@ -77,6 +267,56 @@ MStatus ShakeCommand::gatherFlagArguments(const MArgList& argList) {
 		CHECK_MSTATUS_AND_RETURN_IT(status);
 	}
 
+	_array = argData.isFlagSet(arrayFlagShort);
+	_matrix = argData.isFlagSet(matrixFlagShort);
+	if (_matrix && _array) {
+		MGlobal::displayError("The matrix and array flags can not be combined.");
+		return MS::kFailure;
+	}
+	if (_matrix) {
+		_shakeAttribute = "offsetParentMatrix";
+	}
+	_bake = argData.isFlagSet(bakeFlagShort);
+	_bakeStart = MAnimControl::minTime().asUnits(MTime::uiUnit());
+	_bakeEnd = MAnimControl::maxTime().asUnits(MTime::uiUnit());
+	if (argData.isFlagSet(startFlagShort)) {
+		_bakeStart = argData.flagArgumentDouble(startFlagShort, 0, &status);
+		CHECK_MSTATUS_AND_RETURN_IT(status);
+	}
+	if (argData.isFlagSet(endFlagShort)) {
+		_bakeEnd = argData.flagArgumentDouble(endFlagShort, 0, &status);
+		CHECK_MSTATUS_AND_RETURN_IT(status);
+	}
+	if (argData.isFlagSet(stepFlagShort)) {
+		_bakeStep = argData.flagArgumentDouble(stepFlagShort, 0, &status);
+		CHECK_MSTATUS_AND_RETURN_IT(status);
+		if (_bakeStep <= 0.0) {
+			MGlobal::displayError("Bake step has to be greater than 0.");
+			return MS::kFailure;
+		}
+	}
+
+	_stats = argData.isFlagSet(statsFlagShort);
+	if (_stats && !argData.isQuery()) {
+		MGlobal::displayError("-stats must be used in query mode.");
+		return MS::kFailure;
+	}
+	_resetStats = argData.isFlagSet(resetStatsFlagShort);
+	_traceStart = argData.isFlagSet(traceStartFlagShort);
+	if (argData.isFlagSet(traceDumpFlagShort)) {
+		_traceDumpPath = argData.flagArgumentString(traceDumpFlagShort, 0, &status).asChar();
+		CHECK_MSTATUS_AND_RETURN_IT(status);
+		if (_traceDumpPath.empty()) {
+			MGlobal::displayError("Trace dump needs a file path.");
+			return MS::kFailure;
+		}
+	}
+	_profile = _stats || _resetStats || _traceStart || !_traceDumpPath.empty();
+	if (argData.isQuery() && !_stats) {
+		MGlobal::displayError("Only the stats flag can be queried.");
+		return MS::kFailure;
+	}
+
 	if (argData.isFlagSet(helpFlagShort)) {
 		displayHelp();
 		return MS::kSuccess;
@@ -126,37 +366,255 @@ MStatus ShakeCommand::_validateNodes() {
 	return MS::kSuccess;
 }
 
-MStatus ShakeCommand::_createShakeNode(std::string name, std::string output="angular") {
-	/* Creates the specified shakeNode.
+MStatus ShakeCommand::_findTargetPlug(const MObject &nodeObj, MPlug &targetPlug, std::string &error) {
+	/* Finds the plug of a node a shake should drive and checks that it can be connected.
+
+	The attribute is looked up by name once per node type and the plugs of further
+	nodes of that type are built from the attribute object. Dynamic attributes differ
+	between nodes of a type, they are looked up on every node. All reasons a connection
+	would fail in the modifier are checked here, so a bad node is skipped instead of
+	failing the doIt of the whole selection.
 
 	Args:
-		name (string): Name of the shake node
-		output (string): Type of the shake node to create - with linear or angular
-			output. Default is angular
+		nodeObj (MObject): Node to shake
+		targetPlug (MPlug&): Receives the plug to connect the shake output to
+		error (string&): Receives why the node cannot be shaken
 
 	Returns:
-		status code (MStatus): kSuccess if the command was successful,
-			kFailure if an error occured during the command
+		status code (MStatus): kSuccess if the plug can be connected,
+			kFailure otherwise
 
 	*/
 	MStatus status;
 
-	if (output == "angular") { 
-		_shakeObj = _dgMod.createNode("shakeNodeRot");
-		_dgMod.renameNode(_shakeObj, name.c_str());
-	} else if ( output == "linear") {
-		_shakeObj = _dgMod.createNode("shakeNode");
-		_dgMod.renameNode(_shakeObj, name.c_str());
+	MFnDependencyNode nodeFn(nodeObj);
+	MObject attributeObj;
+	std::string typeName = nodeFn.typeName().asChar();
+	auto cachedAttribute = _targetAttributes.find(typeName);
+	if (cachedAttribute != _targetAttributes.end()) {
+		attributeObj = cachedAttribute->second;
 	} else {
-		MGlobal::displayError("Shake output can either be 'angular' or 'linear'.");
+		attributeObj = nodeFn.attribute(_shakeAttribute == "rotate" ? "rotateAxis" : _shakeAttribute.c_str(), &status);
+		if (!status || attributeObj.isNull()) {
+			error = "does not exist";
+			return MS::kFailure;
+		}
+		if (!MFnAttribute(attributeObj).isDynamic()) {
+			_targetAttributes[typeName] = attributeObj;
+		}
+	}
+
+	targetPlug = MPlug(nodeObj, attributeObj);
+	if (_matrix && (targetPlug.isArray() || targetPlug.isCompound())) {
+		error = "is not a matrix attribute";
+		return MS::kFailure;
+	}
+	if (!_matrix && (targetPlug.isArray() || !targetPlug.isCompound() || targetPlug.numChildren() != 3)) {
+		error = "is not a three component attribute";
 		return MS::kFailure;
 	}
+	if (targetPlug.isConnected()) {
+		error = "is already connected";
+		return MS::kFailure;
+	}
+	if (targetPlug.isLocked()) {
+		error = "is locked";
+		return MS::kFailure;
+	}
+	for (unsigned int axis = 0; axis < targetPlug.numChildren(); ++axis) {
+		MPlug childPlug = targetPlug.child(axis);
+		if (childPlug.isDestination()) {
+			error = "is already connected";
+			return MS::kFailure;
+		}
+		if (childPlug.isLocked()) {
+			error = "is locked";
+			return MS::kFailure;
+		}
+	}
 
 	return MS::kSuccess;
 }
 
+std::string ShakeCommand::_shakeNodeName(const MFnDependencyNode &nodeFn) const {
+	/* Name of the shake node for a node, the name flag or the node name plus the attribute.
+
+	Args:
+		nodeFn (MFnDependencyNode): Node to shake
+
+	Returns:
+		string: Name to give the shake node
+
+	*/
+	if (_shakeName != "Shake") {
+		return _shakeName;
+	}
+	std::string shakeAttrShort = _matrix ? std::string("Transform") : _shakeAttribute == "rotate" ? std::string("Rot") : _shakeAttribute.substr(0, 3);
+	shakeAttrShort[0] = toupper(shakeAttrShort[0]);
+	return std::string(nodeFn.name().asChar()) + shakeAttrShort + _shakeName;
+}
+
+void ShakeCommand::_reportSkippedNodes(const std::vector<std::string> &skipped, unsigned int numNodes) const {
+	/* Warns about the nodes that could not be shaken.
+
+	Only the first reasons are printed one by one, so a selection of thousands of bad
+	nodes does not flood the script editor.
+
+	Args:
+		skipped (vector<string>): Reason for every skipped node
+		numNodes (unsigned int): Number of nodes in the selection
+
+	*/
+	const std::size_t kMaxReportedNodes = 10;
+
+	if (skipped.empty()) {
+		return;
+	}
+	for (std::size_t i = 0; i < std::min(skipped.size(), kMaxReportedNodes); ++i) {
+		MGlobal::displayWarning(skipped[i].c_str());
+	}
+	if (skipped.size() > kMaxReportedNodes) {
+		MGlobal::displayWarning(std::string("... and " + std::to_string(skipped.size() - kMaxReportedNodes) + " more.").c_str());
+	}
+	MGlobal::displayWarning(std::string("Skipped " + std::to_string(skipped.size()) + " of " + std::to_string(numNodes) + " nodes.").c_str());
+}
+
 MStatus ShakeCommand::_setupShake() {
-	/* Core function for creating and setting up the shake and plugs.
+	/* Creates a shake node for every selected node and queues all of them in one modifier.
+
+	Shake nodes are created by type id and their plugs are built from the attribute
+	objects instead of looking anything up by name, see _findTargetPlug for the
+	driven attributes. Nodes that cannot be shaken are skipped and reported, the rest
+	of the selection is still set up. Every node and connection goes into _dgMod, so
+	the whole selection is created by a single doIt and undone in one step.
+
+	Returns:
+		status code (MStatus): kSuccess if at least one node can be shaken,
+			kFailure otherwise
+
+	*/
+	MStatus status;
+
+	const bool angular = _shakeAttribute == "rotate";
+	const MTypeId &shakeTypeId = _matrix ? ShakeTransformNode::typeId : angular ? ShakeNodeRot::typeId : ShakeNode::typeId;
+	const MObject &shakeInAttr = _matrix ? ShakeTransformNode::inTimeAttr : angular ? ShakeNodeRot::inTimeAttr : ShakeNode::inTimeAttr;
+	const MObject &shakeOutAttr = _matrix ? ShakeTransformNode::outputMatrixAttr : angular ? ShakeNodeRot::outputAttr : ShakeNode::outputAttr;
+
+	std::vector<std::string> skipped;
+	unsigned int numNodes = 0;
+	MItSelectionList itSelList(_selList, MFn::kDependencyNode);
+	for (; !itSelList.isDone(); itSelList.next()) {
+		MObject nodeObj;
+		itSelList.getDependNode(nodeObj);
+		MFnDependencyNode nodeFn(nodeObj);
+		++numNodes;
+
+		MPlug nodeInPlug;
+		std::string error;
+		if (!_findTargetPlug(nodeObj, nodeInPlug, error)) {
+			skipped.push_back("Attribute '" + _shakeAttribute + "' of '" + nodeFn.name().asChar() + "' " + error + ".");
+			continue;
+		}
+
+		MObject shakeObj = _dgMod.createNode(shakeTypeId, &status);
+		CHECK_MSTATUS_AND_RETURN_IT(status);
+		_dgMod.renameNode(shakeObj, _shakeNodeName(nodeFn).c_str());
+		_dgMod.connect(_timeOutPlug, MPlug(shakeObj, shakeInAttr));
+		_dgMod.connect(MPlug(shakeObj, shakeOutAttr), nodeInPlug);
+		_shakeObjs.append(shakeObj);
+	}
+
+	_reportSkippedNodes(skipped, numNodes);
+	if (_shakeObjs.length() == 0) {
+		MGlobal::displayError("None of the given nodes can be shaken.");
+		return MS::kFailure;
+	}
+
+	return MS::kSuccess;
+}
+
+MStatus ShakeCommand::_setupArrayShake() {
+	/* Creates one shakeArrayNode and connects every selected node to an element of it.
+
+	Each node gets the next element of the seedOffset and output arrays. The offsets
+	are spaced by kArraySeedOffsetStep so neighbouring nodes do not shake like time
+	shifted copies of each other. Nodes that cannot be shaken are skipped like in
+	_setupShake and do not use up an element.
+
+	The node is created with the Hash noise engine. The Perlin and Gradient1D
+	lattices repeat every 256 seeds, so with them every 256th element of a large
+	selection would shake exactly like the first, Hash gives every seed its own shake.
+
+	Returns:
+		status code (MStatus): kSuccess if at least one node can be shaken,
+			kFailure otherwise
+
+	*/
+	MStatus status;
+
+	// Spaces neighbouring elements far apart in seed
+	const int kArraySeedOffsetStep = 37;
+
+	bool angular = _shakeAttribute == "rotate";
+	std::string shakeName = _shakeName;
+	if (shakeName == "Shake") {
+		std::string shakeAttrShort = angular ? std::string("Rot") : _shakeAttribute.substr(0, 3);
+		shakeAttrShort[0] = toupper(shakeAttrShort[0]);
+		shakeName = "array" + shakeAttrShort + shakeName;
+	}
+	MObject shakeObj = _dgMod.createNode(ShakeArrayNode::typeId, &status);
+	CHECK_MSTATUS_AND_RETURN_IT(status);
+	_dgMod.renameNode(shakeObj, shakeName.c_str());
+	_dgMod.connect(_timeOutPlug, MPlug(shakeObj, ShakeArrayNode::inTimeAttr));
+	_dgMod.newPlugValueShort(MPlug(shakeObj, ShakeArrayNode::noiseEngineAttr), static_cast<short>(NoiseEngine::kHash));
+
+	MPlug seedOffsetPlug(shakeObj, ShakeArrayNode::seedOffsetAttr);
+	MPlug outputPlug(shakeObj, angular ? ShakeArrayNode::outputRotateAttr : ShakeArrayNode::outputAttr);
+
+	std::vector<std::string> skipped;
+	unsigned int numNodes = 0;
+	unsigned int element = 0;
+	MItSelectionList itSelList(_selList, MFn::kDependencyNode);
+	for (; !itSelList.isDone(); itSelList.next()) {
+		MObject nodeObj;
+		itSelList.getDependNode(nodeObj);
+		++numNodes;
+
+		MPlug nodeInPlug;
+		std::string error;
+		if (!_findTargetPlug(nodeObj, nodeInPlug, error)) {
+			skipped.push_back("Attribute '" + _shakeAttribute + "' of '" + MFnDependencyNode(nodeObj).name().asChar() + "' " + error + ".");
+			continue;
+		}
+
+		_dgMod.newPlugValueInt(seedOffsetPlug.elementByLogicalIndex(element), (int) element * kArraySeedOffsetStep);
+		_dgMod.connect(outputPlug.elementByLogicalIndex(element), nodeInPlug);
+		++element;
+	}
+
+	_reportSkippedNodes(skipped, numNodes);
+	if (element == 0) {
+		MGlobal::displayError("None of the given nodes can be shaken.");
+		return MS::kFailure;
+	}
+	_shakeObjs.append(shakeObj);
+
+	return MS::kSuccess;
+}
+
+MStatus ShakeCommand::_gatherBakeTargets(MObjectArray &shakeObjs, MPlugArray &elementPlugs) {
+	/* Collects the shakes to bake from the selection.
+
+	Selected shake nodes are baked directly, for any other selected node the shakes
+	driving one of its attributes are baked. Elements of a shakeArrayNode are baked
+	one by one, a selected shakeArrayNode bakes every element that drives something,
+	a driven node only the elements driving it. shakeTransformNodes can't be baked
+	and are reported by name.
+
+	Args:
+		shakeObjs (MObjectArray&): Receives the shakeNode and shakeNodeRot nodes, without duplicates
+		elementPlugs (MPlugArray&): Receives the output or outputRotate elements of
+			shakeArrayNodes, without duplicates
 
 	Returns:
 		status code (MStatus): kSuccess if the command was successful,
@@ -165,42 +623,360 @@ MStatus ShakeCommand::_setupShake() {
 	*/
 	MStatus status;
 
-	MFnDependencyNode nodeFn(_nodeObj);
+	auto isShakeNode = [](const MObject &obj) {
+		MFnDependencyNode nodeFn(obj);
+		return nodeFn.typeId() == ShakeNode::typeId || nodeFn.typeId() == ShakeNodeRot::typeId;
+	};
+	auto appendUnique = [&shakeObjs](const MObject &obj) {
+		for (unsigned int i = 0; i < shakeObjs.length(); ++i) {
+			if (shakeObjs[i] == obj) {
+				return;
+			}
+		}
+		shakeObjs.append(obj);
+	};
+	auto appendUniqueElement = [&elementPlugs](const MPlug &plug) {
+		for (unsigned int i = 0; i < elementPlugs.length(); ++i) {
+			if (elementPlugs[i] == plug) {
+				return;
+			}
+		}
+		elementPlugs.append(plug);
+	};
+	auto isDriving = [](const MPlug &plug) {
+		MPlugArray destPlugs;
+		if (plug.connectedTo(destPlugs, false, true) && destPlugs.length() > 0) {
+			return true;
+		}
+		for (unsigned int axis = 0; axis < plug.numChildren(); ++axis) {
+			if (plug.child(axis).connectedTo(destPlugs, false, true) && destPlugs.length() > 0) {
+				return true;
+			}
+		}
+		return false;
+	};
+
+	std::vector<std::string> skipped;
+	auto appendSkipped = [&skipped](const MFnDependencyNode &nodeFn) {
+		std::string name = nodeFn.name().asChar();
+		if (std::find(skipped.begin(), skipped.end(), name) == skipped.end()) {
+			skipped.push_back(name);
+		}
+	};
 
-	if (_shakeAttribute == "rotate") {
-		// Check if given attribute is not connected
-		_nodeInPlug = nodeFn.findPlug("rotateAxis", false, &status);
-		CHECK_MSTATUS_AND_RETURN_IT(status)
-		if (_nodeInPlug.isConnected()) {
-			MGlobal::displayError(std::string("Given attribute '" + _shakeAttribute + "' is already connected.").c_str());
-			return MS::kFailure;
+	MItSelectionList itSelList(_selList, MFn::kDependencyNode);
+	while (!itSelList.isDone()) {
+		MObject nodeObj;
+		itSelList.getDependNode(nodeObj);
+		MFnDependencyNode nodeFn(nodeObj);
+		if (isShakeNode(nodeObj)) {
+			appendUnique(nodeObj);
+		} else if (nodeFn.typeId() == ShakeArrayNode::typeId) {
+			for (const MObject *outputAttr : {&ShakeArrayNode::outputAttr, &ShakeArrayNode::outputRotateAttr}) {
+				MPlug outputPlug(nodeObj, *outputAttr);
+				for (unsigned int i = 0; i < outputPlug.numElements(); ++i) {
+					MPlug elementPlug = outputPlug.elementByPhysicalIndex(i);
+					if (isDriving(elementPlug)) {
+						appendUniqueElement(elementPlug);
+					}
+				}
+			}
+		} else if (nodeFn.typeId() == ShakeTransformNode::typeId) {
+			appendSkipped(nodeFn);
+		} else {
+			MPlugArray connectedPlugs;
+			nodeFn.getConnections(connectedPlugs);
+			for (unsigned int i = 0; i < connectedPlugs.length(); ++i) {
+				MPlugArray sourcePlugs;
+				connectedPlugs[i].connectedTo(sourcePlugs, true, false);
+				for (unsigned int j = 0; j < sourcePlugs.length(); ++j) {
+					MObject sourceObj = sourcePlugs[j].node();
+					MFnDependencyNode sourceFn(sourceObj);
+					if (isShakeNode(sourceObj)) {
+						appendUnique(sourceObj);
+					} else if (sourceFn.typeId() == ShakeArrayNode::typeId) {
+						// A single axis can drive the attribute, the whole element is baked
+						MPlug elementPlug = sourcePlugs[j].isChild() ? sourcePlugs[j].parent() : sourcePlugs[j];
+						if (elementPlug.isElement()) {
+							appendUniqueElement(elementPlug);
+						}
+					} else if (sourceFn.typeId() == ShakeTransformNode::typeId) {
+						appendSkipped(sourceFn);
+					}
+				}
+			}
+		}
+		itSelList.next();
+	}
+
+	for (const std::string &name : skipped) {
+		MGlobal::displayWarning(("Skipped '" + name + "', shakeTransformNodes can't be baked.").c_str());
+	}
+	if (shakeObjs.length() == 0 && elementPlugs.length() == 0) {
+		MGlobal::displayError("No shake nodes found to bake.");
+		return MS::kFailure;
+	}
+
+	return MS::kSuccess;
+}
+
+MStatus ShakeCommand::_bakeShakes() {
+	/* Bakes the shakes to animation curves on the attributes they drive.
+
+	The noise is computed directly from the layer parameters, in parallel across
+	shakes and frame chunks, instead of evaluating the DG frame by frame. Each driven
+	channel is then disconnected from its shake and keyed in a single addKeys call.
+	The layer attributes are read at the current time.
+
+	Every shake is baked like its node evaluates. Array elements add their seedOffset
+	to the layer seeds, nodes playing back a cacheFile take its samples wherever the
+	file has them, and shakes whose inTime is not driven by a time node directly are
+	evaluated at the value of inTime at each baked frame. Shakes with animated or
+	connected layers or settings can't be baked from one read of their layers,
+	their output is evaluated through the DG at every frame instead, with a warning.
+
+	Returns:
+		status code (MStatus): kSuccess if the command was successful,
+			kFailure if an error occured during the command
+
+	*/
+	MStatus status;
+
+	MObjectArray shakeObjs;
+	MPlugArray elementPlugs;
+	status = _gatherBakeTargets(shakeObjs, elementPlugs);
+	CHECK_MSTATUS_AND_RETURN_IT(status);
+
+	// Frames to bake, built from an index so the step does not accumulate errors
+	std::vector<double> times;
+	unsigned int numFrames = _bakeEnd >= _bakeStart ? (unsigned int) ((_bakeEnd - _bakeStart) / _bakeStep + 1e-6) + 1 : 0;
+	for (unsigned int i = 0; i < numFrames; ++i) {
+		times.push_back(_bakeStart + i * _bakeStep);
+	}
+	if (times.empty()) {
+		MGlobal::displayError("Bake range is empty.");
+		return MS::kFailure;
+	}
+
+	// One target per shake node and per array element, the shake nodes come first
+	unsigned int numTargets = shakeObjs.length() + elementPlugs.length();
+	std::vector<ShakeBakeTarget> targets(numTargets);
+	std::vector<BakeSource> sources(numTargets);
+	for (unsigned int i = 0; i < shakeObjs.length(); ++i) {
+		MFnDependencyNode shakeFn(shakeObjs[i]);
+		BakeSource &source = sources[i];
+		source.outputPlug = shakeFn.findPlug("output", false, &status);
+		CHECK_MSTATUS_AND_RETURN_IT(status);
+		source.angular = shakeFn.typeId() == ShakeNodeRot::typeId;
+		if (source.angular) {
+			readBakeTarget<ShakeNodeRot>(shakeObjs[i], targets[i], source);
+			source.cacheFile = MPlug(shakeObjs[i], ShakeNodeRot::cacheFileAttr).asString().asChar();
+			source.cacheFileShake = MPlug(shakeObjs[i], ShakeNodeRot::cacheFileShakeAttr).asInt();
+			source.animated = source.animated || isDriven(MPlug(shakeObjs[i], ShakeNodeRot::cacheFileAttr)) ||
+				isDriven(MPlug(shakeObjs[i], ShakeNodeRot::cacheFileShakeAttr));
+		} else {
+			readBakeTarget<ShakeNode>(shakeObjs[i], targets[i], source);
+			source.cacheFile = MPlug(shakeObjs[i], ShakeNode::cacheFileAttr).asString().asChar();
+			source.cacheFileShake = MPlug(shakeObjs[i], ShakeNode::cacheFileShakeAttr).asInt();
+			source.animated = source.animated || isDriven(MPlug(shakeObjs[i], ShakeNode::cacheFileAttr)) ||
+				isDriven(MPlug(shakeObjs[i], ShakeNode::cacheFileShakeAttr));
+		}
+	}
+	for (unsigned int i = 0; i < elementPlugs.length(); ++i) {
+		MObject arrayObj = elementPlugs[i].node();
+		ShakeBakeTarget &target = targets[shakeObjs.length() + i];
+		BakeSource &source = sources[shakeObjs.length() + i];
+		source.outputPlug = elementPlugs[i];
+		source.angular = elementPlugs[i].attribute() == ShakeArrayNode::outputRotateAttr;
+		readBakeTarget<ShakeArrayNode>(arrayObj, target, source);
+		MPlug seedOffsetPlug = MPlug(arrayObj, ShakeArrayNode::seedOffsetAttr).elementByLogicalIndex(elementPlugs[i].logicalIndex());
+		source.animated = source.animated || isDriven(seedOffsetPlug);
+		int seedOffset = seedOffsetPlug.asInt();
+		for (ShakeLayer &layer : target.layers) {
+			layer.seed += seedOffset;
+		}
+	}
+
+	// Animated shakes are sampled through the DG, shakes on time1 are baked together
+	// and retimed shakes each at their own times
+	std::vector<unsigned int> timeIndices;
+	for (unsigned int i = 0; i < numTargets; ++i) {
+		if (sources[i].animated) {
+			MGlobal::displayWarning(("The layers or settings of '" + std::string(sources[i].outputPlug.name().asChar()) +
+				"' are animated, it is baked by evaluating the node at every frame.").c_str());
+			sampleOutput(sources[i], times, targets[i]);
+		} else if (sampleInTime(sources[i].inTimePlug, times, sources[i].times)) {
+			bakeTargets(targets, {i}, sources[i].times);
+		} else {
+			timeIndices.push_back(i);
+		}
+	}
+	bakeTargets(targets, timeIndices, times);
+
+	// Nodes playing back a cache file output its samples, the layers only where it has none
+	for (unsigned int i = 0; i < numTargets; ++i) {
+		const BakeSource &source = sources[i];
+		if (source.cacheFile.empty() || source.animated) {
+			continue;
+		}
+		std::string error;
+		std::shared_ptr<const ShakeCacheFile> file = ShakeCacheFile::open(source.cacheFile, &error);
+		if (file == nullptr) {
+			MGlobal::displayWarning((error + ", baking the layers of '" + MFnDependencyNode(source.outputPlug.node()).name().asChar() + "' instead.").c_str());
+			continue;
 		}
-		// Check if _shakeName was specified in the flag name
-		if (_shakeName == "Shake") {
-			_shakeName = std::string(nodeFn.name().asChar()) + "Rot" + _shakeName;
+		const std::vector<double> &targetTimes = source.times.empty() ? times : source.times;
+		for (std::size_t frame = 0; frame < targetTimes.size(); ++frame) {
+			double value[3];
+			if (source.cacheFileShake >= 0 && file->lookup((std::size_t) source.cacheFileShake, targetTimes[frame], value)) {
+				for (int axis = 0; axis < 3; ++axis) {
+					targets[i].channels[axis][frame] = value[axis];
+				}
+			}
 		}
-		status = _createShakeNode(_shakeName);
+	}
+
+	// Disconnect every driven channel from its shake
+	std::vector<MPlug> channelPlugs;
+	std::vector<const std::vector<double> *> channelValues;
+	std::vector<bool> channelAngular;
+	for (unsigned int i = 0; i < numTargets; ++i) {
+		const MPlug &outputPlug = sources[i].outputPlug;
+		MPlugArray destPlugs;
+		outputPlug.connectedTo(destPlugs, false, true);
+		for (unsigned int j = 0; j < destPlugs.length(); ++j) {
+			_dgMod.disconnect(outputPlug, destPlugs[j]);
+			for (unsigned int axis = 0; axis < 3; ++axis) {
+				channelPlugs.push_back(destPlugs[j].child(axis));
+				channelValues.push_back(&targets[i].channels[axis]);
+				channelAngular.push_back(sources[i].angular);
+			}
+		}
+		for (unsigned int axis = 0; axis < 3; ++axis) {
+			MPlug outputAxisPlug = outputPlug.child(axis);
+			outputAxisPlug.connectedTo(destPlugs, false, true);
+			for (unsigned int j = 0; j < destPlugs.length(); ++j) {
+				_dgMod.disconnect(outputAxisPlug, destPlugs[j]);
+				channelPlugs.push_back(destPlugs[j]);
+				channelValues.push_back(&targets[i].channels[axis]);
+				channelAngular.push_back(sources[i].angular);
+			}
+		}
+	}
+	status = _dgMod.doIt();
+	CHECK_MSTATUS_AND_RETURN_IT(status);
+
+	// Create the curves, they have to exist before keys can be added
+	std::vector<MObject> curveObjs;
+	for (const MPlug &channelPlug : channelPlugs) {
+		MFnAnimCurve curveFn;
+		curveObjs.push_back(curveFn.create(channelPlug, &_dgMod, &status));
 		CHECK_MSTATUS_AND_RETURN_IT(status);
-		MFnDependencyNode shakeFn(_shakeObj);
-		_shakeInPlug = shakeFn.findPlug("inTime", false);
-		_shakeOutPlug = shakeFn.findPlug("output", false);
-	} else {
-		_nodeInPlug = nodeFn.findPlug(_shakeAttribute.c_str(), false);
-		if (!_nodeInPlug || _nodeInPlug.isConnected()) {
-			MGlobal::displayError(std::string("Given attribute '" + _shakeAttribute + "' does not exist or is already connected.").c_str());
+	}
+	status = _dgMod.doIt();
+	CHECK_MSTATUS_AND_RETURN_IT(status);
+
+	MTimeArray keyTimes;
+	keyTimes.setLength((unsigned int) times.size());
+	for (unsigned int frame = 0; frame < times.size(); ++frame) {
+		keyTimes.set(MTime(times[frame], MTime::uiUnit()), frame);
+	}
+
+	// Bulk insert the keys, rotations are stored in radians like the shakeNodeRot output
+	const double pi = 3.14159265358979323846;
+	MDoubleArray keyValues((unsigned int) times.size());
+	for (std::size_t i = 0; i < curveObjs.size(); ++i) {
+		const std::vector<double> &values = *channelValues[i];
+		for (unsigned int frame = 0; frame < values.size(); ++frame) {
+			keyValues[frame] = channelAngular[i] ? values[frame] * pi / 180 : values[frame];
+		}
+		MFnAnimCurve curveFn(curveObjs[i]);
+		status = curveFn.addKeys(&keyTimes, &keyValues, MFnAnimCurve::kTangentAuto, MFnAnimCurve::kTangentAuto, false, &_animCurveChange);
+		CHECK_MSTATUS_AND_RETURN_IT(status);
+		appendToResult(curveFn.name());
+	}
+
+	return MS::kSuccess;
+}
+
+MStatus ShakeCommand::_profileShakes() {
+	/* Queries or resets the compute counters of the shake nodes and records traces.
+
+	The stats query returns six values per given shake node, or for all shake nodes
+	together when none is given: compute calls, cache hits, total and max compute
+	time in milliseconds, layers evaluated and layers skipped for a weight of 0.
+	The totals are summed from the counters of every shake node in the scene, so
+	deleted nodes no longer count. Resetting without nodes resets every shake node
+	in the scene. A trace dump is written after a trace start in the same call, so
+	both flags together write an empty trace.
+
+	Returns:
+		status code (MStatus): kSuccess if the command was successful,
+			kFailure if an error occured during the command
+
+	*/
+	MStatus status;
+
+	std::vector<ShakeNode *> nodes;
+	MItSelectionList itSelList(_selList, MFn::kDependencyNode);
+	while (!itSelList.isDone()) {
+		MObject nodeObj;
+		itSelList.getDependNode(nodeObj);
+		ShakeNode *node = dynamic_cast<ShakeNode *>(MFnDependencyNode(nodeObj).userNode());
+		if (node != nullptr) {
+			nodes.push_back(node);
+		}
+		itSelList.next();
+	}
+
+	std::vector<ShakeNode *> sceneNodes;
+	if (nodes.empty()) {
+		for (MItDependencyNodes itNodes(MFn::kPluginDependNode); !itNodes.isDone(); itNodes.next()) {
+			ShakeNode *node = dynamic_cast<ShakeNode *>(MFnDependencyNode(itNodes.thisNode()).userNode());
+			if (node != nullptr) {
+				sceneNodes.push_back(node);
+			}
+		}
+	}
+
+	if (_resetStats) {
+		for (ShakeNode *node : nodes.empty() ? sceneNodes : nodes) {
+			node->profileCounters().reset();
+		}
+	}
+
+	if (_traceStart) {
+		ShakeTrace::start();
+	}
+	if (!_traceDumpPath.empty()) {
+		std::string error;
+		if (!ShakeTrace::write(_traceDumpPath, &error)) {
+			MGlobal::displayError(error.c_str());
 			return MS::kFailure;
 		}
-		// Check if _shakeName was specified in the flag name
-		if (_shakeName == "Shake") {
-			std::string shakeAttrShort = _shakeAttribute.substr(0, 3);
-			shakeAttrShort[0] = toupper(shakeAttrShort[0]);
-			_shakeName = std::string(nodeFn.name().asChar()) + shakeAttrShort + _shakeName;
+	}
+
+	if (_stats) {
+		std::vector<ShakeProfileStats> stats;
+		if (nodes.empty()) {
+			stats.emplace_back();
+			for (ShakeNode *node : sceneNodes) {
+				stats.back() += node->profileCounters().stats();
+			}
 		}
-		status = _createShakeNode(_shakeName, "linear");
-		CHECK_MSTATUS_AND_RETURN_IT(status);
-		MFnDependencyNode shakeFn(_shakeObj);
-		_shakeInPlug = shakeFn.findPlug("inTime", false);
-		_shakeOutPlug = shakeFn.findPlug("output", false);
+		for (ShakeNode *node : nodes) {
+			stats.push_back(node->profileCounters().stats());
+		}
+		MDoubleArray result;
+		for (const ShakeProfileStats &nodeStats : stats) {
+			result.append((double) nodeStats.computeCalls);
+			result.append((double) nodeStats.cacheHits);
+			result.append(nodeStats.totalSeconds * 1000.0);
+			result.append(nodeStats.maxSeconds * 1000.0);
+			result.append((double) nodeStats.layersEvaluated);
+			result.append((double) nodeStats.layersSkipped);
+		}
+		setResult(result);
 	}
 
 	return MS::kSuccess;
@@ -228,28 +1004,38 @@ MStatus ShakeCommand::doIt(const MArgList& argList) {
 	status = gatherFlagArguments(argList);
 	CHECK_MSTATUS_AND_RETURN_IT(status);
 
+	// Profiling modes only read or reset counters, they work without any selection
+	if (_profile) {
+		return _profileShakes();
+	}
+
 	status = _validateNodes();
 	CHECK_MSTATUS_AND_RETURN_IT(status);
 
+	// Bake mode does its work right away, keys can only be added to existing curves
+	if (_bake) {
+		return _bakeShakes();
+	}
+
 	status = _getTime1Output();
 	CHECK_MSTATUS_AND_RETURN_IT(status);
 
-	// For Loop
-	MItSelectionList itSelList(_selList, MFn::kDependencyNode);
-	while (!itSelList.isDone()) {
-		itSelList.getDependNode(_nodeObj);
-
+	if (_array) {
+		status = _setupArrayShake();
+	} else {
 		status = _setupShake();
-		CHECK_MSTATUS_AND_RETURN_IT(status);
+	}
+	CHECK_MSTATUS_AND_RETURN_IT(status);
 
-		// Connect the attributes
-		_dgMod.connect(_timeOutPlug, _shakeInPlug);
-		_dgMod.connect(_shakeOutPlug, _nodeInPlug);
+	status = redoIt();
+	CHECK_MSTATUS_AND_RETURN_IT(status);
 
-		itSelList.next();
+	// Names are only final once the modifier ran, Maya makes clashing names unique
+	for (unsigned int i = 0; i < _shakeObjs.length(); ++i) {
+		appendToResult(MFnDependencyNode(_shakeObjs[i]).name());
 	}
 
-	return redoIt();
+	return MS::kSuccess;
 }
 
 MStatus ShakeCommand::redoIt() {
@@ -268,6 +1054,11 @@ MStatus ShakeCommand::redoIt() {
 	status = _dgMod.doIt();
 	CHECK_MSTATUS_AND_RETURN_IT(status);
 
+	if (_bake) {
+		status = _animCurveChange.redoIt();
+		CHECK_MSTATUS_AND_RETURN_IT(status);
+	}
+
 	return MS::kSuccess;
 }
 
@@ -285,6 +1076,11 @@ MStatus ShakeCommand::undoIt() {
 	MStatus status;
 
 	// Restore the initial state
+	if (_bake) {
+		status = _animCurveChange.undoIt();
+		CHECK_MSTATUS_AND_RETURN_IT(status);
+	}
+
 	status = _dgMod.undoIt();
 	CHECK_MSTATUS_AND_RETURN_IT(status);
 
@@ -1,7 +1,10 @@
 #pragma once
 
 // System Includes
+#include <algorithm>
 #include <string>
+#include <unordered_map>
+#include <vector>
 
 // Maya General Includes
 #include <maya/MGlobal.h>
@@ -12,14 +15,25 @@
 #include <maya/MSelectionList.h>
 #include <maya/MDGModifier.h>
 #include <maya/MTime.h>
+#include <maya/MDGContext.h>
+#include <maya/MDGContextGuard.h>
 #include <maya/MAnimControl.h>
 #include <maya/MString.h>
+#include <maya/MPlugArray.h>
+#include <maya/MObjectArray.h>
+#include <maya/MTimeArray.h>
+#include <maya/MDoubleArray.h>
+#include <maya/MAnimCurveChange.h>
+#include <maya/MTypeId.h>
 
 // Function Sets
 #include <maya/MFnDependencyNode.h>
+#include <maya/MFnAnimCurve.h>
+#include <maya/MFnAttribute.h>
 
 // Iterators
 #include <maya/MItSelectionList.h>
+#include <maya/MItDependencyNodes.h>
 
 // Proxies
 #include <maya/MPxCommand.h>
@@ -30,14 +44,14 @@ class ShakeCommand: public MPxCommand {
 
 public:
 	// Constructors
-	ShakeCommand(): MPxCommand(), _shakeName("Shake"), _shakeAttribute("rotate") {};
+	ShakeCommand(): MPxCommand(), _shakeName("Shake"), _shakeAttribute("rotate"), _bake(false), _bakeStart(0.0), _bakeEnd(0.0), _bakeStep(1.0), _array(false), _matrix(false), _profile(false), _stats(false), _resetStats(false), _traceStart(false) {};
 
 	// Destructor
 	virtual ~ShakeCommand() override;
 
 	// Public Methods
 	static void *creator() {return new ShakeCommand();}
-	virtual bool isUndoable() const {return true;}
+	virtual bool isUndoable() const {return !_profile;}
 	static MSyntax syntaxCreator();
 	virtual MStatus doIt(const MArgList &argList);
 	virtual MStatus redoIt();
@@ -53,6 +67,36 @@ public:
 	static const char *attributeFlagShort;
 	static const char *attributeFlagLong;
 
+	static const char *bakeFlagShort;
+	static const char *bakeFlagLong;
+
+	static const char *startFlagShort;
+	static const char *startFlagLong;
+
+	static const char *endFlagShort;
+	static const char *endFlagLong;
+
+	static const char *stepFlagShort;
+	static const char *stepFlagLong;
+
+	static const char *arrayFlagShort;
+	static const char *arrayFlagLong;
+
+	static const char *matrixFlagShort;
+	static const char *matrixFlagLong;
+
+	static const char *statsFlagShort;
+	static const char *statsFlagLong;
+
+	static const char *resetStatsFlagShort;
+	static const char *resetStatsFlagLong;
+
+	static const char *traceStartFlagShort;
+	static const char *traceStartFlagLong;
+
+	static const char *traceDumpFlagShort;
+	static const char *traceDumpFlagLong;
+
 	static const char *helpFlagShort;
 	static const char *helpFlagLong;
 
@@ -61,21 +105,40 @@ private:
 	MStatus gatherFlagArguments(const MArgList &argList);
 	MStatus _getTime1Output();
 	MStatus _validateNodes();
-	MStatus _createShakeNode(std::string name, std::string output);
+	MStatus _findTargetPlug(const MObject &nodeObj, MPlug &targetPlug, std::string &error);
+	std::string _shakeNodeName(const MFnDependencyNode &nodeFn) const;
+	void _reportSkippedNodes(const std::vector<std::string> &skipped, unsigned int numNodes) const;
 	MStatus _setupShake();
+	MStatus _setupArrayShake();
+	MStatus _gatherBakeTargets(MObjectArray &shakeObjs, MPlugArray &elementPlugs);
+	MStatus _bakeShakes();
+	MStatus _profileShakes();
 
 	// Private Data
 	std::string _shakeName;
 	std::string _shakeAttribute;
 
+	bool _bake;
+	double _bakeStart;
+	double _bakeEnd;
+	double _bakeStep;
+	MAnimCurveChange _animCurveChange;
+
+	bool _array;
+	bool _matrix;
+
+	bool _profile;
+	bool _stats;
+	bool _resetStats;
+	bool _traceStart;
+	std::string _traceDumpPath;
+
 	MPlug _timeOutPlug;
 
-	MObject _nodeObj;
-	MPlug _nodeInPlug;
+	// Attribute driven on each node type, only static attributes are cached
+	std::unordered_map<std::string, MObject> _targetAttributes;
 
-	MObject _shakeObj;
-	MPlug _shakeInPlug;
-	MPlug _shakeOutPlug;
+	MObjectArray _shakeObjs;
 
 	MSelectionList _selList;
 	MDGModifier _dgMod;
@@ -0,0 +1,209 @@
+#include "shakeCurveCache.h"
+
+// System Includes
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <mutex>
+
+
+
+void ShakeCurveCache::build(const ShakeLayerStack &layers, NoisePrecision precision, NoiseEngine engine, double start, double end, int samplesPerFrame) {
+  /* Samples the layers over the frame range.
+
+  The table resolution is samplesPerFrame, raised to minSamplesPerFrame of the
+  layers if that is higher. One extra sample is stored on each side of the range so
+  the cubic interpolation has neighbours for the first and last interval. If the
+  resolution would have to be raised above maxSamplesPerFrame, or the table would
+  hold more than maxSamples samples, it is left empty. The cache is then still
+  valid for these settings but every lookup fails.
+
+  Args:
+    layers (ShakeLayerStack): Layers to bake, layers with a weight of 0 are skipped
+    precision (NoisePrecision): Floating point precision of the noise kernel
+    engine (NoiseEngine): Lattice noise evaluated by the kernel
+    start (double): First frame of the range
+    end (double): Last frame of the range
+    samplesPerFrame (int): Requested sub-frame resolution of the table
+
+  */
+  unsigned int generation = _generation;
+  double rangeStart = start;
+  double rangeEnd = std::max(start, end);
+  int requestedSamplesPerFrame = std::max(1, samplesPerFrame);
+  int rangeSamplesPerFrame = std::max(requestedSamplesPerFrame, minSamplesPerFrame(layers));
+  double step = 1.0 / rangeSamplesPerFrame;
+
+  double numIntervals = std::max(1.0, std::ceil((rangeEnd - rangeStart) * rangeSamplesPerFrame));
+  std::vector<double> samples;
+  bool raisable = rangeSamplesPerFrame <= std::max(requestedSamplesPerFrame, maxSamplesPerFrame);
+  if (raisable && numIntervals + 3.0 <= (double) maxSamples) {
+    std::size_t numSamples = (std::size_t) numIntervals + 3;
+    std::vector<double> times(numSamples);
+    for (std::size_t i = 0; i < numSamples; ++i) {
+      times[i] = rangeStart + ((double) i - 1.0) * step;
+    }
+    samples.assign(3 * numSamples, 0.0);
+    PerlinNoise::accumulateShakeStackSamples(layers, times.data(), numSamples, samples.data(), precision, engine);
+  }
+
+  std::unique_lock<std::shared_mutex> lock(_mutex);
+  _start = rangeStart;
+  _end = rangeEnd;
+  _requestedSamplesPerFrame = requestedSamplesPerFrame;
+  _samplesPerFrame = rangeSamplesPerFrame;
+  _step = step;
+  _samples.swap(samples);
+  _valid = generation == _generation;
+}
+
+bool ShakeCurveCache::lookup(double time, double result[3]) const {
+  /* Interpolates the baked curve at the given time.
+
+  Uses a Catmull-Rom spline through the four surrounding samples, so the curve and
+  its velocity stay continuous. Times that fall on a sample return it exactly,
+  including the end of the range.
+
+  Args:
+    time (double): Time to evaluate
+    result (double[3]): Receives the X, Y and Z values
+
+  Returns:
+    bool: False if the cache is not valid, holds no table or time is outside the baked range
+
+  */
+  std::shared_lock<std::shared_mutex> lock(_mutex);
+  if (!_valid || _samples.empty() || !(time >= _start && time <= _end)) {
+    return false;
+  }
+
+  std::size_t numIntervals = _samples.size() / 3 - 3;
+  double position = (time - _start) * _samplesPerFrame;
+  std::size_t index = std::min((std::size_t) position, numIntervals - 1);
+  double valT = position - (double) index;
+  double valT2 = valT * valT;
+  double valT3 = valT2 * valT;
+
+  // Samples i-1, i, i+1 and i+2 are stored shifted by the leading padding sample
+  const double *p0 = &_samples[3 * index];
+  const double *p1 = p0 + 3;
+  const double *p2 = p0 + 6;
+  const double *p3 = p0 + 9;
+  if (valT == 1.0) {
+    // Last frame of the range, return the sample exactly like every other sample
+    std::copy(p2, p2 + 3, result);
+    return true;
+  }
+  for (int axis = 0; axis < 3; ++axis) {
+    result[axis] = 0.5 * (2.0 * p1[axis] +
+      (p2[axis] - p0[axis]) * valT +
+      (2.0 * p0[axis] - 5.0 * p1[axis] + 4.0 * p2[axis] - p3[axis]) * valT2 +
+      (3.0 * (p1[axis] - p2[axis]) + p3[axis] - p0[axis]) * valT3);
+  }
+
+  return true;
+}
+
+bool ShakeCurveCache::isValid(double start, double end, int samplesPerFrame) const {
+  /* Checks if the cache holds a bake of the given range and resolution.
+
+  Args:
+    start (double): First frame of the range
+    end (double): Last frame of the range
+    samplesPerFrame (int): Requested sub-frame resolution of the table
+
+  Returns:
+    bool: True if the cache was built for these settings and the current layers
+
+  */
+  std::shared_lock<std::shared_mutex> lock(_mutex);
+  return _valid && _start == start && _end == std::max(start, end) && _requestedSamplesPerFrame == std::max(1, samplesPerFrame);
+}
+
+void ShakeCurveCache::invalidate() {
+  /* Marks the cache as outdated, the next evaluation has to rebuild it.
+
+  Only clears the atomic flag, so it never blocks and can be called while dirty
+  propagation runs on other threads.
+
+  */
+  ++_generation;
+  _valid = false;
+}
+
+int ShakeCurveCache::samplesPerFrame() const {
+  /* Resolution of the current table, 0 before the first build.
+
+  Also set when the table was too large to be baked, it is then the resolution the
+  layers would have needed.
+
+  */
+  std::shared_lock<std::shared_mutex> lock(_mutex);
+  return _samplesPerFrame;
+}
+
+std::size_t ShakeCurveCache::numBytes() const {
+  /* Memory held by the current table, 0 if it was too large to be baked. */
+  std::shared_lock<std::shared_mutex> lock(_mutex);
+  return _samples.size() * sizeof(double);
+}
+
+int ShakeCurveCache::minSamplesPerFrame(const ShakeLayerStack &layers) {
+  /* Lowest table resolution that keeps lookups within maxInterpolationError.
+
+  Every band, the base and fractal band of a classic layer or an octave of an fBm
+  layer, moves |frequency| lattice cells per frame. The Catmull-Rom error of a band
+  grows with the cube of its cells per sample, so a band with the share a of the
+  amplitude of its n bands gets samplesPerCell * cbrt(n * a) samples per cell, which
+  splits the error evenly between the bands. Quiet high octaves need far fewer
+  samples than the fractal band of a classic layer.
+
+  Args:
+    layers (ShakeLayerStack): Layers to bake, layers with a weight of 0 are skipped
+
+  Returns:
+    int: Samples per frame, at least 1
+
+  */
+  double bandFrequencies[PerlinNoise::fbmMaxOctaves];
+  double bandAmplitudes[PerlinNoise::fbmMaxOctaves];
+  double minSamples = 1.0;
+  for (std::size_t index = 0; index < layers.size(); ++index) {
+    if (layers.weight[index] == 0) {
+      continue;
+    }
+    const ShakeLayer layer = layers.layer(index);
+    const double strength = std::max({std::fabs(layer.strength[0]), std::fabs(layer.strength[1]), std::fabs(layer.strength[2])});
+    int numBands = 0;
+    if (layer.fractalMode == FractalMode::kFbm) {
+      double frequency = layer.frequency * 0.078;
+      double amplitude = strength;
+      for (int octave = 0; octave < PerlinNoise::fbmOctaveCount(layer); ++octave) {
+        bandFrequencies[numBands] = frequency;
+        bandAmplitudes[numBands++] = amplitude;
+        frequency *= layer.lacunarity;
+        amplitude *= std::fabs(layer.gain);
+      }
+    } else {
+      bandFrequencies[numBands] = layer.frequency * 0.078;
+      bandAmplitudes[numBands++] = strength;
+      bandFrequencies[numBands] = 2 * (layer.frequency + 0.067);
+      bandAmplitudes[numBands++] = std::fabs(layer.fractal) * (layer.rough + 0.084) * 3.3;
+    }
+
+    double layerAmplitude = 0.0;
+    for (int band = 0; band < numBands; ++band) {
+      layerAmplitude += bandAmplitudes[band];
+    }
+    if (!(layerAmplitude > 0.0)) {
+      continue;
+    }
+    for (int band = 0; band < numBands; ++band) {
+      double share = numBands * bandAmplitudes[band] / layerAmplitude;
+      minSamples = std::max(minSamples, samplesPerCell * std::fabs(bandFrequencies[band]) * std::cbrt(share));
+    }
+  }
+
+  // Beyond the int range the table could never be built anyway
+  return minSamples < (double) std::numeric_limits<int>::max() ? (int) std::ceil(minSamples) : std::numeric_limits<int>::max();
+}
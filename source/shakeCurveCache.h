@@ -0,0 +1,77 @@
+#pragma once
+
+#include "perlinNoise.h"
+
+// System Includes
+#include <atomic>
+#include <cstddef>
+#include <shared_mutex>
+#include <vector>
+
+
+
+class ShakeCurveCache {
+  /* Baked XYZ shake curve sampled over a frame range.
+
+  The output of a shake is a pure function of time and the layer parameters, so it
+  can be sampled once over a frame range and afterwards served by an interpolated
+  table lookup. The owner is responsible for invalidating the cache whenever one of
+  the layer parameters changes.
+
+  The table is sampled at least at minSamplesPerFrame of the layers, so lookups
+  stay within maxInterpolationError of the live evaluation. The resolution is
+  raised to at most maxSamplesPerFrame, and the table holds at most maxSamples
+  samples. Stacks that would need more are not baked, lookups then always fail
+  and the owner evaluates live.
+
+  A build evaluates the whole range at once, so it costs as much as playing every
+  sample of the table live and holds 24 bytes per sample.
+
+  All methods are safe to call concurrently. Lookups share a read lock, a build
+  samples into a new table first and only locks exclusively to swap it in. A build
+  that overlaps an invalidate does not mark the cache valid.
+
+  */
+
+public:
+  // Constructors
+  ShakeCurveCache(): _valid(false), _generation(0), _start(0.0), _end(0.0), _requestedSamplesPerFrame(0), _samplesPerFrame(0), _step(1.0) {};
+
+  // Public Methods
+  void build(const ShakeLayerStack &layers, NoisePrecision precision, NoiseEngine engine, double start, double end, int samplesPerFrame);
+  bool lookup(double time, double result[3]) const;
+  bool isValid(double start, double end, int samplesPerFrame) const;
+  void invalidate();
+  int samplesPerFrame() const;
+  std::size_t numBytes() const;
+  static int minSamplesPerFrame(const ShakeLayerStack &layers);
+
+  // Public Data
+  // Samples per lattice cell of the fastest band, the Catmull-Rom error of a band falls
+  // with the cube of its lattice cells per sample and is below 2e-4 of its amplitude here
+  static constexpr double samplesPerCell = 32.0;
+
+  // Largest difference between a lookup and the live evaluation, relative to the
+  // amplitude of the stack, the sum of weight * (|strength| + fractal * (rough + 0.084) * 3.3)
+  // of its layers, or weight * |strength| * sum(gain^octave) in fBm mode
+  static constexpr double maxInterpolationError = 1.0e-3;
+
+  // Highest resolution a build raises the requested one to, enough for a classic layer
+  // with a fractal band up to a frequency of about 15
+  static constexpr int maxSamplesPerFrame = 1024;
+
+  // Largest table that is baked, 6 MB
+  static constexpr std::size_t maxSamples = std::size_t(1) << 18;
+
+private:
+  // Private Data
+  std::atomic<bool> _valid;
+  std::atomic<unsigned int> _generation;
+  double _start;
+  double _end;
+  int _requestedSamplesPerFrame;
+  int _samplesPerFrame;
+  double _step;
+  std::vector<double> _samples;
+  mutable std::shared_mutex _mutex;
+};
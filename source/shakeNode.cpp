@@ -5,10 +5,13 @@
 // Node's attributes
 const MString ShakeNode::typeName("shakeNode");
 const MTypeId ShakeNode::typeId(0x00122710);
+int ShakeNode::profilerCategory = 0;
 
 // Node's input attributes
 MObject ShakeNode::enableAttr;
 MObject ShakeNode::inTimeAttr;
+MObject ShakeNode::precisionAttr;
+MObject ShakeNode::noiseEngineAttr;
 MObject ShakeNode::weightAttr;
 MObject ShakeNode::seedAttr;
 MObject ShakeNode::frequencyAttr;
@@ -18,13 +21,41 @@ MObject ShakeNode::strengthAttrZ;
 MObject ShakeNode::strengthAttr;
 MObject ShakeNode::fractalAttr;
 MObject ShakeNode::roughnessAttr;
+MObject ShakeNode::fractalModeAttr;
+MObject ShakeNode::octavesAttr;
+MObject ShakeNode::lacunarityAttr;
+MObject ShakeNode::gainAttr;
 MObject ShakeNode::shakeAttr;
+MObject ShakeNode::cacheEnableAttr;
+MObject ShakeNode::cacheStartAttr;
+MObject ShakeNode::cacheEndAttr;
+MObject ShakeNode::cacheSamplesAttr;
+MObject ShakeNode::cacheFileAttr;
+MObject ShakeNode::cacheFileShakeAttr;
+MObject ShakeNode::shutterSamplesAttr;
+MObject ShakeNode::shutterOpenAttr;
+MObject ShakeNode::shutterCloseAttr;
+MObject ShakeNode::errorBudgetAttr;
  
 // Node's output attributes
 MObject ShakeNode::outputAttrX;
 MObject ShakeNode::outputAttrY;
 MObject ShakeNode::outputAttrZ;
 MObject ShakeNode::outputAttr;
+MObject ShakeNode::outputVelocityAttrX;
+MObject ShakeNode::outputVelocityAttrY;
+MObject ShakeNode::outputVelocityAttrZ;
+MObject ShakeNode::outputVelocityAttr;
+MObject ShakeNode::outputAccelerationAttrX;
+MObject ShakeNode::outputAccelerationAttrY;
+MObject ShakeNode::outputAccelerationAttrZ;
+MObject ShakeNode::outputAccelerationAttr;
+MObject ShakeNode::outputSamplesAttrX;
+MObject ShakeNode::outputSamplesAttrY;
+MObject ShakeNode::outputSamplesAttrZ;
+MObject ShakeNode::outputSamplesAttr;
+MObject ShakeNode::culledLayersAttr;
+MObject ShakeNode::culledBandsAttr;
 
 
 
@@ -45,7 +76,10 @@ MStatus ShakeNode::initialize() {
 	*/
 	MStatus status;
 	MFnNumericAttribute nAttr;
+	MFnEnumAttribute eAttr;
 	MFnUnitAttribute uAttr;
+	MFnTypedAttribute tAttr;
+	MFnStringData stringData;
 	MFnCompoundAttribute cAttr;
 
 	enableAttr = nAttr.create("enable", "ena", MFnNumericData::kBoolean, 1);
@@ -56,6 +90,17 @@ MStatus ShakeNode::initialize() {
 	uAttr.setKeyable(true);
 	uAttr.setReadable(false);
 
+	precisionAttr = eAttr.create("precision", "prc", static_cast<short>(kDefaultNoisePrecision));
+	eAttr.addField("Double", static_cast<short>(NoisePrecision::kDouble));
+	eAttr.addField("Single", static_cast<short>(NoisePrecision::kSingle));
+	eAttr.setReadable(false);
+
+	noiseEngineAttr = eAttr.create("noiseEngine", "nen", static_cast<short>(NoiseEngine::kPerlin));
+	eAttr.addField("Perlin", static_cast<short>(NoiseEngine::kPerlin));
+	eAttr.addField("Gradient1D", static_cast<short>(NoiseEngine::kGradient1D));
+	eAttr.addField("Hash", static_cast<short>(NoiseEngine::kHash));
+	eAttr.setReadable(false);
+
 	weightAttr = nAttr.create("weight", "wgt", MFnNumericData::kDouble, 1.0);
 	nAttr.setMin(0);
 	nAttr.setMax(1);
@@ -80,6 +125,22 @@ MStatus ShakeNode::initialize() {
 	nAttr.setMin(0);
 	nAttr.setMax(1);
 
+	fractalModeAttr = eAttr.create("fractalMode", "frm", static_cast<short>(FractalMode::kClassic));
+	eAttr.addField("Classic", static_cast<short>(FractalMode::kClassic));
+	eAttr.addField("fBm", static_cast<short>(FractalMode::kFbm));
+
+	octavesAttr = nAttr.create("octaves", "oct", MFnNumericData::kInt, 4);
+	nAttr.setMin(1);
+	nAttr.setMax(PerlinNoise::fbmMaxOctaves);
+
+	lacunarityAttr = nAttr.create("lacunarity", "lac", MFnNumericData::kDouble, 2.0);
+	nAttr.setMin(1);
+	nAttr.setSoftMax(4);
+
+	gainAttr = nAttr.create("gain", "gan", MFnNumericData::kDouble, 0.5);
+	nAttr.setMin(0);
+	nAttr.setMax(1);
+
 	/* shakeAttr:
 	-- shake
 		 | -- weight
@@ -88,6 +149,10 @@ MStatus ShakeNode::initialize() {
 		 | -- strength X Y Z
 		 | -- fractal
 		 | -- roughness
+		 | -- fractalMode
+		 | -- octaves
+		 | -- lacunarity
+		 | -- gain
 	*/
 	shakeAttr = cAttr.create("shakeLayer", "shk");
 	cAttr.addChild(weightAttr);
@@ -96,24 +161,136 @@ MStatus ShakeNode::initialize() {
 	cAttr.addChild(strengthAttr);
 	cAttr.addChild(fractalAttr);
 	cAttr.addChild(roughnessAttr);
+	cAttr.addChild(fractalModeAttr);
+	cAttr.addChild(octavesAttr);
+	cAttr.addChild(lacunarityAttr);
+	cAttr.addChild(gainAttr);
 	cAttr.setArray(true);
 	cAttr.setKeyable(true);
 	cAttr.setReadable(false);
 
+	// The first evaluation after enabling the cache, or after changing a layer, bakes the
+	// whole cacheStart to cacheEnd range synchronously in compute, at 24 bytes per sample
+	cacheEnableAttr = nAttr.create("cacheEnable", "cen", MFnNumericData::kBoolean, 0);
+	nAttr.setReadable(false);
+
+	cacheStartAttr = nAttr.create("cacheStart", "cst", MFnNumericData::kDouble, 1.0);
+	nAttr.setReadable(false);
+
+	cacheEndAttr = nAttr.create("cacheEnd", "cnd", MFnNumericData::kDouble, 120.0);
+	nAttr.setReadable(false);
+
+	// Lowest resolution, raised with a warning up to ShakeCurveCache::maxSamplesPerFrame for
+	// fast layers, a fractal band at frequency 10 needs about 800 samples per frame
+	cacheSamplesAttr = nAttr.create("cacheSamplesPerFrame", "csp", MFnNumericData::kInt, 4);
+	nAttr.setMin(1);
+	nAttr.setSoftMax(16);
+	nAttr.setReadable(false);
+
+	cacheFileAttr = tAttr.create("cacheFile", "cfl", MFnData::kString, stringData.create(""));
+	tAttr.setUsedAsFilename(true);
+	tAttr.setReadable(false);
+
+	cacheFileShakeAttr = nAttr.create("cacheFileShake", "cfs", MFnNumericData::kInt, 0);
+	nAttr.setMin(0);
+	nAttr.setReadable(false);
+
+	shutterSamplesAttr = nAttr.create("shutterSamples", "shs", MFnNumericData::kInt, 3);
+	nAttr.setMin(1);
+	nAttr.setSoftMax(16);
+	nAttr.setReadable(false);
+
+	shutterOpenAttr = nAttr.create("shutterOpen", "sho", MFnNumericData::kDouble, -0.25);
+	nAttr.setReadable(false);
+
+	shutterCloseAttr = nAttr.create("shutterClose", "shc", MFnNumericData::kDouble, 0.25);
+	nAttr.setReadable(false);
+
+	errorBudgetAttr = nAttr.create("errorBudget", "erb", MFnNumericData::kDouble, 0.0);
+	nAttr.setMin(0);
+	nAttr.setSoftMax(1);
+	nAttr.setReadable(false);
+
 	outputAttrX = nAttr.create("outputX", "outX", MFnNumericData::kDouble, 0.0);
 	outputAttrY = nAttr.create("outputY", "outY", MFnNumericData::kDouble, 0.0);
 	outputAttrZ = nAttr.create("outputZ", "outZ", MFnNumericData::kDouble, 0.0);
 	outputAttr = nAttr.create("output", "out", outputAttrX, outputAttrY, outputAttrZ);
 	nAttr.setWritable(false);
 
+	outputVelocityAttrX = nAttr.create("outputVelocityX", "ovlX", MFnNumericData::kDouble, 0.0);
+	outputVelocityAttrY = nAttr.create("outputVelocityY", "ovlY", MFnNumericData::kDouble, 0.0);
+	outputVelocityAttrZ = nAttr.create("outputVelocityZ", "ovlZ", MFnNumericData::kDouble, 0.0);
+	outputVelocityAttr = nAttr.create("outputVelocity", "ovl", outputVelocityAttrX, outputVelocityAttrY, outputVelocityAttrZ);
+	nAttr.setWritable(false);
+	nAttr.setStorable(false);
+
+	outputAccelerationAttrX = nAttr.create("outputAccelerationX", "oacX", MFnNumericData::kDouble, 0.0);
+	outputAccelerationAttrY = nAttr.create("outputAccelerationY", "oacY", MFnNumericData::kDouble, 0.0);
+	outputAccelerationAttrZ = nAttr.create("outputAccelerationZ", "oacZ", MFnNumericData::kDouble, 0.0);
+	outputAccelerationAttr = nAttr.create("outputAcceleration", "oac", outputAccelerationAttrX, outputAccelerationAttrY, outputAccelerationAttrZ);
+	nAttr.setWritable(false);
+	nAttr.setStorable(false);
+
+	outputSamplesAttrX = nAttr.create("outputSamplesX", "osmX", MFnNumericData::kDouble, 0.0);
+	outputSamplesAttrY = nAttr.create("outputSamplesY", "osmY", MFnNumericData::kDouble, 0.0);
+	outputSamplesAttrZ = nAttr.create("outputSamplesZ", "osmZ", MFnNumericData::kDouble, 0.0);
+	outputSamplesAttr = nAttr.create("outputSamples", "osm", outputSamplesAttrX, outputSamplesAttrY, outputSamplesAttrZ);
+	nAttr.setArray(true);
+	nAttr.setUsesArrayDataBuilder(true);
+	nAttr.setWritable(false);
+	nAttr.setStorable(false);
+
+	culledLayersAttr = nAttr.create("culledLayers", "cly", MFnNumericData::kInt, 0);
+	nAttr.setWritable(false);
+	nAttr.setStorable(false);
+
+	culledBandsAttr = nAttr.create("culledBands", "cbd", MFnNumericData::kInt, 0);
+	nAttr.setWritable(false);
+	nAttr.setStorable(false);
+
 	addAttribute(enableAttr);
 	addAttribute(inTimeAttr);
+	addAttribute(precisionAttr);
+	addAttribute(noiseEngineAttr);
 	addAttribute(shakeAttr);
+	addAttribute(cacheEnableAttr);
+	addAttribute(cacheStartAttr);
+	addAttribute(cacheEndAttr);
+	addAttribute(cacheSamplesAttr);
+	addAttribute(cacheFileAttr);
+	addAttribute(cacheFileShakeAttr);
+	addAttribute(shutterSamplesAttr);
+	addAttribute(shutterOpenAttr);
+	addAttribute(shutterCloseAttr);
+	addAttribute(errorBudgetAttr);
 	addAttribute(outputAttr);
-
-	attributeAffects(enableAttr, outputAttr);
-	attributeAffects(inTimeAttr, outputAttr);
-	attributeAffects(shakeAttr, outputAttr);
+	addAttribute(outputVelocityAttr);
+	addAttribute(outputAccelerationAttr);
+	addAttribute(outputSamplesAttr);
+	addAttribute(culledLayersAttr);
+	addAttribute(culledBandsAttr);
+
+	for (const MObject *output : {&outputAttr, &outputVelocityAttr, &outputAccelerationAttr, &outputSamplesAttr}) {
+		attributeAffects(enableAttr, *output);
+		attributeAffects(inTimeAttr, *output);
+		attributeAffects(precisionAttr, *output);
+		attributeAffects(noiseEngineAttr, *output);
+		attributeAffects(shakeAttr, *output);
+		attributeAffects(errorBudgetAttr, *output);
+		attributeAffects(cacheEnableAttr, *output);
+		attributeAffects(cacheStartAttr, *output);
+		attributeAffects(cacheEndAttr, *output);
+		attributeAffects(cacheSamplesAttr, *output);
+		attributeAffects(cacheFileAttr, *output);
+		attributeAffects(cacheFileShakeAttr, *output);
+	}
+	attributeAffects(shutterSamplesAttr, outputSamplesAttr);
+	attributeAffects(shutterOpenAttr, outputSamplesAttr);
+	attributeAffects(shutterCloseAttr, outputSamplesAttr);
+	for (const MObject *output : {&culledLayersAttr, &culledBandsAttr}) {
+		attributeAffects(shakeAttr, *output);
+		attributeAffects(errorBudgetAttr, *output);
+	}
 
 	return MS::kSuccess;
 }
@@ -149,43 +326,241 @@ MStatus ShakeNode::compute(const MPlug &plug, MDataBlock &dataBlock) {
 	*/
 	MStatus status;
 
-	bool enable = dataBlock.inputValue(enableAttr, &status).asBool();
-	if (enable == 0) {
+	if (isCullPlug<ShakeNode>(plug)) {
+		ShakeCullStats cullStats;
+		layerStack<ShakeNode>(dataBlock, &cullStats);
+		return writeCullStats(dataBlock, culledLayersAttr, culledBandsAttr, cullStats);
+	}
+
+	ShakeComputeScope computeScope(*this, typeName.asChar());
+
+	if (isSamplesPlug<ShakeNode>(plug)) {
+		thread_local std::vector<unsigned int> indices;
+		thread_local std::vector<double> results;
+		if (evaluateShakeSamples<ShakeNode>(dataBlock, indices, results)) {
+			status = writeOutputArray(dataBlock, outputSamplesAttr, indices, results, 1.0);
+			CHECK_MSTATUS_AND_RETURN_IT(status);
+		}
 		dataBlock.setClean(plug);
-	} else {
-		MArrayDataHandle shakeLayersDH = dataBlock.inputArrayValue(shakeAttr, &status);
-		unsigned int numShakeLayers = shakeLayersDH.elementCount();
-		if (numShakeLayers == 0) {
-			dataBlock.setClean(plug);
+		return MS::kSuccess;
+	}
+
+	double result[3];
+	double velocity[3];
+	double acceleration[3];
+	bool derivatives = isDerivativePlug<ShakeNode>(plug);
+	if (evaluateShake<ShakeNode>(dataBlock, result, derivatives ? velocity : nullptr, derivatives ? acceleration : nullptr)) {
+		MDataHandle outputDH = dataBlock.outputValue(outputAttr, &status);
+		outputDH.set3Double(result[0], result[1], result[2]);
+		outputDH.setClean();
+		if (derivatives) {
+			MDataHandle velocityDH = dataBlock.outputValue(outputVelocityAttr, &status);
+			velocityDH.set3Double(velocity[0], velocity[1], velocity[2]);
+			velocityDH.setClean();
+			MDataHandle accelerationDH = dataBlock.outputValue(outputAccelerationAttr, &status);
+			accelerationDH.set3Double(acceleration[0], acceleration[1], acceleration[2]);
+			accelerationDH.setClean();
 		}
-		else {
-			double uiTime = dataBlock.inputValue(inTimeAttr, &status).asTime().asUnits(MTime::uiUnit());
-			double resultX = 0, resultY = 0, resultZ = 0;
-			PerlinNoise ipNoise;
-			for (unsigned int i = 0; i < numShakeLayers; ++i) {
-				shakeLayersDH.jumpToArrayElement(i);
-				MDataHandle shakeLayerDH = shakeLayersDH.inputValue();
-				double weight = shakeLayerDH.child(weightAttr).asDouble();
-				if (weight != 0) {
-					int seed = shakeLayerDH.child(seedAttr).asInt();
-					double freq = shakeLayerDH.child(frequencyAttr).asDouble();
-					MDataHandle strengthDH = shakeLayerDH.child(strengthAttr);
-					double strX = strengthDH.child(strengthAttrX).asDouble();
-					double strY = strengthDH.child(strengthAttrY).asDouble();
-					double strZ = strengthDH.child(strengthAttrZ).asDouble();
-					double fractal = shakeLayerDH.child(fractalAttr).asDouble();
-					double rough = shakeLayerDH.child(roughnessAttr).asDouble();
-					resultX += ipNoise.calculateNoise(weight, uiTime, seed + 13.0, freq, strX, fractal, rough);
-					resultY += ipNoise.calculateNoise(weight, uiTime, seed + 578.0, freq, strY, fractal, rough);
-					resultZ += ipNoise.calculateNoise(weight, uiTime, seed + 1511.0, freq, strZ, fractal, rough);
-				}
-			}
-			MDataHandle outputDH = dataBlock.outputValue(outputAttr, &status);
-			outputDH.set3Double(resultX, resultY, resultZ);
-			outputDH.setClean();
+	}
+	dataBlock.setClean(plug);
+
+	return MS::kSuccess;
+}
+
+MStatus ShakeNode::writeOutputArray(MDataBlock &dataBlock, const MObject &attribute, const std::vector<unsigned int> &indices, const std::vector<double> &results, double scale) {
+	/* Replaces the elements of an output array with the computed shakes.
+
+	Shared by the array outputs of the shake nodes, every element is a double3 or
+	angle3 compound.
+
+	Args:
+		dataBlock (MDataBlock&): Data block containing storage for the node's attributes
+		attribute (MObject&): Output array attribute to write
+		indices (vector<unsigned int>&): Logical index of each element
+		results (vector<double>&): Interleaved X, Y and Z shake of each element
+		scale (double): Multiplier applied to the results, converts degrees for rotations
+
+	Returns:
+		status code (MStatus): kSuccess if the operation was successful,
+			kFailure if an error occured during the operation
+
+	*/
+	MStatus status;
+
+	MArrayDataHandle outputArrayDH = dataBlock.outputArrayValue(attribute, &status);
+	CHECK_MSTATUS_AND_RETURN_IT(status);
+	MArrayDataBuilder outputBuilder(&dataBlock, attribute, (unsigned int) indices.size(), &status);
+	CHECK_MSTATUS_AND_RETURN_IT(status);
+	for (std::size_t i = 0; i < indices.size(); ++i) {
+		MDataHandle outputDH = outputBuilder.addElement(indices[i], &status);
+		CHECK_MSTATUS_AND_RETURN_IT(status);
+		outputDH.set3Double(scale * results[3 * i], scale * results[3 * i + 1], scale * results[3 * i + 2]);
+	}
+	status = outputArrayDH.set(outputBuilder);
+	CHECK_MSTATUS_AND_RETURN_IT(status);
+	outputArrayDH.setAllClean();
+
+	return MS::kSuccess;
+}
+
+MStatus ShakeNode::writeCullStats(MDataBlock &dataBlock, const MObject &culledLayersAttr, const MObject &culledBandsAttr, const ShakeCullStats &stats) {
+	/* Writes what the error budget culled to the culledLayers and culledBands outputs.
+
+	Args:
+		dataBlock (MDataBlock&): Data block containing storage for the node's attributes
+		culledLayersAttr (MObject&): Output receiving the number of culled layers
+		culledBandsAttr (MObject&): Output receiving the number of culled bands
+		stats (ShakeCullStats&): Result of culling the layers of the node
+
+	Returns:
+		status code (MStatus): kSuccess if the operation was successful,
+			kFailure if an error occured during the operation
+
+	*/
+	MStatus status;
+
+	MDataHandle culledLayersDH = dataBlock.outputValue(culledLayersAttr, &status);
+	CHECK_MSTATUS_AND_RETURN_IT(status);
+	culledLayersDH.setInt((int) stats.layersCulled);
+	culledLayersDH.setClean();
+
+	MDataHandle culledBandsDH = dataBlock.outputValue(culledBandsAttr, &status);
+	CHECK_MSTATUS_AND_RETURN_IT(status);
+	culledBandsDH.setInt((int) stats.bandsCulled);
+	culledBandsDH.setClean();
+
+	return MS::kSuccess;
+}
+
+void ShakeNode::warnCurveCacheResolution(int requestedSamplesPerFrame) {
+	/* Warns after a curve cache build that raised cacheSamplesPerFrame or could not bake the layers.
+
+	Each outcome is only reported once, so rebuilding while a layer is dragged does
+	not repeat the same warning.
+
+	Args:
+		requestedSamplesPerFrame (int): Value of cacheSamplesPerFrame the cache was built with
+
+	*/
+	int samplesPerFrame = _curveCache.samplesPerFrame();
+	std::size_t numBytes = _curveCache.numBytes();
+	if (numBytes > 0 && samplesPerFrame <= requestedSamplesPerFrame) {
+		_curveCacheWarning = 0;
+		return;
+	}
+	int warning = numBytes > 0 ? samplesPerFrame : -samplesPerFrame;
+	if (_curveCacheWarning.exchange(warning) == warning) {
+		return;
+	}
+
+	char message[512];
+	if (numBytes > 0) {
+		std::snprintf(message, sizeof(message), "%s: cacheSamplesPerFrame raised from %d to %d to stay within %g%% of the live shake, the cache holds %.1f MB.",
+			name().asChar(), requestedSamplesPerFrame, samplesPerFrame, ShakeCurveCache::maxInterpolationError * 100.0, numBytes / 1048576.0);
+	} else {
+		std::snprintf(message, sizeof(message), "%s: the layers need %d samples per frame, too many to cache from cacheStart to cacheEnd, they are evaluated live.",
+			name().asChar(), samplesPerFrame);
+	}
+	MGlobal::displayWarning(message);
+}
+
+MStatus ShakeNode::setDependentsDirty(const MPlug &plug, MPlugArray &plugArray) {
+	/* Invalidates the layer copy and curve cache when a layer attribute is dirtied,
+	and reopens the cache file when cacheFile is set.
+
+	Args:
+		plug (MPlug&): Plug being dirtied
+		plugArray (MPlugArray&): Extra plugs to mark dirty, left untouched
+
+	Returns:
+		status code (MStatus): kSuccess if the operation was successful,
+			kFailure if an error occured during the operation
+
+	*/
+	invalidateOnDirty<ShakeNode>(plug);
+	if (plug.attribute() == cacheFileAttr) {
+		_cacheFileDirty = true;
+	}
+
+	return MPxNode::setDependentsDirty(plug, plugArray);
+}
+
+MStatus ShakeNode::preEvaluation(const MDGContext &context, const MEvaluationNode &evaluationNode) {
+	/* Invalidates the layer copy, curve cache and cache file before an Evaluation Manager evaluation.
+
+	Args:
+		context (MDGContext&): Context of the evaluation
+		evaluationNode (MEvaluationNode&): Evaluation node holding the dirty plugs
+
+	Returns:
+		status code (MStatus): kSuccess if the operation was successful,
+			kFailure if an error occured during the operation
+
+	*/
+	if (context.isNormal()) {
+		invalidateOnDirty<ShakeNode>(evaluationNode);
+		if (evaluationNode.dirtyPlugExists(cacheFileAttr)) {
+			_cacheFileDirty = true;
 		}
-		dataBlock.setClean(plug);
 	}
 
 	return MS::kSuccess;
 }
+
+
+
+// Static Data
+thread_local ShakeComputeScope *ShakeComputeScope::_current = nullptr;
+
+ShakeComputeScope::ShakeComputeScope(ShakeNode &node, const char *typeName):
+	_node(node),
+	_typeName(typeName),
+	_profilingScope(ShakeNode::profilerCategory, MProfiler::kColorE_L1, "compute", typeName, node.thisMObject()),
+	_start(ShakeTrace::now()),
+	_cacheHit(false),
+	_layersEvaluated(0),
+	_layersSkipped(0),
+	_previous(_current) {
+	/* Starts profiling a compute of the given node on this thread.
+
+	Args:
+		node (ShakeNode&): Node being computed
+		typeName (const char*): Type of the node, the category of its trace events
+
+	*/
+	_current = this;
+}
+
+ShakeComputeScope::~ShakeComputeScope() {
+	/* Adds the compute to the node's counters and to the trace if one is recording. */
+	std::uint64_t duration = ShakeTrace::now() - _start;
+	_current = _previous;
+
+	_node.profileCounters().addCompute(duration, _cacheHit, _layersEvaluated, _layersSkipped);
+	if (ShakeTrace::isRecording()) {
+		ShakeTrace::addEvent(_node.name().asChar(), _typeName, _start, duration, _cacheHit, _layersEvaluated);
+	}
+}
+
+void ShakeComputeScope::countCacheHit() {
+	/* Marks the compute running on this thread as served from a cache. */
+	if (_current != nullptr) {
+		_current->_cacheHit = true;
+	}
+}
+
+void ShakeComputeScope::countLayers(const ShakeLayerStack &layers, std::size_t numShakes) {
+	/* Counts the layers the compute running on this thread evaluated live.
+
+	Args:
+		layers (ShakeLayerStack): Evaluated layers, the ones with a weight of 0 count as skipped
+		numShakes (size_t): Number of times the stack was evaluated, per element or sub-sample
+
+	*/
+	if (_current == nullptr) {
+		return;
+	}
+	std::size_t numSkipped = (std::size_t) std::count(layers.weight.begin(), layers.weight.end(), 0.0);
+	_current->_layersEvaluated += (layers.size() - numSkipped) * numShakes;
+	_current->_layersSkipped += numSkipped * numShakes;
+}
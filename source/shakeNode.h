@@ -1,19 +1,38 @@
 #pragma once
 
 #include "perlinNoise.h"
+#include "shakeCurveCache.h"
+#include "shakeCacheFile.h"
+#include "shakeProfile.h"
 
 // System Includes
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdio>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <vector>
 
 // Maya General Includes
 #include <maya/MGlobal.h>
 #include <maya/MArrayDataHandle.h>
+#include <maya/MArrayDataBuilder.h>
 #include <maya/MDataHandle.h>
+#include <maya/MPlug.h>
+#include <maya/MPlugArray.h>
+#include <maya/MEvaluationNode.h>
+#include <maya/MDGContext.h>
+#include <maya/MProfiler.h>
 
 // Function Sets
 #include <maya/MFnNumericAttribute.h>
+#include <maya/MFnEnumAttribute.h>
 #include <maya/MFnCompoundAttribute.h>
 #include <maya/MFnUnitAttribute.h>
+#include <maya/MFnTypedAttribute.h>
+#include <maya/MFnStringData.h>
 #include <maya/MFnAttribute.h>
 
 // Proxies
@@ -25,7 +44,7 @@ class ShakeNode: public MPxNode {
 
 public:
 	// Constructors
-	ShakeNode(): MPxNode() {};
+	ShakeNode(): MPxNode(), _layersDirty(true), _curveCacheWarning(0), _cacheFileDirty(false) {};
 
 	// Destructor
 	virtual ~ShakeNode() override;
@@ -34,14 +53,24 @@ public:
 	static void *creator() {return new ShakeNode();}
 	static MStatus initialize();
 	virtual MStatus compute(const MPlug &plug, MDataBlock &dataBlock) override;
+	virtual MStatus setDependentsDirty(const MPlug &plug, MPlugArray &plugArray) override;
+	virtual MStatus preEvaluation(const MDGContext &context, const MEvaluationNode &evaluationNode) override;
+	virtual SchedulingType schedulingType() const override {return SchedulingType::kParallel;}
+	template <class NodeT> static void readShakeLayerPlugs(const MObject &nodeObj, std::vector<ShakeLayer> &layers);
+	ShakeProfileCounters &profileCounters() {return _profileCounters;}
 
 	// Node's attributes
 	static const MString typeName;
 	static const MTypeId typeId;
 
+	// Maya profiler category of the shake computes, registered by initializePlugin
+	static int profilerCategory;
+
 	// Node's input attributes
 	static MObject enableAttr;
 	static MObject inTimeAttr;
+	static MObject precisionAttr;
+	static MObject noiseEngineAttr;
 	static MObject weightAttr;
 	static MObject seedAttr;
 	static MObject frequencyAttr;
@@ -51,11 +80,543 @@ public:
 	static MObject strengthAttr;
 	static MObject fractalAttr;
 	static MObject roughnessAttr;
+	static MObject fractalModeAttr;
+	static MObject octavesAttr;
+	static MObject lacunarityAttr;
+	static MObject gainAttr;
 	static MObject shakeAttr;
+	static MObject cacheEnableAttr;
+	static MObject cacheStartAttr;
+	static MObject cacheEndAttr;
+	static MObject cacheSamplesAttr;
+	static MObject cacheFileAttr;
+	static MObject cacheFileShakeAttr;
+	static MObject shutterSamplesAttr;
+	static MObject shutterOpenAttr;
+	static MObject shutterCloseAttr;
+	static MObject errorBudgetAttr;
 
 	// Node's output attributes
 	static MObject outputAttrX;
 	static MObject outputAttrY;
 	static MObject outputAttrZ;
 	static MObject outputAttr;
+	static MObject outputVelocityAttrX;
+	static MObject outputVelocityAttrY;
+	static MObject outputVelocityAttrZ;
+	static MObject outputVelocityAttr;
+	static MObject outputAccelerationAttrX;
+	static MObject outputAccelerationAttrY;
+	static MObject outputAccelerationAttrZ;
+	static MObject outputAccelerationAttr;
+	static MObject outputSamplesAttrX;
+	static MObject outputSamplesAttrY;
+	static MObject outputSamplesAttrZ;
+	static MObject outputSamplesAttr;
+	static MObject culledLayersAttr;
+	static MObject culledBandsAttr;
+
+protected:
+	// Protected Methods
+	template <class NodeT> bool evaluateShake(MDataBlock &dataBlock, double result[3], double velocity[3] = nullptr, double acceleration[3] = nullptr);
+	template <class NodeT> static bool isDerivativePlug(const MPlug &plug);
+	template <class NodeT> bool evaluateShakeSamples(MDataBlock &dataBlock, std::vector<unsigned int> &indices, std::vector<double> &results);
+	template <class NodeT> static bool isSamplesPlug(const MPlug &plug);
+	static MStatus writeOutputArray(MDataBlock &dataBlock, const MObject &attribute, const std::vector<unsigned int> &indices, const std::vector<double> &results, double scale);
+	template <class NodeT> const ShakeLayerStack &layerStack(MDataBlock &dataBlock, ShakeCullStats *cullStats=nullptr);
+	template <class NodeT> std::shared_ptr<const ShakeCacheFile> cacheFile(MDataBlock &dataBlock);
+	template <class NodeT> static ShakeCullStats readShakeLayers(MDataBlock &dataBlock, ShakeLayerStack &layers);
+	template <class NodeT> static std::array<const MObject *, 17> shakeLayerAttributes();
+	template <class NodeT> static bool isCullPlug(const MPlug &plug);
+	static MStatus writeCullStats(MDataBlock &dataBlock, const MObject &culledLayersAttr, const MObject &culledBandsAttr, const ShakeCullStats &stats);
+	template <class NodeT> void invalidateOnDirty(const MPlug &plug);
+	template <class NodeT> void invalidateOnDirty(const MEvaluationNode &evaluationNode);
+	void warnCurveCacheResolution(int requestedSamplesPerFrame);
+
+	// Protected Data
+	ShakeLayerStack _layerStack;
+	ShakeCullStats _cullStats;
+	std::atomic<bool> _layersDirty;
+	ShakeCurveCache _curveCache;
+	std::atomic<int> _curveCacheWarning;
+	std::mutex _cacheFileMutex;
+	std::atomic<bool> _cacheFileDirty;
+	std::string _cacheFilePath;
+	std::shared_ptr<const ShakeCacheFile> _cacheFile;
+	ShakeProfileCounters _profileCounters;
 };
+
+
+
+class ShakeComputeScope {
+	/* Profiles one compute of a shake node.
+
+	Shows the compute in the shake category of Maya's profiler and, when it ends,
+	adds it to the counters of the node and a running trace. There are no global
+	counters, shake -q -stats sums the counters of the nodes when queried.
+	The evaluate methods report cache hits and evaluated layers to the scope of
+	their thread, so their signatures stay free of profiling arguments.
+
+	*/
+
+public:
+	// Constructors
+	ShakeComputeScope(ShakeNode &node, const char *typeName);
+
+	// Destructor
+	~ShakeComputeScope();
+
+	// Public Methods
+	static void countCacheHit();
+	static void countLayers(const ShakeLayerStack &layers, std::size_t numShakes=1);
+
+private:
+	// Private Data
+	ShakeNode &_node;
+	const char *_typeName;
+	MProfilingScope _profilingScope;
+	std::uint64_t _start;
+	bool _cacheHit;
+	std::uint64_t _layersEvaluated;
+	std::uint64_t _layersSkipped;
+	ShakeComputeScope *_previous;
+	static thread_local ShakeComputeScope *_current;
+};
+
+
+
+// Template Methods
+// Shared by ShakeNode and ShakeNodeRot, NodeT provides the attributes of the node type
+
+template <class NodeT>
+bool ShakeNode::evaluateShake(MDataBlock &dataBlock, double result[3], double velocity[3], double acceleration[3]) {
+	/* Evaluates the shake layers at the node's current time.
+
+	When cacheFile names a valid shake cache file, the shake cacheFileShake of it is
+	looked up instead and the layers are not evaluated at all, including the
+	derivatives, which come from the interpolating spline. A missing file or shake
+	falls back to the layers.
+
+	When the cache is enabled and holds a bake of the requested range, the result is
+	an interpolated table lookup within ShakeCurveCache::maxInterpolationError of
+	the live value. Otherwise the cache is rebuilt first, and times outside of the
+	cached range, or stacks too fast to bake, fall back to the live evaluation of
+	every layer.
+
+	When velocity and acceleration are given the layers are always evaluated live,
+	the derivatives come out of the same kernel pass. They are per unit of inTime,
+	so per frame when inTime is driven by time1. The result still comes from the
+	cache when it serves the time, so output has the same value whether it was
+	computed alone or together with the derivatives.
+
+	Safe to run for many nodes in parallel. The layers come from layerStack and the
+	cache synchronizes itself. The cache is only rebuilt in the normal context,
+	evaluations for cached playback or other contexts use it when it is valid and
+	evaluate the layers live otherwise.
+
+	Args:
+		dataBlock (MDataBlock&): Data block containing storage for the node's attributes
+		result (double[3]): Receives the X, Y and Z shake
+		velocity (double[3]): Receives the first time derivative of the shake, or nullptr
+		acceleration (double[3]): Receives the second time derivative of the shake, or nullptr
+
+	Returns:
+		bool: False if the node is disabled or has no layers, result is then untouched
+
+	*/
+	MStatus status;
+
+	bool enable = dataBlock.inputValue(NodeT::enableAttr, &status).asBool();
+	if (enable == 0) {
+		return false;
+	}
+
+	double uiTime = dataBlock.inputValue(NodeT::inTimeAttr, &status).asTime().asUnits(MTime::uiUnit());
+	std::shared_ptr<const ShakeCacheFile> file = cacheFile<NodeT>(dataBlock);
+	if (file != nullptr) {
+		int fileShake = dataBlock.inputValue(NodeT::cacheFileShakeAttr, &status).asInt();
+		if (fileShake >= 0 && file->lookup((std::size_t) fileShake, uiTime, result, velocity, acceleration)) {
+			ShakeComputeScope::countCacheHit();
+			return true;
+		}
+	}
+
+	const ShakeLayerStack &layers = layerStack<NodeT>(dataBlock);
+	if (layers.size() == 0) {
+		return false;
+	}
+
+	NoisePrecision precision = static_cast<NoisePrecision>(dataBlock.inputValue(NodeT::precisionAttr, &status).asShort());
+	NoiseEngine engine = static_cast<NoiseEngine>(dataBlock.inputValue(NodeT::noiseEngineAttr, &status).asShort());
+	result[0] = result[1] = result[2] = 0.0;
+
+	// With cacheEnable the output always comes from the cache where it is valid, no
+	// matter which output was pulled, so it never depends on the order of evaluation
+	auto lookupCurveCache = [&]() {
+		bool cacheEnable = dataBlock.inputValue(NodeT::cacheEnableAttr, &status).asBool();
+		if (!cacheEnable) {
+			return false;
+		}
+		double cacheStart = dataBlock.inputValue(NodeT::cacheStartAttr, &status).asDouble();
+		double cacheEnd = dataBlock.inputValue(NodeT::cacheEndAttr, &status).asDouble();
+		int cacheSamples = dataBlock.inputValue(NodeT::cacheSamplesAttr, &status).asInt();
+		if (!_curveCache.isValid(cacheStart, cacheEnd, cacheSamples) && dataBlock.context().isNormal()) {
+			_curveCache.build(layers, precision, engine, cacheStart, cacheEnd, cacheSamples);
+			warnCurveCacheResolution(cacheSamples);
+		}
+		if (!_curveCache.lookup(uiTime, result)) {
+			return false;
+		}
+		ShakeComputeScope::countCacheHit();
+		return true;
+	};
+
+	if (velocity != nullptr) {
+		double liveResult[3] = {0.0, 0.0, 0.0};
+		velocity[0] = velocity[1] = velocity[2] = 0.0;
+		acceleration[0] = acceleration[1] = acceleration[2] = 0.0;
+		PerlinNoise::accumulateShakeStackDerivatives(layers, uiTime, liveResult, velocity, acceleration, precision, engine);
+		ShakeComputeScope::countLayers(layers);
+		if (!lookupCurveCache()) {
+			std::copy(liveResult, liveResult + 3, result);
+		}
+		return true;
+	}
+
+	if (lookupCurveCache()) {
+		return true;
+	}
+
+	PerlinNoise::accumulateShakeStack(layers, uiTime, result, precision, engine);
+	ShakeComputeScope::countLayers(layers);
+
+	return true;
+}
+
+template <class NodeT>
+bool ShakeNode::isDerivativePlug(const MPlug &plug) {
+	/* Whether compute was asked for the velocity or acceleration output or one of their children.
+
+	Computing the derivatives costs a little more than the shake alone, so they are
+	only evaluated when one of them is requested, together with the output.
+
+	Args:
+		plug (MPlug&): Plug being computed
+
+	Returns:
+		bool: True for the outputVelocity and outputAcceleration plugs
+
+	*/
+	MPlug compoundPlug = plug.isChild() ? plug.parent() : plug;
+	return compoundPlug == NodeT::outputVelocityAttr || compoundPlug == NodeT::outputAccelerationAttr;
+}
+
+template <class NodeT>
+bool ShakeNode::evaluateShakeSamples(MDataBlock &dataBlock, std::vector<unsigned int> &indices, std::vector<double> &results) {
+	/* Evaluates the shake layers at evenly spaced times across the shutter interval.
+
+	The shutterSamples times run from inTime + shutterOpen to inTime + shutterClose,
+	a single sample sits in the middle of the interval. All samples are evaluated in
+	one batched kernel call, so a motion blur exporter gets every sub-frame from one
+	evaluation. With a valid cacheFile all samples are looked up from the file.
+
+	The curve cache is never used, even with cacheEnable on. Sub-frame times fall
+	between its samples, where the interpolation differs most from the noise, and
+	blurred frames have to show the same shake the live node shows at those times.
+
+	Args:
+		dataBlock (MDataBlock&): Data block containing storage for the node's attributes
+		indices (vector<unsigned int>&): Receives the logical index of each sample
+		results (vector<double>&): Receives the interleaved X, Y and Z shake of each sample
+
+	Returns:
+		bool: False if the node is disabled or has no layers, indices and results are then untouched
+
+	*/
+	MStatus status;
+	thread_local std::vector<double> times;
+
+	bool enable = dataBlock.inputValue(NodeT::enableAttr, &status).asBool();
+	if (enable == 0) {
+		return false;
+	}
+
+	double uiTime = dataBlock.inputValue(NodeT::inTimeAttr, &status).asTime().asUnits(MTime::uiUnit());
+	int numSamples = std::max(1, dataBlock.inputValue(NodeT::shutterSamplesAttr, &status).asInt());
+	double shutterOpen = dataBlock.inputValue(NodeT::shutterOpenAttr, &status).asDouble();
+	double shutterClose = dataBlock.inputValue(NodeT::shutterCloseAttr, &status).asDouble();
+
+	indices.resize(numSamples);
+	times.resize(numSamples);
+	for (int i = 0; i < numSamples; ++i) {
+		double shutter = numSamples == 1 ? 0.5 : (double) i / (numSamples - 1);
+		indices[i] = (unsigned int) i;
+		times[i] = uiTime + (shutterOpen + shutter * (shutterClose - shutterOpen));
+	}
+	results.assign(3 * (std::size_t) numSamples, 0.0);
+
+	std::shared_ptr<const ShakeCacheFile> file = cacheFile<NodeT>(dataBlock);
+	int fileShake = dataBlock.inputValue(NodeT::cacheFileShakeAttr, &status).asInt();
+	if (file != nullptr && fileShake >= 0 && (std::size_t) fileShake < file->numShakes()) {
+		for (int i = 0; i < numSamples; ++i) {
+			file->lookup((std::size_t) fileShake, times[i], &results[3 * i]);
+		}
+		ShakeComputeScope::countCacheHit();
+		return true;
+	}
+
+	const ShakeLayerStack &layers = layerStack<NodeT>(dataBlock);
+	if (layers.size() == 0) {
+		return false;
+	}
+
+	NoisePrecision precision = static_cast<NoisePrecision>(dataBlock.inputValue(NodeT::precisionAttr, &status).asShort());
+	NoiseEngine engine = static_cast<NoiseEngine>(dataBlock.inputValue(NodeT::noiseEngineAttr, &status).asShort());
+
+	PerlinNoise::accumulateShakeStackSamples(layers, times.data(), times.size(), results.data(), precision, engine);
+	ShakeComputeScope::countLayers(layers, times.size());
+
+	return true;
+}
+
+template <class NodeT>
+bool ShakeNode::isSamplesPlug(const MPlug &plug) {
+	/* Whether compute was asked for the outputSamples array, one of its elements or their children.
+
+	Args:
+		plug (MPlug&): Plug being computed
+
+	Returns:
+		bool: True for the outputSamples plugs
+
+	*/
+	MPlug arrayPlug = plug.isChild() ? plug.parent() : plug;
+	if (arrayPlug.isElement()) {
+		arrayPlug = arrayPlug.array();
+	}
+	return arrayPlug == NodeT::outputSamplesAttr;
+}
+
+template <class NodeT>
+bool ShakeNode::isCullPlug(const MPlug &plug) {
+	/* Whether compute was asked for the culledLayers or culledBands output.
+
+	Args:
+		plug (MPlug&): Plug being computed
+
+	Returns:
+		bool: True for the culled outputs
+
+	*/
+	return plug == NodeT::culledLayersAttr || plug == NodeT::culledBandsAttr;
+}
+
+template <class NodeT>
+const ShakeLayerStack &ShakeNode::layerStack(MDataBlock &dataBlock, ShakeCullStats *cullStats) {
+	/* Layer parameters to evaluate for the context of the data block.
+
+	In the normal context the node keeps its own structure of arrays copy of the
+	layers, which is only read again after one of the layer plugs was dirtied, so
+	evaluations where just the time changed do not touch the layer data at all.
+	Reading the layers also cleans their plugs, so the next change propagates dirty
+	again. Maya never evaluates a node twice at once in the same context.
+
+	Other contexts, like the background evaluation of cached playback, can see
+	different layer values and run concurrently, so they read into a per thread copy.
+
+	The copy is already culled to the errorBudget of the node.
+
+	Args:
+		dataBlock (MDataBlock&): Data block containing storage for the node's attributes
+		cullStats (ShakeCullStats*): Receives what the error budget culled, or nullptr
+
+	Returns:
+		ShakeLayerStack&: Layers of the node, valid until the next call on this thread
+
+	*/
+	thread_local ShakeLayerStack contextLayers;
+
+	if (!dataBlock.context().isNormal()) {
+		ShakeCullStats contextStats = readShakeLayers<NodeT>(dataBlock, contextLayers);
+		if (cullStats != nullptr) {
+			*cullStats = contextStats;
+		}
+		return contextLayers;
+	}
+	if (_layersDirty.exchange(false)) {
+		_cullStats = readShakeLayers<NodeT>(dataBlock, _layerStack);
+	}
+	if (cullStats != nullptr) {
+		*cullStats = _cullStats;
+	}
+	return _layerStack;
+}
+
+template <class NodeT>
+std::shared_ptr<const ShakeCacheFile> ShakeNode::cacheFile(MDataBlock &dataBlock) {
+	/* Shake cache file named by the cacheFile attribute.
+
+	The file is opened again whenever the cacheFile attribute is set, also to the
+	same path, so setting it again picks up a rebaked file. A file that could not
+	be opened is retried on every evaluation until it opens, the warning is only
+	shown once per setting. Nodes playing back the same file share a single read
+	only mapping of it.
+
+	Args:
+		dataBlock (MDataBlock&): Data block containing storage for the node's attributes
+
+	Returns:
+		shared_ptr<const ShakeCacheFile>: The mapped file, nullptr without a path or if it could not be opened
+
+	*/
+	MStatus status;
+	std::string path = dataBlock.inputValue(NodeT::cacheFileAttr, &status).asString().asChar();
+
+	std::lock_guard<std::mutex> lock(_cacheFileMutex);
+	bool pathSet = _cacheFileDirty.exchange(false) || path != _cacheFilePath;
+	if (pathSet || (_cacheFile == nullptr && !path.empty())) {
+		_cacheFilePath = path;
+		_cacheFile = nullptr;
+		if (!path.empty()) {
+			std::string error;
+			_cacheFile = ShakeCacheFile::open(path, &error);
+			if (_cacheFile == nullptr && pathSet) {
+				MGlobal::displayWarning(error.c_str());
+			}
+		}
+	}
+	return _cacheFile;
+}
+
+template <class NodeT>
+ShakeCullStats ShakeNode::readShakeLayers(MDataBlock &dataBlock, ShakeLayerStack &layers) {
+	/* Reads the shakeLayer array attribute and culls it to the error budget.
+
+	The array is sparse, the existing elements are visited in order with next()
+	whatever their logical indices are. Only the weight is read for layers with a
+	weight of 0, they do not contribute.
+
+	Args:
+		dataBlock (MDataBlock&): Data block containing storage for the node's attributes
+		layers (ShakeLayerStack&): Receives one entry per layer element, its capacity
+			is reused between calls
+
+	Returns:
+		ShakeCullStats: What the errorBudget attribute culled from the layers
+
+	*/
+	MStatus status;
+
+	MArrayDataHandle shakeLayersDH = dataBlock.inputArrayValue(NodeT::shakeAttr, &status);
+	unsigned int numShakeLayers = shakeLayersDH.elementCount();
+	layers.resize(numShakeLayers);
+	for (unsigned int i = 0; i < numShakeLayers; ++i, shakeLayersDH.next()) {
+		MDataHandle shakeLayerDH = shakeLayersDH.inputValue();
+		layers.weight[i] = shakeLayerDH.child(NodeT::weightAttr).asDouble();
+		if (layers.weight[i] != 0) {
+			layers.seed[i] = shakeLayerDH.child(NodeT::seedAttr).asInt();
+			layers.frequency[i] = shakeLayerDH.child(NodeT::frequencyAttr).asDouble();
+			MDataHandle strengthDH = shakeLayerDH.child(NodeT::strengthAttr);
+			layers.strength[0][i] = strengthDH.child(NodeT::strengthAttrX).asDouble();
+			layers.strength[1][i] = strengthDH.child(NodeT::strengthAttrY).asDouble();
+			layers.strength[2][i] = strengthDH.child(NodeT::strengthAttrZ).asDouble();
+			layers.fractal[i] = shakeLayerDH.child(NodeT::fractalAttr).asDouble();
+			layers.rough[i] = shakeLayerDH.child(NodeT::roughnessAttr).asDouble();
+			layers.fractalMode[i] = static_cast<FractalMode>(shakeLayerDH.child(NodeT::fractalModeAttr).asShort());
+			layers.octaves[i] = shakeLayerDH.child(NodeT::octavesAttr).asInt();
+			layers.lacunarity[i] = shakeLayerDH.child(NodeT::lacunarityAttr).asDouble();
+			layers.gain[i] = shakeLayerDH.child(NodeT::gainAttr).asDouble();
+		}
+	}
+
+	return layers.cull(dataBlock.inputValue(NodeT::errorBudgetAttr, &status).asDouble());
+}
+
+template <class NodeT>
+void ShakeNode::readShakeLayerPlugs(const MObject &nodeObj, std::vector<ShakeLayer> &layers) {
+	/* Reads the shakeLayer array of a node through its plugs.
+
+	Used outside of compute, for example by the shake command when baking. The plugs
+	are read at the current time.
+
+	Args:
+		nodeObj (MObject&): Shake node of type NodeT
+		layers (vector<ShakeLayer>&): Receives one entry per existing layer element
+
+	*/
+	MPlug shakeLayersPlug(nodeObj, NodeT::shakeAttr);
+	unsigned int numShakeLayers = shakeLayersPlug.numElements();
+	layers.resize(numShakeLayers);
+	for (unsigned int i = 0; i < numShakeLayers; ++i) {
+		MPlug shakeLayerPlug = shakeLayersPlug.elementByPhysicalIndex(i);
+		ShakeLayer &layer = layers[i];
+		layer.weight = shakeLayerPlug.child(NodeT::weightAttr).asDouble();
+		layer.seed = shakeLayerPlug.child(NodeT::seedAttr).asInt();
+		layer.frequency = shakeLayerPlug.child(NodeT::frequencyAttr).asDouble();
+		MPlug strengthPlug = shakeLayerPlug.child(NodeT::strengthAttr);
+		layer.strength[0] = strengthPlug.child(NodeT::strengthAttrX).asDouble();
+		layer.strength[1] = strengthPlug.child(NodeT::strengthAttrY).asDouble();
+		layer.strength[2] = strengthPlug.child(NodeT::strengthAttrZ).asDouble();
+		layer.fractal = shakeLayerPlug.child(NodeT::fractalAttr).asDouble();
+		layer.rough = shakeLayerPlug.child(NodeT::roughnessAttr).asDouble();
+		layer.fractalMode = static_cast<FractalMode>(shakeLayerPlug.child(NodeT::fractalModeAttr).asShort());
+		layer.octaves = shakeLayerPlug.child(NodeT::octavesAttr).asInt();
+		layer.lacunarity = shakeLayerPlug.child(NodeT::lacunarityAttr).asDouble();
+		layer.gain = shakeLayerPlug.child(NodeT::gainAttr).asDouble();
+	}
+}
+
+template <class NodeT>
+std::array<const MObject *, 17> ShakeNode::shakeLayerAttributes() {
+	/* Attributes that change the baked shake curve.
+
+	Returns:
+		array<MObject*>: The shakeLayer compound, all of its children, the precision,
+			engine and error budget
+
+	*/
+	return {
+		&NodeT::shakeAttr, &NodeT::precisionAttr, &NodeT::noiseEngineAttr, &NodeT::errorBudgetAttr, &NodeT::weightAttr, &NodeT::seedAttr,
+		&NodeT::frequencyAttr, &NodeT::strengthAttr, &NodeT::strengthAttrX, &NodeT::strengthAttrY,
+		&NodeT::strengthAttrZ, &NodeT::fractalAttr, &NodeT::roughnessAttr, &NodeT::fractalModeAttr,
+		&NodeT::octavesAttr, &NodeT::lacunarityAttr, &NodeT::gainAttr
+	};
+}
+
+template <class NodeT>
+void ShakeNode::invalidateOnDirty(const MPlug &plug) {
+	/* Invalidates the layer copy and curve cache when a layer plug is dirtied in DG evaluation.
+
+	Args:
+		plug (MPlug&): Plug being dirtied
+
+	*/
+	MObject attribute = plug.attribute();
+	for (const MObject *layerAttribute : shakeLayerAttributes<NodeT>()) {
+		if (attribute == *layerAttribute) {
+			_layersDirty = true;
+			_curveCache.invalidate();
+			return;
+		}
+	}
+}
+
+template <class NodeT>
+void ShakeNode::invalidateOnDirty(const MEvaluationNode &evaluationNode) {
+	/* Invalidates the layer copy and curve cache when a layer plug is dirty in EM evaluation.
+
+	The Evaluation Manager does not call setDependentsDirty during playback, so the
+	dirty plugs of the evaluation node are checked before each evaluation instead.
+
+	Args:
+		evaluationNode (MEvaluationNode&): Evaluation node about to be evaluated
+
+	*/
+	for (const MObject *layerAttribute : shakeLayerAttributes<NodeT>()) {
+		if (evaluationNode.dirtyPlugExists(*layerAttribute)) {
+			_layersDirty = true;
+			_curveCache.invalidate();
+			return;
+		}
+	}
+}
\ No newline at end of file
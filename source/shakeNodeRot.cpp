@@ -8,6 +8,8 @@ const MTypeId ShakeNodeRot::typeId(0x00122711);
 // Node's input attributes
 MObject ShakeNodeRot::enableAttr;
 MObject ShakeNodeRot::inTimeAttr;
+MObject ShakeNodeRot::precisionAttr;
+MObject ShakeNodeRot::noiseEngineAttr;
 MObject ShakeNodeRot::weightAttr;
 MObject ShakeNodeRot::seedAttr;
 MObject ShakeNodeRot::frequencyAttr;
@@ -17,13 +19,41 @@ MObject ShakeNodeRot::strengthAttrZ;
 MObject ShakeNodeRot::strengthAttr;
 MObject ShakeNodeRot::fractalAttr;
 MObject ShakeNodeRot::roughnessAttr;
+MObject ShakeNodeRot::fractalModeAttr;
+MObject ShakeNodeRot::octavesAttr;
+MObject ShakeNodeRot::lacunarityAttr;
+MObject ShakeNodeRot::gainAttr;
 MObject ShakeNodeRot::shakeAttr;
+MObject ShakeNodeRot::cacheEnableAttr;
+MObject ShakeNodeRot::cacheStartAttr;
+MObject ShakeNodeRot::cacheEndAttr;
+MObject ShakeNodeRot::cacheSamplesAttr;
+MObject ShakeNodeRot::cacheFileAttr;
+MObject ShakeNodeRot::cacheFileShakeAttr;
+MObject ShakeNodeRot::shutterSamplesAttr;
+MObject ShakeNodeRot::shutterOpenAttr;
+MObject ShakeNodeRot::shutterCloseAttr;
+MObject ShakeNodeRot::errorBudgetAttr;
  
 // Node's output attributes
 MObject ShakeNodeRot::outputAttrX;
 MObject ShakeNodeRot::outputAttrY;
 MObject ShakeNodeRot::outputAttrZ;
 MObject ShakeNodeRot::outputAttr;
+MObject ShakeNodeRot::outputVelocityAttrX;
+MObject ShakeNodeRot::outputVelocityAttrY;
+MObject ShakeNodeRot::outputVelocityAttrZ;
+MObject ShakeNodeRot::outputVelocityAttr;
+MObject ShakeNodeRot::outputAccelerationAttrX;
+MObject ShakeNodeRot::outputAccelerationAttrY;
+MObject ShakeNodeRot::outputAccelerationAttrZ;
+MObject ShakeNodeRot::outputAccelerationAttr;
+MObject ShakeNodeRot::outputSamplesAttrX;
+MObject ShakeNodeRot::outputSamplesAttrY;
+MObject ShakeNodeRot::outputSamplesAttrZ;
+MObject ShakeNodeRot::outputSamplesAttr;
+MObject ShakeNodeRot::culledLayersAttr;
+MObject ShakeNodeRot::culledBandsAttr;
 
 
 
@@ -44,7 +74,10 @@ MStatus ShakeNodeRot::initialize() {
 	*/
 	MStatus status;
 	MFnNumericAttribute nAttr;
+	MFnEnumAttribute eAttr;
 	MFnUnitAttribute uAttr;
+	MFnTypedAttribute tAttr;
+	MFnStringData stringData;
 	MFnCompoundAttribute cAttr;
 
 	enableAttr = nAttr.create("enable", "ena", MFnNumericData::kBoolean, 1);
@@ -55,6 +88,17 @@ MStatus ShakeNodeRot::initialize() {
 	uAttr.setKeyable(true);
 	uAttr.setReadable(false);
 
+	precisionAttr = eAttr.create("precision", "prc", static_cast<short>(kDefaultNoisePrecision));
+	eAttr.addField("Double", static_cast<short>(NoisePrecision::kDouble));
+	eAttr.addField("Single", static_cast<short>(NoisePrecision::kSingle));
+	eAttr.setReadable(false);
+
+	noiseEngineAttr = eAttr.create("noiseEngine", "nen", static_cast<short>(NoiseEngine::kPerlin));
+	eAttr.addField("Perlin", static_cast<short>(NoiseEngine::kPerlin));
+	eAttr.addField("Gradient1D", static_cast<short>(NoiseEngine::kGradient1D));
+	eAttr.addField("Hash", static_cast<short>(NoiseEngine::kHash));
+	eAttr.setReadable(false);
+
 	weightAttr = nAttr.create("weight", "wgt", MFnNumericData::kDouble, 1.0);
 	nAttr.setMin(0);
 	nAttr.setMax(1);
@@ -79,6 +123,22 @@ MStatus ShakeNodeRot::initialize() {
 	nAttr.setMin(0);
 	nAttr.setMax(1);
 
+	fractalModeAttr = eAttr.create("fractalMode", "frm", static_cast<short>(FractalMode::kClassic));
+	eAttr.addField("Classic", static_cast<short>(FractalMode::kClassic));
+	eAttr.addField("fBm", static_cast<short>(FractalMode::kFbm));
+
+	octavesAttr = nAttr.create("octaves", "oct", MFnNumericData::kInt, 4);
+	nAttr.setMin(1);
+	nAttr.setMax(PerlinNoise::fbmMaxOctaves);
+
+	lacunarityAttr = nAttr.create("lacunarity", "lac", MFnNumericData::kDouble, 2.0);
+	nAttr.setMin(1);
+	nAttr.setSoftMax(4);
+
+	gainAttr = nAttr.create("gain", "gan", MFnNumericData::kDouble, 0.5);
+	nAttr.setMin(0);
+	nAttr.setMax(1);
+
 	/* shakeAttr:
 	-- shake
 		 | -- weight
@@ -87,6 +147,10 @@ MStatus ShakeNodeRot::initialize() {
 		 | -- strength X Y Z
 		 | -- fractal
 		 | -- roughness
+		 | -- fractalMode
+		 | -- octaves
+		 | -- lacunarity
+		 | -- gain
 	*/
 	shakeAttr = cAttr.create("shakeLayer", "shk");
 	cAttr.addChild(weightAttr);
@@ -95,10 +159,56 @@ MStatus ShakeNodeRot::initialize() {
 	cAttr.addChild(strengthAttr);
 	cAttr.addChild(fractalAttr);
 	cAttr.addChild(roughnessAttr);
+	cAttr.addChild(fractalModeAttr);
+	cAttr.addChild(octavesAttr);
+	cAttr.addChild(lacunarityAttr);
+	cAttr.addChild(gainAttr);
 	cAttr.setArray(true);
 	cAttr.setKeyable(true);
 	cAttr.setReadable(false);
 
+	// The first evaluation after enabling the cache, or after changing a layer, bakes the
+	// whole cacheStart to cacheEnd range synchronously in compute, at 24 bytes per sample
+	cacheEnableAttr = nAttr.create("cacheEnable", "cen", MFnNumericData::kBoolean, 0);
+	nAttr.setReadable(false);
+
+	cacheStartAttr = nAttr.create("cacheStart", "cst", MFnNumericData::kDouble, 1.0);
+	nAttr.setReadable(false);
+
+	cacheEndAttr = nAttr.create("cacheEnd", "cnd", MFnNumericData::kDouble, 120.0);
+	nAttr.setReadable(false);
+
+	// Lowest resolution, raised with a warning up to ShakeCurveCache::maxSamplesPerFrame for
+	// fast layers, a fractal band at frequency 10 needs about 800 samples per frame
+	cacheSamplesAttr = nAttr.create("cacheSamplesPerFrame", "csp", MFnNumericData::kInt, 4);
+	nAttr.setMin(1);
+	nAttr.setSoftMax(16);
+	nAttr.setReadable(false);
+
+	cacheFileAttr = tAttr.create("cacheFile", "cfl", MFnData::kString, stringData.create(""));
+	tAttr.setUsedAsFilename(true);
+	tAttr.setReadable(false);
+
+	cacheFileShakeAttr = nAttr.create("cacheFileShake", "cfs", MFnNumericData::kInt, 0);
+	nAttr.setMin(0);
+	nAttr.setReadable(false);
+
+	shutterSamplesAttr = nAttr.create("shutterSamples", "shs", MFnNumericData::kInt, 3);
+	nAttr.setMin(1);
+	nAttr.setSoftMax(16);
+	nAttr.setReadable(false);
+
+	shutterOpenAttr = nAttr.create("shutterOpen", "sho", MFnNumericData::kDouble, -0.25);
+	nAttr.setReadable(false);
+
+	shutterCloseAttr = nAttr.create("shutterClose", "shc", MFnNumericData::kDouble, 0.25);
+	nAttr.setReadable(false);
+
+	errorBudgetAttr = nAttr.create("errorBudget", "erb", MFnNumericData::kDouble, 0.0);
+	nAttr.setMin(0);
+	nAttr.setSoftMax(1);
+	nAttr.setReadable(false);
+
 	outputAttrX = uAttr.create("outputX", "outX", MFnUnitAttribute::kAngle, 0.0);
 	outputAttrY = uAttr.create("outputY", "outY", MFnUnitAttribute::kAngle, 0.0);
 	outputAttrZ = uAttr.create("outputZ", "outZ", MFnUnitAttribute::kAngle, 0.0);
@@ -106,14 +216,80 @@ MStatus ShakeNodeRot::initialize() {
 	outputAttr = nAttr.create("output", "out", outputAttrX, outputAttrY, outputAttrZ);
 	nAttr.setWritable(false);
 
+	outputVelocityAttrX = uAttr.create("outputVelocityX", "ovlX", MFnUnitAttribute::kAngle, 0.0);
+	outputVelocityAttrY = uAttr.create("outputVelocityY", "ovlY", MFnUnitAttribute::kAngle, 0.0);
+	outputVelocityAttrZ = uAttr.create("outputVelocityZ", "ovlZ", MFnUnitAttribute::kAngle, 0.0);
+	outputVelocityAttr = nAttr.create("outputVelocity", "ovl", outputVelocityAttrX, outputVelocityAttrY, outputVelocityAttrZ);
+	nAttr.setWritable(false);
+	nAttr.setStorable(false);
+
+	outputAccelerationAttrX = uAttr.create("outputAccelerationX", "oacX", MFnUnitAttribute::kAngle, 0.0);
+	outputAccelerationAttrY = uAttr.create("outputAccelerationY", "oacY", MFnUnitAttribute::kAngle, 0.0);
+	outputAccelerationAttrZ = uAttr.create("outputAccelerationZ", "oacZ", MFnUnitAttribute::kAngle, 0.0);
+	outputAccelerationAttr = nAttr.create("outputAcceleration", "oac", outputAccelerationAttrX, outputAccelerationAttrY, outputAccelerationAttrZ);
+	nAttr.setWritable(false);
+	nAttr.setStorable(false);
+
+	outputSamplesAttrX = uAttr.create("outputSamplesX", "osmX", MFnUnitAttribute::kAngle, 0.0);
+	outputSamplesAttrY = uAttr.create("outputSamplesY", "osmY", MFnUnitAttribute::kAngle, 0.0);
+	outputSamplesAttrZ = uAttr.create("outputSamplesZ", "osmZ", MFnUnitAttribute::kAngle, 0.0);
+	outputSamplesAttr = nAttr.create("outputSamples", "osm", outputSamplesAttrX, outputSamplesAttrY, outputSamplesAttrZ);
+	nAttr.setArray(true);
+	nAttr.setUsesArrayDataBuilder(true);
+	nAttr.setWritable(false);
+	nAttr.setStorable(false);
+
+	culledLayersAttr = nAttr.create("culledLayers", "cly", MFnNumericData::kInt, 0);
+	nAttr.setWritable(false);
+	nAttr.setStorable(false);
+
+	culledBandsAttr = nAttr.create("culledBands", "cbd", MFnNumericData::kInt, 0);
+	nAttr.setWritable(false);
+	nAttr.setStorable(false);
+
 	addAttribute(enableAttr);
 	addAttribute(inTimeAttr);
+	addAttribute(precisionAttr);
+	addAttribute(noiseEngineAttr);
 	addAttribute(shakeAttr);
+	addAttribute(cacheEnableAttr);
+	addAttribute(cacheStartAttr);
+	addAttribute(cacheEndAttr);
+	addAttribute(cacheSamplesAttr);
+	addAttribute(cacheFileAttr);
+	addAttribute(cacheFileShakeAttr);
+	addAttribute(shutterSamplesAttr);
+	addAttribute(shutterOpenAttr);
+	addAttribute(shutterCloseAttr);
+	addAttribute(errorBudgetAttr);
 	addAttribute(outputAttr);
-
-	attributeAffects(enableAttr, outputAttr);
-	attributeAffects(inTimeAttr, outputAttr);
-	attributeAffects(shakeAttr, outputAttr);
+	addAttribute(outputVelocityAttr);
+	addAttribute(outputAccelerationAttr);
+	addAttribute(outputSamplesAttr);
+	addAttribute(culledLayersAttr);
+	addAttribute(culledBandsAttr);
+
+	for (const MObject *output : {&outputAttr, &outputVelocityAttr, &outputAccelerationAttr, &outputSamplesAttr}) {
+		attributeAffects(enableAttr, *output);
+		attributeAffects(inTimeAttr, *output);
+		attributeAffects(precisionAttr, *output);
+		attributeAffects(noiseEngineAttr, *output);
+		attributeAffects(shakeAttr, *output);
+		attributeAffects(errorBudgetAttr, *output);
+		attributeAffects(cacheEnableAttr, *output);
+		attributeAffects(cacheStartAttr, *output);
+		attributeAffects(cacheEndAttr, *output);
+		attributeAffects(cacheSamplesAttr, *output);
+		attributeAffects(cacheFileAttr, *output);
+		attributeAffects(cacheFileShakeAttr, *output);
+	}
+	attributeAffects(shutterSamplesAttr, outputSamplesAttr);
+	attributeAffects(shutterOpenAttr, outputSamplesAttr);
+	attributeAffects(shutterCloseAttr, outputSamplesAttr);
+	for (const MObject *output : {&culledLayersAttr, &culledBandsAttr}) {
+		attributeAffects(shakeAttr, *output);
+		attributeAffects(errorBudgetAttr, *output);
+	}
 
 	return MS::kSuccess;
 }
@@ -162,43 +338,85 @@ MStatus ShakeNodeRot::compute(const MPlug &plug, MDataBlock &dataBlock) {
 	*/
 	MStatus status;
 
-	bool enable = dataBlock.inputValue(enableAttr, &status).asBool();
-	if (enable == 0) {
+	if (isCullPlug<ShakeNodeRot>(plug)) {
+		ShakeCullStats cullStats;
+		layerStack<ShakeNodeRot>(dataBlock, &cullStats);
+		return writeCullStats(dataBlock, culledLayersAttr, culledBandsAttr, cullStats);
+	}
+
+	ShakeComputeScope computeScope(*this, typeName.asChar());
+
+	if (isSamplesPlug<ShakeNodeRot>(plug)) {
+		thread_local std::vector<unsigned int> indices;
+		thread_local std::vector<double> results;
+		if (evaluateShakeSamples<ShakeNodeRot>(dataBlock, indices, results)) {
+			status = writeOutputArray(dataBlock, outputSamplesAttr, indices, results, pi / 180);
+			CHECK_MSTATUS_AND_RETURN_IT(status);
+		}
 		dataBlock.setClean(plug);
+		return MS::kSuccess;
 	}
-	else {
-		MArrayDataHandle shakeLayersDH = dataBlock.inputArrayValue(shakeAttr, &status);
-		unsigned int numShakeLayers = shakeLayersDH.elementCount();
-		if (numShakeLayers == 0) {
-			dataBlock.setClean(plug);
+
+	double result[3];
+	double velocity[3];
+	double acceleration[3];
+	bool derivatives = isDerivativePlug<ShakeNodeRot>(plug);
+	if (evaluateShake<ShakeNodeRot>(dataBlock, result, derivatives ? velocity : nullptr, derivatives ? acceleration : nullptr)) {
+		MDataHandle strengthDH = dataBlock.outputValue(outputAttr, &status);
+		strengthDH.set3Double(radians(result[0]), radians(result[1]), radians(result[2]));
+		strengthDH.setClean();
+		if (derivatives) {
+			MDataHandle velocityDH = dataBlock.outputValue(outputVelocityAttr, &status);
+			velocityDH.set3Double(radians(velocity[0]), radians(velocity[1]), radians(velocity[2]));
+			velocityDH.setClean();
+			MDataHandle accelerationDH = dataBlock.outputValue(outputAccelerationAttr, &status);
+			accelerationDH.set3Double(radians(acceleration[0]), radians(acceleration[1]), radians(acceleration[2]));
+			accelerationDH.setClean();
 		}
-		else {
-			double uiTime = dataBlock.inputValue(inTimeAttr, &status).asTime().asUnits(MTime::uiUnit());
-			double resultX = 0, resultY = 0, resultZ = 0;
-			PerlinNoise ipNoise;
-			for (unsigned int i = 0; i < numShakeLayers; ++i) {
-				shakeLayersDH.jumpToArrayElement(i);
-				MDataHandle shakeLayerDH = shakeLayersDH.inputValue();
-				double weight = shakeLayerDH.child(weightAttr).asDouble();
-				if (weight != 0) {
-					int seed = shakeLayerDH.child(seedAttr).asInt();
-					double freq = shakeLayerDH.child(frequencyAttr).asDouble();
-					MDataHandle strengthDH = shakeLayerDH.child(strengthAttr);
-					double strX = strengthDH.child(strengthAttrX).asDouble();
-					double strY = strengthDH.child(strengthAttrY).asDouble();
-					double strZ = strengthDH.child(strengthAttrZ).asDouble();
-					double fractal = shakeLayerDH.child(fractalAttr).asDouble();
-					double rough = shakeLayerDH.child(roughnessAttr).asDouble();
-					resultX += ipNoise.calculateNoise(weight, uiTime, seed + 13.0, freq, strX, fractal, rough);
-					resultY += ipNoise.calculateNoise(weight, uiTime, seed + 578.0, freq, strY, fractal, rough);
-					resultZ += ipNoise.calculateNoise(weight, uiTime, seed + 1511.0, freq, strZ, fractal, rough);
-				}
-			}
-			MDataHandle strengthDH = dataBlock.outputValue(outputAttr, &status);
-			strengthDH.set3Double(radians(resultX), radians(resultY), radians(resultZ));
-			strengthDH.setClean();
+	}
+	dataBlock.setClean(plug);
+
+	return MS::kSuccess;
+}
+
+MStatus ShakeNodeRot::setDependentsDirty(const MPlug &plug, MPlugArray &plugArray) {
+	/* Invalidates the layer copy and curve cache when a layer attribute is dirtied,
+	and reopens the cache file when cacheFile is set.
+
+	Args:
+		plug (MPlug&): Plug being dirtied
+		plugArray (MPlugArray&): Extra plugs to mark dirty, left untouched
+
+	Returns:
+		status code (MStatus): kSuccess if the operation was successful,
+			kFailure if an error occured during the operation
+
+	*/
+	invalidateOnDirty<ShakeNodeRot>(plug);
+	if (plug.attribute() == cacheFileAttr) {
+		_cacheFileDirty = true;
+	}
+
+	return MPxNode::setDependentsDirty(plug, plugArray);
+}
+
+MStatus ShakeNodeRot::preEvaluation(const MDGContext &context, const MEvaluationNode &evaluationNode) {
+	/* Invalidates the layer copy, curve cache and cache file before an Evaluation Manager evaluation.
+
+	Args:
+		context (MDGContext&): Context of the evaluation
+		evaluationNode (MEvaluationNode&): Evaluation node holding the dirty plugs
+
+	Returns:
+		status code (MStatus): kSuccess if the operation was successful,
+			kFailure if an error occured during the operation
+
+	*/
+	if (context.isNormal()) {
+		invalidateOnDirty<ShakeNodeRot>(evaluationNode);
+		if (evaluationNode.dirtyPlugExists(cacheFileAttr)) {
+			_cacheFileDirty = true;
 		}
-		dataBlock.setClean(plug);
 	}
 
 	return MS::kSuccess;
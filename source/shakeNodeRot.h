@@ -13,6 +13,7 @@
 
 // Function Sets
 #include <maya/MFnNumericAttribute.h>
+#include <maya/MFnEnumAttribute.h>
 #include <maya/MFnUnitAttribute.h>
 #include <maya/MFnCompoundAttribute.h>
 
@@ -31,6 +32,8 @@ public:
 	static void *creator() {return new ShakeNodeRot();}
 	static MStatus initialize();
 	virtual MStatus compute(const MPlug& plug, MDataBlock& dataBlock) override;
+	virtual MStatus setDependentsDirty(const MPlug &plug, MPlugArray &plugArray) override;
+	virtual MStatus preEvaluation(const MDGContext &context, const MEvaluationNode &evaluationNode) override;
 
 	// Node's attributes
 	static const MString typeName;
@@ -39,6 +42,8 @@ public:
 	// Node's input attributes
 	static MObject enableAttr;
 	static MObject inTimeAttr;
+	static MObject precisionAttr;
+	static MObject noiseEngineAttr;
 	static MObject weightAttr;
 	static MObject seedAttr;
 	static MObject frequencyAttr;
@@ -48,13 +53,41 @@ public:
 	static MObject strengthAttr;
 	static MObject fractalAttr;
 	static MObject roughnessAttr;
+	static MObject fractalModeAttr;
+	static MObject octavesAttr;
+	static MObject lacunarityAttr;
+	static MObject gainAttr;
 	static MObject shakeAttr;
+	static MObject cacheEnableAttr;
+	static MObject cacheStartAttr;
+	static MObject cacheEndAttr;
+	static MObject cacheSamplesAttr;
+	static MObject cacheFileAttr;
+	static MObject cacheFileShakeAttr;
+	static MObject shutterSamplesAttr;
+	static MObject shutterOpenAttr;
+	static MObject shutterCloseAttr;
+	static MObject errorBudgetAttr;
 
 	// Node's output attributes
 	static MObject outputAttrX;
 	static MObject outputAttrY;
 	static MObject outputAttrZ;
 	static MObject outputAttr;
+	static MObject outputVelocityAttrX;
+	static MObject outputVelocityAttrY;
+	static MObject outputVelocityAttrZ;
+	static MObject outputVelocityAttr;
+	static MObject outputAccelerationAttrX;
+	static MObject outputAccelerationAttrY;
+	static MObject outputAccelerationAttrZ;
+	static MObject outputAccelerationAttr;
+	static MObject outputSamplesAttrX;
+	static MObject outputSamplesAttrY;
+	static MObject outputSamplesAttrZ;
+	static MObject outputSamplesAttr;
+	static MObject culledLayersAttr;
+	static MObject culledBandsAttr;
 
 private:
 	// Private Methods
@@ -0,0 +1,200 @@
+#include "shakeNoiseC.h"
+#include "perlinNoise.h"
+
+// System Includes
+#include <algorithm>
+#include <cstddef>
+#include <type_traits>
+
+
+
+static_assert(sizeof(ShakeNoiseLayer) == 88, "ShakeNoiseLayer must not change its size");
+static_assert(offsetof(ShakeNoiseLayer, frequency) == 16, "ShakeNoiseLayer must not change its layout");
+static_assert(offsetof(ShakeNoiseLayer, octaves) == 64, "ShakeNoiseLayer must not change its layout");
+static_assert(offsetof(ShakeNoiseLayer, gain) == 80, "ShakeNoiseLayer must not change its layout");
+static_assert(std::is_standard_layout<ShakeNoiseLayer>::value, "ShakeNoiseLayer must stay a C struct");
+
+
+
+namespace {
+
+bool validArguments(const ShakeNoiseLayer *layers, size_t numLayers, const double *times, size_t numTimes, int precision, int engine) {
+  /* Whether the buffers and enum values of an evaluation can be used. */
+  if ((layers == nullptr && numLayers > 0) || (times == nullptr && numTimes > 0)) {
+    return false;
+  }
+  if (precision != SHAKE_NOISE_PRECISION_DOUBLE && precision != SHAKE_NOISE_PRECISION_SINGLE) {
+    return false;
+  }
+  if (engine < SHAKE_NOISE_ENGINE_PERLIN || engine > SHAKE_NOISE_ENGINE_HASH) {
+    return false;
+  }
+  return std::all_of(layers, layers + numLayers, [](const ShakeNoiseLayer &layer) {
+    return layer.fractalMode == SHAKE_NOISE_FRACTAL_CLASSIC || layer.fractalMode == SHAKE_NOISE_FRACTAL_FBM;
+  });
+}
+
+
+const ShakeLayerStack &readLayerStack(const ShakeNoiseLayer *layers, size_t numLayers, double errorBudget) {
+  /* Structure of arrays copy of the layers, culled like the nodes cull them.
+
+  The copy is kept per thread so its capacity is reused between calls, it is valid
+  until the next call on the same thread.
+
+  */
+  thread_local ShakeLayerStack stack;
+
+  stack.resize(numLayers);
+  for (size_t i = 0; i < numLayers; ++i) {
+    const ShakeNoiseLayer &source = layers[i];
+    ShakeLayer layer;
+    layer.weight = source.weight;
+    layer.seed = source.seed;
+    layer.frequency = source.frequency;
+    std::copy(source.strength, source.strength + 3, layer.strength);
+    layer.fractal = source.fractal;
+    layer.rough = source.rough;
+    layer.fractalMode = static_cast<FractalMode>(source.fractalMode);
+    layer.octaves = source.octaves;
+    layer.lacunarity = source.lacunarity;
+    layer.gain = source.gain;
+    stack.setLayer(i, layer);
+  }
+  stack.cull(std::max(errorBudget, 0.0));
+  return stack;
+}
+
+}
+
+
+
+uint32_t shakeNoiseAbiVersion() {
+  /* SHAKE_NOISE_ABI_VERSION the library was built with. */
+  return SHAKE_NOISE_ABI_VERSION;
+}
+
+
+const char *shakeNoiseStatusString(int status) {
+  /* Human readable description of a status code, never null. */
+  switch (status) {
+    case SHAKE_NOISE_OK:
+      return "ok";
+    case SHAKE_NOISE_INVALID_ARGUMENT:
+      return "invalid argument";
+    case SHAKE_NOISE_INTERNAL_ERROR:
+      return "internal error";
+    default:
+      return "unknown status";
+  }
+}
+
+
+void shakeNoiseDefaultLayer(ShakeNoiseLayer *layer) {
+  /* Sets a layer to the defaults of a new shakeLayer element.
+
+  Args:
+    layer (ShakeNoiseLayer*): Layer to set, ignored if null
+
+  */
+  if (layer == nullptr) {
+    return;
+  }
+  const ShakeLayer defaults;
+  *layer = ShakeNoiseLayer();
+  layer->weight = defaults.weight;
+  layer->seed = defaults.seed;
+  layer->fractalMode = static_cast<int32_t>(defaults.fractalMode);
+  layer->frequency = defaults.frequency;
+  std::copy(defaults.strength, defaults.strength + 3, layer->strength);
+  layer->fractal = defaults.fractal;
+  layer->rough = defaults.rough;
+  layer->octaves = defaults.octaves;
+  layer->lacunarity = defaults.lacunarity;
+  layer->gain = defaults.gain;
+}
+
+
+int shakeNoiseEvaluate(const ShakeNoiseLayer *layers, size_t numLayers, const double *times, size_t numTimes, int precision, int engine, double errorBudget, double *output) {
+  /* Evaluates a layer stack at many times into a caller-owned buffer.
+
+  All times go through the batched stack kernel at once, the values are identical
+  to the output of a live node with the same layers, precision, noiseEngine and
+  errorBudget at the same inTime. Rotation stacks come out in degrees.
+
+  Args:
+    layers (const ShakeNoiseLayer*): Layers of the stack, numLayers entries
+    numLayers (size_t): Number of layers
+    times (const double*): Time of each sample in frames, numTimes entries
+    numTimes (size_t): Number of samples
+    precision (int): SHAKE_NOISE_PRECISION_DOUBLE or SHAKE_NOISE_PRECISION_SINGLE
+    engine (int): One of the SHAKE_NOISE_ENGINE values
+    errorBudget (double): Maximum deviation culled layers and bands may add, 0 culls nothing
+    output (double*): Receives 3 * numTimes interleaved X, Y and Z values, overwritten
+
+  Returns:
+    int: SHAKE_NOISE_OK, or the status code of the failure
+
+  */
+  if (!validArguments(layers, numLayers, times, numTimes, precision, engine) || (output == nullptr && numTimes > 0)) {
+    return SHAKE_NOISE_INVALID_ARGUMENT;
+  }
+  try {
+    const ShakeLayerStack &stack = readLayerStack(layers, numLayers, errorBudget);
+    std::fill(output, output + 3 * numTimes, 0.0);
+    PerlinNoise::accumulateShakeStackSamples(stack, times, numTimes, output,
+      static_cast<NoisePrecision>(precision), static_cast<NoiseEngine>(engine));
+  } catch (...) {
+    return SHAKE_NOISE_INTERNAL_ERROR;
+  }
+  return SHAKE_NOISE_OK;
+}
+
+
+int shakeNoiseEvaluateDerivatives(const ShakeNoiseLayer *layers, size_t numLayers, const double *times, size_t numTimes, int precision, int engine, double errorBudget, double *output, double *velocity, double *acceleration) {
+  /* Evaluates a layer stack and its first two time derivatives at many times.
+
+  Same values as shakeNoiseEvaluate, the derivatives are the outputVelocity and
+  outputAcceleration of a live node, per frame and per frame squared.
+
+  Args:
+    layers (const ShakeNoiseLayer*): Layers of the stack, numLayers entries
+    numLayers (size_t): Number of layers
+    times (const double*): Time of each sample in frames, numTimes entries
+    numTimes (size_t): Number of samples
+    precision (int): SHAKE_NOISE_PRECISION_DOUBLE or SHAKE_NOISE_PRECISION_SINGLE
+    engine (int): One of the SHAKE_NOISE_ENGINE values
+    errorBudget (double): Maximum deviation culled layers and bands may add, 0 culls nothing
+    output (double*): Receives 3 * numTimes interleaved X, Y and Z values, or null
+    velocity (double*): Receives 3 * numTimes interleaved first derivatives, or null
+    acceleration (double*): Receives 3 * numTimes interleaved second derivatives, or null
+
+  Returns:
+    int: SHAKE_NOISE_OK, or the status code of the failure
+
+  */
+  if (!validArguments(layers, numLayers, times, numTimes, precision, engine)) {
+    return SHAKE_NOISE_INVALID_ARGUMENT;
+  }
+  try {
+    const ShakeLayerStack &stack = readLayerStack(layers, numLayers, errorBudget);
+    for (size_t i = 0; i < numTimes; ++i) {
+      double result[3] = {0.0, 0.0, 0.0};
+      double resultVelocity[3] = {0.0, 0.0, 0.0};
+      double resultAcceleration[3] = {0.0, 0.0, 0.0};
+      PerlinNoise::accumulateShakeStackDerivatives(stack, times[i], result, resultVelocity, resultAcceleration,
+        static_cast<NoisePrecision>(precision), static_cast<NoiseEngine>(engine));
+      if (output != nullptr) {
+        std::copy(result, result + 3, output + 3 * i);
+      }
+      if (velocity != nullptr) {
+        std::copy(resultVelocity, resultVelocity + 3, velocity + 3 * i);
+      }
+      if (acceleration != nullptr) {
+        std::copy(resultAcceleration, resultAcceleration + 3, acceleration + 3 * i);
+      }
+    }
+  } catch (...) {
+    return SHAKE_NOISE_INTERNAL_ERROR;
+  }
+  return SHAKE_NOISE_OK;
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+/* Stable C interface to the shake noise, for tools that run outside of Maya.
+
+Everything a shake node evaluates is available through plain C functions over
+caller-owned buffers, so pipeline tools can generate shake curves from Python
+(ctypes, see shakeNode/scripts/shakeNoise.py), C or any other language with a
+C foreign function interface without a Maya session or a C++ toolchain. No
+function allocates memory visible to the caller or keeps state between calls,
+all of them are safe to call from any number of threads at once.
+
+The interface only grows: structs keep their layout and functions keep their
+signatures for a given SHAKE_NOISE_ABI_VERSION, callers should compare it with
+shakeNoiseAbiVersion() of the library they loaded.
+
+*/
+
+// System Includes
+#include <stddef.h>
+#include <stdint.h>
+
+
+
+#if defined(_WIN32)
+#  if defined(SHAKE_NOISE_EXPORTS)
+#    define SHAKE_NOISE_API __declspec(dllexport)
+#  else
+#    define SHAKE_NOISE_API __declspec(dllimport)
+#  endif
+#else
+#  define SHAKE_NOISE_API __attribute__((visibility("default")))
+#endif
+
+#define SHAKE_NOISE_ABI_VERSION 1
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+
+/* Status codes returned by the evaluation functions. */
+#define SHAKE_NOISE_OK 0
+#define SHAKE_NOISE_INVALID_ARGUMENT 1  // Null buffer for a non-zero count, or an unknown enum value
+#define SHAKE_NOISE_INTERNAL_ERROR 2    // Out of memory or another unexpected failure, outputs are undefined
+
+/* Values of the precision argument, same as the precision attribute of the nodes. */
+#define SHAKE_NOISE_PRECISION_DOUBLE 0
+#define SHAKE_NOISE_PRECISION_SINGLE 1
+
+/* Values of the engine argument, same as the noiseEngine attribute of the nodes. */
+#define SHAKE_NOISE_ENGINE_PERLIN 0
+#define SHAKE_NOISE_ENGINE_GRADIENT1D 1
+#define SHAKE_NOISE_ENGINE_HASH 2
+
+/* Values of ShakeNoiseLayer.fractalMode, same as the fractalMode attribute of the nodes. */
+#define SHAKE_NOISE_FRACTAL_CLASSIC 0
+#define SHAKE_NOISE_FRACTAL_FBM 1
+
+
+
+typedef struct ShakeNoiseLayer {
+  /* One element of the shakeLayer compound, 88 bytes without implicit padding.
+
+  The fields keep their offsets for a given SHAKE_NOISE_ABI_VERSION, so arrays of
+  layers can be built in place by other languages, for example as a NumPy
+  structured array.
+
+  */
+  double weight;        // Offset 0
+  int32_t seed;         // Offset 8
+  int32_t fractalMode;  // Offset 12, SHAKE_NOISE_FRACTAL_CLASSIC or SHAKE_NOISE_FRACTAL_FBM
+  double frequency;     // Offset 16
+  double strength[3];   // Offset 24, X, Y and Z
+  double fractal;       // Offset 48, fractalNoise
+  double rough;         // Offset 56, roughness
+  int32_t octaves;      // Offset 64
+  int32_t reserved;     // Offset 68, must be 0
+  double lacunarity;    // Offset 72
+  double gain;          // Offset 80
+} ShakeNoiseLayer;
+
+
+
+SHAKE_NOISE_API uint32_t shakeNoiseAbiVersion(void);
+SHAKE_NOISE_API const char *shakeNoiseStatusString(int status);
+SHAKE_NOISE_API void shakeNoiseDefaultLayer(ShakeNoiseLayer *layer);
+SHAKE_NOISE_API int shakeNoiseEvaluate(const ShakeNoiseLayer *layers, size_t numLayers, const double *times, size_t numTimes, int precision, int engine, double errorBudget, double *output);
+SHAKE_NOISE_API int shakeNoiseEvaluateDerivatives(const ShakeNoiseLayer *layers, size_t numLayers, const double *times, size_t numTimes, int precision, int engine, double errorBudget, double *output, double *velocity, double *acceleration);
+
+
+
+#ifdef __cplusplus
+}
+#endif
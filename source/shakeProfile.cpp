@@ -0,0 +1,228 @@
+#include "shakeProfile.h"
+
+// System Includes
+#include <algorithm>
+#include <cstdio>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+
+namespace {
+
+struct TraceEvent {
+  /* One complete event of the trace, times in nanoseconds since the start of the recording. */
+  std::string name;
+  const char *category;
+  std::uint64_t start;
+  std::uint64_t duration;
+  std::size_t thread;
+  bool cacheHit;
+  std::uint64_t layersEvaluated;
+};
+
+std::mutex traceMutex;
+std::vector<TraceEvent> traceEvents;
+std::size_t traceMaxEvents = 0;
+std::uint64_t traceStart = 0;
+
+std::string escapeJson(const std::string &text) {
+  /* Escapes a string for a JSON string literal.
+
+  Args:
+    text (string): Text to escape
+
+  Returns:
+    string: Escaped text, without the surrounding quotes
+
+  */
+  std::string escaped;
+  for (char character : text) {
+    if (character == '"' || character == '\\') {
+      escaped += '\\';
+      escaped += character;
+    } else if ((unsigned char) character < 0x20) {
+      char code[8];
+      std::snprintf(code, sizeof(code), "\\u%04x", (unsigned int) character);
+      escaped += code;
+    } else {
+      escaped += character;
+    }
+  }
+  return escaped;
+}
+
+}
+
+
+
+std::atomic<bool> ShakeTrace::_recording(false);
+
+ShakeProfileStats &ShakeProfileStats::operator+=(const ShakeProfileStats &other) {
+  /* Adds the counters of another node, the max time is the larger of both.
+
+  Args:
+    other (ShakeProfileStats&): Stats to add
+
+  Returns:
+    ShakeProfileStats&: This stats
+
+  */
+  computeCalls += other.computeCalls;
+  cacheHits += other.cacheHits;
+  layersEvaluated += other.layersEvaluated;
+  layersSkipped += other.layersSkipped;
+  totalSeconds += other.totalSeconds;
+  maxSeconds = std::max(maxSeconds, other.maxSeconds);
+  return *this;
+}
+
+void ShakeProfileCounters::addCompute(std::uint64_t nanoseconds, bool cacheHit, std::uint64_t layersEvaluated, std::uint64_t layersSkipped) {
+  /* Adds one compute to the counters.
+
+  Args:
+    nanoseconds (uint64_t): Duration of the compute
+    cacheHit (bool): Whether the compute was served from a cache
+    layersEvaluated (uint64_t): Number of layers evaluated live
+    layersSkipped (uint64_t): Number of layers skipped for their weight of 0
+
+  */
+  _computeCalls.fetch_add(1, std::memory_order_relaxed);
+  _cacheHits.fetch_add(cacheHit ? 1 : 0, std::memory_order_relaxed);
+  _layersEvaluated.fetch_add(layersEvaluated, std::memory_order_relaxed);
+  _layersSkipped.fetch_add(layersSkipped, std::memory_order_relaxed);
+  _totalNanoseconds.fetch_add(nanoseconds, std::memory_order_relaxed);
+  std::uint64_t maxNanoseconds = _maxNanoseconds.load(std::memory_order_relaxed);
+  while (nanoseconds > maxNanoseconds && !_maxNanoseconds.compare_exchange_weak(maxNanoseconds, nanoseconds, std::memory_order_relaxed)) {
+  }
+}
+
+ShakeProfileStats ShakeProfileCounters::stats() const {
+  /* Reads the counters.
+
+  The counters are read one after the other, while computes run concurrently the
+  snapshot can be off by the computes that finish during the read.
+
+  Returns:
+    ShakeProfileStats: Current values of the counters
+
+  */
+  ShakeProfileStats stats;
+  stats.computeCalls = _computeCalls.load(std::memory_order_relaxed);
+  stats.cacheHits = _cacheHits.load(std::memory_order_relaxed);
+  stats.layersEvaluated = _layersEvaluated.load(std::memory_order_relaxed);
+  stats.layersSkipped = _layersSkipped.load(std::memory_order_relaxed);
+  stats.totalSeconds = _totalNanoseconds.load(std::memory_order_relaxed) * 1.0e-9;
+  stats.maxSeconds = _maxNanoseconds.load(std::memory_order_relaxed) * 1.0e-9;
+  return stats;
+}
+
+void ShakeProfileCounters::reset() {
+  /* Sets all counters back to 0. */
+  _computeCalls = 0;
+  _cacheHits = 0;
+  _layersEvaluated = 0;
+  _layersSkipped = 0;
+  _totalNanoseconds = 0;
+  _maxNanoseconds = 0;
+}
+
+void ShakeTrace::start(std::size_t maxEvents) {
+  /* Clears the recorded events and starts recording.
+
+  Args:
+    maxEvents (size_t): Number of events after which further events are dropped
+
+  */
+  std::lock_guard<std::mutex> lock(traceMutex);
+  traceEvents.clear();
+  traceMaxEvents = maxEvents;
+  traceStart = now();
+  _recording = true;
+}
+
+std::uint64_t ShakeTrace::now() {
+  /* Monotonic clock used for the counters and the trace, in nanoseconds. */
+  return (std::uint64_t) std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void ShakeTrace::addEvent(const std::string &name, const char *category, std::uint64_t start, std::uint64_t duration, bool cacheHit, std::uint64_t layersEvaluated) {
+  /* Records a complete event if recording.
+
+  Args:
+    name (string): Name of the event, the node that computed
+    category (const char*): Category of the event, the node type, must outlive the recording
+    start (uint64_t): Start of the event, from now()
+    duration (uint64_t): Duration of the event in nanoseconds
+    cacheHit (bool): Whether the compute was served from a cache
+    layersEvaluated (uint64_t): Number of layers evaluated live
+
+  */
+  std::size_t thread = std::hash<std::thread::id>()(std::this_thread::get_id());
+  std::lock_guard<std::mutex> lock(traceMutex);
+  if (!_recording || traceEvents.size() >= traceMaxEvents) {
+    return;
+  }
+  traceEvents.push_back({name, category, start - std::min(start, traceStart), duration, thread, cacheHit, layersEvaluated});
+}
+
+bool ShakeTrace::write(const std::string &path, std::string *error) {
+  /* Stops recording and writes the recorded events as a Chrome trace JSON file.
+
+  Threads are numbered in the order they first computed, times are written in
+  microseconds as the format expects. Recording only stops once the file is open,
+  and if it can't be written the events are kept, so a dump to a bad path can be
+  retried.
+
+  Args:
+    path (string): Path of the JSON file to write
+    error (string*): Receives the reason the file could not be written, or nullptr
+
+  Returns:
+    bool: True if the file was written
+
+  */
+  FILE *file = std::fopen(path.c_str(), "w");
+  if (file == nullptr) {
+    if (error != nullptr) {
+      *error = "Could not open " + path + " for writing";
+    }
+    return false;
+  }
+
+  std::vector<TraceEvent> events;
+  {
+    std::lock_guard<std::mutex> lock(traceMutex);
+    _recording = false;
+    events.swap(traceEvents);
+  }
+
+  std::vector<std::size_t> threads;
+  std::fputs("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[", file);
+  for (std::size_t i = 0; i < events.size(); ++i) {
+    const TraceEvent &event = events[i];
+    std::size_t thread = std::find(threads.begin(), threads.end(), event.thread) - threads.begin();
+    if (thread == threads.size()) {
+      threads.push_back(event.thread);
+    }
+    std::fprintf(file, "%s\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%zu,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"cacheHit\":%s,\"layersEvaluated\":%llu}}",
+      i == 0 ? "" : ",", escapeJson(event.name).c_str(), event.category, thread,
+      event.start * 1.0e-3, event.duration * 1.0e-3, event.cacheHit ? "true" : "false", (unsigned long long) event.layersEvaluated);
+  }
+  std::fputs("\n]}\n", file);
+
+  bool written = std::ferror(file) == 0;
+  written = std::fclose(file) == 0 && written;
+  if (!written) {
+    if (error != nullptr) {
+      *error = "Could not write " + path;
+    }
+    std::lock_guard<std::mutex> lock(traceMutex);
+    if (traceEvents.empty()) {
+      events.swap(traceEvents);
+    }
+  }
+  return written;
+}
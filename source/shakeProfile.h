@@ -0,0 +1,75 @@
+#pragma once
+
+// System Includes
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+
+
+struct ShakeProfileStats {
+  /* Snapshot of the compute counters of a node, or of all nodes. */
+  std::uint64_t computeCalls = 0;
+  std::uint64_t cacheHits = 0;
+  std::uint64_t layersEvaluated = 0;
+  std::uint64_t layersSkipped = 0;
+  double totalSeconds = 0.0;
+  double maxSeconds = 0.0;
+
+  ShakeProfileStats &operator+=(const ShakeProfileStats &other);
+};
+
+
+
+class ShakeProfileCounters {
+  /* Compute counters, safe to update from many evaluation threads at once.
+
+  Layers are counted once per shake evaluated live, so an array node adds its layers
+  for every element and a motion blur evaluation for every sub-sample. Layers with a
+  weight of 0 are counted as skipped. Computes served from a curve cache or cache
+  file count as cache hits and evaluate no layers.
+
+  */
+
+public:
+  // Public Methods
+  void addCompute(std::uint64_t nanoseconds, bool cacheHit, std::uint64_t layersEvaluated, std::uint64_t layersSkipped);
+  ShakeProfileStats stats() const;
+  void reset();
+
+private:
+  // Private Data
+  std::atomic<std::uint64_t> _computeCalls{0};
+  std::atomic<std::uint64_t> _cacheHits{0};
+  std::atomic<std::uint64_t> _layersEvaluated{0};
+  std::atomic<std::uint64_t> _layersSkipped{0};
+  std::atomic<std::uint64_t> _totalNanoseconds{0};
+  std::atomic<std::uint64_t> _maxNanoseconds{0};
+};
+
+
+
+class ShakeTrace {
+  /* Recorder of compute events for the Chrome trace viewer (chrome://tracing, Perfetto).
+
+  Recording is off by default and costs a single atomic load per compute then. While
+  recording every compute adds one complete event with its node, thread, start and
+  duration, up to a fixed number of events so a forgotten recording cannot grow
+  without bounds.
+
+  */
+
+public:
+  // Public Methods
+  static void start(std::size_t maxEvents=1000000);
+  static bool isRecording() {return _recording.load(std::memory_order_relaxed);}
+  static std::uint64_t now();
+  static void addEvent(const std::string &name, const char *category, std::uint64_t start, std::uint64_t duration, bool cacheHit, std::uint64_t layersEvaluated);
+  static bool write(const std::string &path, std::string *error=nullptr);
+
+private:
+  // Private Data
+  static std::atomic<bool> _recording;
+};
@@ -0,0 +1,456 @@
+#include "shakeTransformNode.h"
+
+
+
+// Node's attributes
+const MString ShakeTransformNode::typeName("shakeTransformNode");
+const MTypeId ShakeTransformNode::typeId(0x00122713);
+
+// Node's input attributes
+MObject ShakeTransformNode::enableAttr;
+MObject ShakeTransformNode::inTimeAttr;
+MObject ShakeTransformNode::precisionAttr;
+MObject ShakeTransformNode::noiseEngineAttr;
+MObject ShakeTransformNode::rotateOrderAttr;
+MObject ShakeTransformNode::errorBudgetAttr;
+MObject ShakeTransformNode::weightAttr;
+MObject ShakeTransformNode::seedAttr;
+MObject ShakeTransformNode::frequencyAttr;
+MObject ShakeTransformNode::strengthAttrX;
+MObject ShakeTransformNode::strengthAttrY;
+MObject ShakeTransformNode::strengthAttrZ;
+MObject ShakeTransformNode::strengthAttr;
+MObject ShakeTransformNode::fractalAttr;
+MObject ShakeTransformNode::roughnessAttr;
+MObject ShakeTransformNode::fractalModeAttr;
+MObject ShakeTransformNode::octavesAttr;
+MObject ShakeTransformNode::lacunarityAttr;
+MObject ShakeTransformNode::gainAttr;
+MObject ShakeTransformNode::shakeAttr;
+MObject ShakeTransformNode::RotateLayer::weightAttr;
+MObject ShakeTransformNode::RotateLayer::seedAttr;
+MObject ShakeTransformNode::RotateLayer::frequencyAttr;
+MObject ShakeTransformNode::RotateLayer::strengthAttrX;
+MObject ShakeTransformNode::RotateLayer::strengthAttrY;
+MObject ShakeTransformNode::RotateLayer::strengthAttrZ;
+MObject ShakeTransformNode::RotateLayer::strengthAttr;
+MObject ShakeTransformNode::RotateLayer::fractalAttr;
+MObject ShakeTransformNode::RotateLayer::roughnessAttr;
+MObject ShakeTransformNode::RotateLayer::fractalModeAttr;
+MObject ShakeTransformNode::RotateLayer::octavesAttr;
+MObject ShakeTransformNode::RotateLayer::lacunarityAttr;
+MObject ShakeTransformNode::RotateLayer::gainAttr;
+MObject ShakeTransformNode::RotateLayer::shakeAttr;
+MObject &ShakeTransformNode::RotateLayer::precisionAttr = ShakeTransformNode::precisionAttr;
+MObject &ShakeTransformNode::RotateLayer::noiseEngineAttr = ShakeTransformNode::noiseEngineAttr;
+MObject &ShakeTransformNode::RotateLayer::errorBudgetAttr = ShakeTransformNode::errorBudgetAttr;
+
+// Node's output attributes
+MObject ShakeTransformNode::outputTranslateAttrX;
+MObject ShakeTransformNode::outputTranslateAttrY;
+MObject ShakeTransformNode::outputTranslateAttrZ;
+MObject ShakeTransformNode::outputTranslateAttr;
+MObject ShakeTransformNode::outputRotateAttrX;
+MObject ShakeTransformNode::outputRotateAttrY;
+MObject ShakeTransformNode::outputRotateAttrZ;
+MObject ShakeTransformNode::outputRotateAttr;
+MObject ShakeTransformNode::outputMatrixAttr;
+MObject ShakeTransformNode::outputQuaternionAttrX;
+MObject ShakeTransformNode::outputQuaternionAttrY;
+MObject ShakeTransformNode::outputQuaternionAttrZ;
+MObject ShakeTransformNode::outputQuaternionAttrW;
+MObject ShakeTransformNode::outputQuaternionAttr;
+MObject ShakeTransformNode::culledLayersAttr;
+MObject ShakeTransformNode::culledBandsAttr;
+
+
+
+ShakeTransformNode::~ShakeTransformNode() {
+	/* ShakeTransformNode Destructor */
+}
+
+template <class LayerT>
+MObject ShakeTransformNode::createShakeLayerAttributes(const MString &prefix, const MString &shortPrefix, double strength) {
+	/* Creates a layer array compound and its children.
+
+	Both layer arrays live on the same node, so the names of their children start
+	with the name of the array to stay unique.
+
+	Args:
+		prefix (MString&): Start of the long names, translate or rotate
+		shortPrefix (MString&): Start of the short names
+		strength (double): Default strength of the layers
+
+	Returns:
+		MObject: The layer array compound, also stored in LayerT::shakeAttr
+
+	*/
+	MFnNumericAttribute nAttr;
+	MFnEnumAttribute eAttr;
+	MFnCompoundAttribute cAttr;
+
+	LayerT::weightAttr = nAttr.create(prefix + "Weight", shortPrefix + "wgt", MFnNumericData::kDouble, 1.0);
+	nAttr.setMin(0);
+	nAttr.setMax(1);
+
+	LayerT::seedAttr = nAttr.create(prefix + "Seed", shortPrefix + "sed", MFnNumericData::kInt, 21);
+	nAttr.setMin(0);
+
+	LayerT::frequencyAttr = nAttr.create(prefix + "Frequency", shortPrefix + "frq", MFnNumericData::kDouble, 1.0);
+	nAttr.setMin(0.001);
+	nAttr.setMax(10);
+
+	LayerT::strengthAttrX = nAttr.create(prefix + "StrengthX", shortPrefix + "strX", MFnNumericData::kDouble, strength);
+	LayerT::strengthAttrY = nAttr.create(prefix + "StrengthY", shortPrefix + "strY", MFnNumericData::kDouble, strength);
+	LayerT::strengthAttrZ = nAttr.create(prefix + "StrengthZ", shortPrefix + "strZ", MFnNumericData::kDouble, strength);
+	LayerT::strengthAttr = nAttr.create(prefix + "Strength", shortPrefix + "str", LayerT::strengthAttrX, LayerT::strengthAttrY, LayerT::strengthAttrZ);
+
+	LayerT::fractalAttr = nAttr.create(prefix + "FractalNoise", shortPrefix + "frn", MFnNumericData::kDouble, 0.0);
+	nAttr.setMin(0);
+	nAttr.setMax(1);
+
+	LayerT::roughnessAttr = nAttr.create(prefix + "Roughness", shortPrefix + "rgh", MFnNumericData::kDouble, 0.0);
+	nAttr.setMin(0);
+	nAttr.setMax(1);
+
+	LayerT::fractalModeAttr = eAttr.create(prefix + "FractalMode", shortPrefix + "frm", static_cast<short>(FractalMode::kClassic));
+	eAttr.addField("Classic", static_cast<short>(FractalMode::kClassic));
+	eAttr.addField("fBm", static_cast<short>(FractalMode::kFbm));
+
+	LayerT::octavesAttr = nAttr.create(prefix + "Octaves", shortPrefix + "oct", MFnNumericData::kInt, 4);
+	nAttr.setMin(1);
+	nAttr.setMax(PerlinNoise::fbmMaxOctaves);
+
+	LayerT::lacunarityAttr = nAttr.create(prefix + "Lacunarity", shortPrefix + "lac", MFnNumericData::kDouble, 2.0);
+	nAttr.setMin(1);
+	nAttr.setSoftMax(4);
+
+	LayerT::gainAttr = nAttr.create(prefix + "Gain", shortPrefix + "gan", MFnNumericData::kDouble, 0.5);
+	nAttr.setMin(0);
+	nAttr.setMax(1);
+
+	LayerT::shakeAttr = cAttr.create(prefix + "Layer", shortPrefix + "ly");
+	cAttr.addChild(LayerT::weightAttr);
+	cAttr.addChild(LayerT::seedAttr);
+	cAttr.addChild(LayerT::frequencyAttr);
+	cAttr.addChild(LayerT::strengthAttr);
+	cAttr.addChild(LayerT::fractalAttr);
+	cAttr.addChild(LayerT::roughnessAttr);
+	cAttr.addChild(LayerT::fractalModeAttr);
+	cAttr.addChild(LayerT::octavesAttr);
+	cAttr.addChild(LayerT::lacunarityAttr);
+	cAttr.addChild(LayerT::gainAttr);
+	cAttr.setArray(true);
+	cAttr.setKeyable(true);
+	cAttr.setReadable(false);
+
+	return LayerT::shakeAttr;
+}
+
+MStatus ShakeTransformNode::initialize() {
+	/* Node initializer.
+
+	This method initializes the node, and should be overridden in user-defined
+	nodes.
+
+	Returns:
+		status code (MStatus): kSuccess if the operation was successful,
+			kFailure if an error occured during the operation
+
+	*/
+	MStatus status;
+	MFnNumericAttribute nAttr;
+	MFnEnumAttribute eAttr;
+	MFnUnitAttribute uAttr;
+	MFnMatrixAttribute mAttr;
+
+	enableAttr = nAttr.create("enable", "ena", MFnNumericData::kBoolean, 1);
+	nAttr.setKeyable(true);
+	nAttr.setReadable(false);
+
+	inTimeAttr = uAttr.create("inTime", "itm", MFnUnitAttribute::kTime);
+	uAttr.setKeyable(true);
+	uAttr.setReadable(false);
+
+	precisionAttr = eAttr.create("precision", "prc", static_cast<short>(kDefaultNoisePrecision));
+	eAttr.addField("Double", static_cast<short>(NoisePrecision::kDouble));
+	eAttr.addField("Single", static_cast<short>(NoisePrecision::kSingle));
+	eAttr.setReadable(false);
+
+	noiseEngineAttr = eAttr.create("noiseEngine", "nen", static_cast<short>(NoiseEngine::kPerlin));
+	eAttr.addField("Perlin", static_cast<short>(NoiseEngine::kPerlin));
+	eAttr.addField("Gradient1D", static_cast<short>(NoiseEngine::kGradient1D));
+	eAttr.addField("Hash", static_cast<short>(NoiseEngine::kHash));
+	eAttr.setReadable(false);
+
+	// Same fields and order as the rotateOrder of a transform, so the two can be connected
+	rotateOrderAttr = eAttr.create("rotateOrder", "ro", static_cast<short>(MEulerRotation::kXYZ));
+	eAttr.addField("xyz", static_cast<short>(MEulerRotation::kXYZ));
+	eAttr.addField("yzx", static_cast<short>(MEulerRotation::kYZX));
+	eAttr.addField("zxy", static_cast<short>(MEulerRotation::kZXY));
+	eAttr.addField("xzy", static_cast<short>(MEulerRotation::kXZY));
+	eAttr.addField("yxz", static_cast<short>(MEulerRotation::kYXZ));
+	eAttr.addField("zyx", static_cast<short>(MEulerRotation::kZYX));
+	eAttr.setKeyable(true);
+	eAttr.setReadable(false);
+
+	// Shared by both stacks, in scene units for the translation and degrees for the rotation
+	errorBudgetAttr = nAttr.create("errorBudget", "erb", MFnNumericData::kDouble, 0.0);
+	nAttr.setMin(0);
+	nAttr.setSoftMax(1);
+	nAttr.setReadable(false);
+
+	createShakeLayerAttributes<ShakeTransformNode>("translate", "t", 10.0);
+	createShakeLayerAttributes<RotateLayer>("rotate", "r", 10.0);
+
+	outputTranslateAttrX = nAttr.create("outputTranslateX", "otX", MFnNumericData::kDouble, 0.0);
+	outputTranslateAttrY = nAttr.create("outputTranslateY", "otY", MFnNumericData::kDouble, 0.0);
+	outputTranslateAttrZ = nAttr.create("outputTranslateZ", "otZ", MFnNumericData::kDouble, 0.0);
+	outputTranslateAttr = nAttr.create("outputTranslate", "ot", outputTranslateAttrX, outputTranslateAttrY, outputTranslateAttrZ);
+	nAttr.setWritable(false);
+	nAttr.setStorable(false);
+
+	outputRotateAttrX = uAttr.create("outputRotateX", "orX", MFnUnitAttribute::kAngle, 0.0);
+	outputRotateAttrY = uAttr.create("outputRotateY", "orY", MFnUnitAttribute::kAngle, 0.0);
+	outputRotateAttrZ = uAttr.create("outputRotateZ", "orZ", MFnUnitAttribute::kAngle, 0.0);
+	outputRotateAttr = nAttr.create("outputRotate", "orot", outputRotateAttrX, outputRotateAttrY, outputRotateAttrZ);
+	nAttr.setWritable(false);
+	nAttr.setStorable(false);
+
+	outputMatrixAttr = mAttr.create("outputMatrix", "omat", MFnMatrixAttribute::kDouble);
+	mAttr.setWritable(false);
+	mAttr.setStorable(false);
+
+	// Unit quaternion of the rotation, W is 1 at rest
+	MFnCompoundAttribute cAttr;
+	outputQuaternionAttrX = nAttr.create("outputQuaternionX", "oqX", MFnNumericData::kDouble, 0.0);
+	nAttr.setWritable(false);
+	outputQuaternionAttrY = nAttr.create("outputQuaternionY", "oqY", MFnNumericData::kDouble, 0.0);
+	nAttr.setWritable(false);
+	outputQuaternionAttrZ = nAttr.create("outputQuaternionZ", "oqZ", MFnNumericData::kDouble, 0.0);
+	nAttr.setWritable(false);
+	outputQuaternionAttrW = nAttr.create("outputQuaternionW", "oqW", MFnNumericData::kDouble, 1.0);
+	nAttr.setWritable(false);
+	outputQuaternionAttr = cAttr.create("outputQuaternion", "oq");
+	cAttr.addChild(outputQuaternionAttrX);
+	cAttr.addChild(outputQuaternionAttrY);
+	cAttr.addChild(outputQuaternionAttrZ);
+	cAttr.addChild(outputQuaternionAttrW);
+	cAttr.setWritable(false);
+	cAttr.setStorable(false);
+
+	culledLayersAttr = nAttr.create("culledLayers", "cly", MFnNumericData::kInt, 0);
+	nAttr.setWritable(false);
+	nAttr.setStorable(false);
+
+	culledBandsAttr = nAttr.create("culledBands", "cbd", MFnNumericData::kInt, 0);
+	nAttr.setWritable(false);
+	nAttr.setStorable(false);
+
+	addAttribute(enableAttr);
+	addAttribute(inTimeAttr);
+	addAttribute(precisionAttr);
+	addAttribute(noiseEngineAttr);
+	addAttribute(rotateOrderAttr);
+	addAttribute(errorBudgetAttr);
+	addAttribute(shakeAttr);
+	addAttribute(RotateLayer::shakeAttr);
+	addAttribute(outputTranslateAttr);
+	addAttribute(outputRotateAttr);
+	addAttribute(outputMatrixAttr);
+	addAttribute(outputQuaternionAttr);
+	addAttribute(culledLayersAttr);
+	addAttribute(culledBandsAttr);
+
+	// Every output comes from the same compute, so every input affects all of them
+	for (const MObject *output : {&outputTranslateAttr, &outputRotateAttr, &outputMatrixAttr, &outputQuaternionAttr}) {
+		attributeAffects(enableAttr, *output);
+		attributeAffects(inTimeAttr, *output);
+		attributeAffects(precisionAttr, *output);
+		attributeAffects(noiseEngineAttr, *output);
+		attributeAffects(rotateOrderAttr, *output);
+		attributeAffects(errorBudgetAttr, *output);
+		attributeAffects(shakeAttr, *output);
+		attributeAffects(RotateLayer::shakeAttr, *output);
+	}
+	for (const MObject *output : {&culledLayersAttr, &culledBandsAttr}) {
+		attributeAffects(errorBudgetAttr, *output);
+		attributeAffects(shakeAttr, *output);
+		attributeAffects(RotateLayer::shakeAttr, *output);
+	}
+
+	return MS::kSuccess;
+}
+
+MStatus ShakeTransformNode::compute(const MPlug &plug, MDataBlock &dataBlock) {
+	/* Computes the translation and rotation shakes and the outputs built from them.
+
+	Both stacks are evaluated at the same time and written to all outputs at once,
+	so pulling the matrix and any of the channels in the same evaluation costs one
+	compute. The rotation is applied before the translation, like the rotate and
+	translate of a transform, so the matrix is the one of a transform with the
+	shaken channels.
+
+	Args:
+		plug (MPlug&): Plug representing the attribute that needs to be recomputed
+		dataBlock (MDataBlock&): Data block containing storage for the node's attributes
+
+	Returns:
+		status code (MStatus): kSuccess if the operation was successful,
+			kFailure if an error occured during the operation
+
+	*/
+	MStatus status;
+
+	// The culled outputs count the layers and bands of both stacks
+	if (isCullPlug<ShakeTransformNode>(plug)) {
+		ShakeCullStats translateStats;
+		ShakeCullStats rotateStats;
+		layerStack<ShakeTransformNode>(dataBlock, &translateStats);
+		rotateLayerStack(dataBlock, &rotateStats);
+		translateStats.layersCulled += rotateStats.layersCulled;
+		translateStats.bandsCulled += rotateStats.bandsCulled;
+		return writeCullStats(dataBlock, culledLayersAttr, culledBandsAttr, translateStats);
+	}
+
+	ShakeComputeScope computeScope(*this, typeName.asChar());
+
+	bool enable = dataBlock.inputValue(enableAttr, &status).asBool();
+	if (enable == 0) {
+		dataBlock.setClean(outputTranslateAttr);
+		dataBlock.setClean(outputRotateAttr);
+		dataBlock.setClean(outputMatrixAttr);
+		dataBlock.setClean(outputQuaternionAttr);
+		return MS::kSuccess;
+	}
+
+	double uiTime = dataBlock.inputValue(inTimeAttr, &status).asTime().asUnits(MTime::uiUnit());
+	NoisePrecision precision = static_cast<NoisePrecision>(dataBlock.inputValue(precisionAttr, &status).asShort());
+	NoiseEngine engine = static_cast<NoiseEngine>(dataBlock.inputValue(noiseEngineAttr, &status).asShort());
+	MEulerRotation::RotationOrder rotateOrder = static_cast<MEulerRotation::RotationOrder>(dataBlock.inputValue(rotateOrderAttr, &status).asShort());
+
+	const ShakeLayerStack &translateLayers = layerStack<ShakeTransformNode>(dataBlock);
+	const ShakeLayerStack &rotateLayers = rotateLayerStack(dataBlock);
+	double translate[3] = {0.0, 0.0, 0.0};
+	double rotate[3] = {0.0, 0.0, 0.0};
+	PerlinNoise::accumulateShakeStack(translateLayers, uiTime, translate, precision, engine);
+	PerlinNoise::accumulateShakeStack(rotateLayers, uiTime, rotate, precision, engine);
+	ShakeComputeScope::countLayers(translateLayers);
+	ShakeComputeScope::countLayers(rotateLayers);
+	for (double &angle : rotate) {
+		angle *= pi / 180;
+	}
+
+	MEulerRotation rotation(rotate[0], rotate[1], rotate[2], rotateOrder);
+	MMatrix matrix = rotation.asMatrix();
+	matrix(3, 0) = translate[0];
+	matrix(3, 1) = translate[1];
+	matrix(3, 2) = translate[2];
+	MQuaternion quaternion = rotation.asQuaternion();
+
+	MDataHandle translateDH = dataBlock.outputValue(outputTranslateAttr, &status);
+	CHECK_MSTATUS_AND_RETURN_IT(status);
+	translateDH.set3Double(translate[0], translate[1], translate[2]);
+	translateDH.setClean();
+
+	MDataHandle rotateDH = dataBlock.outputValue(outputRotateAttr, &status);
+	CHECK_MSTATUS_AND_RETURN_IT(status);
+	rotateDH.set3Double(rotate[0], rotate[1], rotate[2]);
+	rotateDH.setClean();
+
+	MDataHandle matrixDH = dataBlock.outputValue(outputMatrixAttr, &status);
+	CHECK_MSTATUS_AND_RETURN_IT(status);
+	matrixDH.setMMatrix(matrix);
+	matrixDH.setClean();
+
+	MDataHandle quaternionDH = dataBlock.outputValue(outputQuaternionAttr, &status);
+	CHECK_MSTATUS_AND_RETURN_IT(status);
+	quaternionDH.child(outputQuaternionAttrX).setDouble(quaternion.x);
+	quaternionDH.child(outputQuaternionAttrY).setDouble(quaternion.y);
+	quaternionDH.child(outputQuaternionAttrZ).setDouble(quaternion.z);
+	quaternionDH.child(outputQuaternionAttrW).setDouble(quaternion.w);
+	quaternionDH.setClean();
+
+	return MS::kSuccess;
+}
+
+const ShakeLayerStack &ShakeTransformNode::rotateLayerStack(MDataBlock &dataBlock, ShakeCullStats *cullStats) {
+	/* Rotate layers to evaluate for the context of the data block.
+
+	Kept the same way as layerStack keeps the translate layers, with a copy that is
+	only read again after a rotate layer plug was dirtied.
+
+	Args:
+		dataBlock (MDataBlock&): Data block containing storage for the node's attributes
+		cullStats (ShakeCullStats*): Receives what the error budget culled, or nullptr
+
+	Returns:
+		ShakeLayerStack&: Rotate layers of the node, valid until the next call on this thread
+
+	*/
+	thread_local ShakeLayerStack contextLayers;
+
+	if (!dataBlock.context().isNormal()) {
+		ShakeCullStats contextStats = readShakeLayers<RotateLayer>(dataBlock, contextLayers);
+		if (cullStats != nullptr) {
+			*cullStats = contextStats;
+		}
+		return contextLayers;
+	}
+	if (_rotateLayersDirty.exchange(false)) {
+		_rotateCullStats = readShakeLayers<RotateLayer>(dataBlock, _rotateLayerStack);
+	}
+	if (cullStats != nullptr) {
+		*cullStats = _rotateCullStats;
+	}
+	return _rotateLayerStack;
+}
+
+MStatus ShakeTransformNode::setDependentsDirty(const MPlug &plug, MPlugArray &plugArray) {
+	/* Invalidates the copies of the layers when a layer attribute is dirtied.
+
+	Args:
+		plug (MPlug&): Plug being dirtied
+		plugArray (MPlugArray&): Extra plugs to mark dirty, left untouched
+
+	Returns:
+		status code (MStatus): kSuccess if the operation was successful,
+			kFailure if an error occured during the operation
+
+	*/
+	invalidateOnDirty<ShakeTransformNode>(plug);
+	MObject attribute = plug.attribute();
+	for (const MObject *layerAttribute : shakeLayerAttributes<RotateLayer>()) {
+		if (attribute == *layerAttribute) {
+			_rotateLayersDirty = true;
+			break;
+		}
+	}
+
+	return MPxNode::setDependentsDirty(plug, plugArray);
+}
+
+MStatus ShakeTransformNode::preEvaluation(const MDGContext &context, const MEvaluationNode &evaluationNode) {
+	/* Invalidates the copies of the layers before an Evaluation Manager evaluation.
+
+	Args:
+		context (MDGContext&): Context of the evaluation
+		evaluationNode (MEvaluationNode&): Evaluation node holding the dirty plugs
+
+	Returns:
+		status code (MStatus): kSuccess if the operation was successful,
+			kFailure if an error occured during the operation
+
+	*/
+	if (context.isNormal()) {
+		invalidateOnDirty<ShakeTransformNode>(evaluationNode);
+		for (const MObject *layerAttribute : shakeLayerAttributes<RotateLayer>()) {
+			if (evaluationNode.dirtyPlugExists(*layerAttribute)) {
+				_rotateLayersDirty = true;
+				break;
+			}
+		}
+	}
+
+	return MS::kSuccess;
+}
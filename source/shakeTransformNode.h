@@ -0,0 +1,129 @@
+#pragma once
+
+#include "shakeNode.h"
+
+// System Includes
+#include <atomic>
+
+// Maya Api Includes
+#include <maya/MPxNode.h>
+#include <maya/MGlobal.h>
+#include <maya/MDataHandle.h>
+#include <maya/MEulerRotation.h>
+#include <maya/MMatrix.h>
+#include <maya/MQuaternion.h>
+
+// Function Sets
+#include <maya/MFnNumericAttribute.h>
+#include <maya/MFnEnumAttribute.h>
+#include <maya/MFnUnitAttribute.h>
+#include <maya/MFnCompoundAttribute.h>
+#include <maya/MFnMatrixAttribute.h>
+
+
+
+class ShakeTransformNode: public ShakeNode {
+	/* Shakes translation and rotation together and outputs them as one matrix.
+
+	The translateLayer and rotateLayer arrays are two independent layer stacks, both
+	evaluated in the same compute. The results are written to the outputTranslate and
+	outputRotate channels, to outputMatrix for a direct connection to the
+	offsetParentMatrix of a transform, and to outputQuaternion. A shaken object then
+	needs a single node and a single connection, and keeps its own channels free for
+	animation.
+
+	The node itself provides the translate layer attributes to the ShakeNode templates,
+	RotateLayer the rotate layer attributes.
+
+	*/
+
+public:
+	// Constructors
+	ShakeTransformNode(): ShakeNode(), _rotateLayersDirty(true) {};
+
+	// Destructor
+	virtual ~ShakeTransformNode() override;
+
+	// Public Methods
+	static void *creator() {return new ShakeTransformNode();}
+	static MStatus initialize();
+	virtual MStatus compute(const MPlug &plug, MDataBlock &dataBlock) override;
+	virtual MStatus setDependentsDirty(const MPlug &plug, MPlugArray &plugArray) override;
+	virtual MStatus preEvaluation(const MDGContext &context, const MEvaluationNode &evaluationNode) override;
+
+	// Node's attributes
+	static const MString typeName;
+	static const MTypeId typeId;
+
+	// Node's input attributes
+	static MObject enableAttr;
+	static MObject inTimeAttr;
+	static MObject precisionAttr;
+	static MObject noiseEngineAttr;
+	static MObject rotateOrderAttr;
+	static MObject errorBudgetAttr;
+	static MObject weightAttr;
+	static MObject seedAttr;
+	static MObject frequencyAttr;
+	static MObject strengthAttrX;
+	static MObject strengthAttrY;
+	static MObject strengthAttrZ;
+	static MObject strengthAttr;
+	static MObject fractalAttr;
+	static MObject roughnessAttr;
+	static MObject fractalModeAttr;
+	static MObject octavesAttr;
+	static MObject lacunarityAttr;
+	static MObject gainAttr;
+	static MObject shakeAttr;
+
+	struct RotateLayer {
+		/* Attributes of the rotateLayer array, in degrees. */
+		static MObject weightAttr;
+		static MObject seedAttr;
+		static MObject frequencyAttr;
+		static MObject strengthAttrX;
+		static MObject strengthAttrY;
+		static MObject strengthAttrZ;
+		static MObject strengthAttr;
+		static MObject fractalAttr;
+		static MObject roughnessAttr;
+		static MObject fractalModeAttr;
+		static MObject octavesAttr;
+		static MObject lacunarityAttr;
+		static MObject gainAttr;
+		static MObject shakeAttr;
+		static MObject &precisionAttr;
+		static MObject &noiseEngineAttr;
+		static MObject &errorBudgetAttr;
+	};
+
+	// Node's output attributes
+	static MObject outputTranslateAttrX;
+	static MObject outputTranslateAttrY;
+	static MObject outputTranslateAttrZ;
+	static MObject outputTranslateAttr;
+	static MObject outputRotateAttrX;
+	static MObject outputRotateAttrY;
+	static MObject outputRotateAttrZ;
+	static MObject outputRotateAttr;
+	static MObject outputMatrixAttr;
+	static MObject outputQuaternionAttrX;
+	static MObject outputQuaternionAttrY;
+	static MObject outputQuaternionAttrZ;
+	static MObject outputQuaternionAttrW;
+	static MObject outputQuaternionAttr;
+	static MObject culledLayersAttr;
+	static MObject culledBandsAttr;
+
+private:
+	// Private Methods
+	template <class LayerT> static MObject createShakeLayerAttributes(const MString &prefix, const MString &shortPrefix, double strength);
+	const ShakeLayerStack &rotateLayerStack(MDataBlock &dataBlock, ShakeCullStats *cullStats=nullptr);
+
+	// Private Data
+	ShakeLayerStack _rotateLayerStack;
+	ShakeCullStats _rotateCullStats;
+	std::atomic<bool> _rotateLayersDirty;
+	const double pi = 3.14159265358979323846;
+};
@@ -0,0 +1,52 @@
+# Fails if an instruction set build of perlinNoiseKernels.cpp defines any global
+# symbol besides its NoiseKernelTable. A weak out of line copy of a shared inline
+# function compiled for AVX could otherwise replace the baseline one at link time.
+# The constexpr data members of PerlinNoise, like the permutation table, hold no
+# code and are shared with the other builds, they are only accepted as data symbols.
+#
+# Usage:
+#	cmake -DNM=<nm> -DTABLE=<table name> -DOBJECTS=<objects> -P checkKernelSymbols.cmake
+
+cmake_minimum_required(VERSION 3.13)
+
+foreach(OBJECT ${OBJECTS})
+	execute_process(
+		COMMAND ${NM} -g -P ${OBJECT}
+		OUTPUT_VARIABLE SYMBOLS
+		RESULT_VARIABLE RESULT
+	)
+	if(NOT RESULT EQUAL 0)
+		message(FATAL_ERROR "Could not list the symbols of ${OBJECT}")
+	endif()
+
+	string(REPLACE "\n" ";" SYMBOLS "${SYMBOLS}")
+	set(FOUND_TABLE OFF)
+	set(LEAKED "")
+	foreach(LINE ${SYMBOLS})
+		# POSIX format: name type [value size], undefined references are U, w or v
+		if(NOT LINE MATCHES "^([^ ]+) ([A-Za-z])")
+			continue()
+		endif()
+		set(NAME ${CMAKE_MATCH_1})
+		set(TYPE ${CMAKE_MATCH_2})
+		if(TYPE STREQUAL "U" OR TYPE STREQUAL "w" OR TYPE STREQUAL "v")
+			continue()
+		endif()
+		if(NAME MATCHES "^_?${TABLE}$")
+			set(FOUND_TABLE ON)
+		elseif(NAME MATCHES "^_?_ZN11PerlinNoise[0-9]+[A-Za-z0-9_]+E$" AND TYPE MATCHES "^[BDRSuV]$")
+			continue()
+		else()
+			list(APPEND LEAKED "${NAME} (${TYPE})")
+		endif()
+	endforeach()
+
+	if(NOT FOUND_TABLE)
+		message(FATAL_ERROR "${OBJECT} does not define ${TABLE}")
+	endif()
+	if(LEAKED)
+		string(REPLACE ";" "\n\t" LEAKED "${LEAKED}")
+		message(FATAL_ERROR "${OBJECT} defines global symbols besides ${TABLE}:\n\t${LEAKED}")
+	endif()
+	message(STATUS "${OBJECT} only defines ${TABLE}")
+endforeach()
@@ -0,0 +1,761 @@
+/* Equivalence test of the optimized noise kernels against a scalar reference.
+
+The reference is a frozen copy of the original scalar improved Perlin noise and
+of the layer formulas, evaluated one band of one axis at a time in double
+precision. A deterministic fuzzer draws random layer stacks, times and seeds and
+compares every public evaluation path with it for every engine and precision:
+calculateNoise, calculateNoiseBatch, accumulateShake, accumulateShakeArray,
+accumulateShakeStack, accumulateShakeStackSamples and
+accumulateShakeStackDerivatives, whose velocity is also checked against a
+central difference of the reference, and the C interface of shakeNoiseC.h when
+it is built. Stacks culled by ShakeLayerStack::cull have
+to stay within their error budget of the reference.
+
+Double precision results may differ from the reference by 4 ulp or 1e-12 of the
+layer amplitude, so a compiler contracting to FMA or reordering does not fail the
+test, results that are not bit identical are counted and reported separately.
+Single precision results may differ by maxSingleDeviation of the layer amplitude.
+A table of golden values pins the reference itself, so changing the look of any
+engine fails the test as well. Everything is checked once for every instruction
+set build of the kernels the machine supports.
+
+Usage:
+	noiseEquivalenceTest [iterations] [seed]
+	noiseEquivalenceTest --golden    prints the golden table of the current reference
+
+Returns 0 on success and 1 if any result is out of tolerance.
+
+*/
+#include "perlinNoise.h"
+#ifdef SHAKENODE_TEST_C_API
+#include "shakeNoiseC.h"
+#endif
+
+// System Includes
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+
+
+namespace reference {
+
+// Ken's permutation array, frozen copy of the original table
+constexpr int permutation[256] = {
+	151, 160, 137, 91, 90, 15, 131, 13, 201, 95, 96, 53, 194, 233, 7, 225,
+	140, 36, 103, 30, 69, 142, 8, 99, 37, 240, 21, 10, 23, 190, 6, 148,
+	247, 120, 234, 75, 0, 26, 197, 62, 94, 252, 219, 203, 117, 35, 11, 32,
+	57, 177, 33, 88, 237, 149, 56, 87, 174, 20, 125, 136, 171, 168, 68, 175,
+	74, 165, 71, 134, 139, 48, 27, 166, 77, 146, 158, 231, 83, 111, 229, 122,
+	60, 211, 133, 230, 220, 105, 92, 41, 55, 46, 245, 40, 244, 102, 143, 54,
+	65, 25, 63, 161, 1, 216, 80, 73, 209, 76, 132, 187, 208, 89, 18, 169,
+	200, 196, 135, 130, 116, 188, 159, 86, 164, 100, 109, 198, 173, 186, 3, 64,
+	52, 217, 226, 250, 124, 123, 5, 202, 38, 147, 118, 126, 255, 82, 85, 212,
+	207, 206, 59, 227, 47, 16, 58, 17, 182, 189, 28, 42, 223, 183, 170, 213,
+	119, 248, 152, 2, 44, 154, 163, 70, 221, 153, 101, 155, 167, 43, 172, 9,
+	129, 22, 39, 253, 19, 98, 108, 110, 79, 113, 224, 232, 178, 185, 112, 104,
+	218, 246, 97, 228, 251, 34, 242, 193, 238, 210, 144, 12, 191, 179, 162, 241,
+	81, 51, 145, 235, 249, 14, 239, 107, 49, 192, 214, 31, 181, 199, 106, 157,
+	184, 84, 204, 176, 115, 121, 50, 45, 127, 4, 150, 254, 138, 236, 205, 93,
+	222, 114, 67, 29, 24, 72, 243, 141, 128, 195, 78, 66, 215, 61, 156, 180,
+};
+
+
+double fade(double valT) {
+	return valT * valT * valT * (valT * (valT * 6.0 - 15.0) + 10.0);
+}
+
+
+double lerp(double valT, double valA, double valB) {
+	return valA + valT * (valB - valA);
+}
+
+
+double gradient(int hashID, double valX, double valY, double valZ) {
+	/* Original gradient function, including the flip of hshU for every hash. */
+	int hshID = hashID & 15;
+	double hshU = hshID < 8 ? valX : valY;
+	double hshV = hshID == 12 || hshID == 14 ? valX : valZ;
+	hshU = -hshU;
+	if ((hshID & 2) != 0) {
+		hshV = -hshV;
+	}
+	return hshU + hshV;
+}
+
+
+int hash(int index) {
+	/* Lookup in the doubled 512 entry table of the original. */
+	return permutation[index & 255];
+}
+
+
+double gradNoise(double valXYZ) {
+	/* Original improved Perlin noise along the diagonal. */
+	double valX = valXYZ;
+	double valY = valXYZ;
+	double valZ = valXYZ;
+
+	// The original cast floor to int, which overflows past the int range, the cell
+	// modulo 256 is the same for every input it did handle
+	int intX = (int) (std::floor(valX) - 256.0 * std::floor(valX / 256.0));
+	int intY = (int) (std::floor(valY) - 256.0 * std::floor(valY / 256.0));
+	int intZ = (int) (std::floor(valZ) - 256.0 * std::floor(valZ / 256.0));
+
+	valX -= std::floor(valX);
+	valY -= std::floor(valY);
+	valZ -= std::floor(valZ);
+
+	double valU = fade(valX);
+	double valV = fade(valY);
+	double valW = fade(valZ);
+
+	int A = hash(intX) + intY;
+	int B = hash(intX + 1) + intY;
+	int AA = hash(A) + intZ;
+	int BA = hash(B) + intZ;
+	int AB = hash(A + 1) + intZ;
+	int BB = hash(B + 1) + intZ;
+
+	double gradAA = gradient(hash(AA), valX, valY, valZ);
+	double gradBA = gradient(hash(BA), valX - 1.0, valY, valZ);
+	double gradAB = gradient(hash(AB), valX, valY - 1.0, valZ);
+	double gradBB = gradient(hash(BB), valX - 1.0, valY - 1.0, valZ);
+	double gradAA1 = gradient(hash(AA + 1), valX, valY, valZ - 1.0);
+	double gradBA1 = gradient(hash(BA + 1), valX - 1.0, valY, valZ - 1.0);
+	double gradAB1 = gradient(hash(AB + 1), valX, valY - 1.0, valZ - 1.0);
+	double gradBB1 = gradient(hash(BB + 1), valX - 1.0, valY - 1.0, valZ - 1.0);
+
+	double firstPassA = lerp(valU, gradAA, gradBA);
+	double firstPassB = lerp(valU, gradAB, gradBB);
+	double firstPassesCombined = lerp(valV, firstPassA, firstPassB);
+	double secondPassA = lerp(valU, gradAA1, gradBA1);
+	double secondPassB = lerp(valU, gradAB1, gradBB1);
+	double secondPassesCombined = lerp(valV, secondPassA, secondPassB);
+	return lerp(valW, firstPassesCombined, secondPassesCombined);
+}
+
+
+double calculateNoise(double weight, double time, double seed, double frequency, double strength, double fractal, double rough) {
+	/* Original combination of the base and fractal band of one axis. */
+	double baseNoise = gradNoise(time * (frequency * 0.078) + seed);
+	double fractalNoise = gradNoise(time * (2 * (frequency + 0.067)) + seed);
+	return weight * (strength * baseNoise + fractal * ((rough + 0.084) * 3.3 * fractalNoise));
+}
+
+
+double bandNoise(NoiseEngine engine, double time, double frequency, double seed, int layerSeed, std::uint32_t streamID) {
+	/* One band of one axis, seed is the layer seed plus the axis and octave offsets.
+
+	The gradient 1D and hash engines postdate the original, their scalar functions
+	are the reference the vectorized kernels have to match.
+
+	*/
+	if (engine == NoiseEngine::kHash) {
+		return PerlinNoise::hashNoise(time * frequency, PerlinNoise::streamSeed((std::uint32_t) layerSeed, streamID));
+	}
+	if (engine == NoiseEngine::kGradient1D) {
+		return PerlinNoise::gradientNoise1D(time * frequency + seed);
+	}
+	return gradNoise(time * frequency + seed);
+}
+
+
+void accumulateLayer(const ShakeLayer &layer, double time, NoiseEngine engine, double result[3]) {
+	/* Adds one layer on all three axes, one band at a time. */
+	for (int axis = 0; axis < 3; ++axis) {
+		double axisSeed = PerlinNoise::axisSeeds[axis];
+		if (layer.fractalMode == FractalMode::kFbm) {
+			double sum = 0.0;
+			double amplitude = 1.0;
+			double frequency = layer.frequency * 0.078;
+			for (int octave = 0; octave < PerlinNoise::fbmOctaveCount(layer); ++octave) {
+				double seed = layer.seed + octave * PerlinNoise::fbmOctaveSeed + axisSeed;
+				sum += amplitude * bandNoise(engine, time, frequency, seed, layer.seed, 3 * octave + axis);
+				amplitude *= layer.gain;
+				frequency *= layer.lacunarity;
+			}
+			result[axis] += layer.weight * (layer.strength[axis] * sum);
+		} else {
+			double seed = layer.seed + axisSeed;
+			double baseNoise = bandNoise(engine, time, layer.frequency * 0.078, seed, layer.seed, axis);
+			double fractalNoise = bandNoise(engine, time, 2 * (layer.frequency + 0.067), seed, layer.seed, 3 + axis);
+			result[axis] += layer.weight * (layer.strength[axis] * baseNoise + layer.fractal * ((layer.rough + 0.084) * 3.3 * fractalNoise));
+		}
+	}
+}
+
+
+void accumulateStack(const std::vector<ShakeLayer> &layers, double time, NoiseEngine engine, double result[3]) {
+	/* Adds every layer with a weight other than 0, in order. */
+	for (const ShakeLayer &layer : layers) {
+		if (layer.weight != 0) {
+			accumulateLayer(layer, time, engine, result);
+		}
+	}
+}
+
+}
+
+
+
+namespace {
+
+constexpr NoiseEngine kEngines[] = {NoiseEngine::kPerlin, NoiseEngine::kGradient1D, NoiseEngine::kHash};
+constexpr NoisePrecision kPrecisions[] = {NoisePrecision::kDouble, NoisePrecision::kSingle};
+constexpr std::size_t kMaxReportedFailures = 5;
+
+
+const char *engineName(NoiseEngine engine) {
+	return engine == NoiseEngine::kHash ? "hash" : engine == NoiseEngine::kGradient1D ? "gradient1D" : "perlin";
+}
+
+
+const char *precisionName(NoisePrecision precision) {
+	return precision == NoisePrecision::kSingle ? "single" : "double";
+}
+
+
+class Random {
+	/* SplitMix64 generator, the same stream of cases on every platform for a seed. */
+
+public:
+	explicit Random(std::uint64_t seed): _state(seed) {}
+
+	std::uint64_t next() {
+		std::uint64_t value = (_state += 0x9e3779b97f4a7c15ull);
+		value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ull;
+		value = (value ^ (value >> 27)) * 0x94d049bb133111ebull;
+		return value ^ (value >> 31);
+	}
+
+	double uniform(double low, double high) {
+		return low + (high - low) * ((double) (next() >> 11) * (1.0 / 9007199254740992.0));
+	}
+
+	int integer(int low, int high) {
+		return low + (int) (next() % (std::uint64_t) (high - low + 1));
+	}
+
+	bool chance(double probability) {
+		return uniform(0.0, 1.0) < probability;
+	}
+
+private:
+	std::uint64_t _state;
+};
+
+
+double randomTime(Random &random) {
+	/* Times of a typical scene, whole and sub frames, negative frames and frames around a million. */
+	switch (random.integer(0, 4)) {
+	case 0:
+		return (double) random.integer(-200, 2000);
+	case 1:
+		return random.integer(-200, 2000) + random.integer(0, 7) / 8.0;
+	case 2:
+		return random.uniform(-1000.0, 1000.0);
+	case 3:
+		return 1.0e6 + random.uniform(-1000.0, 1000.0);
+	default:
+		return random.uniform(-1.0, 1.0);
+	}
+}
+
+
+ShakeLayer randomLayer(Random &random) {
+	/* Layer with random parameters, some switched off and a third of them in fBm mode. */
+	ShakeLayer layer;
+	layer.weight = random.chance(0.1) ? 0.0 : random.uniform(-2.0, 2.0);
+	layer.seed = random.integer(-100000, 100000);
+	layer.frequency = random.uniform(0.01, 8.0);
+	for (int axis = 0; axis < 3; ++axis) {
+		layer.strength[axis] = random.uniform(-20.0, 20.0);
+	}
+	layer.fractal = random.chance(0.5) ? 0.0 : random.uniform(0.0, 2.0);
+	layer.rough = random.uniform(0.0, 1.5);
+	if (random.chance(0.3)) {
+		layer.fractalMode = FractalMode::kFbm;
+		layer.octaves = random.integer(1, PerlinNoise::fbmMaxOctaves);
+		layer.lacunarity = random.uniform(1.5, 3.0);
+		layer.gain = random.uniform(0.05, 0.9);
+	}
+	return layer;
+}
+
+
+double layerAmplitude(const ShakeLayer &layer) {
+	/* Amplitude the single precision deviation is relative to, see maxSingleDeviation. */
+	double strength = std::max({std::fabs(layer.strength[0]), std::fabs(layer.strength[1]), std::fabs(layer.strength[2])});
+	if (layer.fractalMode == FractalMode::kFbm) {
+		double sum = 0.0;
+		double amplitude = 1.0;
+		for (int octave = 0; octave < PerlinNoise::fbmOctaveCount(layer); ++octave) {
+			sum += amplitude;
+			amplitude *= std::fabs(layer.gain);
+		}
+		return std::fabs(layer.weight) * strength * sum;
+	}
+	return std::fabs(layer.weight) * (strength + std::fabs(layer.fractal) * (layer.rough + 0.084) * 3.3);
+}
+
+
+double stackAmplitude(const std::vector<ShakeLayer> &layers) {
+	double amplitude = 0.0;
+	for (const ShakeLayer &layer : layers) {
+		amplitude += layerAmplitude(layer);
+	}
+	return amplitude;
+}
+
+
+std::uint64_t ulpDistance(double valA, double valB) {
+	/* Number of representable doubles between two values. */
+	if (valA == valB) {
+		return 0;
+	}
+	std::int64_t bitsA;
+	std::int64_t bitsB;
+	std::memcpy(&bitsA, &valA, sizeof(double));
+	std::memcpy(&bitsB, &valB, sizeof(double));
+	// Map the sign magnitude bits onto a monotonic integer line
+	if (bitsA < 0) {
+		bitsA = INT64_MIN - bitsA;
+	}
+	if (bitsB < 0) {
+		bitsB = INT64_MIN - bitsB;
+	}
+	return bitsA > bitsB ? (std::uint64_t) bitsA - (std::uint64_t) bitsB : (std::uint64_t) bitsB - (std::uint64_t) bitsA;
+}
+
+
+struct Tolerance {
+	/* A result passes within maxUlps of the reference or within maxRelative of the amplitude. */
+	std::uint64_t maxUlps;
+	double maxRelative;
+};
+
+constexpr Tolerance kExact = {0, 0.0};
+constexpr Tolerance kDoubleTolerance = {4, 1.0e-12};
+constexpr Tolerance kSingleTolerance = {0, PerlinNoise::maxSingleDeviation};
+
+
+Tolerance precisionTolerance(NoisePrecision precision) {
+	return precision == NoisePrecision::kSingle ? kSingleTolerance : kDoubleTolerance;
+}
+
+
+class Check {
+	/* Results of one evaluation path, engine and precision. */
+
+public:
+	Check(const char *name, NoiseEngine engine, NoisePrecision precision, Tolerance tolerance):
+		_name(name), _engine(engine), _precision(precision), _tolerance(tolerance) {}
+
+	void compare(double expected, double actual, double amplitude, double time, int iteration) {
+		/* Compares one result with the reference, the first failures are printed with their case. */
+		++_numResults;
+		double error = std::fabs(actual - expected);
+		double relative = amplitude > 0.0 ? error / amplitude : error;
+		_maxRelative = std::max(_maxRelative, relative);
+		if (actual != expected) {
+			++_numInexact;
+		}
+		bool passed = ulpDistance(expected, actual) <= _tolerance.maxUlps || relative <= _tolerance.maxRelative;
+		if (!passed || std::isnan(actual)) {
+			if (++_numFailures <= kMaxReportedFailures) {
+				std::printf("  FAIL %s %s %s: iteration %d, time %.17g, expected %.17g, got %.17g, error %.3g of amplitude %.6g\n",
+					_name, engineName(_engine), precisionName(_precision), iteration, time, expected, actual, relative, amplitude);
+			}
+		}
+	}
+
+	std::size_t report() const {
+		/* Prints the summary line and returns the number of failures. */
+		std::printf("%-28s %-10s %-6s %9zu results, %7zu not bit identical, max error %.3g of amplitude, %zu failures\n",
+			_name, engineName(_engine), precisionName(_precision), _numResults, _numInexact, _maxRelative, _numFailures);
+		return _numFailures;
+	}
+
+private:
+	const char *_name;
+	NoiseEngine _engine;
+	NoisePrecision _precision;
+	Tolerance _tolerance;
+	std::size_t _numResults = 0;
+	std::size_t _numInexact = 0;
+	std::size_t _numFailures = 0;
+	double _maxRelative = 0.0;
+};
+
+
+struct GoldenValue {
+	/* Reference shake of a golden layer at a time, see goldenLayers. */
+	NoiseEngine engine;
+	int layer;
+	double time;
+	double result[3];
+};
+
+
+std::vector<ShakeLayer> goldenLayers() {
+	/* Plain, fractal and fBm layers the golden table is evaluated for. */
+	std::vector<ShakeLayer> layers(3);
+	layers[1].seed = -4711;
+	layers[1].frequency = 2.5;
+	layers[1].strength[0] = 3.0;
+	layers[1].strength[2] = -7.0;
+	layers[1].fractal = 0.75;
+	layers[1].rough = 0.4;
+	layers[2].weight = 0.5;
+	layers[2].seed = 90210;
+	layers[2].frequency = 1.5;
+	layers[2].fractalMode = FractalMode::kFbm;
+	layers[2].octaves = 5;
+	layers[2].lacunarity = 2.2;
+	layers[2].gain = 0.6;
+	return layers;
+}
+
+constexpr double kGoldenTimes[] = {0.5, 1.0, 24.5, -37.75, 1000.25, 1000000.5};
+
+// Printed by noiseEquivalenceTest --golden, only regenerate on purpose
+const GoldenValue kGoldenValues[] = {
+	{NoiseEngine::kPerlin, 0, 0.5, {-0.77912527761152539, -0.76280893074709444, 0.0051544961264429739}},
+	{NoiseEngine::kPerlin, 0, 1, {-1.5467510592149964, -1.4281188153618318, 0.035539162608407761}},
+	{NoiseEngine::kPerlin, 0, 24.5, {-0.16139863938591237, 1.5968695126131494, -0.060909882518068725}},
+	{NoiseEngine::kPerlin, 0, -37.75, {-1.0925557864648123, -1.1064261329995841, -1.076876656038896}},
+	{NoiseEngine::kPerlin, 0, 1000.25, {-0.38922377874125258, 0.00069183757476722096, -0.38994359140851409}},
+	{NoiseEngine::kPerlin, 0, 1000000.5, {-0.77397390160671042, -0.76838360940782824, -0.76882540864449389}},
+	{NoiseEngine::kPerlin, 1, 0.5, {-0.28445444018269744, -0.33314301450212774, 1.1239349162459791}},
+	{NoiseEngine::kPerlin, 1, 1, {-1.3799399510918811, 0.8239704588685246, 1.8651263315310165}},
+	{NoiseEngine::kPerlin, 1, 24.5, {0.55033269579056188, 5.3682102828426217, -2.4296006787335758}},
+	{NoiseEngine::kPerlin, 1, -37.75, {0.052764522169836375, 5.9973098732532621, -1.8704225450138541}},
+	{NoiseEngine::kPerlin, 1, 1000.25, {-0.071883700200422784, -1.5708487927709212, 0.68707852706614492}},
+	{NoiseEngine::kPerlin, 1, 1000000.5, {-0.37512955551753396, 0.1488256931276439, -0.29208483758388226}},
+	{NoiseEngine::kPerlin, 2, 0.5, {-1.5566690120344753, -1.3258431785970723, -0.1273500448227704}},
+	{NoiseEngine::kPerlin, 2, 1, {-0.83146758321880521, -1.2826764724617699, -0.28503159984797699}},
+	{NoiseEngine::kPerlin, 2, 24.5, {-0.20471394295429068, 0.90208091276146984, -0.26406539623040587}},
+	{NoiseEngine::kPerlin, 2, -37.75, {-1.6437445399681989, 0.43272836575641954, -0.60662651135116141}},
+	{NoiseEngine::kPerlin, 2, 1000.25, {0.12277859855895572, -0.73300645371647588, -0.69175895785982777}},
+	{NoiseEngine::kPerlin, 2, 1000000.5, {-1.0653909649374678, -1.6491202149117223, -0.92732644773562223}},
+	{NoiseEngine::kGradient1D, 0, 0.5, {-0.1913094720645096, -0.13709036041124475, 0.5250815802472889}},
+	{NoiseEngine::kGradient1D, 0, 1, {-0.36249620886209888, -0.31063166038123891, 1.0744183087464119}},
+	{NoiseEngine::kGradient1D, 0, 24.5, {-0.18472504322787131, 1.1065613914064065, 0.6811571315927023}},
+	{NoiseEngine::kGradient1D, 0, -37.75, {0.44199739176804809, -0.45682962268063559, 0.38672322911780788}},
+	{NoiseEngine::kGradient1D, 0, 1000.25, {-0.033085934088347799, -0.097963599498303772, -0.22842485909873148}},
+	{NoiseEngine::kGradient1D, 0, 1000000.5, {0.13350884328865745, -0.38799121987857499, 0.52329082173686059}},
+	{NoiseEngine::kGradient1D, 1, 0.5, {0.020899404114337078, -0.85927858345851182, -0.29148182421701763}},
+	{NoiseEngine::kGradient1D, 1, 1, {0.084430488887837052, -2.9382035511295284, -1.3027572703709642}},
+	{NoiseEngine::kGradient1D, 1, 24.5, {0.50458053719850959, 0.11766778225815983, -0.4773373942175983}},
+	{NoiseEngine::kGradient1D, 1, -37.75, {-0.8902817561051295, -0.19096464443832609, 0.67668354004882325}},
+	{NoiseEngine::kGradient1D, 1, 1000.25, {0.12292526169276149, 0.22838500259163297, 0.0028051149418620303}},
+	{NoiseEngine::kGradient1D, 1, 1000000.5, {0.30602258227636586, 0.54459619565974227, 0.97089772419662368}},
+	{NoiseEngine::kGradient1D, 2, 0.5, {-0.51271936925722139, 0.96388598667094594, -0.53859044345695906}},
+	{NoiseEngine::kGradient1D, 2, 1, {-0.87801449491524963, -0.67749887746587967, 0.016626664062157903}},
+	{NoiseEngine::kGradient1D, 2, 24.5, {0.60586993196137928, -1.4568896434805687, -0.50685859086950846}},
+	{NoiseEngine::kGradient1D, 2, -37.75, {1.5419115737013196, -1.2360870808138438, 0.82796485820640942}},
+	{NoiseEngine::kGradient1D, 2, 1000.25, {-0.42020843711503075, 1.6856785345685679, -0.2261906555650709}},
+	{NoiseEngine::kGradient1D, 2, 1000000.5, {1.6200724576049894, 0.2330331853280139, 0.14576653597907252}},
+	{NoiseEngine::kHash, 0, 0.5, {-3.640999368210541, 2.3624656804072144, -0.010025463437434157}},
+	{NoiseEngine::kHash, 0, 1, {-3.2510960486817106, 2.8610624426709297, -0.036490935243695954}},
+	{NoiseEngine::kHash, 0, 24.5, {-1.4376407286734776, -2.4483232468046654, 0.6816472439473098}},
+	{NoiseEngine::kHash, 0, -37.75, {-1.3208722934656874, -4.7249170742812439, 2.4287023784838988}},
+	{NoiseEngine::kHash, 0, 1000.25, {1.5461708483938503, 2.1699063475998646, 2.4456326676520144}},
+	{NoiseEngine::kHash, 0, 1000000.5, {-3.1245358664745422, 1.7300534384809552, -0.096215339703095148}},
+	{NoiseEngine::kHash, 1, 0.5, {0.37349045650036028, 0.6669719375192491, -1.9261170286211753}},
+	{NoiseEngine::kHash, 1, 1, {-0.4847000851071569, 3.4460942543397604, -2.9894092112890509}},
+	{NoiseEngine::kHash, 1, 24.5, {0.39748721827679423, -2.9644843417353042, 0.42799954521121886}},
+	{NoiseEngine::kHash, 1, -37.75, {-0.2606624863643438, 0.28956065938242243, 1.4258037469986906}},
+	{NoiseEngine::kHash, 1, 1000.25, {0.11530269423874812, -5.1520632052323725, 1.1298911363853668}},
+	{NoiseEngine::kHash, 1, 1000000.5, {0.09657691961051032, 2.3373081445319417, 0.2904180378558659}},
+	{NoiseEngine::kHash, 2, 0.5, {3.0569026367958037, 1.3664417603035974, 0.85848098208725632}},
+	{NoiseEngine::kHash, 2, 1, {3.3248413615596615, 1.819946160209662, 0.10900624432480301}},
+	{NoiseEngine::kHash, 2, 24.5, {-1.7046168966273032, -2.3683500097573509, 0.30268950617920748}},
+	{NoiseEngine::kHash, 2, -37.75, {-0.4102622976931235, 1.2727945382430039, -0.46278848745374995}},
+	{NoiseEngine::kHash, 2, 1000.25, {-1.1456971360702002, -0.15579810762885452, 0.55012302799463353}},
+	{NoiseEngine::kHash, 2, 1000000.5, {1.3559674394703147, -0.74280156182616353, -0.41366533387740329}},
+};
+
+
+void printGolden() {
+	/* Prints the golden table of the current reference in the format of kGoldenValues. */
+	std::vector<ShakeLayer> layers = goldenLayers();
+	for (NoiseEngine engine : kEngines) {
+		for (std::size_t layer = 0; layer < layers.size(); ++layer) {
+			for (double time : kGoldenTimes) {
+				double result[3] = {0.0, 0.0, 0.0};
+				reference::accumulateLayer(layers[layer], time, engine, result);
+				std::printf("\t{NoiseEngine::k%s, %zu, %.17g, {%.17g, %.17g, %.17g}},\n",
+					engine == NoiseEngine::kHash ? "Hash" : engine == NoiseEngine::kGradient1D ? "Gradient1D" : "Perlin",
+					layer, time, result[0], result[1], result[2]);
+			}
+		}
+	}
+}
+
+
+std::size_t checkGolden() {
+	/* Compares the reference and the double precision kernels with the golden table. */
+	std::vector<ShakeLayer> layers = goldenLayers();
+	std::vector<Check> referenceChecks;
+	std::vector<Check> kernelChecks;
+	for (NoiseEngine engine : kEngines) {
+		referenceChecks.emplace_back("golden reference", engine, NoisePrecision::kDouble, kExact);
+		kernelChecks.emplace_back("golden accumulateShake", engine, NoisePrecision::kDouble, kDoubleTolerance);
+	}
+
+	for (const GoldenValue &golden : kGoldenValues) {
+		const ShakeLayer &layer = layers[golden.layer];
+		double expected[3] = {0.0, 0.0, 0.0};
+		double actual[3] = {0.0, 0.0, 0.0};
+		reference::accumulateLayer(layer, golden.time, golden.engine, expected);
+		PerlinNoise::accumulateShake(layer, golden.time, actual, NoisePrecision::kDouble, golden.engine);
+		for (int axis = 0; axis < 3; ++axis) {
+			referenceChecks[(int) golden.engine].compare(golden.result[axis], expected[axis], layerAmplitude(layer), golden.time, golden.layer);
+			kernelChecks[(int) golden.engine].compare(golden.result[axis], actual[axis], layerAmplitude(layer), golden.time, golden.layer);
+		}
+	}
+
+	std::size_t numFailures = 0;
+	for (std::size_t i = 0; i < referenceChecks.size(); ++i) {
+		numFailures += referenceChecks[i].report();
+		numFailures += kernelChecks[i].report();
+	}
+	return numFailures;
+}
+
+
+std::size_t checkCalculateNoise(int iterations, std::uint64_t seed) {
+	/* Scalar and batch single layer evaluation of the original Perlin engine. */
+	Check scalarCheck("calculateNoise", NoiseEngine::kPerlin, NoisePrecision::kDouble, kExact);
+	Check batchCheck("calculateNoiseBatch", NoiseEngine::kPerlin, NoisePrecision::kDouble, kDoubleTolerance);
+	Check batchSingleCheck("calculateNoiseBatch", NoiseEngine::kPerlin, NoisePrecision::kSingle, kSingleTolerance);
+
+	Random random(seed);
+	std::vector<double> times;
+	std::vector<double> output;
+	std::vector<float> outputSingle;
+	for (int iteration = 0; iteration < iterations; ++iteration) {
+		ShakeLayer shakeLayer = randomLayer(random);
+		NoiseLayer layer;
+		layer.weight = shakeLayer.weight;
+		layer.seed = shakeLayer.seed + PerlinNoise::axisSeeds[random.integer(0, 2)];
+		layer.frequency = shakeLayer.frequency;
+		layer.strength = shakeLayer.strength[0];
+		layer.fractal = shakeLayer.fractal;
+		layer.rough = shakeLayer.rough;
+		const double amplitude = std::fabs(layer.weight) * (std::fabs(layer.strength) + layer.fractal * (layer.rough + 0.084) * 3.3);
+
+		// Odd counts leave partial blocks of lanes
+		times.resize(random.integer(1, 37));
+		for (double &time : times) {
+			time = randomTime(random);
+		}
+		output.assign(times.size(), 0.0);
+		outputSingle.assign(times.size(), 0.0f);
+		PerlinNoise::calculateNoiseBatch(layer, times.data(), times.size(), output.data());
+		PerlinNoise::calculateNoiseBatch(layer, times.data(), times.size(), outputSingle.data());
+
+		for (std::size_t i = 0; i < times.size(); ++i) {
+			double expected = reference::calculateNoise(layer.weight, times[i], layer.seed, layer.frequency, layer.strength, layer.fractal, layer.rough);
+			double actual = PerlinNoise::calculateNoise(layer.weight, times[i], layer.seed, layer.frequency, layer.strength, layer.fractal, layer.rough);
+			scalarCheck.compare(expected, actual, amplitude, times[i], iteration);
+			batchCheck.compare(expected, output[i], amplitude, times[i], iteration);
+			batchSingleCheck.compare(expected, outputSingle[i], amplitude, times[i], iteration);
+		}
+	}
+
+	return scalarCheck.report() + batchCheck.report() + batchSingleCheck.report();
+}
+
+
+std::size_t checkShakes(NoiseEngine engine, NoisePrecision precision, int iterations, std::uint64_t seed) {
+	/* Every layer and stack evaluation path of one engine and precision. */
+	const Tolerance tolerance = precisionTolerance(precision);
+	Check shakeCheck("accumulateShake", engine, precision, tolerance);
+	Check arrayCheck("accumulateShakeArray", engine, precision, tolerance);
+	Check stackCheck("accumulateShakeStack", engine, precision, tolerance);
+	Check samplesCheck("accumulateShakeStackSamples", engine, precision, tolerance);
+	Check derivativesCheck("accumulateShakeStackDerivs", engine, precision, tolerance);
+	Check velocityCheck("velocity finite difference", engine, precision, {0, 1.0e-4});
+	Check cullCheck("ShakeLayerStack::cull", engine, precision, {0, 1.0});
+#ifdef SHAKENODE_TEST_C_API
+	Check cApiCheck("shakeNoiseEvaluate", engine, precision, kExact);
+	std::vector<ShakeNoiseLayer> cLayers;
+	std::vector<double> cSamples;
+#endif
+
+	Random random(seed);
+	std::vector<ShakeLayer> layers;
+	ShakeLayerStack stack;
+	std::vector<int> seedOffsets;
+	std::vector<double> arrayResults;
+	std::vector<double> times;
+	std::vector<double> samples;
+	ShakeLayerStack culledStack;
+	for (int iteration = 0; iteration < iterations; ++iteration) {
+		layers.resize(random.integer(1, 20));
+		for (ShakeLayer &layer : layers) {
+			layer = randomLayer(random);
+		}
+		stack.assign(layers.data(), layers.size());
+		const double time = randomTime(random);
+		const double amplitude = stackAmplitude(layers);
+
+		// Single layers, and the elements of an array shaken by the first layer
+		const ShakeLayer &layer = layers.front();
+		double expected[3] = {0.0, 0.0, 0.0};
+		double actual[3] = {0.0, 0.0, 0.0};
+		reference::accumulateLayer(layer, time, engine, expected);
+		PerlinNoise::accumulateShake(layer, time, actual, precision, engine);
+		for (int axis = 0; axis < 3; ++axis) {
+			shakeCheck.compare(expected[axis], actual[axis], layerAmplitude(layer), time, iteration);
+		}
+
+		seedOffsets.resize(random.integer(1, 21));
+		for (int &seedOffset : seedOffsets) {
+			seedOffset = random.integer(-1000, 1000);
+		}
+		arrayResults.assign(3 * seedOffsets.size(), 0.0);
+		PerlinNoise::accumulateShakeArray(layer, time, seedOffsets.data(), seedOffsets.size(), arrayResults.data(), precision, engine);
+		for (std::size_t element = 0; element < seedOffsets.size(); ++element) {
+			ShakeLayer elementLayer = layer;
+			elementLayer.seed = layer.seed + seedOffsets[element];
+			double elementExpected[3] = {0.0, 0.0, 0.0};
+			reference::accumulateLayer(elementLayer, time, engine, elementExpected);
+			for (int axis = 0; axis < 3; ++axis) {
+				arrayCheck.compare(elementExpected[axis], arrayResults[3 * element + axis], layerAmplitude(layer), time, iteration);
+			}
+		}
+
+		// Whole stacks
+		double stackExpected[3] = {0.0, 0.0, 0.0};
+		double stackActual[3] = {0.0, 0.0, 0.0};
+		double derivativesActual[3] = {0.0, 0.0, 0.0};
+		double velocity[3] = {0.0, 0.0, 0.0};
+		double acceleration[3] = {0.0, 0.0, 0.0};
+		reference::accumulateStack(layers, time, engine, stackExpected);
+		PerlinNoise::accumulateShakeStack(stack, time, stackActual, precision, engine);
+		PerlinNoise::accumulateShakeStackDerivatives(stack, time, derivativesActual, velocity, acceleration, precision, engine);
+		for (int axis = 0; axis < 3; ++axis) {
+			stackCheck.compare(stackExpected[axis], stackActual[axis], amplitude, time, iteration);
+			derivativesCheck.compare(stackExpected[axis], derivativesActual[axis], amplitude, time, iteration);
+		}
+
+		// The noise is C2, so a central difference of the reference converges on the velocity
+		constexpr double kStep = 1.0e-4;
+		double before[3] = {0.0, 0.0, 0.0};
+		double after[3] = {0.0, 0.0, 0.0};
+		reference::accumulateStack(layers, time - kStep, engine, before);
+		reference::accumulateStack(layers, time + kStep, engine, after);
+		double maxFrequency = 0.0;
+		for (const ShakeLayer &stackLayer : layers) {
+			double frequency = stackLayer.fractalMode == FractalMode::kFbm ?
+				stackLayer.frequency * 0.078 * std::pow(stackLayer.lacunarity, PerlinNoise::fbmOctaveCount(stackLayer) - 1) :
+				2 * (stackLayer.frequency + 0.067);
+			maxFrequency = std::max(maxFrequency, frequency);
+		}
+		for (int axis = 0; axis < 3; ++axis) {
+			double difference = (after[axis] - before[axis]) / (2.0 * kStep);
+			velocityCheck.compare(difference, velocity[axis], amplitude * maxFrequency * std::max(1.0, maxFrequency * maxFrequency), time, iteration);
+		}
+
+		// Many samples of the stack at once, odd counts leave partial blocks of lanes
+		times.resize(random.integer(1, 13));
+		for (double &sampleTime : times) {
+			sampleTime = randomTime(random);
+		}
+		samples.assign(3 * times.size(), 0.0);
+		PerlinNoise::accumulateShakeStackSamples(stack, times.data(), times.size(), samples.data(), precision, engine);
+		for (std::size_t sample = 0; sample < times.size(); ++sample) {
+			double sampleExpected[3] = {0.0, 0.0, 0.0};
+			reference::accumulateStack(layers, times[sample], engine, sampleExpected);
+			for (int axis = 0; axis < 3; ++axis) {
+				samplesCheck.compare(sampleExpected[axis], samples[3 * sample + axis], amplitude, times[sample], iteration);
+			}
+		}
+
+#ifdef SHAKENODE_TEST_C_API
+		// The same samples through the C interface, which overwrites its output
+		cLayers.resize(layers.size());
+		for (std::size_t i = 0; i < layers.size(); ++i) {
+			ShakeNoiseLayer &cLayer = cLayers[i];
+			shakeNoiseDefaultLayer(&cLayer);
+			cLayer.weight = layers[i].weight;
+			cLayer.seed = layers[i].seed;
+			cLayer.fractalMode = static_cast<std::int32_t>(layers[i].fractalMode);
+			cLayer.frequency = layers[i].frequency;
+			std::copy(layers[i].strength, layers[i].strength + 3, cLayer.strength);
+			cLayer.fractal = layers[i].fractal;
+			cLayer.rough = layers[i].rough;
+			cLayer.octaves = layers[i].octaves;
+			cLayer.lacunarity = layers[i].lacunarity;
+			cLayer.gain = layers[i].gain;
+		}
+		cSamples.assign(3 * times.size(), 1.0);
+		if (shakeNoiseEvaluate(cLayers.data(), cLayers.size(), times.data(), times.size(), static_cast<int>(precision),
+				static_cast<int>(engine), 0.0, cSamples.data()) != SHAKE_NOISE_OK) {
+			cSamples.assign(3 * times.size(), NAN);
+		}
+		for (std::size_t i = 0; i < cSamples.size(); ++i) {
+			cApiCheck.compare(samples[i], cSamples[i], amplitude, times[i / 3], iteration);
+		}
+#endif
+
+		// Culled stacks, the error is measured relative to the budget plus the precision tolerance
+		culledStack.assign(layers.data(), layers.size());
+		const double budget = random.uniform(0.0, 0.5) * amplitude;
+		culledStack.cull(budget);
+		double culled[3] = {0.0, 0.0, 0.0};
+		PerlinNoise::accumulateShakeStack(culledStack, time, culled, precision, engine);
+		for (int axis = 0; axis < 3; ++axis) {
+			cullCheck.compare(stackExpected[axis], culled[axis], budget + tolerance.maxRelative * amplitude, time, iteration);
+		}
+	}
+
+	return shakeCheck.report() + arrayCheck.report() + stackCheck.report() + samplesCheck.report() +
+		derivativesCheck.report() + velocityCheck.report() + cullCheck.report()
+#ifdef SHAKENODE_TEST_C_API
+		+ cApiCheck.report()
+#endif
+		;
+}
+
+}
+
+
+
+int main(int argc, char *argv[]) {
+	if (argc > 1 && std::strcmp(argv[1], "--golden") == 0) {
+		printGolden();
+		return 0;
+	}
+	const int iterations = argc > 1 ? std::max(1, std::atoi(argv[1])) : 2000;
+	const std::uint64_t seed = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 1;
+	std::printf("%d iterations, seed %llu\n", iterations, (unsigned long long) seed);
+
+	// Every build of the kernels this machine can run has to pass on its own
+	std::size_t numFailures = 0;
+	for (NoiseIsa isa : {NoiseIsa::kBaseline, NoiseIsa::kAvx2, NoiseIsa::kAvx512}) {
+		if (!PerlinNoise::setIsa(isa)) {
+			std::printf("%s kernels: not available in this build or on this machine, skipped\n", PerlinNoise::isaName(isa));
+			continue;
+		}
+		std::printf("%s kernels:\n", PerlinNoise::isaName(isa));
+		numFailures += checkGolden();
+		numFailures += checkCalculateNoise(iterations, seed);
+		for (NoiseEngine engine : kEngines) {
+			for (NoisePrecision precision : kPrecisions) {
+				numFailures += checkShakes(engine, precision, iterations, seed);
+			}
+		}
+	}
+
+	std::printf("%zu failures\n", numFailures);
+	return numFailures == 0 ? 0 : 1;
+}
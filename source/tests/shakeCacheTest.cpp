@@ -0,0 +1,465 @@
+/* Accuracy test of the curve cache and of shake cache files.
+
+A deterministic fuzzer draws random layer stacks, like the ones of
+noiseEquivalenceTest, bakes them into a ShakeCurveCache at a random requested
+resolution and compares lookups at random sub-frame times with the live
+evaluation of the same stack, for every engine and precision. Every lookup has to
+stay within ShakeCurveCache::maxInterpolationError of the stack amplitude, no
+matter how low the requested resolution is, and no table may be raised above
+maxSamplesPerFrame or hold more than maxSamples samples.
+
+Random stacks are also baked with bakeShakes and written to shake cache files in
+every encoding. Every sample read back has to stay within the quantization error
+of its encoding, and lookups at sample times have to return the stored samples.
+Truncated and corrupt files have to be rejected by ShakeCacheFile::open.
+
+Usage:
+	shakeCacheTest [iterations] [seed]
+
+Returns 0 on success and 1 if any lookup is out of tolerance or any file check fails.
+
+*/
+#include "perlinNoise.h"
+#include "shakeCurveCache.h"
+#include "shakeCacheFile.h"
+#include "shakeBake.h"
+
+// System Includes
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <string>
+#include <vector>
+
+
+
+namespace {
+
+constexpr NoiseEngine kEngines[] = {NoiseEngine::kPerlin, NoiseEngine::kGradient1D, NoiseEngine::kHash};
+constexpr NoisePrecision kPrecisions[] = {NoisePrecision::kDouble, NoisePrecision::kSingle};
+constexpr int kLookupsPerStack = 200;
+constexpr std::size_t kMaxReportedFailures = 5;
+constexpr ShakeCacheEncoding kEncodings[] = {ShakeCacheEncoding::kFloat64, ShakeCacheEncoding::kFloat32,
+	ShakeCacheEncoding::kQuantized16, ShakeCacheEncoding::kDelta8};
+
+
+const char *engineName(NoiseEngine engine) {
+	return engine == NoiseEngine::kHash ? "hash" : engine == NoiseEngine::kGradient1D ? "gradient1D" : "perlin";
+}
+
+
+const char *precisionName(NoisePrecision precision) {
+	return precision == NoisePrecision::kSingle ? "single" : "double";
+}
+
+
+const char *encodingName(ShakeCacheEncoding encoding) {
+	return encoding == ShakeCacheEncoding::kDelta8 ? "delta8" : encoding == ShakeCacheEncoding::kQuantized16 ? "quantized16" :
+		encoding == ShakeCacheEncoding::kFloat32 ? "float32" : "float64";
+}
+
+
+class Random {
+	/* SplitMix64 generator, the same stream of cases on every platform for a seed. */
+
+public:
+	explicit Random(std::uint64_t seed): _state(seed) {}
+
+	std::uint64_t next() {
+		std::uint64_t value = (_state += 0x9e3779b97f4a7c15ull);
+		value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ull;
+		value = (value ^ (value >> 27)) * 0x94d049bb133111ebull;
+		return value ^ (value >> 31);
+	}
+
+	double uniform(double low, double high) {
+		return low + (high - low) * ((double) (next() >> 11) * (1.0 / 9007199254740992.0));
+	}
+
+	int integer(int low, int high) {
+		return low + (int) (next() % (std::uint64_t) (high - low + 1));
+	}
+
+	bool chance(double probability) {
+		return uniform(0.0, 1.0) < probability;
+	}
+
+private:
+	std::uint64_t _state;
+};
+
+
+ShakeLayer randomLayer(Random &random) {
+	/* Layer with random parameters, a third of them in fBm mode with few enough octaves to be baked. */
+	ShakeLayer layer;
+	layer.weight = random.chance(0.1) ? 0.0 : random.uniform(-2.0, 2.0);
+	layer.seed = random.integer(-100000, 100000);
+	layer.frequency = random.uniform(0.01, 8.0);
+	for (int axis = 0; axis < 3; ++axis) {
+		layer.strength[axis] = random.uniform(-20.0, 20.0);
+	}
+	layer.fractal = random.chance(0.3) ? 0.0 : random.uniform(0.0, 2.0);
+	layer.rough = random.uniform(0.0, 1.5);
+	if (random.chance(0.3)) {
+		layer.fractalMode = FractalMode::kFbm;
+		layer.octaves = random.integer(1, 8);
+		layer.lacunarity = random.uniform(1.5, 3.0);
+		layer.gain = random.uniform(0.05, 0.9);
+	}
+	return layer;
+}
+
+
+double stackAmplitude(const std::vector<ShakeLayer> &layers) {
+	/* Amplitude maxInterpolationError is relative to. */
+	double sum = 0.0;
+	for (const ShakeLayer &layer : layers) {
+		double strength = std::max({std::fabs(layer.strength[0]), std::fabs(layer.strength[1]), std::fabs(layer.strength[2])});
+		if (layer.fractalMode == FractalMode::kFbm) {
+			double amplitude = 1.0;
+			for (int octave = 0; octave < PerlinNoise::fbmOctaveCount(layer); ++octave) {
+				sum += std::fabs(layer.weight) * strength * amplitude;
+				amplitude *= std::fabs(layer.gain);
+			}
+		} else {
+			sum += std::fabs(layer.weight) * (strength + std::fabs(layer.fractal) * (layer.rough + 0.084) * 3.3);
+		}
+	}
+	return sum;
+}
+
+
+std::size_t checkStack(const std::vector<ShakeLayer> &layers, NoiseEngine engine, NoisePrecision precision, int samplesPerFrame,
+		double start, double end, Random &random, double &worstError, std::size_t &numFailures) {
+	/* Bakes a stack and compares random lookups with the live evaluation.
+
+	Returns:
+		size_t: Number of lookups served by the cache, 0 if the stack was too fast to be baked
+
+	*/
+	ShakeLayerStack stack;
+	stack.assign(layers.data(), layers.size());
+	ShakeCurveCache cache;
+	cache.build(stack, precision, engine, start, end, samplesPerFrame);
+	const double tolerance = ShakeCurveCache::maxInterpolationError * stackAmplitude(layers);
+	const bool baked = cache.numBytes() > 0;
+	if (cache.numBytes() > 3 * sizeof(double) * ShakeCurveCache::maxSamples ||
+			(baked && cache.samplesPerFrame() > std::max(samplesPerFrame, ShakeCurveCache::maxSamplesPerFrame))) {
+		std::printf("  FAIL %s %s: %zu layers baked %d samples per frame for %d requested into %zu bytes\n", engineName(engine),
+			precisionName(precision), layers.size(), cache.samplesPerFrame(), samplesPerFrame, cache.numBytes());
+		++numFailures;
+	}
+
+	std::size_t numLookups = 0;
+	for (int i = 0; i < kLookupsPerStack; ++i) {
+		const double time = i == 0 ? end : random.uniform(start, end);
+		double cached[3];
+		if (!cache.lookup(time, cached)) {
+			continue;
+		}
+		++numLookups;
+		double live[3] = {0.0, 0.0, 0.0};
+		PerlinNoise::accumulateShakeStack(stack, time, live, precision, engine);
+		for (int axis = 0; axis < 3; ++axis) {
+			const double error = std::fabs(cached[axis] - live[axis]);
+			if (tolerance > 0.0) {
+				worstError = std::max(worstError, error / tolerance);
+			}
+			if (!(error <= tolerance)) {
+				if (numFailures < kMaxReportedFailures) {
+					std::printf("  FAIL %s %s: %zu layers, time %.17g, axis %d, requested %d, baked %d samples per frame: "
+						"cached %.17g, live %.17g, tolerance %g\n", engineName(engine), precisionName(precision), layers.size(),
+						time, axis, samplesPerFrame, cache.samplesPerFrame(), cached[axis], live[axis], tolerance);
+				}
+				++numFailures;
+			}
+		}
+	}
+	return numLookups;
+}
+
+
+std::size_t checkFastBands() {
+	/* Classic layers with a fractal band at the default 4 requested samples per frame, too fast ones stay live. */
+	std::size_t numFailures = 0;
+	double worstError = 0.0;
+	Random random(7);
+	for (double frequency : {1.0, 5.0, 8.0}) {
+		ShakeLayer layer;
+		layer.frequency = frequency;
+		layer.fractal = 1.0;
+		layer.rough = 0.5;
+		for (NoiseEngine engine : kEngines) {
+			if (checkStack({layer}, engine, NoisePrecision::kDouble, 4, 1.0, 240.0, random, worstError, numFailures) == 0) {
+				std::printf("  FAIL fractal band at frequency %g was not baked\n", frequency);
+				++numFailures;
+			}
+		}
+	}
+	// Beyond maxSamplesPerFrame the band is evaluated live instead of raising the resolution further
+	ShakeLayer layer;
+	layer.frequency = 40.0;
+	layer.fractal = 1.0;
+	layer.rough = 0.5;
+	if (checkStack({layer}, NoiseEngine::kPerlin, NoisePrecision::kDouble, 4, 1.0, 240.0, random, worstError, numFailures) != 0) {
+		std::printf("  FAIL fractal band at frequency 40 was baked above %d samples per frame\n", ShakeCurveCache::maxSamplesPerFrame);
+		++numFailures;
+	}
+	std::printf("fast fractal bands: worst error %.3f of the tolerance, %zu failures\n", worstError, numFailures);
+	return numFailures;
+}
+
+
+std::size_t checkRandomStacks(NoiseEngine engine, NoisePrecision precision, int iterations, std::uint64_t seed) {
+	/* Random stacks, ranges and requested resolutions. */
+	Random random(seed);
+	std::size_t numFailures = 0;
+	std::size_t numLookups = 0;
+	std::size_t numUnbaked = 0;
+	double worstError = 0.0;
+	for (int iteration = 0; iteration < iterations; ++iteration) {
+		std::vector<ShakeLayer> layers(random.integer(1, 4));
+		for (ShakeLayer &layer : layers) {
+			layer = randomLayer(random);
+		}
+		const double start = random.integer(-100, 100);
+		const double end = start + random.uniform(0.5, 60.0);
+		const std::size_t stackLookups = checkStack(layers, engine, precision, random.integer(1, 16), start, end, random, worstError, numFailures);
+		numLookups += stackLookups;
+		numUnbaked += stackLookups == 0;
+	}
+	std::printf("%s %s: %zu lookups, %zu stacks too fast to bake, worst error %.3f of the tolerance, %zu failures\n",
+		engineName(engine), precisionName(precision), numLookups, numUnbaked, worstError, numFailures);
+	return numFailures;
+}
+
+
+
+double quantizationError(const std::vector<double> &values, ShakeCacheEncoding encoding) {
+	/* Largest error the encoding may add to a sample of the channel, from the grid writeShakeCache uses. */
+	auto range = std::minmax_element(values.begin(), values.end());
+	double largest = std::max(std::fabs(*range.first), std::fabs(*range.second));
+	switch (encoding) {
+		case ShakeCacheEncoding::kFloat64:
+			return 0.0;
+		case ShakeCacheEncoding::kFloat32:
+			return largest * std::ldexp(1.0, -24);
+		case ShakeCacheEncoding::kQuantized16:
+		case ShakeCacheEncoding::kDelta8: {
+			double scale = (*range.second - *range.first) / 65534.0;
+			if (encoding == ShakeCacheEncoding::kDelta8) {
+				for (std::size_t j = 1; j < values.size(); ++j) {
+					scale = std::max(scale, std::fabs(values[j] - values[j - 1]) / 126.0);
+				}
+			}
+			// Half a grid step, plus the rounding of bias + scale * value
+			return 0.5 * scale + largest * 1.0e-15;
+		}
+	}
+	return 0.0;
+}
+
+
+std::size_t checkCacheFileRoundTrip(int iterations, std::uint64_t seed) {
+	/* Bakes random shakes, writes them in every encoding and reads them back.
+
+	The sample counts are not multiples of kDeltaBlockSamples, so the last block of
+	kDelta8 is a partial one, and one axis of the first shake is constant.
+
+	*/
+	Random random(seed);
+	std::size_t numFailures = 0;
+	std::size_t numSamplesChecked = 0;
+	const std::string path = "shakeCacheTest.roundTrip.shkc";
+	auto fail = [&numFailures](const std::string &message) {
+		if (numFailures < kMaxReportedFailures) {
+			std::printf("  FAIL %s\n", message.c_str());
+		}
+		++numFailures;
+	};
+
+	for (int iteration = 0; iteration < std::max(1, iterations / 5); ++iteration) {
+		std::vector<ShakeBakeTarget> targets(random.integer(1, 3));
+		for (ShakeBakeTarget &target : targets) {
+			target.layers.resize(random.integer(1, 3));
+			for (ShakeLayer &layer : target.layers) {
+				layer = randomLayer(random);
+			}
+			target.engine = kEngines[random.integer(0, 2)];
+		}
+		for (ShakeLayer &layer : targets[0].layers) {
+			layer.strength[2] = 0.0;
+		}
+		const int samplesPerFrame = 1 << random.integer(0, 3);
+		const double start = random.integer(-200, 200) * 0.5;
+		const std::size_t numSamples = kDeltaBlockSamples * random.integer(0, 20) + random.integer(1, (int) kDeltaBlockSamples - 1);
+		std::vector<double> times(numSamples);
+		for (std::size_t j = 0; j < numSamples; ++j) {
+			times[j] = start + (double) j / samplesPerFrame;
+		}
+		bakeShakes(targets, times);
+
+		for (ShakeCacheEncoding encoding : kEncodings) {
+			std::string error;
+			if (!writeShakeCache(path, targets, start, samplesPerFrame, encoding, &error)) {
+				fail(std::string(encodingName(encoding)) + ": " + error);
+				continue;
+			}
+			std::shared_ptr<const ShakeCacheFile> file = ShakeCacheFile::open(path, &error);
+			if (file == nullptr) {
+				fail(std::string(encodingName(encoding)) + ": " + error);
+				continue;
+			}
+			if (file->encoding() != encoding || file->numShakes() != targets.size() || file->numSamples() != numSamples ||
+					file->samplesPerFrame() != samplesPerFrame || file->start() != start || file->end() != times.back()) {
+				fail(std::string(encodingName(encoding)) + ": header does not match what was written");
+				continue;
+			}
+
+			for (std::size_t shake = 0; shake < targets.size(); ++shake) {
+				for (int axis = 0; axis < 3; ++axis) {
+					const std::vector<double> &values = targets[shake].channels[axis];
+					const double tolerance = quantizationError(values, encoding);
+					for (std::size_t j = 0; j < numSamples; ++j) {
+						const double stored = file->sample(3 * shake + axis, j);
+						double looked[3];
+						file->lookup(shake, times[j], looked);
+						++numSamplesChecked;
+						if (!(std::fabs(stored - values[j]) <= tolerance)) {
+							char message[256];
+							std::snprintf(message, sizeof(message), "%s shake %zu axis %d sample %zu of %zu: stored %.17g, baked %.17g, tolerance %g",
+								encodingName(encoding), shake, axis, j, numSamples, stored, values[j], tolerance);
+							fail(message);
+						}
+						if (looked[axis] != stored) {
+							char message[256];
+							std::snprintf(message, sizeof(message), "%s shake %zu axis %d: lookup at sample time %.17g gives %.17g, sample %.17g",
+								encodingName(encoding), shake, axis, times[j], looked[axis], stored);
+							fail(message);
+						}
+					}
+				}
+			}
+
+			// Times outside of the file hold the end samples, shakes past the end don't exist
+			double before[3];
+			double after[3];
+			double past[3];
+			if (!file->lookup(0, start - 10.0, before) || !file->lookup(0, times.back() + 10.0, after) || file->lookup(targets.size(), start, past) ||
+					before[0] != file->sample(0, 0) || after[0] != file->sample(0, numSamples - 1)) {
+				fail(std::string(encodingName(encoding)) + ": lookups outside of the file");
+			}
+		}
+	}
+	std::remove(path.c_str());
+
+	std::printf("cache file round trip: %zu samples, %zu failures\n", numSamplesChecked, numFailures);
+	return numFailures;
+}
+
+
+std::size_t checkCorruptCacheFiles() {
+	/* Writes a valid cache file, damages copies of it and checks that open rejects every copy. */
+	std::vector<ShakeBakeTarget> targets(2);
+	std::vector<double> times(40);
+	for (std::size_t j = 0; j < times.size(); ++j) {
+		times[j] = 1.0 + (double) j;
+	}
+	for (ShakeBakeTarget &target : targets) {
+		target.layers.resize(1);
+	}
+	targets[1].layers[0].seed = 7;
+	bakeShakes(targets, times);
+
+	const std::string path = "shakeCacheTest.corrupt.shkc";
+	std::string error;
+	if (!writeShakeCache(path, targets, 1.0, 1, ShakeCacheEncoding::kFloat64, &error) || ShakeCacheFile::open(path, &error) == nullptr) {
+		std::printf("  FAIL could not write the valid file: %s\n", error.c_str());
+		return 1;
+	}
+	std::ifstream stream(path, std::ios::binary);
+	const std::vector<char> valid((std::istreambuf_iterator<char>(stream)), std::istreambuf_iterator<char>());
+	stream.close();
+	std::remove(path.c_str());
+
+	auto patch = [](std::vector<char> &bytes, std::size_t offset, auto value) {
+		std::memcpy(bytes.data() + offset, &value, sizeof(value));
+	};
+	const std::size_t channelTable = sizeof(ShakeCacheHeader);
+	struct Damage {
+		const char *name;
+		std::function<void(std::vector<char> &)> apply;
+	};
+	const std::vector<Damage> damages = {
+		{"empty", [](std::vector<char> &bytes) {bytes.clear();}},
+		{"truncated header", [](std::vector<char> &bytes) {bytes.resize(sizeof(ShakeCacheHeader) - 1);}},
+		{"truncated channel table", [](std::vector<char> &bytes) {bytes.resize(sizeof(ShakeCacheHeader) + sizeof(ShakeCacheChannel));}},
+		{"truncated samples", [](std::vector<char> &bytes) {bytes.resize(bytes.size() - 1);}},
+		{"magic", [](std::vector<char> &bytes) {bytes[0] = 'X';}},
+		{"version", [&](std::vector<char> &bytes) {patch(bytes, offsetof(ShakeCacheHeader, version), (std::uint32_t) 2);}},
+		{"encoding", [&](std::vector<char> &bytes) {patch(bytes, offsetof(ShakeCacheHeader, encoding), (std::uint32_t) 4);}},
+		{"zero samples per frame", [&](std::vector<char> &bytes) {patch(bytes, offsetof(ShakeCacheHeader, samplesPerFrame), (std::uint32_t) 0);}},
+		{"zero shakes", [&](std::vector<char> &bytes) {patch(bytes, offsetof(ShakeCacheHeader, numShakes), (std::uint32_t) 0);}},
+		{"too many shakes", [&](std::vector<char> &bytes) {patch(bytes, offsetof(ShakeCacheHeader, numShakes), (std::uint32_t) 1000000);}},
+		{"zero samples", [&](std::vector<char> &bytes) {patch(bytes, offsetof(ShakeCacheHeader, numSamples), (std::uint64_t) 0);}},
+		{"more samples", [&](std::vector<char> &bytes) {patch(bytes, offsetof(ShakeCacheHeader, numSamples), (std::uint64_t) 41);}},
+		// 8 * numSamples wraps around to the real channel size
+		{"overflowing samples", [&](std::vector<char> &bytes) {patch(bytes, offsetof(ShakeCacheHeader, numSamples), ((std::uint64_t) 1 << 61) + 40);}},
+		{"channel size", [&](std::vector<char> &bytes) {patch(bytes, channelTable + offsetof(ShakeCacheChannel, size), (std::uint64_t) 8);}},
+		{"unaligned channel", [&](std::vector<char> &bytes) {patch(bytes, channelTable + offsetof(ShakeCacheChannel, offset), (std::uint64_t) 65);}},
+		{"channel past the end", [&](std::vector<char> &bytes) {patch(bytes, channelTable + 5 * sizeof(ShakeCacheChannel), (std::uint64_t) bytes.size());}},
+	};
+
+	std::size_t numFailures = 0;
+	for (const Damage &damage : damages) {
+		std::vector<char> bytes = valid;
+		damage.apply(bytes);
+		const std::string damagedPath = "shakeCacheTest.corrupt." + std::to_string(&damage - damages.data()) + ".shkc";
+		std::ofstream(damagedPath, std::ios::binary).write(bytes.data(), (std::streamsize) bytes.size());
+		error.clear();
+		std::shared_ptr<const ShakeCacheFile> file = ShakeCacheFile::open(damagedPath, &error);
+		std::remove(damagedPath.c_str());
+		if (file != nullptr || error.empty()) {
+			std::printf("  FAIL %s file was accepted\n", damage.name);
+			++numFailures;
+		}
+	}
+	error.clear();
+	if (ShakeCacheFile::open("shakeCacheTest.missing.shkc", &error) != nullptr || error.empty()) {
+		std::printf("  FAIL missing file was accepted\n");
+		++numFailures;
+	}
+
+	std::printf("corrupt cache files: %zu damages, %zu failures\n", damages.size() + 1, numFailures);
+	return numFailures;
+}
+
+}
+
+
+
+int main(int argc, char *argv[]) {
+	const int iterations = argc > 1 ? std::max(1, std::atoi(argv[1])) : 50;
+	const std::uint64_t seed = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 1;
+	std::printf("%d iterations, seed %llu\n", iterations, (unsigned long long) seed);
+
+	std::size_t numFailures = checkFastBands();
+	for (NoiseEngine engine : kEngines) {
+		for (NoisePrecision precision : kPrecisions) {
+			numFailures += checkRandomStacks(engine, precision, iterations, seed);
+		}
+	}
+
+	numFailures += checkCacheFileRoundTrip(iterations, seed);
+	numFailures += checkCorruptCacheFiles();
+
+	std::printf("%zu failures\n", numFailures);
+	return numFailures == 0 ? 0 : 1;
+}
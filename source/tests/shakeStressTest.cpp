@@ -0,0 +1,349 @@
+/* Stress test for evaluating many shakes concurrently.
+
+Mirrors what the Evaluation Manager does with hundreds of shake nodes in parallel
+mode: every node owns a layer stack and a ShakeCurveCache, worker threads evaluate
+the nodes for a range of frames the same way ShakeNode::evaluateShake does, and a
+separate thread keeps invalidating the caches like dirty propagation would. Every
+result has to match a serial live evaluation bit for bit, the cache returns its
+samples exactly on whole frames.
+
+Every evaluation is also profiled like ShakeComputeScope does, into the
+ShakeProfileCounters of its node. After the parallel runs each node has to have
+counted every one of its computes, with the layers of its live computes split
+into evaluated and skipped. A small trace is recorded, written and parsed back.
+
+Returns 0 on success and 1 if any result, counter or trace event is wrong.
+
+*/
+#include "perlinNoise.h"
+#include "shakeCurveCache.h"
+#include "shakeProfile.h"
+
+// System Includes
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+
+namespace {
+
+constexpr std::size_t kNumNodes = 400;
+constexpr int kStartFrame = 1;
+constexpr int kEndFrame = 120;
+constexpr int kCacheSamples = 4;
+constexpr std::size_t kTraceNodes = 8;
+constexpr int kTraceFrames = 4;
+const char *kTraceCategory = "stressNode";
+
+
+struct StressNode {
+	std::string name;
+	std::vector<ShakeLayer> layers;
+	NoisePrecision precision = NoisePrecision::kDouble;
+	NoiseEngine engine = NoiseEngine::kPerlin;
+	bool cacheEnable = false;
+	ShakeCurveCache curveCache;
+	ShakeProfileCounters counters;
+	std::size_t numSkippedLayers = 0;  // Layers with a weight of 0
+};
+
+
+bool evaluateNode(StressNode &node, double time, double result[3]) {
+	/* Evaluates a node the same way ShakeNode::evaluateShake does, returns true on a cache hit. */
+	thread_local ShakeLayerStack layers;
+
+	result[0] = result[1] = result[2] = 0.0;
+	layers.assign(node.layers.data(), node.layers.size());
+	if (node.cacheEnable) {
+		if (!node.curveCache.isValid(kStartFrame, kEndFrame, kCacheSamples)) {
+			node.curveCache.build(layers, node.precision, node.engine, kStartFrame, kEndFrame, kCacheSamples);
+		}
+		if (node.curveCache.lookup(time, result)) {
+			return true;
+		}
+	}
+
+	PerlinNoise::accumulateShakeStack(layers, time, result, node.precision, node.engine);
+	return false;
+}
+
+
+void computeNode(StressNode &node, double time, double result[3]) {
+	/* Evaluates a node and profiles it the same way ShakeComputeScope does. */
+	std::uint64_t start = ShakeTrace::now();
+	bool cacheHit = evaluateNode(node, time, result);
+	std::uint64_t duration = ShakeTrace::now() - start;
+
+	std::uint64_t layersEvaluated = cacheHit ? 0 : node.layers.size() - node.numSkippedLayers;
+	std::uint64_t layersSkipped = cacheHit ? 0 : node.numSkippedLayers;
+	node.counters.addCompute(duration, cacheHit, layersEvaluated, layersSkipped);
+	if (ShakeTrace::isRecording()) {
+		ShakeTrace::addEvent(node.name, kTraceCategory, start, duration, cacheHit, layersEvaluated);
+	}
+}
+
+
+std::vector<std::unique_ptr<StressNode>> createNodes() {
+	/* Creates a mix of node setups, half of them with the curve cache enabled. */
+	std::vector<std::unique_ptr<StressNode>> nodes;
+	for (std::size_t i = 0; i < kNumNodes; ++i) {
+		std::unique_ptr<StressNode> node(new StressNode());
+		node->name = "stressShake" + std::to_string(i);
+		node->precision = i % 3 == 0 ? NoisePrecision::kSingle : NoisePrecision::kDouble;
+		node->engine = i % 7 == 0 ? NoiseEngine::kGradient1D : i % 5 == 0 ? NoiseEngine::kHash : NoiseEngine::kPerlin;
+		node->cacheEnable = i % 2 == 0;
+		for (std::size_t j = 0; j < 1 + i % 4; ++j) {
+			ShakeLayer layer;
+			layer.seed = (int) (i * 7 + j * 131);
+			layer.frequency = 0.5 + 0.25 * j;
+			layer.fractal = j % 2 == 0 ? 0.0 : 0.5;
+			layer.rough = 0.3;
+			if (i % 5 == 0) {
+				layer.fractalMode = FractalMode::kFbm;
+				layer.octaves = 3 + (int) j;
+			}
+			node->layers.push_back(layer);
+		}
+		if (i % 3 == 1) {
+			ShakeLayer mutedLayer;
+			mutedLayer.weight = 0.0;
+			node->layers.push_back(mutedLayer);
+			node->numSkippedLayers = 1;
+		}
+		nodes.push_back(std::move(node));
+	}
+	return nodes;
+}
+
+
+std::size_t evaluateParallel(std::vector<std::unique_ptr<StressNode>> &nodes, const std::vector<double> &expected, unsigned int numThreads, bool invalidate) {
+	/* Evaluates every node on every frame from numThreads threads.
+
+	Each frame is a separate round over all nodes, like playback. Returns the number
+	of results that differ from the expected serial values.
+
+	*/
+	const std::size_t numFrames = kEndFrame - kStartFrame + 1;
+	std::atomic<std::size_t> numErrors(0);
+	std::atomic<bool> done(false);
+
+	std::thread invalidator;
+	if (invalidate) {
+		invalidator = std::thread([&]() {
+			for (std::size_t i = 0; !done; i = (i + 37) % nodes.size()) {
+				nodes[i]->curveCache.invalidate();
+				std::this_thread::yield();
+			}
+		});
+	}
+
+	for (std::size_t frame = 0; frame < numFrames; ++frame) {
+		double time = kStartFrame + (double) frame;
+		std::atomic<std::size_t> nextNode(0);
+		auto worker = [&]() {
+			for (std::size_t i = nextNode++; i < nodes.size(); i = nextNode++) {
+				double result[3];
+				computeNode(*nodes[i], time, result);
+				const double *reference = &expected[3 * (i * numFrames + frame)];
+				if (result[0] != reference[0] || result[1] != reference[1] || result[2] != reference[2]) {
+					++numErrors;
+				}
+			}
+		};
+		std::vector<std::thread> threads;
+		for (unsigned int i = 1; i < numThreads; ++i) {
+			threads.emplace_back(worker);
+		}
+		worker();
+		for (std::thread &thread : threads) {
+			thread.join();
+		}
+	}
+
+	done = true;
+	if (invalidator.joinable()) {
+		invalidator.join();
+	}
+	return numErrors;
+}
+
+
+std::size_t checkCounters(const std::vector<std::unique_ptr<StressNode>> &nodes, std::uint64_t computesPerNode) {
+	/* Checks that the counters of every node add up after the parallel runs.
+
+	Returns the number of nodes with wrong counters.
+
+	*/
+	std::size_t numErrors = 0;
+	ShakeProfileStats total;
+	for (const std::unique_ptr<StressNode> &node : nodes) {
+		ShakeProfileStats stats = node->counters.stats();
+		total += stats;
+		std::uint64_t liveComputes = stats.computeCalls - stats.cacheHits;
+		bool valid = stats.computeCalls == computesPerNode && stats.cacheHits <= stats.computeCalls &&
+			(node->cacheEnable || stats.cacheHits == 0) &&
+			stats.layersEvaluated == liveComputes * (node->layers.size() - node->numSkippedLayers) &&
+			stats.layersSkipped == liveComputes * node->numSkippedLayers &&
+			stats.maxSeconds <= stats.totalSeconds;
+		if (!valid) {
+			if (numErrors < 5) {
+				std::printf("  FAIL %s: %llu computes of %llu, %llu cache hits, %llu layers evaluated, %llu skipped\n", node->name.c_str(),
+					(unsigned long long) stats.computeCalls, (unsigned long long) computesPerNode, (unsigned long long) stats.cacheHits,
+					(unsigned long long) stats.layersEvaluated, (unsigned long long) stats.layersSkipped);
+			}
+			++numErrors;
+		}
+	}
+	std::printf("counters: %llu computes, %llu cache hits, %llu layers evaluated, %llu skipped, %zu wrong nodes\n",
+		(unsigned long long) total.computeCalls, (unsigned long long) total.cacheHits,
+		(unsigned long long) total.layersEvaluated, (unsigned long long) total.layersSkipped, numErrors);
+	return numErrors;
+}
+
+
+std::size_t countOccurrences(const std::string &text, const std::string &pattern) {
+	std::size_t count = 0;
+	for (std::size_t position = text.find(pattern); position != std::string::npos; position = text.find(pattern, position + pattern.size())) {
+		++count;
+	}
+	return count;
+}
+
+
+std::size_t checkTrace(std::vector<std::unique_ptr<StressNode>> &nodes, unsigned int numThreads) {
+	/* Records the computes of a few nodes from numThreads threads, writes the trace and parses it back.
+
+	The trace is first dumped to a path that can't be opened, which has to fail and
+	keep the events for the second dump. Returns the number of errors.
+
+	*/
+	const std::string path = "shakeStressTest.trace.json";
+	std::size_t numErrors = 0;
+
+	ShakeTrace::start();
+	std::atomic<std::size_t> nextCompute(0);
+	for (std::size_t i = 0; i < kTraceNodes; ++i) {
+		nodes[i]->curveCache.invalidate();
+		nodes[i]->counters.reset();
+	}
+	auto worker = [&]() {
+		for (std::size_t compute = nextCompute++; compute < kTraceNodes * kTraceFrames; compute = nextCompute++) {
+			double result[3];
+			computeNode(*nodes[compute % kTraceNodes], kStartFrame + (double) (compute / kTraceNodes), result);
+		}
+	};
+	std::vector<std::thread> threads;
+	for (unsigned int i = 1; i < numThreads; ++i) {
+		threads.emplace_back(worker);
+	}
+	worker();
+	for (std::thread &thread : threads) {
+		thread.join();
+	}
+
+	std::string error;
+	if (ShakeTrace::write("/nonexistent/shakeStressTest/trace.json", &error) || error.empty()) {
+		std::printf("  FAIL trace dump to a missing directory did not fail\n");
+		++numErrors;
+	}
+	if (!ShakeTrace::write(path, &error)) {
+		std::printf("  FAIL %s\n", error.c_str());
+		return numErrors + 1;
+	}
+
+	std::ifstream file(path);
+	std::stringstream stream;
+	stream << file.rdbuf();
+	file.close();
+	std::remove(path.c_str());
+	const std::string trace = stream.str();
+
+	// Every compute is one complete event of its node, the layers of all events add up
+	const std::size_t numEvents = countOccurrences(trace, "\"ph\":\"X\"");
+	std::size_t numNamedEvents = 0;
+	for (std::size_t i = 0; i < kTraceNodes; ++i) {
+		numNamedEvents += countOccurrences(trace, "\"name\":\"" + nodes[i]->name + "\",\"cat\":\"" + kTraceCategory + "\"");
+	}
+	std::uint64_t numLayers = 0;
+	const std::string layersKey = "\"layersEvaluated\":";
+	for (std::size_t position = trace.find(layersKey); position != std::string::npos; position = trace.find(layersKey, position + 1)) {
+		numLayers += std::strtoull(trace.c_str() + position + layersKey.size(), nullptr, 10);
+	}
+	std::uint64_t expectedLayers = 0;
+	for (std::size_t i = 0; i < kTraceNodes; ++i) {
+		expectedLayers += nodes[i]->counters.stats().layersEvaluated;
+	}
+	const std::string header = "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+	const bool wellFormed = trace.compare(0, header.size(), header) == 0 &&
+		trace.size() >= 4 && trace.compare(trace.size() - 4, 4, "\n]}\n") == 0 &&
+		countOccurrences(trace, "{") == 1 + 2 * numEvents && countOccurrences(trace, "}") == 1 + 2 * numEvents;
+	if (!wellFormed || numEvents != kTraceNodes * kTraceFrames || numNamedEvents != numEvents || numLayers != expectedLayers) {
+		std::printf("  FAIL trace: %zu events of %zu, %zu with a node name, %llu layers of %llu, %s\n", numEvents,
+			kTraceNodes * kTraceFrames, numNamedEvents, (unsigned long long) numLayers, (unsigned long long) expectedLayers,
+			wellFormed ? "well formed" : "malformed");
+		++numErrors;
+	}
+	std::printf("trace: %zu events, %llu layers evaluated, %zu errors\n", numEvents, (unsigned long long) numLayers, numErrors);
+	return numErrors;
+}
+
+}
+
+
+
+int main() {
+	std::vector<std::unique_ptr<StressNode>> nodes = createNodes();
+	const std::size_t numFrames = kEndFrame - kStartFrame + 1;
+
+	// Serial live evaluation of the layers is the reference
+	std::vector<double> expected(3 * nodes.size() * numFrames, 0.0);
+	for (std::size_t i = 0; i < nodes.size(); ++i) {
+		for (std::size_t frame = 0; frame < numFrames; ++frame) {
+			double *result = &expected[3 * (i * numFrames + frame)];
+			for (const ShakeLayer &layer : nodes[i]->layers) {
+				if (layer.weight == 0.0) {
+					continue;
+				}
+				PerlinNoise::accumulateShake(layer, kStartFrame + (double) frame, result, nodes[i]->precision, nodes[i]->engine);
+			}
+		}
+	}
+
+	unsigned int maxThreads = std::max(2u, std::thread::hardware_concurrency());
+	std::size_t numErrors = 0;
+	double serialTime = 0.0;
+	for (unsigned int numThreads : {1u, maxThreads}) {
+		for (std::unique_ptr<StressNode> &node : nodes) {
+			node->curveCache.invalidate();
+		}
+		auto begin = std::chrono::steady_clock::now();
+		std::size_t errors = evaluateParallel(nodes, expected, numThreads, false);
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+		if (numThreads == 1) {
+			serialTime = seconds;
+		}
+		std::printf("%zu nodes x %zu frames, %2u threads: %8.3f ms, speedup %5.2fx, %zu errors\n",
+			nodes.size(), numFrames, numThreads, seconds * 1e3, serialTime / seconds, errors);
+		numErrors += errors;
+	}
+
+	std::size_t errors = evaluateParallel(nodes, expected, maxThreads, true);
+	std::printf("%zu nodes x %zu frames, %2u threads with concurrent invalidation: %zu errors\n",
+		nodes.size(), numFrames, maxThreads, errors);
+	numErrors += errors;
+
+	// Every node computed every frame once per run above
+	numErrors += checkCounters(nodes, 3 * numFrames);
+	numErrors += checkTrace(nodes, maxThreads);
+
+	return numErrors == 0 ? 0 : 1;
+}